@@ -84,6 +84,13 @@ class APPLESEED_DLLSYMBOL CanvasProperties
     // Compute the width and height in pixels of a given tile.
     size_t get_tile_width(const size_t tile_x) const;
     size_t get_tile_height(const size_t tile_y) const;
+
+    // Return the number of levels of the MIP pyramid of the canvas, down to a single pixel.
+    size_t get_mip_level_count() const;
+
+    // Return the properties of a given MIP level, level 0 being the canvas itself. Each level
+    // is half as wide and high as the previous one, rounded down, and has the same tile size.
+    CanvasProperties get_mip_level(const size_t level) const;
 };
 
 
@@ -139,4 +146,26 @@ inline size_t CanvasProperties::get_tile_height(const size_t tile_y) const
             m_tile_height);
 }
 
+inline size_t CanvasProperties::get_mip_level_count() const
+{
+    size_t level_count = 1;
+
+    for (size_t size = std::max(m_canvas_width, m_canvas_height); size > 1; size /= 2)
+        ++level_count;
+
+    return level_count;
+}
+
+inline CanvasProperties CanvasProperties::get_mip_level(const size_t level) const
+{
+    return
+        CanvasProperties(
+            std::max<size_t>(m_canvas_width >> level, 1),
+            std::max<size_t>(m_canvas_height >> level, 1),
+            m_tile_width,
+            m_tile_height,
+            m_channel_count,
+            m_pixel_format);
+}
+
 }   // namespace foundation
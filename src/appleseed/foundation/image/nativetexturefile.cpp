@@ -0,0 +1,471 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Interface header.
+#include "nativetexturefile.h"
+
+// appleseed.foundation headers.
+#include "foundation/core/exceptions/exceptionioerror.h"
+#include "foundation/image/icanvas.h"
+#include "foundation/image/tile.h"
+
+// Boost headers.
+#include "boost/interprocess/exceptions.hpp"
+#include "boost/interprocess/file_mapping.hpp"
+#include "boost/interprocess/mapped_region.hpp"
+
+// Standard headers.
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace bip = boost::interprocess;
+
+namespace foundation
+{
+
+namespace
+{
+    const std::uint32_t NativeTextureFileMagic = 0x58545341;     // "ASTX"
+    const std::uint32_t NativeTextureFileVersion = 1;
+    const size_t TileAlignment = 64;
+    const size_t MaxLevelCount = 32;
+
+    struct FileHeader
+    {
+        std::uint32_t   m_magic;
+        std::uint32_t   m_version;
+        std::uint32_t   m_channel_count;
+        std::uint32_t   m_pixel_format;
+        std::uint32_t   m_tile_width;
+        std::uint32_t   m_tile_height;
+        std::uint32_t   m_level_count;
+        std::uint32_t   m_reserved;
+    };
+
+    struct LevelHeader
+    {
+        std::uint32_t   m_width;
+        std::uint32_t   m_height;
+    };
+
+    // A level of the MIP pyramid being built, as a flat array of floats.
+    struct Level
+    {
+        size_t              m_width;
+        size_t              m_height;
+        std::vector<float>  m_pixels;
+    };
+
+    size_t align_offset(const size_t offset)
+    {
+        return (offset + TileAlignment - 1) & ~(TileAlignment - 1);
+    }
+
+    size_t get_header_size(const size_t level_count, const size_t tile_count)
+    {
+        return
+              sizeof(FileHeader)
+            + level_count * sizeof(LevelHeader)
+            + tile_count * sizeof(std::uint64_t);
+    }
+
+    // Build the next level of the pyramid with a 2x2 box filter.
+    void downsample(const Level& src, Level& dst, const size_t channel_count)
+    {
+        dst.m_width = std::max<size_t>(src.m_width / 2, 1);
+        dst.m_height = std::max<size_t>(src.m_height / 2, 1);
+        dst.m_pixels.assign(dst.m_width * dst.m_height * channel_count, 0.0f);
+
+        for (size_t y = 0; y < dst.m_height; ++y)
+        {
+            const size_t y0 = std::min(2 * y, src.m_height - 1);
+            const size_t y1 = std::min(2 * y + 1, src.m_height - 1);
+
+            for (size_t x = 0; x < dst.m_width; ++x)
+            {
+                const size_t x0 = std::min(2 * x, src.m_width - 1);
+                const size_t x1 = std::min(2 * x + 1, src.m_width - 1);
+
+                const float* p00 = &src.m_pixels[(y0 * src.m_width + x0) * channel_count];
+                const float* p01 = &src.m_pixels[(y0 * src.m_width + x1) * channel_count];
+                const float* p10 = &src.m_pixels[(y1 * src.m_width + x0) * channel_count];
+                const float* p11 = &src.m_pixels[(y1 * src.m_width + x1) * channel_count];
+                float* d = &dst.m_pixels[(y * dst.m_width + x) * channel_count];
+
+                for (size_t c = 0; c < channel_count; ++c)
+                    d[c] = 0.25f * (p00[c] + p01[c] + p10[c] + p11[c]);
+            }
+        }
+    }
+}
+
+
+//
+// NativeTextureFileWriter class implementation.
+//
+
+NativeTextureFileWriter::Options::Options()
+  : m_tile_width(64)
+  , m_tile_height(64)
+  , m_pixel_format(PixelFormatHalf)
+  , m_mip_levels(true)
+{
+}
+
+void NativeTextureFileWriter::write(
+    const char*     filepath,
+    const ICanvas&  canvas,
+    const Options&  options)
+{
+    assert(options.m_pixel_format == PixelFormatHalf || options.m_pixel_format == PixelFormatFloat);
+    assert(options.m_tile_width > 0 && options.m_tile_height > 0);
+
+    const CanvasProperties& canvas_props = canvas.properties();
+    const size_t channel_count = canvas_props.m_channel_count;
+
+    // Read the canvas as level 0 and build the rest of the pyramid.
+    std::vector<Level> levels(1);
+    levels[0].m_width = canvas_props.m_canvas_width;
+    levels[0].m_height = canvas_props.m_canvas_height;
+    levels[0].m_pixels.resize(canvas_props.m_pixel_count * channel_count);
+
+    for (size_t y = 0; y < levels[0].m_height; ++y)
+    {
+        for (size_t x = 0; x < levels[0].m_width; ++x)
+        {
+            canvas.get_pixel(
+                x, y,
+                &levels[0].m_pixels[(y * levels[0].m_width + x) * channel_count],
+                channel_count);
+        }
+    }
+
+    if (options.m_mip_levels)
+    {
+        while ((levels.back().m_width > 1 || levels.back().m_height > 1) && levels.size() < MaxLevelCount)
+        {
+            levels.emplace_back();
+            downsample(levels[levels.size() - 2], levels.back(), channel_count);
+        }
+    }
+
+    // Lay out the tiles.
+    std::vector<CanvasProperties> level_props;
+    size_t tile_count = 0;
+
+    for (const Level& level : levels)
+    {
+        level_props.emplace_back(
+            level.m_width,
+            level.m_height,
+            options.m_tile_width,
+            options.m_tile_height,
+            channel_count,
+            options.m_pixel_format);
+        tile_count += level_props.back().m_tile_count;
+    }
+
+    std::vector<std::uint64_t> tile_offsets;
+    tile_offsets.reserve(tile_count);
+
+    size_t offset = align_offset(get_header_size(levels.size(), tile_count));
+
+    for (const CanvasProperties& props : level_props)
+    {
+        for (size_t ty = 0; ty < props.m_tile_count_y; ++ty)
+        {
+            for (size_t tx = 0; tx < props.m_tile_count_x; ++tx)
+            {
+                tile_offsets.push_back(offset);
+                offset =
+                    align_offset(
+                        offset + props.get_tile_width(tx) * props.get_tile_height(ty) * props.m_pixel_size);
+            }
+        }
+    }
+
+    // Write the file.
+    std::ofstream file(filepath, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        throw ExceptionIOError("could not open native texture file for writing");
+
+    FileHeader header;
+    header.m_magic = NativeTextureFileMagic;
+    header.m_version = NativeTextureFileVersion;
+    header.m_channel_count = static_cast<std::uint32_t>(channel_count);
+    header.m_pixel_format = static_cast<std::uint32_t>(options.m_pixel_format);
+    header.m_tile_width = static_cast<std::uint32_t>(options.m_tile_width);
+    header.m_tile_height = static_cast<std::uint32_t>(options.m_tile_height);
+    header.m_level_count = static_cast<std::uint32_t>(levels.size());
+    header.m_reserved = 0;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (const Level& level : levels)
+    {
+        LevelHeader level_header;
+        level_header.m_width = static_cast<std::uint32_t>(level.m_width);
+        level_header.m_height = static_cast<std::uint32_t>(level.m_height);
+        file.write(reinterpret_cast<const char*>(&level_header), sizeof(level_header));
+    }
+
+    file.write(
+        reinterpret_cast<const char*>(&tile_offsets[0]),
+        tile_offsets.size() * sizeof(std::uint64_t));
+
+    const char Padding[TileAlignment] = { 0 };
+    size_t position = get_header_size(levels.size(), tile_count);
+    size_t tile_index = 0;
+
+    for (size_t l = 0; l < levels.size(); ++l)
+    {
+        const Level& level = levels[l];
+        const CanvasProperties& props = level_props[l];
+
+        for (size_t ty = 0; ty < props.m_tile_count_y; ++ty)
+        {
+            for (size_t tx = 0; tx < props.m_tile_count_x; ++tx)
+            {
+                Tile tile(
+                    props.get_tile_width(tx),
+                    props.get_tile_height(ty),
+                    channel_count,
+                    options.m_pixel_format);
+
+                for (size_t y = 0; y < tile.get_height(); ++y)
+                {
+                    for (size_t x = 0; x < tile.get_width(); ++x)
+                    {
+                        const size_t ix = tx * props.m_tile_width + x;
+                        const size_t iy = ty * props.m_tile_height + y;
+                        tile.set_pixel(x, y, &level.m_pixels[(iy * level.m_width + ix) * channel_count], channel_count);
+                    }
+                }
+
+                const size_t tile_offset = static_cast<size_t>(tile_offsets[tile_index++]);
+                assert(tile_offset >= position && tile_offset - position < TileAlignment);
+                file.write(Padding, tile_offset - position);
+                file.write(reinterpret_cast<const char*>(tile.get_storage()), tile.get_size());
+                position = tile_offset + tile.get_size();
+            }
+        }
+    }
+
+    file.close();
+
+    if (file.fail())
+        throw ExceptionIOError("could not write native texture file");
+}
+
+
+//
+// NativeTextureFile class implementation.
+//
+
+struct NativeTextureFile::Impl
+{
+    bip::file_mapping               m_file;
+    bip::mapped_region              m_region;
+    std::vector<CanvasProperties>   m_levels;
+    std::vector<size_t>             m_level_first_tile;     // index in m_tile_offsets of the first tile of each level
+    std::vector<std::uint64_t>      m_tile_offsets;
+
+    void map(const char* filepath)
+    {
+        try
+        {
+            bip::file_mapping file(filepath, bip::read_only);
+            bip::mapped_region region(file, bip::read_only);
+            m_file.swap(file);
+            m_region.swap(region);
+        }
+        catch (const bip::interprocess_exception&)
+        {
+            throw ExceptionIOError("could not map native texture file");
+        }
+    }
+
+    void read_layout()
+    {
+        const std::uint8_t* base = static_cast<const std::uint8_t*>(m_region.get_address());
+        const size_t file_size = m_region.get_size();
+
+        if (file_size < sizeof(FileHeader))
+            throw ExceptionIOError("invalid native texture file: truncated header");
+
+        FileHeader header;
+        std::memcpy(&header, base, sizeof(header));
+
+        if (header.m_magic != NativeTextureFileMagic)
+            throw ExceptionIOError("invalid native texture file: bad signature");
+
+        if (header.m_version != NativeTextureFileVersion)
+            throw ExceptionIOError("unsupported native texture file version");
+
+        if (header.m_channel_count == 0 || header.m_channel_count > 4 ||
+            header.m_tile_width == 0 || header.m_tile_height == 0 ||
+            header.m_level_count == 0 || header.m_level_count > MaxLevelCount ||
+            (header.m_pixel_format != PixelFormatHalf && header.m_pixel_format != PixelFormatFloat))
+            throw ExceptionIOError("invalid native texture file: bad header");
+
+        // All size checks below are written so that they cannot overflow, whatever the header says.
+        if ((file_size - sizeof(FileHeader)) / sizeof(LevelHeader) < header.m_level_count)
+            throw ExceptionIOError("invalid native texture file: truncated header");
+
+        // Number of tile offsets the rest of the file could hold.
+        const size_t max_tile_count =
+            (file_size - sizeof(FileHeader) - header.m_level_count * sizeof(LevelHeader)) / sizeof(std::uint64_t);
+
+        size_t tile_count = 0;
+
+        for (size_t i = 0; i < header.m_level_count; ++i)
+        {
+            LevelHeader level_header;
+            std::memcpy(&level_header, base + sizeof(FileHeader) + i * sizeof(LevelHeader), sizeof(level_header));
+
+            if (level_header.m_width == 0 || level_header.m_height == 0)
+                throw ExceptionIOError("invalid native texture file: empty level");
+
+            m_levels.emplace_back(
+                level_header.m_width,
+                level_header.m_height,
+                header.m_tile_width,
+                header.m_tile_height,
+                header.m_channel_count,
+                static_cast<PixelFormat>(header.m_pixel_format));
+
+            if (m_levels.back().m_tile_count > max_tile_count - tile_count)
+                throw ExceptionIOError("invalid native texture file: truncated tile table");
+
+            m_level_first_tile.push_back(tile_count);
+            tile_count += m_levels.back().m_tile_count;
+        }
+
+        const size_t header_size = get_header_size(m_levels.size(), tile_count);
+        if (file_size < header_size)
+            throw ExceptionIOError("invalid native texture file: truncated tile table");
+
+        m_tile_offsets.resize(tile_count);
+        std::memcpy(
+            &m_tile_offsets[0],
+            base + header_size - tile_count * sizeof(std::uint64_t),
+            tile_count * sizeof(std::uint64_t));
+
+        // Make sure every tile lies within the file and is properly aligned.
+        for (size_t l = 0; l < m_levels.size(); ++l)
+        {
+            const CanvasProperties& props = m_levels[l];
+
+            for (size_t ty = 0; ty < props.m_tile_count_y; ++ty)
+            {
+                for (size_t tx = 0; tx < props.m_tile_count_x; ++tx)
+                {
+                    const std::uint64_t offset = m_tile_offsets[m_level_first_tile[l] + ty * props.m_tile_count_x + tx];
+                    const std::uint64_t pixel_count =
+                        static_cast<std::uint64_t>(props.get_tile_width(tx)) * props.get_tile_height(ty);
+
+                    if (offset % TileAlignment != 0 ||
+                        offset < header_size ||
+                        offset > file_size ||
+                        pixel_count > (file_size - offset) / props.m_pixel_size)
+                        throw ExceptionIOError("invalid native texture file: bad tile offset");
+                }
+            }
+        }
+    }
+};
+
+bool NativeTextureFile::is_native_texture_file(const char* filepath)
+{
+    std::ifstream file(filepath, std::ios::in | std::ios::binary);
+
+    std::uint32_t magic;
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+
+    return file.good() && magic == NativeTextureFileMagic;
+}
+
+NativeTextureFile::NativeTextureFile(const char* filepath)
+  : impl(new Impl())
+{
+    try
+    {
+        impl->map(filepath);
+        impl->read_layout();
+    }
+    catch (...)
+    {
+        delete impl;
+        throw;
+    }
+}
+
+NativeTextureFile::~NativeTextureFile()
+{
+    delete impl;
+}
+
+size_t NativeTextureFile::get_level_count() const
+{
+    return impl->m_levels.size();
+}
+
+const CanvasProperties& NativeTextureFile::get_level_properties(const size_t level) const
+{
+    assert(level < impl->m_levels.size());
+    return impl->m_levels[level];
+}
+
+Tile* NativeTextureFile::get_tile(
+    const size_t    level,
+    const size_t    tile_x,
+    const size_t    tile_y) const
+{
+    assert(level < impl->m_levels.size());
+
+    const CanvasProperties& props = impl->m_levels[level];
+    assert(tile_x < props.m_tile_count_x);
+    assert(tile_y < props.m_tile_count_y);
+
+    const size_t tile_index = impl->m_level_first_tile[level] + tile_y * props.m_tile_count_x + tile_x;
+    std::uint8_t* storage =
+        static_cast<std::uint8_t*>(impl->m_region.get_address()) + impl->m_tile_offsets[tile_index];
+
+    return
+        new Tile(
+            props.get_tile_width(tile_x),
+            props.get_tile_height(tile_y),
+            props.m_channel_count,
+            props.m_pixel_format,
+            storage);
+}
+
+}   // namespace foundation
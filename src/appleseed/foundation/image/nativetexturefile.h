@@ -0,0 +1,120 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+// appleseed.foundation headers.
+#include "foundation/core/concepts/noncopyable.h"
+#include "foundation/image/canvasproperties.h"
+#include "foundation/image/pixel.h"
+
+// appleseed.main headers.
+#include "main/dllsymbol.h"
+
+// Standard headers.
+#include <cstddef>
+
+// Forward declarations.
+namespace foundation    { class ICanvas; }
+namespace foundation    { class Tile; }
+
+namespace foundation
+{
+
+//
+// Native texture files.
+//
+// A native texture file stores the MIP pyramid of an image, already tiled and with pixels
+// already in their final (linear) format, so that tiles can be used straight from a read-only
+// memory mapping of the file: there is nothing to decode, and render processes sharing the
+// same textures on one machine share their pages through the page cache.
+//
+// Layout (native byte order):
+//
+//   header         magic, version, channel count, pixel format, tile width and height, level count
+//   levels         width and height of each level, level 0 being the full resolution image
+//   tile offsets   file offset of each tile, level after level, tiles in row-major order
+//   tiles          pixels of each tile, each tile starting on a 64-byte boundary
+//
+// Tiles on the right and bottom edges of a level are cropped to the level, as in any canvas.
+//
+
+class APPLESEED_DLLSYMBOL NativeTextureFileWriter
+  : public NonCopyable
+{
+  public:
+    struct Options
+    {
+        size_t          m_tile_width;
+        size_t          m_tile_height;
+        PixelFormat     m_pixel_format;         // must be PixelFormatHalf or PixelFormatFloat
+        bool            m_mip_levels;           // store the MIP levels beyond level 0?
+
+        Options();
+    };
+
+    // Write a canvas and its MIP levels to disk. Throws foundation::ExceptionIOError on failure.
+    static void write(
+        const char*     filepath,
+        const ICanvas&  canvas,
+        const Options&  options = Options());
+};
+
+class APPLESEED_DLLSYMBOL NativeTextureFile
+  : public NonCopyable
+{
+  public:
+    // Return true if a file starts with the signature of native texture files.
+    static bool is_native_texture_file(const char* filepath);
+
+    // Map a native texture file in memory. Throws foundation::ExceptionIOError
+    // if the file cannot be mapped or is not a valid native texture file.
+    explicit NativeTextureFile(const char* filepath);
+
+    // Destructor. Tiles returned by get_tile() must not be used anymore.
+    ~NativeTextureFile();
+
+    // Return the number of MIP levels, at least one.
+    size_t get_level_count() const;
+
+    // Return the properties of a given level.
+    const CanvasProperties& get_level_properties(const size_t level) const;
+
+    // Return a new tile whose pixels are read directly from the memory mapping.
+    // The caller owns the tile but not its pixels, which must not be modified.
+    Tile* get_tile(
+        const size_t    level,
+        const size_t    tile_x,
+        const size_t    tile_y) const;
+
+  private:
+    struct Impl;
+    Impl* impl;
+};
+
+}   // namespace foundation
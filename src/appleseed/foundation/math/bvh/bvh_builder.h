@@ -31,11 +31,16 @@
 
 // appleseed.foundation headers.
 #include "foundation/core/concepts/noncopyable.h"
+#include "foundation/utility/job/ijob.h"
+#include "foundation/utility/job/jobqueue.h"
 #include "foundation/utility/stopwatch.h"
 
 // Standard headers.
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
+#include <deque>
+#include <vector>
 
 namespace foundation {
 namespace bvh {
@@ -64,6 +69,11 @@ namespace bvh {
 //              const AABBType&     bbox);
 //      };
 //
+// The parallel version of build() additionally requires that concurrent calls
+// to partition() on disjoint sets of items, each smaller than half the total
+// number of items, are safe. All partitioners derived from PartitionerBase
+// satisfy this requirement.
+//
 
 template <typename Tree, typename Partitioner>
 class Builder
@@ -81,23 +91,81 @@ class Builder
         const size_t    size,
         const size_t    items_per_leaf_hint);
 
+    // Build a tree using the worker threads consuming a given job queue.
+    // The resulting tree is identical to the one built by the serial version.
+    template <typename Timer>
+    void build(
+        Tree&           tree,
+        Partitioner&    partitioner,
+        const size_t    size,
+        const size_t    items_per_leaf_hint,
+        JobQueue&       job_queue,
+        const size_t    thread_count);
+
     // Return the construction time.
     double get_build_time() const;
 
+    // Return the number of subtrees built in parallel during the last construction.
+    size_t get_subtree_count() const;
+
   private:
+    typedef typename Tree::NodeVectorType NodeVectorType;
     typedef typename Tree::NodeType NodeType;
     typedef typename NodeType::AABBType AABBType;
 
-    double m_build_time;
+    // Minimum number of items in a subtree built by a single job.
+    static const size_t MinSubtreeSize = 1024;
+
+    // Node of the upper part of the tree, built before the subtrees.
+    struct TopNode
+    {
+        size_t          m_begin;
+        size_t          m_end;
+        size_t          m_pivot;            // equals m_end for leaves and subtrees
+        AABBType        m_left_bbox;
+        AABBType        m_right_bbox;
+        size_t          m_left_child;       // index of the left child in the top nodes
+        size_t          m_subtree;          // index of the subtree, or ~0 if none
+    };
+
+    class SubtreeJob;
+
+    double                      m_build_time;
+    size_t                      m_subtree_count;
+    std::vector<TopNode>        m_top_nodes;
+    std::deque<NodeVectorType>  m_subtrees;
+
+    // Reserve memory for the nodes of a tree.
+    static void reserve_nodes(
+        NodeVectorType& nodes,
+        const size_t    size,
+        const size_t    items_per_leaf_hint);
 
     // Recursively subdivide the tree.
-    void subdivide_recurse(
-        Tree&           tree,
+    static void subdivide_recurse(
+        NodeVectorType& nodes,
         Partitioner&    partitioner,
         const size_t    node_index,
         const size_t    begin,
         const size_t    end,
         const AABBType& bbox);
+
+    // Recursively subdivide the upper part of the tree, and schedule one job per subtree.
+    void subdivide_top_recurse(
+        const Tree&     tree,
+        Partitioner&    partitioner,
+        JobQueue&       job_queue,
+        const size_t    top_node_index,
+        const AABBType& bbox,
+        const size_t    max_subtree_size,
+        const size_t    items_per_leaf_hint);
+
+    // Recursively store the upper part of the tree and the subtrees into the final tree,
+    // in the order in which the serial version would have created the nodes.
+    void store_recurse(
+        NodeVectorType& nodes,
+        const size_t    top_node_index,
+        const size_t    node_index);
 };
 
 
@@ -105,9 +173,54 @@ class Builder
 // Builder class implementation.
 //
 
+template <typename Tree, typename Partitioner>
+class Builder<Tree, Partitioner>::SubtreeJob
+  : public IJob
+{
+  public:
+    SubtreeJob(
+        NodeVectorType&     nodes,
+        Partitioner&        partitioner,
+        const size_t        begin,
+        const size_t        end,
+        const AABBType&     bbox,
+        const size_t        items_per_leaf_hint)
+      : m_nodes(nodes)
+      , m_partitioner(partitioner)
+      , m_begin(begin)
+      , m_end(end)
+      , m_bbox(bbox)
+      , m_items_per_leaf_hint(items_per_leaf_hint)
+    {
+    }
+
+    void execute(const size_t thread_index) override
+    {
+        reserve_nodes(m_nodes, m_end - m_begin, m_items_per_leaf_hint);
+        m_nodes.push_back(NodeType());
+
+        subdivide_recurse(
+            m_nodes,
+            m_partitioner,
+            0,
+            m_begin,
+            m_end,
+            m_bbox);
+    }
+
+  private:
+    NodeVectorType&         m_nodes;
+    Partitioner&            m_partitioner;
+    const size_t            m_begin;
+    const size_t            m_end;
+    const AABBType          m_bbox;
+    const size_t            m_items_per_leaf_hint;
+};
+
 template <typename Tree, typename Partitioner>
 Builder<Tree, Partitioner>::Builder()
   : m_build_time(0.0)
+  , m_subtree_count(0)
 {
 }
 
@@ -125,11 +238,10 @@ void Builder<Tree, Partitioner>::build(
 
     // Clear the tree.
     tree.m_nodes.clear();
+    m_subtree_count = 0;
 
     // Reserve memory for the nodes.
-    const size_t leaf_count_guess = size / items_per_leaf_hint;
-    const size_t node_count_guess = leaf_count_guess > 0 ? 2 * leaf_count_guess - 1 : 0;
-    tree.m_nodes.reserve(node_count_guess);
+    reserve_nodes(tree.m_nodes, size, items_per_leaf_hint);
 
     // Create the root node of the tree.
     tree.m_nodes.push_back(NodeType());
@@ -137,11 +249,9 @@ void Builder<Tree, Partitioner>::build(
     // Compute the bounding box of the tree.
     const AABBType root_bbox(partitioner.compute_bbox(0, size));
 
-    // todo: preallocate node memory?
-
     // Recursively subdivide the tree.
     subdivide_recurse(
-        tree,
+        tree.m_nodes,
         partitioner,
         0,              // node index
         0,              // begin
@@ -153,22 +263,110 @@ void Builder<Tree, Partitioner>::build(
     m_build_time = stopwatch.get_seconds();
 }
 
+template <typename Tree, typename Partitioner>
+template <typename Timer>
+void Builder<Tree, Partitioner>::build(
+    Tree&               tree,
+    Partitioner&        partitioner,
+    const size_t        size,
+    const size_t        items_per_leaf_hint,
+    JobQueue&           job_queue,
+    const size_t        thread_count)
+{
+    // Subtrees are small enough for the partitioner to safely work on several of them
+    // concurrently, and numerous enough to keep all threads busy until the end.
+    const size_t max_subtree_size = std::max(size / (8 * std::max<size_t>(thread_count, 1)), MinSubtreeSize);
+
+    // Fall back to the serial version if there isn't enough work for multiple threads.
+    if (thread_count <= 1 || max_subtree_size > size / 2)
+    {
+        build<Timer>(tree, partitioner, size, items_per_leaf_hint);
+        return;
+    }
+
+    // Start stopwatch.
+    Stopwatch<Timer> stopwatch;
+    stopwatch.start();
+
+    // Clear the tree.
+    tree.m_nodes.clear();
+    m_top_nodes.clear();
+    m_subtrees.clear();
+
+    // Create the root node of the upper part of the tree.
+    m_top_nodes.push_back(TopNode());
+    m_top_nodes[0].m_begin = 0;
+    m_top_nodes[0].m_end = size;
+
+    // Compute the bounding box of the tree.
+    const AABBType root_bbox(partitioner.compute_bbox(0, size));
+
+    // Subdivide the upper part of the tree while subtrees are being built.
+    subdivide_top_recurse(
+        tree,
+        partitioner,
+        job_queue,
+        0,              // top node index
+        root_bbox,
+        max_subtree_size,
+        items_per_leaf_hint);
+
+    // Wait until all subtrees are built.
+    job_queue.wait_until_completion();
+
+    // Reserve memory for the nodes.
+    size_t node_count = m_top_nodes.size();
+    for (size_t i = 0, e = m_subtrees.size(); i < e; ++i)
+        node_count += m_subtrees[i].size();
+    tree.m_nodes.reserve(node_count);
+
+    // Assemble the final tree.
+    tree.m_nodes.push_back(NodeType());
+    store_recurse(tree.m_nodes, 0, 0);
+
+    // Release temporary memory.
+    m_subtree_count = m_subtrees.size();
+    std::vector<TopNode>().swap(m_top_nodes);
+    std::deque<NodeVectorType>().swap(m_subtrees);
+
+    // Measure and save construction time.
+    stopwatch.measure();
+    m_build_time = stopwatch.get_seconds();
+}
+
 template <typename Tree, typename Partitioner>
 inline double Builder<Tree, Partitioner>::get_build_time() const
 {
     return m_build_time;
 }
 
+template <typename Tree, typename Partitioner>
+inline size_t Builder<Tree, Partitioner>::get_subtree_count() const
+{
+    return m_subtree_count;
+}
+
+template <typename Tree, typename Partitioner>
+void Builder<Tree, Partitioner>::reserve_nodes(
+    NodeVectorType&     nodes,
+    const size_t        size,
+    const size_t        items_per_leaf_hint)
+{
+    const size_t leaf_count_guess = size / items_per_leaf_hint;
+    const size_t node_count_guess = leaf_count_guess > 0 ? 2 * leaf_count_guess - 1 : 0;
+    nodes.reserve(node_count_guess);
+}
+
 template <typename Tree, typename Partitioner>
 void Builder<Tree, Partitioner>::subdivide_recurse(
-    Tree&               tree,
+    NodeVectorType&     nodes,
     Partitioner&        partitioner,
     const size_t        node_index,
     const size_t        begin,
     const size_t        end,
     const AABBType&     bbox)
 {
-    assert(node_index < tree.m_nodes.size());
+    assert(node_index < nodes.size());
 
     // Try to partition the set of items.
     size_t pivot = end;
@@ -182,7 +380,7 @@ void Builder<Tree, Partitioner>::subdivide_recurse(
     if (pivot == end)
     {
         // Turn the current node into a leaf node.
-        NodeType& node = tree.m_nodes[node_index];
+        NodeType& node = nodes[node_index];
         node.make_leaf();
         node.set_item_index(begin);
         node.set_item_count(end - begin);
@@ -194,23 +392,23 @@ void Builder<Tree, Partitioner>::subdivide_recurse(
         const AABBType right_bbox(partitioner.compute_bbox(pivot, end));
 
         // Compute the indices of the child nodes.
-        const size_t left_node_index = tree.m_nodes.size();
+        const size_t left_node_index = nodes.size();
         const size_t right_node_index = left_node_index + 1;
 
         // Turn the current node into an interior node.
-        NodeType& node = tree.m_nodes[node_index];
+        NodeType& node = nodes[node_index];
         node.make_interior();
         node.set_left_bbox(left_bbox);
         node.set_right_bbox(right_bbox);
         node.set_child_node_index(left_node_index);
 
         // Create the child nodes.
-        tree.m_nodes.push_back(NodeType());
-        tree.m_nodes.push_back(NodeType());
+        nodes.push_back(NodeType());
+        nodes.push_back(NodeType());
 
         // Recurse into the left subtree.
         subdivide_recurse(
-            tree,
+            nodes,
             partitioner,
             left_node_index,
             begin,
@@ -219,7 +417,7 @@ void Builder<Tree, Partitioner>::subdivide_recurse(
 
         // Recurse into the right subtree.
         subdivide_recurse(
-            tree,
+            nodes,
             partitioner,
             right_node_index,
             pivot,
@@ -228,5 +426,140 @@ void Builder<Tree, Partitioner>::subdivide_recurse(
     }
 }
 
+template <typename Tree, typename Partitioner>
+void Builder<Tree, Partitioner>::subdivide_top_recurse(
+    const Tree&         tree,
+    Partitioner&        partitioner,
+    JobQueue&           job_queue,
+    const size_t        top_node_index,
+    const AABBType&     bbox,
+    const size_t        max_subtree_size,
+    const size_t        items_per_leaf_hint)
+{
+    const size_t begin = m_top_nodes[top_node_index].m_begin;
+    const size_t end = m_top_nodes[top_node_index].m_end;
+
+    m_top_nodes[top_node_index].m_pivot = end;
+    m_top_nodes[top_node_index].m_subtree = ~size_t(0);
+
+    // Build small enough subtrees in parallel.
+    if (end - begin <= max_subtree_size)
+    {
+        // Elements of a std::deque are never moved when new ones are appended.
+        m_top_nodes[top_node_index].m_subtree = m_subtrees.size();
+        m_subtrees.push_back(NodeVectorType(tree.m_nodes.get_allocator()));
+
+        job_queue.schedule(
+            new SubtreeJob(
+                m_subtrees.back(),
+                partitioner,
+                begin,
+                end,
+                bbox,
+                items_per_leaf_hint));
+
+        return;
+    }
+
+    // Try to partition the set of items.
+    const size_t pivot = partitioner.partition(begin, end, typename Partitioner::AABBType(bbox));
+    assert(pivot > begin);
+    assert(pivot <= end);
+
+    if (pivot < end)
+    {
+        // Compute the bounding box of the child nodes.
+        const AABBType left_bbox(partitioner.compute_bbox(begin, pivot));
+        const AABBType right_bbox(partitioner.compute_bbox(pivot, end));
+
+        // Create the child nodes.
+        const size_t left_child = m_top_nodes.size();
+        m_top_nodes.push_back(TopNode());
+        m_top_nodes.push_back(TopNode());
+        m_top_nodes[left_child].m_begin = begin;
+        m_top_nodes[left_child].m_end = pivot;
+        m_top_nodes[left_child + 1].m_begin = pivot;
+        m_top_nodes[left_child + 1].m_end = end;
+
+        TopNode& top_node = m_top_nodes[top_node_index];
+        top_node.m_pivot = pivot;
+        top_node.m_left_bbox = left_bbox;
+        top_node.m_right_bbox = right_bbox;
+        top_node.m_left_child = left_child;
+
+        // Recurse into the larger child node first: this guarantees that the nodes holding
+        // more than half the items are partitioned before any subtree job is scheduled.
+        if (pivot - begin >= end - pivot)
+        {
+            subdivide_top_recurse(tree, partitioner, job_queue, left_child, left_bbox, max_subtree_size, items_per_leaf_hint);
+            subdivide_top_recurse(tree, partitioner, job_queue, left_child + 1, right_bbox, max_subtree_size, items_per_leaf_hint);
+        }
+        else
+        {
+            subdivide_top_recurse(tree, partitioner, job_queue, left_child + 1, right_bbox, max_subtree_size, items_per_leaf_hint);
+            subdivide_top_recurse(tree, partitioner, job_queue, left_child, left_bbox, max_subtree_size, items_per_leaf_hint);
+        }
+    }
+}
+
+template <typename Tree, typename Partitioner>
+void Builder<Tree, Partitioner>::store_recurse(
+    NodeVectorType&     nodes,
+    const size_t        top_node_index,
+    const size_t        node_index)
+{
+    const TopNode& top_node = m_top_nodes[top_node_index];
+
+    if (top_node.m_subtree != ~size_t(0))
+    {
+        // Store the subtree: its root goes to the current node, and the other nodes are
+        // appended, just as the serial version would have created them.
+        const NodeVectorType& subtree = m_subtrees[top_node.m_subtree];
+        assert(!subtree.empty());
+
+        const size_t offset = nodes.size() - 1;
+
+        nodes[node_index] = subtree[0];
+        if (nodes[node_index].is_interior())
+            nodes[node_index].set_child_node_index(subtree[0].get_child_node_index() + offset);
+
+        for (size_t i = 1, e = subtree.size(); i < e; ++i)
+        {
+            nodes.push_back(subtree[i]);
+            if (nodes.back().is_interior())
+                nodes.back().set_child_node_index(subtree[i].get_child_node_index() + offset);
+        }
+    }
+    else if (top_node.m_pivot == top_node.m_end)
+    {
+        // Turn the current node into a leaf node.
+        NodeType& node = nodes[node_index];
+        node.make_leaf();
+        node.set_item_index(top_node.m_begin);
+        node.set_item_count(top_node.m_end - top_node.m_begin);
+    }
+    else
+    {
+        // Compute the indices of the child nodes.
+        const size_t left_node_index = nodes.size();
+        const size_t right_node_index = left_node_index + 1;
+
+        // Turn the current node into an interior node.
+        NodeType& node = nodes[node_index];
+        node.make_interior();
+        node.set_left_bbox(top_node.m_left_bbox);
+        node.set_right_bbox(top_node.m_right_bbox);
+        node.set_child_node_index(left_node_index);
+
+        // Create the child nodes.
+        nodes.push_back(NodeType());
+        nodes.push_back(NodeType());
+
+        // Recurse into the child nodes.
+        store_recurse(nodes, top_node.m_left_child, left_node_index);
+        store_recurse(nodes, top_node.m_left_child + 1, right_node_index);
+    }
+}
+
 }   // namespace bvh
 }   // namespace foundation
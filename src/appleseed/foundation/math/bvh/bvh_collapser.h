@@ -0,0 +1,261 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2019 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+// appleseed.foundation headers.
+#include "foundation/core/concepts/noncopyable.h"
+#include "foundation/math/aabb.h"
+#include "foundation/utility/stopwatch.h"
+
+// Standard headers.
+#include <cassert>
+#include <cstddef>
+
+namespace foundation {
+namespace bvh {
+
+//
+// Collapse a binary BVH into a wide BVH.
+//
+// Starting from the root, each wide node is formed by repeatedly replacing the
+// interior child with the largest surface area by its own two children, until
+// the wide node is full or only leaves remain. This is applied recursively to
+// the remaining interior children. Leaves of the binary tree are copied as-is.
+//
+// Any binary tree can be collapsed, no matter how it was built (e.g. by
+// bvh::Builder or bvh::SpatialBuilder). The binary tree must not have motion.
+//
+
+template <typename Tree, typename WideTree>
+class Collapser
+  : public NonCopyable
+{
+  public:
+    typedef typename Tree::NodeType NodeType;
+    typedef typename NodeType::AABBType AABBType;
+    typedef typename WideTree::WideNodeType WideNodeType;
+
+    // Constructor.
+    Collapser();
+
+    // Collapse a binary tree into a wide tree.
+    // 'tree_bbox' is the bounding box of the entire binary tree.
+    template <typename Timer>
+    void collapse(
+        const Tree&         tree,
+        const AABBType&     tree_bbox,
+        WideTree&           wide_tree);
+
+    // Return the collapse time.
+    double get_collapse_time() const;
+
+  private:
+    typedef typename AABBType::ValueType ValueType;
+
+    struct Child
+    {
+        size_t      m_node_index;
+        AABBType    m_bbox;
+    };
+
+    double m_collapse_time;
+
+    // Recursively collapse the interior node with a given index.
+    // Return the index of the wide node that was created.
+    size_t collapse_recurse(
+        const Tree&         tree,
+        WideTree&           wide_tree,
+        const size_t        node_index);
+
+    // Store a given child into a given slot of a wide node.
+    void store_child(
+        const Tree&         tree,
+        WideTree&           wide_tree,
+        const size_t        wide_node_index,
+        const size_t        slot,
+        const Child&        child);
+};
+
+
+//
+// Collapser class implementation.
+//
+
+template <typename Tree, typename WideTree>
+Collapser<Tree, WideTree>::Collapser()
+  : m_collapse_time(0.0)
+{
+}
+
+template <typename Tree, typename WideTree>
+template <typename Timer>
+void Collapser<Tree, WideTree>::collapse(
+    const Tree&             tree,
+    const AABBType&         tree_bbox,
+    WideTree&               wide_tree)
+{
+    assert(!tree.m_nodes.empty());
+
+    // Start stopwatch.
+    Stopwatch<Timer> stopwatch;
+    stopwatch.start();
+
+    // Clear the wide tree.
+    wide_tree.clear();
+
+    // Reserve memory for the nodes.
+    const size_t leaf_count = (tree.m_nodes.size() + 1) / 2;
+    wide_tree.m_leaf_nodes.reserve(leaf_count);
+    wide_tree.m_wide_nodes.reserve(leaf_count / (WideNodeType::Width - 1) + 1);
+
+    if (tree.m_nodes[0].is_leaf())
+    {
+        // The root of the binary tree is a leaf: create a wide root node with a single child.
+        wide_tree.m_wide_nodes.push_back(WideNodeType());
+        wide_tree.m_wide_nodes[0].clear();
+
+        Child root;
+        root.m_node_index = 0;
+        root.m_bbox = tree_bbox;
+        store_child(tree, wide_tree, 0, 0, root);
+
+        AABB3d child_bboxes[WideNodeType::Width];
+        child_bboxes[0] = AABB3d(tree_bbox);
+        wide_tree.m_wide_nodes[0].set_child_bboxes(child_bboxes);
+    }
+    else
+    {
+        // Recursively collapse the binary tree.
+        collapse_recurse(tree, wide_tree, 0);
+    }
+
+    // Measure and save collapse time.
+    stopwatch.measure();
+    m_collapse_time = stopwatch.get_seconds();
+}
+
+template <typename Tree, typename WideTree>
+inline double Collapser<Tree, WideTree>::get_collapse_time() const
+{
+    return m_collapse_time;
+}
+
+template <typename Tree, typename WideTree>
+size_t Collapser<Tree, WideTree>::collapse_recurse(
+    const Tree&             tree,
+    WideTree&               wide_tree,
+    const size_t            node_index)
+{
+    const NodeType& node = tree.m_nodes[node_index];
+    assert(node.is_interior());
+
+    // Start with the two children of the binary node.
+    Child children[WideNodeType::Width];
+    children[0].m_node_index = node.get_child_node_index();
+    children[0].m_bbox = node.get_left_bbox();
+    children[1].m_node_index = node.get_child_node_index() + 1;
+    children[1].m_bbox = node.get_right_bbox();
+    size_t child_count = 2;
+
+    // Pull grandchildren up until the wide node is full.
+    while (child_count < WideNodeType::Width)
+    {
+        // Find the interior child with the largest surface area.
+        size_t best_child = ~size_t(0);
+        ValueType best_area(-1.0);
+        for (size_t i = 0; i < child_count; ++i)
+        {
+            if (tree.m_nodes[children[i].m_node_index].is_leaf())
+                continue;
+
+            const ValueType area = half_surface_area(children[i].m_bbox);
+            if (best_area < area)
+            {
+                best_area = area;
+                best_child = i;
+            }
+        }
+
+        // Stop if all children are leaves.
+        if (best_child == ~size_t(0))
+            break;
+
+        // Replace this child by its own two children.
+        const NodeType& best_node = tree.m_nodes[children[best_child].m_node_index];
+        children[child_count].m_node_index = best_node.get_child_node_index() + 1;
+        children[child_count].m_bbox = best_node.get_right_bbox();
+        children[best_child].m_node_index = best_node.get_child_node_index();
+        children[best_child].m_bbox = best_node.get_left_bbox();
+        ++child_count;
+    }
+
+    // Create the wide node. Nodes are stored in depth-first order.
+    const size_t wide_node_index = wide_tree.m_wide_nodes.size();
+    wide_tree.m_wide_nodes.push_back(WideNodeType());
+    wide_tree.m_wide_nodes[wide_node_index].clear();
+
+    // Store the children, recursing into interior ones.
+    for (size_t i = 0; i < child_count; ++i)
+        store_child(tree, wide_tree, wide_node_index, i, children[i]);
+
+    // Set the bounding boxes of the children once they are all stored.
+    AABB3d child_bboxes[WideNodeType::Width];
+    for (size_t i = 0; i < child_count; ++i)
+        child_bboxes[i] = AABB3d(children[i].m_bbox);
+    wide_tree.m_wide_nodes[wide_node_index].set_child_bboxes(child_bboxes);
+
+    return wide_node_index;
+}
+
+template <typename Tree, typename WideTree>
+void Collapser<Tree, WideTree>::store_child(
+    const Tree&             tree,
+    WideTree&               wide_tree,
+    const size_t            wide_node_index,
+    const size_t            slot,
+    const Child&            child)
+{
+    const NodeType& node = tree.m_nodes[child.m_node_index];
+
+    if (node.is_leaf())
+    {
+        const size_t leaf_index = wide_tree.m_leaf_nodes.size();
+        wide_tree.m_leaf_nodes.push_back(node);
+        wide_tree.m_wide_nodes[wide_node_index].set_leaf_child(slot, leaf_index);
+    }
+    else
+    {
+        // Don't keep references to wide nodes across the recursion: the vector may grow.
+        const size_t child_wide_node_index = collapse_recurse(tree, wide_tree, child.m_node_index);
+        wide_tree.m_wide_nodes[wide_node_index].set_interior_child(slot, child_wide_node_index);
+    }
+}
+
+}   // namespace bvh
+}   // namespace foundation
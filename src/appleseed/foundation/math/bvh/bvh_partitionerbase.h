@@ -46,6 +46,10 @@ namespace bvh {
 //
 // A base class for BVH partitioners.
 //
+// Disjoint sets of items can be partitioned concurrently as long as each of
+// them contains at most half the total number of items (larger sets cause
+// the temporary index buffer to be swapped with the sorted indices).
+//
 
 template <typename AABBVector>
 class PartitionerBase
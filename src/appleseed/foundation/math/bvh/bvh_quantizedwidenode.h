@@ -0,0 +1,331 @@
+
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2019 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+// appleseed.foundation headers.
+#include "foundation/math/aabb.h"
+#include "foundation/platform/compiler.h"
+
+// Standard headers.
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace foundation {
+namespace bvh {
+
+//
+// Interior node of a wide (N-ary) BVH with quantized child bounding boxes.
+//
+// This is a compact alternative to bvh::WideNode: the bounding boxes of the
+// children are stored as 8-bit integers relative to the bounding box of the node
+// itself, which is described by an origin and a power-of-two scale per dimension.
+// Child boxes are quantized conservatively (minimums are rounded down, maximums
+// are rounded up) so that the dequantized boxes always enclose the original ones.
+//
+// A quantized 4-wide node occupies 64 bytes instead of 128 bytes for a 4-wide
+// node, and a quantized 8-wide node 128 bytes instead of 256 bytes.
+//
+// Reference:
+//
+//   Efficient Incoherent Ray Traversal on GPUs Through Compressed Wide BVHs
+//   Henri Ylitie, Tero Karras, Samuli Laine, High Performance Graphics 2017
+//
+
+template <size_t N>
+class APPLESEED_ALIGN(64) QuantizedWideNode
+{
+  public:
+    // Number of children.
+    static const size_t Width = N;
+
+    // Largest quantized coordinate.
+    static const std::uint32_t MaxQuantizedValue = 255;
+
+    // Mark all children as empty.
+    void clear();
+
+    // Set the bounding box of the node. Must be called before setting the
+    // bounding boxes of the children, which must lie inside this box.
+    void set_bbox(const AABB3d& bbox);
+
+    // Set/get the bounding box of a given child.
+    void set_child_bbox(const size_t child, const AABB3d& bbox);
+    AABB3f get_child_bbox(const size_t child) const;
+
+    // Set the bounding boxes of all non-empty children, indexed by child. The bounding
+    // box of the node is set to the union of the valid bounding boxes of the children.
+    void set_child_bboxes(const AABB3d bboxes[]);
+
+    // Make a given child an interior node, a leaf node or an empty slot.
+    void set_interior_child(const size_t child, const size_t node_index);
+    void set_leaf_child(const size_t child, const size_t leaf_index);
+    void set_empty_child(const size_t child);
+
+    // Query a given child.
+    bool is_empty_child(const size_t child) const;
+    bool is_leaf_child(const size_t child) const;
+    size_t get_child_index(const size_t child) const;
+
+    // Return the number of non-empty children.
+    size_t get_child_count() const;
+
+  private:
+    template <typename Tree, typename Visitor, typename Ray, size_t StackSize>
+    friend class WideIntersector;
+
+    template <size_t Width>
+    friend class WideNodeTester;
+
+    static const std::uint32_t EmptyChild = ~std::uint32_t(0);
+    static const std::uint32_t LeafFlag = std::uint32_t(1) << 31;
+
+    // Origin and scale of the quantization grid in each dimension.
+    float                           m_origin[3];
+    float                           m_scale[3];
+
+    // Quantized bounding boxes of the children, in the same layout as in bvh::WideNode:
+    // for each dimension, Width minimum coordinates followed by Width maximum coordinates.
+    std::uint8_t                    m_bbox_data[6 * N];
+
+    std::uint32_t                   m_children[N];
+
+    // Dequantize a coordinate. Since the scale is a power of two, the product is
+    // exact and the result is the same whether or not a fused multiply-add is used.
+    static float dequantize(
+        const float                 origin,
+        const float                 scale,
+        const std::uint32_t         value);
+};
+
+
+//
+// QuantizedWideNode class implementation.
+//
+
+template <size_t N>
+inline void QuantizedWideNode<N>::clear()
+{
+    for (size_t d = 0; d < 3; ++d)
+    {
+        m_origin[d] = 0.0f;
+        m_scale[d] = 1.0f;
+    }
+
+    for (size_t i = 0; i < N; ++i)
+        set_empty_child(i);
+}
+
+template <size_t N>
+inline void QuantizedWideNode<N>::set_bbox(const AABB3d& bbox)
+{
+    assert(bbox.is_valid());
+
+    for (size_t d = 0; d < 3; ++d)
+    {
+        // Round the origin down so that it lies below the minimum of the node.
+        float origin = static_cast<float>(bbox.min[d]);
+        if (static_cast<double>(origin) > bbox.min[d])
+            origin = std::nextafter(origin, -std::numeric_limits<float>::infinity());
+
+        // Find the smallest power-of-two scale such that the quantization grid spans the node.
+        const double extent = bbox.max[d] - static_cast<double>(origin);
+        int exponent = std::numeric_limits<float>::min_exponent - 1;
+        if (extent > 0.0)
+        {
+            const double mantissa = std::frexp(extent / MaxQuantizedValue, &exponent);
+            if (mantissa == 0.5)
+                --exponent;
+            exponent = std::max(exponent, std::numeric_limits<float>::min_exponent - 1);
+        }
+        float scale = std::ldexp(1.0f, exponent);
+
+        // Account for the rounding of the dequantized coordinates.
+        while (static_cast<double>(dequantize(origin, scale, MaxQuantizedValue)) < bbox.max[d])
+            scale *= 2.0f;
+
+        m_origin[d] = origin;
+        m_scale[d] = scale;
+    }
+}
+
+template <size_t N>
+inline void QuantizedWideNode<N>::set_child_bbox(const size_t child, const AABB3d& bbox)
+{
+    assert(child < N);
+
+    for (size_t d = 0; d < 3; ++d)
+    {
+        const float origin = m_origin[d];
+        const float scale = m_scale[d];
+
+        assert(static_cast<double>(origin) <= bbox.min[d]);
+        assert(static_cast<double>(dequantize(origin, scale, MaxQuantizedValue)) >= bbox.max[d]);
+
+        // Estimate the quantized coordinates.
+        const double limit = static_cast<double>(MaxQuantizedValue);
+        std::uint32_t qmin =
+            static_cast<std::uint32_t>(
+                std::min(std::max(std::floor((bbox.min[d] - origin) / scale), 0.0), limit));
+        std::uint32_t qmax =
+            static_cast<std::uint32_t>(
+                std::min(std::max(std::ceil((bbox.max[d] - origin) / scale), 0.0), limit));
+
+        // Round outward so that the dequantized box encloses the original one.
+        while (qmin > 0 && static_cast<double>(dequantize(origin, scale, qmin)) > bbox.min[d])
+            --qmin;
+        while (qmax < MaxQuantizedValue && static_cast<double>(dequantize(origin, scale, qmax)) < bbox.max[d])
+            ++qmax;
+
+        m_bbox_data[d * 2 * N + child] = static_cast<std::uint8_t>(qmin);
+        m_bbox_data[d * 2 * N + N + child] = static_cast<std::uint8_t>(qmax);
+    }
+}
+
+template <size_t N>
+inline AABB3f QuantizedWideNode<N>::get_child_bbox(const size_t child) const
+{
+    assert(child < N);
+
+    AABB3f bbox;
+
+    for (size_t d = 0; d < 3; ++d)
+    {
+        bbox.min[d] = dequantize(m_origin[d], m_scale[d], m_bbox_data[d * 2 * N + child]);
+        bbox.max[d] = dequantize(m_origin[d], m_scale[d], m_bbox_data[d * 2 * N + N + child]);
+    }
+
+    return bbox;
+}
+
+template <size_t N>
+inline void QuantizedWideNode<N>::set_child_bboxes(const AABB3d bboxes[])
+{
+    AABB3d bbox;
+    bbox.invalidate();
+
+    for (size_t i = 0; i < N; ++i)
+    {
+        if (!is_empty_child(i) && bboxes[i].is_valid())
+            bbox.insert(bboxes[i]);
+    }
+
+    if (bbox.is_valid())
+        set_bbox(bbox);
+
+    for (size_t i = 0; i < N; ++i)
+    {
+        if (!is_empty_child(i))
+            set_child_bbox(i, bboxes[i]);
+    }
+}
+
+template <size_t N>
+inline void QuantizedWideNode<N>::set_interior_child(const size_t child, const size_t node_index)
+{
+    assert(child < N);
+    assert(node_index < LeafFlag);
+    m_children[child] = static_cast<std::uint32_t>(node_index);
+}
+
+template <size_t N>
+inline void QuantizedWideNode<N>::set_leaf_child(const size_t child, const size_t leaf_index)
+{
+    assert(child < N);
+    assert(leaf_index < LeafFlag - 1);
+    m_children[child] = static_cast<std::uint32_t>(leaf_index) | LeafFlag;
+}
+
+template <size_t N>
+inline void QuantizedWideNode<N>::set_empty_child(const size_t child)
+{
+    assert(child < N);
+
+    m_children[child] = EmptyChild;
+
+    // Use an inverted box. Since a degenerate node may collapse it to a point,
+    // empty children are also explicitly skipped during traversal.
+    for (size_t d = 0; d < 3; ++d)
+    {
+        m_bbox_data[d * 2 * N + child] = static_cast<std::uint8_t>(MaxQuantizedValue);
+        m_bbox_data[d * 2 * N + N + child] = 0;
+    }
+}
+
+template <size_t N>
+inline bool QuantizedWideNode<N>::is_empty_child(const size_t child) const
+{
+    assert(child < N);
+    return m_children[child] == EmptyChild;
+}
+
+template <size_t N>
+inline bool QuantizedWideNode<N>::is_leaf_child(const size_t child) const
+{
+    assert(child < N);
+    return m_children[child] != EmptyChild && (m_children[child] & LeafFlag) != 0;
+}
+
+template <size_t N>
+inline size_t QuantizedWideNode<N>::get_child_index(const size_t child) const
+{
+    assert(child < N);
+    assert(!is_empty_child(child));
+    return static_cast<size_t>(m_children[child] & ~LeafFlag);
+}
+
+template <size_t N>
+inline size_t QuantizedWideNode<N>::get_child_count() const
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < N; ++i)
+    {
+        if (m_children[i] != EmptyChild)
+            ++count;
+    }
+
+    return count;
+}
+
+template <size_t N>
+inline float QuantizedWideNode<N>::dequantize(
+    const float                     origin,
+    const float                     scale,
+    const std::uint32_t             value)
+{
+    return origin + static_cast<float>(value) * scale;
+}
+
+}   // namespace bvh
+}   // namespace foundation
@@ -0,0 +1,661 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2010-2013 Francois Beaune, Jupiter Jazz Limited
+// Copyright (c) 2014-2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+// appleseed.foundation headers.
+#include "foundation/core/concepts/noncopyable.h"
+#include "foundation/math/aabb.h"
+#include "foundation/utility/job/ijob.h"
+#include "foundation/utility/job/jobqueue.h"
+#include "foundation/utility/stopwatch.h"
+
+// Standard headers.
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace foundation {
+namespace bvh {
+
+//
+// BVH refitters.
+//
+// A refitter updates the bounding boxes of an existing tree after its items have
+// moved, without changing the topology of the tree. The new bounding box of each
+// leaf is computed by the LeafRefitter class, then bounding boxes are propagated
+// bottom-up to the root.
+//
+// The LeafRefitter class must conform to the following prototype:
+//
+//      class LeafRefitter
+//      {
+//        public:
+//          // Update a leaf and return the bounding box of its items.
+//          AABBType operator()(NodeType& leaf) const;
+//      };
+//
+// The parallel versions of refit() call the leaf refitter concurrently on distinct
+// leaves. Motion bounding boxes of binary trees are not refit.
+//
+// The quality of the tree is measured with the surface area heuristic (SAH), before
+// and after refitting. Costs are relative to the surface area of the root so that
+// trees of different sizes can be compared. Refitting degrades the quality of the
+// tree as items move away from their original location; callers are expected to
+// rebuild the tree when the cost grows too much.
+//
+
+template <typename Tree, typename LeafRefitter>
+class Refitter
+  : public NonCopyable
+{
+  public:
+    typedef typename Tree::NodeType NodeType;
+    typedef typename NodeType::AABBType AABBType;
+    typedef typename AABBType::ValueType ValueType;
+
+    // Constructor.
+    Refitter(
+        const ValueType         interior_node_traversal_cost = ValueType(1.0),
+        const ValueType         item_intersection_cost = ValueType(1.0));
+
+    // Refit a tree.
+    template <typename Timer>
+    void refit(
+        Tree&                   tree,
+        const LeafRefitter&     leaf_refitter);
+
+    // Refit a tree, refitting leaves using the worker threads consuming a given job queue.
+    template <typename Timer>
+    void refit(
+        Tree&                   tree,
+        const LeafRefitter&     leaf_refitter,
+        JobQueue&               job_queue,
+        const size_t            thread_count);
+
+    // Return the bounding box of the refit tree.
+    const AABBType& get_tree_bbox() const;
+
+    // Return the SAH cost of the tree before and after the last refit.
+    ValueType get_initial_cost() const;
+    ValueType get_cost() const;
+
+    // Return the refit time.
+    double get_refit_time() const;
+
+  private:
+    const ValueType             m_interior_node_traversal_cost;
+    const ValueType             m_item_intersection_cost;
+    AABBType                    m_tree_bbox;
+    ValueType                   m_initial_cost;
+    ValueType                   m_cost;
+    double                      m_refit_time;
+
+    // Refit a tree, in parallel if a job queue is provided.
+    template <typename Timer>
+    void do_refit(
+        Tree&                   tree,
+        const LeafRefitter&     leaf_refitter,
+        JobQueue*               job_queue,
+        const size_t            thread_count);
+
+    // Recursively propagate bounding boxes from the leaves to a given interior node.
+    AABBType refit_recurse(
+        Tree&                   tree,
+        const std::vector<AABBType>& leaf_bboxes,
+        const size_t            node_index);
+
+    // Accumulate the cost of a given child into a SAH cost.
+    void accumulate_cost(
+        const NodeType&         node,
+        const AABBType&         bbox,
+        ValueType&              cost) const;
+};
+
+
+//
+// Wide BVH refitter.
+//
+// Relies on the depth-first order in which bvh::Collapser stores wide nodes:
+// every wide node is stored before its children.
+//
+
+template <typename WideTree, typename LeafRefitter>
+class WideRefitter
+  : public NonCopyable
+{
+  public:
+    typedef typename WideTree::WideNodeType WideNodeType;
+    typedef typename WideTree::LeafNodeType LeafNodeType;
+    typedef typename LeafNodeType::AABBType AABBType;
+    typedef typename AABBType::ValueType ValueType;
+
+    // Constructor.
+    WideRefitter(
+        const ValueType         interior_node_traversal_cost = ValueType(1.0),
+        const ValueType         item_intersection_cost = ValueType(1.0));
+
+    // Refit a wide tree.
+    template <typename Timer>
+    void refit(
+        WideTree&               wide_tree,
+        const LeafRefitter&     leaf_refitter);
+
+    // Refit a wide tree, refitting leaves using the worker threads consuming a given job queue.
+    template <typename Timer>
+    void refit(
+        WideTree&               wide_tree,
+        const LeafRefitter&     leaf_refitter,
+        JobQueue&               job_queue,
+        const size_t            thread_count);
+
+    // Return the bounding box of the refit tree.
+    const AABBType& get_tree_bbox() const;
+
+    // Return the SAH cost of the tree before and after the last refit.
+    ValueType get_initial_cost() const;
+    ValueType get_cost() const;
+
+    // Return the refit time.
+    double get_refit_time() const;
+
+  private:
+    const ValueType             m_interior_node_traversal_cost;
+    const ValueType             m_item_intersection_cost;
+    AABBType                    m_tree_bbox;
+    ValueType                   m_initial_cost;
+    ValueType                   m_cost;
+    double                      m_refit_time;
+
+    // Refit a wide tree, in parallel if a job queue is provided.
+    template <typename Timer>
+    void do_refit(
+        WideTree&               wide_tree,
+        const LeafRefitter&     leaf_refitter,
+        JobQueue*               job_queue,
+        const size_t            thread_count);
+
+    // Propagate bounding boxes from the leaves to the root.
+    void refit_nodes(
+        WideTree&               wide_tree,
+        const std::vector<AABBType>& leaf_bboxes);
+};
+
+
+//
+// Utilities shared by the refitters.
+//
+
+namespace impl
+{
+    // Minimum number of leaves refit by a single job.
+    const size_t MinRefitJobSize = 1024;
+
+    // Refit a range of leaves.
+    template <typename LeafNodeType, typename LeafRefitter>
+    class LeafRefitJob
+      : public IJob
+    {
+      public:
+        typedef typename LeafNodeType::AABBType AABBType;
+
+        LeafRefitJob(
+            const LeafRefitter&             leaf_refitter,
+            const std::vector<LeafNodeType*>& leaves,
+            std::vector<AABBType>&          leaf_bboxes,
+            const std::vector<size_t>&      leaf_bbox_indices,
+            const size_t                    begin,
+            const size_t                    end)
+          : m_leaf_refitter(leaf_refitter)
+          , m_leaves(leaves)
+          , m_leaf_bboxes(leaf_bboxes)
+          , m_leaf_bbox_indices(leaf_bbox_indices)
+          , m_begin(begin)
+          , m_end(end)
+        {
+        }
+
+        void execute(const size_t thread_index) override
+        {
+            for (size_t i = m_begin; i < m_end; ++i)
+                m_leaf_bboxes[m_leaf_bbox_indices[i]] = m_leaf_refitter(*m_leaves[i]);
+        }
+
+      private:
+        const LeafRefitter&                 m_leaf_refitter;
+        const std::vector<LeafNodeType*>&   m_leaves;
+        std::vector<AABBType>&              m_leaf_bboxes;
+        const std::vector<size_t>&          m_leaf_bbox_indices;
+        const size_t                        m_begin;
+        const size_t                        m_end;
+    };
+
+    // Refit a set of leaves, in parallel if there are enough of them.
+    template <typename LeafNodeType, typename LeafRefitter>
+    void refit_leaves(
+        const LeafRefitter&                 leaf_refitter,
+        const std::vector<LeafNodeType*>&   leaves,
+        std::vector<typename LeafNodeType::AABBType>& leaf_bboxes,
+        const std::vector<size_t>&          leaf_bbox_indices,
+        JobQueue*                           job_queue,
+        const size_t                        thread_count)
+    {
+        const size_t leaf_count = leaves.size();
+        const size_t job_count =
+            job_queue != nullptr
+                ? std::min(thread_count, leaf_count / MinRefitJobSize)
+                : 0;
+
+        if (job_count <= 1)
+        {
+            LeafRefitJob<LeafNodeType, LeafRefitter> job(
+                leaf_refitter, leaves, leaf_bboxes, leaf_bbox_indices, 0, leaf_count);
+            job.execute(0);
+            return;
+        }
+
+        for (size_t i = 0; i < job_count; ++i)
+        {
+            job_queue->schedule(
+                new LeafRefitJob<LeafNodeType, LeafRefitter>(
+                    leaf_refitter,
+                    leaves,
+                    leaf_bboxes,
+                    leaf_bbox_indices,
+                    (i + 0) * leaf_count / job_count,
+                    (i + 1) * leaf_count / job_count));
+        }
+
+        job_queue->wait_until_completion();
+    }
+
+    template <typename T>
+    T normalize_cost(const T cost, const T root_area)
+    {
+        return root_area > T(0.0) ? cost / root_area : T(0.0);
+    }
+}
+
+
+//
+// Refitter class implementation.
+//
+
+template <typename Tree, typename LeafRefitter>
+Refitter<Tree, LeafRefitter>::Refitter(
+    const ValueType             interior_node_traversal_cost,
+    const ValueType             item_intersection_cost)
+  : m_interior_node_traversal_cost(interior_node_traversal_cost)
+  , m_item_intersection_cost(item_intersection_cost)
+  , m_initial_cost(ValueType(0.0))
+  , m_cost(ValueType(0.0))
+  , m_refit_time(0.0)
+{
+    m_tree_bbox.invalidate();
+}
+
+template <typename Tree, typename LeafRefitter>
+template <typename Timer>
+void Refitter<Tree, LeafRefitter>::refit(
+    Tree&                       tree,
+    const LeafRefitter&         leaf_refitter)
+{
+    do_refit<Timer>(tree, leaf_refitter, nullptr, 1);
+}
+
+template <typename Tree, typename LeafRefitter>
+template <typename Timer>
+void Refitter<Tree, LeafRefitter>::refit(
+    Tree&                       tree,
+    const LeafRefitter&         leaf_refitter,
+    JobQueue&                   job_queue,
+    const size_t                thread_count)
+{
+    do_refit<Timer>(tree, leaf_refitter, &job_queue, thread_count);
+}
+
+template <typename Tree, typename LeafRefitter>
+inline const typename Refitter<Tree, LeafRefitter>::AABBType& Refitter<Tree, LeafRefitter>::get_tree_bbox() const
+{
+    return m_tree_bbox;
+}
+
+template <typename Tree, typename LeafRefitter>
+inline typename Refitter<Tree, LeafRefitter>::ValueType Refitter<Tree, LeafRefitter>::get_initial_cost() const
+{
+    return m_initial_cost;
+}
+
+template <typename Tree, typename LeafRefitter>
+inline typename Refitter<Tree, LeafRefitter>::ValueType Refitter<Tree, LeafRefitter>::get_cost() const
+{
+    return m_cost;
+}
+
+template <typename Tree, typename LeafRefitter>
+inline double Refitter<Tree, LeafRefitter>::get_refit_time() const
+{
+    return m_refit_time;
+}
+
+template <typename Tree, typename LeafRefitter>
+template <typename Timer>
+void Refitter<Tree, LeafRefitter>::do_refit(
+    Tree&                       tree,
+    const LeafRefitter&         leaf_refitter,
+    JobQueue*                   job_queue,
+    const size_t                thread_count)
+{
+    assert(!tree.m_nodes.empty());
+
+    // Start stopwatch.
+    Stopwatch<Timer> stopwatch;
+    stopwatch.start();
+
+    // Collect the leaves. Leaf bounding boxes are indexed by node index.
+    std::vector<NodeType*> leaves;
+    std::vector<size_t> leaf_bbox_indices;
+    for (size_t i = 0, e = tree.m_nodes.size(); i < e; ++i)
+    {
+        if (tree.m_nodes[i].is_leaf())
+        {
+            leaves.push_back(&tree.m_nodes[i]);
+            leaf_bbox_indices.push_back(i);
+        }
+    }
+
+    // Refit the leaves.
+    std::vector<AABBType> leaf_bboxes(tree.m_nodes.size());
+    impl::refit_leaves(
+        leaf_refitter,
+        leaves,
+        leaf_bboxes,
+        leaf_bbox_indices,
+        job_queue,
+        thread_count);
+
+    const NodeType& root = tree.m_nodes[0];
+
+    if (root.is_leaf())
+    {
+        m_tree_bbox = leaf_bboxes[0];
+        m_initial_cost = m_cost = m_item_intersection_cost * static_cast<ValueType>(root.get_item_count());
+    }
+    else
+    {
+        // The cost of the root is computed from its children since its own bounding box isn't stored.
+        AABBType initial_root_bbox = root.get_left_bbox();
+        initial_root_bbox.insert(root.get_right_bbox());
+
+        m_initial_cost = ValueType(0.0);
+        m_cost = ValueType(0.0);
+        m_tree_bbox = refit_recurse(tree, leaf_bboxes, 0);
+
+        const ValueType initial_root_area = half_surface_area(initial_root_bbox);
+        const ValueType root_area = half_surface_area(m_tree_bbox);
+        m_initial_cost = m_interior_node_traversal_cost + impl::normalize_cost(m_initial_cost, initial_root_area);
+        m_cost = m_interior_node_traversal_cost + impl::normalize_cost(m_cost, root_area);
+    }
+
+    // Measure and save refit time.
+    stopwatch.measure();
+    m_refit_time = stopwatch.get_seconds();
+}
+
+template <typename Tree, typename LeafRefitter>
+typename Refitter<Tree, LeafRefitter>::AABBType Refitter<Tree, LeafRefitter>::refit_recurse(
+    Tree&                       tree,
+    const std::vector<AABBType>& leaf_bboxes,
+    const size_t                node_index)
+{
+    const size_t child_index = tree.m_nodes[node_index].get_child_node_index();
+    const NodeType& left_node = tree.m_nodes[child_index + 0];
+    const NodeType& right_node = tree.m_nodes[child_index + 1];
+
+    // Accumulate the cost of the children before their bounding boxes are overwritten.
+    accumulate_cost(left_node, tree.m_nodes[node_index].get_left_bbox(), m_initial_cost);
+    accumulate_cost(right_node, tree.m_nodes[node_index].get_right_bbox(), m_initial_cost);
+
+    // Don't keep references to the node across the recursion.
+    const AABBType left_bbox =
+        left_node.is_leaf()
+            ? leaf_bboxes[child_index + 0]
+            : refit_recurse(tree, leaf_bboxes, child_index + 0);
+    const AABBType right_bbox =
+        right_node.is_leaf()
+            ? leaf_bboxes[child_index + 1]
+            : refit_recurse(tree, leaf_bboxes, child_index + 1);
+
+    accumulate_cost(left_node, left_bbox, m_cost);
+    accumulate_cost(right_node, right_bbox, m_cost);
+
+    NodeType& node = tree.m_nodes[node_index];
+    node.set_left_bbox(left_bbox);
+    node.set_right_bbox(right_bbox);
+
+    AABBType bbox(left_bbox);
+    bbox.insert(right_bbox);
+    return bbox;
+}
+
+template <typename Tree, typename LeafRefitter>
+inline void Refitter<Tree, LeafRefitter>::accumulate_cost(
+    const NodeType&             node,
+    const AABBType&             bbox,
+    ValueType&                  cost) const
+{
+    if (!bbox.is_valid())
+        return;
+
+    cost +=
+        half_surface_area(bbox) *
+            (node.is_leaf()
+                 ? m_item_intersection_cost * static_cast<ValueType>(node.get_item_count())
+                 : m_interior_node_traversal_cost);
+}
+
+
+//
+// WideRefitter class implementation.
+//
+
+template <typename WideTree, typename LeafRefitter>
+WideRefitter<WideTree, LeafRefitter>::WideRefitter(
+    const ValueType             interior_node_traversal_cost,
+    const ValueType             item_intersection_cost)
+  : m_interior_node_traversal_cost(interior_node_traversal_cost)
+  , m_item_intersection_cost(item_intersection_cost)
+  , m_initial_cost(ValueType(0.0))
+  , m_cost(ValueType(0.0))
+  , m_refit_time(0.0)
+{
+    m_tree_bbox.invalidate();
+}
+
+template <typename WideTree, typename LeafRefitter>
+template <typename Timer>
+void WideRefitter<WideTree, LeafRefitter>::refit(
+    WideTree&                   wide_tree,
+    const LeafRefitter&         leaf_refitter)
+{
+    do_refit<Timer>(wide_tree, leaf_refitter, nullptr, 1);
+}
+
+template <typename WideTree, typename LeafRefitter>
+template <typename Timer>
+void WideRefitter<WideTree, LeafRefitter>::refit(
+    WideTree&                   wide_tree,
+    const LeafRefitter&         leaf_refitter,
+    JobQueue&                   job_queue,
+    const size_t                thread_count)
+{
+    do_refit<Timer>(wide_tree, leaf_refitter, &job_queue, thread_count);
+}
+
+template <typename WideTree, typename LeafRefitter>
+template <typename Timer>
+void WideRefitter<WideTree, LeafRefitter>::do_refit(
+    WideTree&                   wide_tree,
+    const LeafRefitter&         leaf_refitter,
+    JobQueue*                   job_queue,
+    const size_t                thread_count)
+{
+    assert(!wide_tree.m_wide_nodes.empty());
+
+    // Start stopwatch.
+    Stopwatch<Timer> stopwatch;
+    stopwatch.start();
+
+    // Collect the leaves. Leaf bounding boxes are indexed by leaf index.
+    const size_t leaf_count = wide_tree.m_leaf_nodes.size();
+    std::vector<LeafNodeType*> leaves(leaf_count);
+    std::vector<size_t> leaf_bbox_indices(leaf_count);
+    for (size_t i = 0; i < leaf_count; ++i)
+    {
+        leaves[i] = &wide_tree.m_leaf_nodes[i];
+        leaf_bbox_indices[i] = i;
+    }
+
+    // Refit the leaves.
+    std::vector<AABBType> leaf_bboxes(leaf_count);
+    impl::refit_leaves(
+        leaf_refitter,
+        leaves,
+        leaf_bboxes,
+        leaf_bbox_indices,
+        job_queue,
+        thread_count);
+
+    // Refit the wide nodes.
+    refit_nodes(wide_tree, leaf_bboxes);
+
+    // Measure and save refit time.
+    stopwatch.measure();
+    m_refit_time = stopwatch.get_seconds();
+}
+
+template <typename WideTree, typename LeafRefitter>
+inline const typename WideRefitter<WideTree, LeafRefitter>::AABBType& WideRefitter<WideTree, LeafRefitter>::get_tree_bbox() const
+{
+    return m_tree_bbox;
+}
+
+template <typename WideTree, typename LeafRefitter>
+inline typename WideRefitter<WideTree, LeafRefitter>::ValueType WideRefitter<WideTree, LeafRefitter>::get_initial_cost() const
+{
+    return m_initial_cost;
+}
+
+template <typename WideTree, typename LeafRefitter>
+inline typename WideRefitter<WideTree, LeafRefitter>::ValueType WideRefitter<WideTree, LeafRefitter>::get_cost() const
+{
+    return m_cost;
+}
+
+template <typename WideTree, typename LeafRefitter>
+inline double WideRefitter<WideTree, LeafRefitter>::get_refit_time() const
+{
+    return m_refit_time;
+}
+
+template <typename WideTree, typename LeafRefitter>
+void WideRefitter<WideTree, LeafRefitter>::refit_nodes(
+    WideTree&                   wide_tree,
+    const std::vector<AABBType>& leaf_bboxes)
+{
+    const size_t node_count = wide_tree.m_wide_nodes.size();
+    std::vector<AABBType> node_bboxes(node_count);
+
+    ValueType initial_cost(0.0);
+    ValueType cost(0.0);
+
+    AABBType initial_root_bbox;
+    initial_root_bbox.invalidate();
+
+    // Children are always stored after their parent: visit nodes in reverse order.
+    for (size_t n = node_count; n-- > 0; )
+    {
+        WideNodeType& node = wide_tree.m_wide_nodes[n];
+
+        AABBType child_bboxes[WideNodeType::Width];
+        AABBType bbox;
+        bbox.invalidate();
+
+        for (size_t i = 0; i < WideNodeType::Width; ++i)
+        {
+            if (node.is_empty_child(i))
+                continue;
+
+            const size_t child_index = node.get_child_index(i);
+            const ValueType child_cost =
+                node.is_leaf_child(i)
+                    ? m_item_intersection_cost * static_cast<ValueType>(wide_tree.m_leaf_nodes[child_index].get_item_count())
+                    : m_interior_node_traversal_cost;
+
+            // Accumulate the cost of the child before its bounding box is overwritten.
+            const AABBType initial_child_bbox(node.get_child_bbox(i));
+            if (initial_child_bbox.is_valid())
+                initial_cost += half_surface_area(initial_child_bbox) * child_cost;
+            if (n == 0)
+                initial_root_bbox.insert(initial_child_bbox);
+
+            child_bboxes[i] =
+                node.is_leaf_child(i)
+                    ? leaf_bboxes[child_index]
+                    : node_bboxes[child_index];
+
+            if (child_bboxes[i].is_valid())
+            {
+                cost += half_surface_area(child_bboxes[i]) * child_cost;
+                bbox.insert(child_bboxes[i]);
+            }
+        }
+
+        AABB3d node_child_bboxes[WideNodeType::Width];
+        for (size_t i = 0; i < WideNodeType::Width; ++i)
+        {
+            if (!node.is_empty_child(i))
+                node_child_bboxes[i] = AABB3d(child_bboxes[i]);
+        }
+        node.set_child_bboxes(node_child_bboxes);
+
+        node_bboxes[n] = bbox;
+    }
+
+    m_tree_bbox = node_bboxes[0];
+
+    const ValueType initial_root_area = initial_root_bbox.is_valid() ? half_surface_area(initial_root_bbox) : ValueType(0.0);
+    const ValueType root_area = m_tree_bbox.is_valid() ? half_surface_area(m_tree_bbox) : ValueType(0.0);
+    m_initial_cost = m_interior_node_traversal_cost + impl::normalize_cost(initial_cost, initial_root_area);
+    m_cost = m_interior_node_traversal_cost + impl::normalize_cost(cost, root_area);
+}
+
+}   // namespace bvh
+}   // namespace foundation
@@ -124,11 +124,14 @@ size_t SAHPartitioner<AABBVector>::partition(
         AABBType bbox_accumulator;
 
         // Left-to-right sweep to accumulate bounding boxes and compute their surface area.
+        // The areas are stored at the position of the items so that disjoint sets of items
+        // can be partitioned concurrently.
+        ValueType* left_areas = &m_left_areas[begin];
         bbox_accumulator.invalidate();
         for (size_t i = 0; i < count - 1; ++i)
         {
             bbox_accumulator.insert(bboxes[indices[begin + i]]);
-            m_left_areas[i] = half_surface_area(bbox_accumulator);
+            left_areas[i] = half_surface_area(bbox_accumulator);
         }
 
         // Right-to-left sweep to accumulate bounding boxes, compute their surface area find the best partition.
@@ -139,7 +142,7 @@ size_t SAHPartitioner<AABBVector>::partition(
             bbox_accumulator.insert(bboxes[indices[begin + i]]);
 
             // Compute the cost of this partition.
-            const ValueType left_cost = m_left_areas[i - 1] * i;
+            const ValueType left_cost = left_areas[i - 1] * i;
             const ValueType right_cost = half_surface_area(bbox_accumulator) * (count - i);
             const ValueType split_cost = left_cost + right_cost;
 
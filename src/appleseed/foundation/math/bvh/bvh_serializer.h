@@ -0,0 +1,252 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2010-2013 Francois Beaune, Jupiter Jazz Limited
+// Copyright (c) 2014-2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+// appleseed.foundation headers.
+#include "foundation/utility/bufferedfile.h"
+
+// Standard headers.
+#include <cstddef>
+#include <cstdint>
+
+namespace foundation {
+namespace bvh {
+
+//
+// Read and write binary trees (bvh::Tree) and wide trees (bvh::WideTree).
+//
+// Nodes are plain data and are stored as raw bytes, so serialized trees can only
+// be read back by builds sharing the same node layout. Callers are expected to
+// store enough information alongside the tree to detect mismatches.
+//
+
+template <typename Tree>
+class TreeSerializer
+{
+  public:
+    // Write a tree. Return true on success.
+    static bool write(WriterAdapter& writer, const Tree& tree);
+
+    // Read a tree written by write(). Return true on success, in which case the
+    // previous content of the tree is replaced. Return false on error, in which
+    // case the tree is left in an unspecified state. Child node indices are
+    // checked, so a corrupted tree is reported as an error instead of causing
+    // out-of-bounds accesses during traversal.
+    static bool read(ReaderAdapter& reader, Tree& tree);
+
+    // Same as above, but additionally reject the tree if is_valid_leaf(leaf)
+    // returns false for any of its leaf nodes.
+    template <typename LeafChecker>
+    static bool read(ReaderAdapter& reader, Tree& tree, const LeafChecker& is_valid_leaf);
+};
+
+template <typename WideTree>
+class WideTreeSerializer
+{
+  public:
+    // Write a wide tree. Return true on success.
+    static bool write(WriterAdapter& writer, const WideTree& tree);
+
+    // Read a wide tree written by write(). Same semantics as TreeSerializer::read().
+    static bool read(ReaderAdapter& reader, WideTree& tree);
+
+    template <typename LeafChecker>
+    static bool read(ReaderAdapter& reader, WideTree& tree, const LeafChecker& is_valid_leaf);
+};
+
+// Write a vector of plain data as its size followed by its raw content.
+// Return true on success.
+template <typename Vector>
+bool write_plain_vector(WriterAdapter& writer, const Vector& vec);
+
+// Read a vector written by write_plain_vector(). Return true on success.
+template <typename Vector>
+bool read_plain_vector(ReaderAdapter& reader, Vector& vec);
+
+
+//
+// Implementation.
+//
+
+template <typename Vector>
+bool write_plain_vector(WriterAdapter& writer, const Vector& vec)
+{
+    typedef typename Vector::value_type ValueType;
+
+    const std::uint64_t size = static_cast<std::uint64_t>(vec.size());
+    if (writer.write(size) != sizeof(size))
+        return false;
+
+    if (size == 0)
+        return true;
+
+    const size_t bytes = vec.size() * sizeof(ValueType);
+    return writer.write(&vec[0], bytes) == bytes;
+}
+
+template <typename Vector>
+bool read_plain_vector(ReaderAdapter& reader, Vector& vec)
+{
+    typedef typename Vector::value_type ValueType;
+
+    std::uint64_t size;
+    if (reader.read(size) != sizeof(size))
+        return false;
+
+    // Protect against corrupted sizes before allocating memory.
+    if (size > ~size_t(0) / sizeof(ValueType))
+        return false;
+
+    vec.clear();
+    vec.resize(static_cast<size_t>(size));
+
+    if (size == 0)
+        return true;
+
+    const size_t bytes = vec.size() * sizeof(ValueType);
+    return reader.read(&vec[0], bytes) == bytes;
+}
+
+template <typename Tree>
+bool TreeSerializer<Tree>::write(WriterAdapter& writer, const Tree& tree)
+{
+    return
+        write_plain_vector(writer, tree.m_nodes) &&
+        write_plain_vector(writer, tree.m_node_bboxes);
+}
+
+namespace impl
+{
+    struct AcceptAnyLeaf
+    {
+        template <typename LeafNodeType>
+        bool operator()(const LeafNodeType&) const
+        {
+            return true;
+        }
+    };
+}
+
+template <typename Tree>
+bool TreeSerializer<Tree>::read(ReaderAdapter& reader, Tree& tree)
+{
+    return read(reader, tree, impl::AcceptAnyLeaf());
+}
+
+template <typename Tree>
+template <typename LeafChecker>
+bool TreeSerializer<Tree>::read(ReaderAdapter& reader, Tree& tree, const LeafChecker& is_valid_leaf)
+{
+    typedef typename Tree::NodeType NodeType;
+
+    if (!read_plain_vector(reader, tree.m_nodes) ||
+        !read_plain_vector(reader, tree.m_node_bboxes))
+        return false;
+
+    const size_t node_count = tree.m_nodes.size();
+
+    for (size_t i = 0; i < node_count; ++i)
+    {
+        const NodeType& node = tree.m_nodes[i];
+
+        if (node.is_interior())
+        {
+            // Child nodes are always stored after their parent, which also rules out cycles.
+            const size_t child_index = node.get_child_node_index();
+            if (child_index <= i || child_index >= node_count - 1)
+                return false;
+        }
+        else if (!is_valid_leaf(node))
+            return false;
+    }
+
+    return true;
+}
+
+template <typename WideTree>
+bool WideTreeSerializer<WideTree>::write(WriterAdapter& writer, const WideTree& tree)
+{
+    return
+        write_plain_vector(writer, tree.m_wide_nodes) &&
+        write_plain_vector(writer, tree.m_leaf_nodes);
+}
+
+template <typename WideTree>
+bool WideTreeSerializer<WideTree>::read(ReaderAdapter& reader, WideTree& tree)
+{
+    return read(reader, tree, impl::AcceptAnyLeaf());
+}
+
+template <typename WideTree>
+template <typename LeafChecker>
+bool WideTreeSerializer<WideTree>::read(ReaderAdapter& reader, WideTree& tree, const LeafChecker& is_valid_leaf)
+{
+    typedef typename WideTree::WideNodeType WideNodeType;
+
+    if (!read_plain_vector(reader, tree.m_wide_nodes) ||
+        !read_plain_vector(reader, tree.m_leaf_nodes))
+        return false;
+
+    const size_t wide_node_count = tree.m_wide_nodes.size();
+    const size_t leaf_node_count = tree.m_leaf_nodes.size();
+
+    // Leaf nodes can only be reached through a wide root node.
+    if (wide_node_count == 0 && leaf_node_count > 0)
+        return false;
+
+    for (size_t i = 0; i < wide_node_count; ++i)
+    {
+        const WideNodeType& node = tree.m_wide_nodes[i];
+
+        for (size_t c = 0; c < WideNodeType::Width; ++c)
+        {
+            if (node.is_empty_child(c))
+                continue;
+
+            // Interior children are always stored after their parent, which also rules out cycles.
+            const size_t child_index = node.get_child_index(c);
+            if (node.is_leaf_child(c)
+                    ? child_index >= leaf_node_count
+                    : child_index <= i || child_index >= wide_node_count)
+                return false;
+        }
+    }
+
+    for (size_t i = 0; i < leaf_node_count; ++i)
+    {
+        if (!is_valid_leaf(tree.m_leaf_nodes[i]))
+            return false;
+    }
+
+    return true;
+}
+
+}   // namespace bvh
+}   // namespace foundation
@@ -77,6 +77,30 @@ class TreeStatistics
 };
 
 
+//
+// Wide BVH tree statistics.
+//
+
+template <typename WideTree>
+class WideTreeStatistics
+  : public Statistics
+{
+  public:
+    // Constructor, collects statistics for a given wide tree.
+    explicit WideTreeStatistics(const WideTree& tree);
+
+  private:
+    Population<size_t>      m_child_count;          // number of children per interior node
+    Population<size_t>      m_leaf_depth;           // leaf depth statistics
+
+    // Helper method to recursively traverse the tree and collect statistics.
+    void collect_stats_recurse(
+        const WideTree&     tree,
+        const size_t        node_index,
+        const size_t        depth);
+};
+
+
 //
 // BVH traversal statistics.
 //
@@ -167,5 +191,51 @@ void TreeStatistics<Tree>::collect_stats_recurse(
     }
 }
 
+
+
+//
+// WideTreeStatistics class implementation.
+//
+
+template <typename WideTree>
+WideTreeStatistics<WideTree>::WideTreeStatistics(const WideTree& tree)
+{
+    assert(!tree.m_wide_nodes.empty());
+
+    collect_stats_recurse(tree, 0, 1);
+
+    insert_size("wide tree size", tree.get_memory_size());
+    insert(
+        "wide nodes",
+        "width " + pretty_uint(WideTree::WideNodeType::Width) +
+        "  interior " + pretty_uint(tree.m_wide_nodes.size()) +
+        "  leaves " + pretty_uint(tree.m_leaf_nodes.size()));
+    insert_size("wide node size", sizeof(typename WideTree::WideNodeType));
+    insert("wide node children", m_child_count);
+    insert("wide leaf depth", m_leaf_depth);
+}
+
+template <typename WideTree>
+void WideTreeStatistics<WideTree>::collect_stats_recurse(
+    const WideTree&         tree,
+    const size_t            node_index,
+    const size_t            depth)
+{
+    typedef typename WideTree::WideNodeType WideNodeType;
+
+    const WideNodeType& node = tree.m_wide_nodes[node_index];
+    m_child_count.insert(node.get_child_count());
+
+    for (size_t i = 0; i < WideNodeType::Width; ++i)
+    {
+        if (node.is_empty_child(i))
+            continue;
+
+        if (node.is_leaf_child(i))
+            m_leaf_depth.insert(depth + 1);
+        else collect_stats_recurse(tree, node.get_child_index(i), depth + 1);
+    }
+}
+
 }   // namespace bvh
 }   // namespace foundation
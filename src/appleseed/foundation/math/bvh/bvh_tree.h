@@ -68,6 +68,15 @@ class Tree
     template <typename Tree>
     friend class TreeStatistics;
 
+    template <typename Tree, typename WideTree>
+    friend class Collapser;
+
+    template <typename Tree, typename LeafRefitter>
+    friend class Refitter;
+
+    template <typename Tree>
+    friend class TreeSerializer;
+
     template <typename Tree, typename Visitor, typename Ray, size_t StackSize, size_t N>
     friend class Intersector;
 
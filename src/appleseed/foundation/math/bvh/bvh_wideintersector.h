@@ -0,0 +1,712 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2019 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+// appleseed.foundation headers.
+#include "foundation/core/concepts/noncopyable.h"
+#include "foundation/math/bvh/bvh_intersector.h"
+#include "foundation/math/bvh/bvh_quantizedwidenode.h"
+#include "foundation/math/bvh/bvh_statistics.h"
+#include "foundation/math/bvh/bvh_widenode.h"
+#include "foundation/math/ray.h"
+#include "foundation/platform/compiler.h"
+#ifdef APPLESEED_USE_SSE
+#include "foundation/platform/sse.h"
+#endif
+
+// Standard headers.
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace foundation {
+namespace bvh {
+
+//
+// Ray/wide node intersection test.
+//
+// The ray is converted to single precision once per traversal. To remain
+// conservative, the slabs of the boxes are widened on both sides: by the error
+// made when rounding the ray origin to single precision, which matters for rays
+// starting far from the world origin, then by the relative rounding error of
+// the single precision distance computations.
+//
+// Quantized wide nodes are dequantized on the fly; the dequantized boxes are
+// then tested exactly like the boxes of regular wide nodes.
+//
+
+template <size_t Width>
+class WideNodeTester
+{
+  public:
+    // Constructor.
+    template <typename Ray, typename RayInfo>
+    WideNodeTester(
+        const Ray&                  ray,
+        const RayInfo&              ray_info);
+
+    // Intersect the ray with the bounding boxes of all children of a node.
+    // Return a bitmask of the children that were hit, and store their entry
+    // distances into 'tmin'.
+    size_t intersect(
+        const WideNode<Width>&      node,
+        const float                 ray_tmax,
+        float                       tmin[Width]) const;
+    size_t intersect(
+        const QuantizedWideNode<Width>& node,
+        const float                 ray_tmax,
+        float                       tmin[Width]) const;
+
+  private:
+    float                           m_org[3];
+    float                           m_org_error[3];
+    float                           m_rcp_dir[3];
+    float                           m_ray_tmin;
+    size_t                          m_near[3];
+    size_t                          m_far[3];
+};
+
+// Bound on the relative error of the distances (b - org) * rcp_dir computed in single
+// precision: 2 * gamma(3) as defined in Physically Based Rendering, 3rd edition, 3.9.
+const float WideNodeRelativeError =
+    2.0f * (3.0f * 0.5f * std::numeric_limits<float>::epsilon()) /
+    (1.0f - 3.0f * 0.5f * std::numeric_limits<float>::epsilon());
+
+// Factors applied to entry and exit distances to make ray/box tests conservative.
+const float WideNodeRobustNearFactor = 1.0f - WideNodeRelativeError;
+const float WideNodeRobustFactor = 1.0f + WideNodeRelativeError;
+
+// Return the largest error, as a distance along the ray, caused by rounding the
+// origin of a ray to single precision along a given axis. The error is infinite
+// if the ray is parallel to the axis, in which case the axis is ignored.
+template <typename Ray, typename RayInfo>
+inline float compute_wide_node_origin_error(
+    const Ray&                      ray,
+    const RayInfo&                  ray_info,
+    const size_t                    d)
+{
+    const double org_error =
+        std::abs(static_cast<double>(ray.m_org[d]) - static_cast<double>(static_cast<float>(ray.m_org[d])));
+
+    return
+        org_error > 0.0
+            ? static_cast<float>(org_error * std::abs(ray_info.m_rcp_dir[d])) * WideNodeRobustFactor
+            : 0.0f;
+}
+
+
+//
+// Wide BVH intersector.
+//
+// The Visitor class must conform to the prototype described in bvh_intersector.h;
+// it is invoked on the leaf nodes of the wide tree.
+//
+
+template <
+    typename Tree,
+    typename Visitor,
+    typename Ray,
+    size_t StackSize = 256
+>
+class WideIntersector
+  : public NonCopyable
+{
+  public:
+    typedef typename Tree::WideNodeType WideNodeType;
+    typedef typename Tree::LeafNodeType LeafNodeType;
+    typedef Ray RayType;
+    typedef typename RayType::ValueType ValueType;
+    typedef RayInfo<ValueType, 3> RayInfoType;
+
+    // Intersect a ray with a given wide BVH.
+    void intersect(
+        const Tree&             tree,
+        const RayType&          ray,
+        const RayInfoType&      ray_info,
+        Visitor&                visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+        , TraversalStatistics&  stats
+#endif
+        ) const;
+
+  private:
+    static const size_t Width = WideNodeType::Width;
+
+    struct StackEntry
+    {
+        std::uint32_t   m_child;
+        float           m_tmin;
+    };
+};
+
+
+//
+// WideNodeTester class implementation.
+//
+
+template <size_t Width>
+template <typename Ray, typename RayInfo>
+inline WideNodeTester<Width>::WideNodeTester(
+    const Ray&                      ray,
+    const RayInfo&                  ray_info)
+  : m_ray_tmin(static_cast<float>(ray.m_tmin))
+{
+    for (size_t d = 0; d < 3; ++d)
+    {
+        m_org[d] = static_cast<float>(ray.m_org[d]);
+        m_org_error[d] = compute_wide_node_origin_error(ray, ray_info, d);
+        m_rcp_dir[d] = static_cast<float>(ray_info.m_rcp_dir[d]);
+        m_near[d] = d * 2 * Width + Width * (1 - ray_info.m_sgn_dir[d]);
+        m_far[d] = d * 2 * Width + Width * ray_info.m_sgn_dir[d];
+    }
+}
+
+template <size_t Width>
+inline size_t WideNodeTester<Width>::intersect(
+    const WideNode<Width>&          node,
+    const float                     ray_tmax,
+    float                           tmin[Width]) const
+{
+    const float* bbox_data = node.m_bbox_data;
+    size_t hits = 0;
+
+    for (size_t i = 0; i < Width; ++i)
+    {
+        float t0 = m_ray_tmin;
+        float t1 = ray_tmax;
+
+        for (size_t d = 0; d < 3; ++d)
+        {
+            // NaNs (0 * inf) are ignored by the comparisons below.
+            const float near_t = (bbox_data[m_near[d] + i] - m_org[d]) * m_rcp_dir[d] - m_org_error[d];
+            const float far_t = ((bbox_data[m_far[d] + i] - m_org[d]) * m_rcp_dir[d] + m_org_error[d]) * WideNodeRobustFactor;
+
+            if (near_t > t0)
+                t0 = near_t;
+
+            if (far_t < t1)
+                t1 = far_t;
+        }
+
+        t0 *= WideNodeRobustNearFactor;
+        tmin[i] = t0;
+
+        if (t0 <= t1)
+            hits |= size_t(1) << i;
+    }
+
+    return hits;
+}
+
+template <size_t Width>
+inline size_t WideNodeTester<Width>::intersect(
+    const QuantizedWideNode<Width>& node,
+    const float                     ray_tmax,
+    float                           tmin[Width]) const
+{
+    typedef QuantizedWideNode<Width> NodeType;
+
+    const std::uint8_t* bbox_data = node.m_bbox_data;
+    size_t hits = 0;
+
+    for (size_t i = 0; i < Width; ++i)
+    {
+        float t0 = m_ray_tmin;
+        float t1 = ray_tmax;
+
+        for (size_t d = 0; d < 3; ++d)
+        {
+            const float near_value = NodeType::dequantize(node.m_origin[d], node.m_scale[d], bbox_data[m_near[d] + i]);
+            const float far_value = NodeType::dequantize(node.m_origin[d], node.m_scale[d], bbox_data[m_far[d] + i]);
+
+            // NaNs (0 * inf) are ignored by the comparisons below.
+            const float near_t = (near_value - m_org[d]) * m_rcp_dir[d] - m_org_error[d];
+            const float far_t = ((far_value - m_org[d]) * m_rcp_dir[d] + m_org_error[d]) * WideNodeRobustFactor;
+
+            if (near_t > t0)
+                t0 = near_t;
+
+            if (far_t < t1)
+                t1 = far_t;
+        }
+
+        t0 *= WideNodeRobustNearFactor;
+        tmin[i] = t0;
+
+        if (t0 <= t1 && node.m_children[i] != NodeType::EmptyChild)
+            hits |= size_t(1) << i;
+    }
+
+    return hits;
+}
+
+#ifdef APPLESEED_USE_SSE
+
+template <>
+class WideNodeTester<4>
+{
+  public:
+    template <typename Ray, typename RayInfo>
+    WideNodeTester(
+        const Ray&                  ray,
+        const RayInfo&              ray_info)
+      : m_org_x(_mm_set1_ps(static_cast<float>(ray.m_org[0])))
+      , m_org_y(_mm_set1_ps(static_cast<float>(ray.m_org[1])))
+      , m_org_z(_mm_set1_ps(static_cast<float>(ray.m_org[2])))
+      , m_org_error_x(_mm_set1_ps(compute_wide_node_origin_error(ray, ray_info, 0)))
+      , m_org_error_y(_mm_set1_ps(compute_wide_node_origin_error(ray, ray_info, 1)))
+      , m_org_error_z(_mm_set1_ps(compute_wide_node_origin_error(ray, ray_info, 2)))
+      , m_rcp_dir_x(_mm_set1_ps(static_cast<float>(ray_info.m_rcp_dir[0])))
+      , m_rcp_dir_y(_mm_set1_ps(static_cast<float>(ray_info.m_rcp_dir[1])))
+      , m_rcp_dir_z(_mm_set1_ps(static_cast<float>(ray_info.m_rcp_dir[2])))
+      , m_ray_tmin(_mm_set1_ps(static_cast<float>(ray.m_tmin)))
+      , m_near_factor(_mm_set1_ps(WideNodeRobustNearFactor))
+      , m_robust_factor(_mm_set1_ps(WideNodeRobustFactor))
+    {
+        for (size_t d = 0; d < 3; ++d)
+        {
+            m_near[d] = d * 8 + 4 * (1 - ray_info.m_sgn_dir[d]);
+            m_far[d] = d * 8 + 4 * ray_info.m_sgn_dir[d];
+        }
+    }
+
+    APPLESEED_FORCE_INLINE size_t intersect(
+        const WideNode<4>&          node,
+        const float                 ray_tmax,
+        float                       tmin[4]) const
+    {
+        const float* bbox_data = node.m_bbox_data;
+
+        const __m128 near_x = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(bbox_data + m_near[0]), m_org_x), m_rcp_dir_x), m_org_error_x);
+        const __m128 near_y = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(bbox_data + m_near[1]), m_org_y), m_rcp_dir_y), m_org_error_y);
+        const __m128 near_z = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(bbox_data + m_near[2]), m_org_z), m_rcp_dir_z), m_org_error_z);
+        const __m128 far_x = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(bbox_data + m_far[0]), m_org_x), m_rcp_dir_x), m_org_error_x);
+        const __m128 far_y = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(bbox_data + m_far[1]), m_org_y), m_rcp_dir_y), m_org_error_y);
+        const __m128 far_z = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(bbox_data + m_far[2]), m_org_z), m_rcp_dir_z), m_org_error_z);
+
+        // The operand order matters: _mm_min_ps() and _mm_max_ps() return their second operand if either one is NaN.
+        const __m128 t0 =
+            _mm_mul_ps(
+                _mm_max_ps(near_z, _mm_max_ps(near_y, _mm_max_ps(near_x, m_ray_tmin))),
+                m_near_factor);
+        const __m128 t1 =
+            _mm_min_ps(
+                _mm_mul_ps(_mm_min_ps(far_z, _mm_min_ps(far_y, far_x)), m_robust_factor),
+                _mm_set1_ps(ray_tmax));
+
+        _mm_storeu_ps(tmin, t0);
+
+        return static_cast<size_t>(_mm_movemask_ps(_mm_cmple_ps(t0, t1)));
+    }
+
+    APPLESEED_FORCE_INLINE size_t intersect(
+        const QuantizedWideNode<4>& node,
+        const float                 ray_tmax,
+        float                       tmin[4]) const
+    {
+        const std::uint8_t* bbox_data = node.m_bbox_data;
+
+        const __m128 origin_x = _mm_set1_ps(node.m_origin[0]);
+        const __m128 origin_y = _mm_set1_ps(node.m_origin[1]);
+        const __m128 origin_z = _mm_set1_ps(node.m_origin[2]);
+        const __m128 scale_x = _mm_set1_ps(node.m_scale[0]);
+        const __m128 scale_y = _mm_set1_ps(node.m_scale[1]);
+        const __m128 scale_z = _mm_set1_ps(node.m_scale[2]);
+
+        const __m128 near_x = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(_mm_add_ps(origin_x, _mm_mul_ps(load_quantized(bbox_data + m_near[0]), scale_x)), m_org_x), m_rcp_dir_x), m_org_error_x);
+        const __m128 near_y = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(_mm_add_ps(origin_y, _mm_mul_ps(load_quantized(bbox_data + m_near[1]), scale_y)), m_org_y), m_rcp_dir_y), m_org_error_y);
+        const __m128 near_z = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(_mm_add_ps(origin_z, _mm_mul_ps(load_quantized(bbox_data + m_near[2]), scale_z)), m_org_z), m_rcp_dir_z), m_org_error_z);
+        const __m128 far_x = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_add_ps(origin_x, _mm_mul_ps(load_quantized(bbox_data + m_far[0]), scale_x)), m_org_x), m_rcp_dir_x), m_org_error_x);
+        const __m128 far_y = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_add_ps(origin_y, _mm_mul_ps(load_quantized(bbox_data + m_far[1]), scale_y)), m_org_y), m_rcp_dir_y), m_org_error_y);
+        const __m128 far_z = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_add_ps(origin_z, _mm_mul_ps(load_quantized(bbox_data + m_far[2]), scale_z)), m_org_z), m_rcp_dir_z), m_org_error_z);
+
+        // The operand order matters: _mm_min_ps() and _mm_max_ps() return their second operand if either one is NaN.
+        const __m128 t0 =
+            _mm_mul_ps(
+                _mm_max_ps(near_z, _mm_max_ps(near_y, _mm_max_ps(near_x, m_ray_tmin))),
+                m_near_factor);
+        const __m128 t1 =
+            _mm_min_ps(
+                _mm_mul_ps(_mm_min_ps(far_z, _mm_min_ps(far_y, far_x)), m_robust_factor),
+                _mm_set1_ps(ray_tmax));
+
+        _mm_storeu_ps(tmin, t0);
+
+        // Skip empty children.
+        const __m128i children = _mm_loadu_si128(reinterpret_cast<const __m128i*>(node.m_children));
+        const int empty = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(children, _mm_set1_epi32(-1))));
+
+        return static_cast<size_t>(_mm_movemask_ps(_mm_cmple_ps(t0, t1)) & ~empty);
+    }
+
+  private:
+    const __m128    m_org_x;
+    const __m128    m_org_y;
+    const __m128    m_org_z;
+    const __m128    m_org_error_x;
+    const __m128    m_org_error_y;
+    const __m128    m_org_error_z;
+    const __m128    m_rcp_dir_x;
+    const __m128    m_rcp_dir_y;
+    const __m128    m_rcp_dir_z;
+    const __m128    m_ray_tmin;
+    const __m128    m_near_factor;
+    const __m128    m_robust_factor;
+    size_t          m_near[3];
+    size_t          m_far[3];
+
+    // Load four quantized coordinates and convert them to single precision.
+    APPLESEED_FORCE_INLINE static __m128 load_quantized(const std::uint8_t* values)
+    {
+        std::int32_t packed;
+        std::memcpy(&packed, values, sizeof(packed));
+
+        const __m128i v8 = _mm_cvtsi32_si128(packed);
+#ifdef APPLESEED_USE_SSE42
+        const __m128i v32 = _mm_cvtepu8_epi32(v8);
+#else
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i v16 = _mm_unpacklo_epi8(v8, zero);
+        const __m128i v32 = _mm_unpacklo_epi16(v16, zero);
+#endif
+
+        return _mm_cvtepi32_ps(v32);
+    }
+};
+
+#endif  // APPLESEED_USE_SSE
+
+#ifdef APPLESEED_USE_AVX
+
+template <>
+class WideNodeTester<8>
+{
+  public:
+    template <typename Ray, typename RayInfo>
+    WideNodeTester(
+        const Ray&                  ray,
+        const RayInfo&              ray_info)
+      : m_org_x(_mm256_set1_ps(static_cast<float>(ray.m_org[0])))
+      , m_org_y(_mm256_set1_ps(static_cast<float>(ray.m_org[1])))
+      , m_org_z(_mm256_set1_ps(static_cast<float>(ray.m_org[2])))
+      , m_org_error_x(_mm256_set1_ps(compute_wide_node_origin_error(ray, ray_info, 0)))
+      , m_org_error_y(_mm256_set1_ps(compute_wide_node_origin_error(ray, ray_info, 1)))
+      , m_org_error_z(_mm256_set1_ps(compute_wide_node_origin_error(ray, ray_info, 2)))
+      , m_rcp_dir_x(_mm256_set1_ps(static_cast<float>(ray_info.m_rcp_dir[0])))
+      , m_rcp_dir_y(_mm256_set1_ps(static_cast<float>(ray_info.m_rcp_dir[1])))
+      , m_rcp_dir_z(_mm256_set1_ps(static_cast<float>(ray_info.m_rcp_dir[2])))
+      , m_ray_tmin(_mm256_set1_ps(static_cast<float>(ray.m_tmin)))
+      , m_near_factor(_mm256_set1_ps(WideNodeRobustNearFactor))
+      , m_robust_factor(_mm256_set1_ps(WideNodeRobustFactor))
+    {
+        for (size_t d = 0; d < 3; ++d)
+        {
+            m_near[d] = d * 16 + 8 * (1 - ray_info.m_sgn_dir[d]);
+            m_far[d] = d * 16 + 8 * ray_info.m_sgn_dir[d];
+        }
+    }
+
+    APPLESEED_FORCE_INLINE size_t intersect(
+        const WideNode<8>&          node,
+        const float                 ray_tmax,
+        float                       tmin[8]) const
+    {
+        const float* bbox_data = node.m_bbox_data;
+
+        const __m256 near_x = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bbox_data + m_near[0]), m_org_x), m_rcp_dir_x), m_org_error_x);
+        const __m256 near_y = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bbox_data + m_near[1]), m_org_y), m_rcp_dir_y), m_org_error_y);
+        const __m256 near_z = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bbox_data + m_near[2]), m_org_z), m_rcp_dir_z), m_org_error_z);
+        const __m256 far_x = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bbox_data + m_far[0]), m_org_x), m_rcp_dir_x), m_org_error_x);
+        const __m256 far_y = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bbox_data + m_far[1]), m_org_y), m_rcp_dir_y), m_org_error_y);
+        const __m256 far_z = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bbox_data + m_far[2]), m_org_z), m_rcp_dir_z), m_org_error_z);
+
+        // The operand order matters: _mm256_min_ps() and _mm256_max_ps() return their second operand if either one is NaN.
+        const __m256 t0 =
+            _mm256_mul_ps(
+                _mm256_max_ps(near_z, _mm256_max_ps(near_y, _mm256_max_ps(near_x, m_ray_tmin))),
+                m_near_factor);
+        const __m256 t1 =
+            _mm256_min_ps(
+                _mm256_mul_ps(_mm256_min_ps(far_z, _mm256_min_ps(far_y, far_x)), m_robust_factor),
+                _mm256_set1_ps(ray_tmax));
+
+        _mm256_storeu_ps(tmin, t0);
+
+        return static_cast<size_t>(_mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ)));
+    }
+
+    APPLESEED_FORCE_INLINE size_t intersect(
+        const QuantizedWideNode<8>& node,
+        const float                 ray_tmax,
+        float                       tmin[8]) const
+    {
+        const std::uint8_t* bbox_data = node.m_bbox_data;
+
+        const __m256 origin_x = _mm256_set1_ps(node.m_origin[0]);
+        const __m256 origin_y = _mm256_set1_ps(node.m_origin[1]);
+        const __m256 origin_z = _mm256_set1_ps(node.m_origin[2]);
+        const __m256 scale_x = _mm256_set1_ps(node.m_scale[0]);
+        const __m256 scale_y = _mm256_set1_ps(node.m_scale[1]);
+        const __m256 scale_z = _mm256_set1_ps(node.m_scale[2]);
+
+        const __m256 near_x = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(origin_x, _mm256_mul_ps(load_quantized(bbox_data + m_near[0]), scale_x)), m_org_x), m_rcp_dir_x), m_org_error_x);
+        const __m256 near_y = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(origin_y, _mm256_mul_ps(load_quantized(bbox_data + m_near[1]), scale_y)), m_org_y), m_rcp_dir_y), m_org_error_y);
+        const __m256 near_z = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(origin_z, _mm256_mul_ps(load_quantized(bbox_data + m_near[2]), scale_z)), m_org_z), m_rcp_dir_z), m_org_error_z);
+        const __m256 far_x = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(origin_x, _mm256_mul_ps(load_quantized(bbox_data + m_far[0]), scale_x)), m_org_x), m_rcp_dir_x), m_org_error_x);
+        const __m256 far_y = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(origin_y, _mm256_mul_ps(load_quantized(bbox_data + m_far[1]), scale_y)), m_org_y), m_rcp_dir_y), m_org_error_y);
+        const __m256 far_z = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(origin_z, _mm256_mul_ps(load_quantized(bbox_data + m_far[2]), scale_z)), m_org_z), m_rcp_dir_z), m_org_error_z);
+
+        // The operand order matters: _mm256_min_ps() and _mm256_max_ps() return their second operand if either one is NaN.
+        const __m256 t0 =
+            _mm256_mul_ps(
+                _mm256_max_ps(near_z, _mm256_max_ps(near_y, _mm256_max_ps(near_x, m_ray_tmin))),
+                m_near_factor);
+        const __m256 t1 =
+            _mm256_min_ps(
+                _mm256_mul_ps(_mm256_min_ps(far_z, _mm256_min_ps(far_y, far_x)), m_robust_factor),
+                _mm256_set1_ps(ray_tmax));
+
+        _mm256_storeu_ps(tmin, t0);
+
+        // Skip empty children.
+        const __m128i all_ones = _mm_set1_epi32(-1);
+        const __m128i children_lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(node.m_children));
+        const __m128i children_hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(node.m_children + 4));
+        const int empty =
+              _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(children_lo, all_ones)))
+            | (_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(children_hi, all_ones))) << 4);
+
+        return static_cast<size_t>(_mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ)) & ~empty);
+    }
+
+  private:
+    const __m256    m_org_x;
+    const __m256    m_org_y;
+    const __m256    m_org_z;
+    const __m256    m_org_error_x;
+    const __m256    m_org_error_y;
+    const __m256    m_org_error_z;
+    const __m256    m_rcp_dir_x;
+    const __m256    m_rcp_dir_y;
+    const __m256    m_rcp_dir_z;
+    const __m256    m_ray_tmin;
+    const __m256    m_near_factor;
+    const __m256    m_robust_factor;
+    size_t          m_near[3];
+    size_t          m_far[3];
+
+    // Load eight quantized coordinates and convert them to single precision.
+    APPLESEED_FORCE_INLINE static __m256 load_quantized(const std::uint8_t* values)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i v8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(values));
+        const __m128i v16 = _mm_unpacklo_epi8(v8, zero);
+        const __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(v16, zero));
+        const __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(v16, zero));
+
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+    }
+};
+
+#endif  // APPLESEED_USE_AVX
+
+
+//
+// WideIntersector class implementation.
+//
+
+template <
+    typename Tree,
+    typename Visitor,
+    typename Ray,
+    size_t StackSize
+>
+void WideIntersector<Tree, Visitor, Ray, StackSize>::intersect(
+    const Tree&                 tree,
+    const RayType&              ray,
+    const RayInfoType&          ray_info,
+    Visitor&                    visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+    , TraversalStatistics&      stats
+#endif
+    ) const
+{
+    // Make sure the tree was built.
+    assert(!tree.m_wide_nodes.empty());
+
+    // Convert the ray to single precision once for the entire traversal.
+    const WideNodeTester<Width> tester(ray, ray_info);
+
+    // Node stack.
+    StackEntry stack[StackSize];
+    StackEntry* stack_ptr = stack;
+
+    // Current node (the root node is always an interior node).
+    std::uint32_t current = 0;
+
+    // Initialize traversal statistics.
+    FOUNDATION_BVH_TRAVERSAL_STATS(++stats.m_traversal_count);
+    FOUNDATION_BVH_TRAVERSAL_STATS(size_t visited_nodes = 0);
+    FOUNDATION_BVH_TRAVERSAL_STATS(size_t visited_leaves = 0);
+    FOUNDATION_BVH_TRAVERSAL_STATS(size_t intersected_bboxes = 0);
+    FOUNDATION_BVH_TRAVERSAL_STATS(size_t discarded_nodes = 0);
+
+    // Traverse the tree and intersect leaf nodes.
+    ValueType ray_tmax = ray.m_tmax;
+    float ray_tmax_float = static_cast<float>(ray_tmax) * WideNodeRobustFactor;
+    while (true)
+    {
+        // Fetch the node.
+        FOUNDATION_BVH_TRAVERSAL_STATS(++visited_nodes);
+
+        if ((current & WideNodeType::LeafFlag) == 0)
+        {
+            const WideNodeType& node = tree.m_wide_nodes[current];
+
+            FOUNDATION_BVH_TRAVERSAL_STATS(intersected_bboxes += Width);
+
+            // Intersect the bounding boxes of all children at once.
+            float tmin[Width];
+            const size_t hits = tester.intersect(node, ray_tmax_float, tmin);
+
+            if (hits != 0)
+            {
+                // Collect the children that were hit.
+                std::uint32_t hit_children[Width];
+                float hit_tmin[Width];
+                size_t hit_count = 0;
+                for (size_t i = 0; i < Width; ++i)
+                {
+                    if (hits & (size_t(1) << i))
+                    {
+                        hit_children[hit_count] = node.m_children[i];
+                        hit_tmin[hit_count] = tmin[i];
+                        ++hit_count;
+                    }
+                }
+
+                FOUNDATION_BVH_TRAVERSAL_STATS(discarded_nodes += node.get_child_count() - hit_count);
+
+                if (hit_count > 1)
+                {
+                    // Sort the children by decreasing entry distance.
+                    for (size_t i = 1; i < hit_count; ++i)
+                    {
+                        const std::uint32_t child = hit_children[i];
+                        const float t = hit_tmin[i];
+                        size_t j = i;
+                        for (; j > 0 && hit_tmin[j - 1] < t; --j)
+                        {
+                            hit_children[j] = hit_children[j - 1];
+                            hit_tmin[j] = hit_tmin[j - 1];
+                        }
+                        hit_children[j] = child;
+                        hit_tmin[j] = t;
+                    }
+
+                    // Push the far child nodes to the stack. Should the stack ever be too small,
+                    // drop the farthest ones rather than writing past its end.
+                    assert(stack_ptr + hit_count - 1 <= stack + StackSize);
+                    const size_t stack_room = static_cast<size_t>(stack + StackSize - stack_ptr);
+                    const size_t push_count = std::min(hit_count - 1, stack_room);
+                    for (size_t i = hit_count - 1 - push_count; i < hit_count - 1; ++i)
+                    {
+                        stack_ptr->m_child = hit_children[i];
+                        stack_ptr->m_tmin = hit_tmin[i];
+                        ++stack_ptr;
+                    }
+                }
+
+                // Continue with the nearest child node.
+                current = hit_children[hit_count - 1];
+                continue;
+            }
+
+            FOUNDATION_BVH_TRAVERSAL_STATS(discarded_nodes += node.get_child_count());
+        }
+        else
+        {
+            // Visit the leaf.
+            FOUNDATION_BVH_TRAVERSAL_STATS(++visited_leaves);
+            ValueType distance;
+#ifndef NDEBUG
+            distance = ValueType(-1.0);
+#endif
+            const bool proceed =
+                visitor.visit(
+                    tree.m_leaf_nodes[current & ~WideNodeType::LeafFlag],
+                    ray,
+                    ray_info,
+                    distance
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                    , stats
+#endif
+                    );
+            assert(!proceed || distance >= ValueType(0.0));
+
+            // Terminate traversal if the visitor decided so.
+            if (!proceed)
+                break;
+
+            // Keep track of the distance to the closest intersection.
+            if (ray_tmax > distance)
+            {
+                ray_tmax = distance;
+                ray_tmax_float = static_cast<float>(ray_tmax) * WideNodeRobustFactor;
+            }
+        }
+
+        // Discard the nodes of the stack that lie beyond the closest intersection.
+        while (stack_ptr > stack && (stack_ptr - 1)->m_tmin > ray_tmax_float)
+        {
+            FOUNDATION_BVH_TRAVERSAL_STATS(++discarded_nodes);
+            --stack_ptr;
+        }
+
+        // Terminate traversal if the node stack is empty.
+        if (stack_ptr == stack)
+            break;
+
+        // Pop the top node from the stack.
+        current = (--stack_ptr)->m_child;
+    }
+
+    // Store traversal statistics.
+    FOUNDATION_BVH_TRAVERSAL_STATS(stats.m_visited_nodes.insert(visited_nodes));
+    FOUNDATION_BVH_TRAVERSAL_STATS(stats.m_visited_leaves.insert(visited_leaves));
+    FOUNDATION_BVH_TRAVERSAL_STATS(stats.m_intersected_bboxes.insert(intersected_bboxes));
+    FOUNDATION_BVH_TRAVERSAL_STATS(stats.m_discarded_nodes.insert(discarded_nodes));
+}
+
+}   // namespace bvh
+}   // namespace foundation
@@ -0,0 +1,231 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2019 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+// appleseed.foundation headers.
+#include "foundation/math/aabb.h"
+#include "foundation/platform/compiler.h"
+
+// Standard headers.
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace foundation {
+namespace bvh {
+
+//
+// Interior node of a wide (N-ary) BVH.
+//
+// A wide node stores the bounding boxes of its Width children in single precision,
+// in structure-of-arrays form so that all children can be tested at once with SIMD
+// instructions. Bounding boxes are rounded outward when converted to single precision
+// so that the stored boxes always enclose the original ones.
+//
+// Each child is either an interior node (an index into the array of wide nodes),
+// a leaf (an index into the array of leaf nodes) or empty.
+//
+
+template <size_t N>
+class APPLESEED_ALIGN(64) WideNode
+{
+  public:
+    // Number of children.
+    static const size_t Width = N;
+
+    // Mark all children as empty.
+    void clear();
+
+    // Set/get the bounding box of a given child.
+    void set_child_bbox(const size_t child, const AABB3d& bbox);
+    AABB3f get_child_bbox(const size_t child) const;
+
+    // Set the bounding boxes of all non-empty children, indexed by child.
+    void set_child_bboxes(const AABB3d bboxes[]);
+
+    // Make a given child an interior node, a leaf node or an empty slot.
+    void set_interior_child(const size_t child, const size_t node_index);
+    void set_leaf_child(const size_t child, const size_t leaf_index);
+    void set_empty_child(const size_t child);
+
+    // Query a given child.
+    bool is_empty_child(const size_t child) const;
+    bool is_leaf_child(const size_t child) const;
+    size_t get_child_index(const size_t child) const;
+
+    // Return the number of non-empty children.
+    size_t get_child_count() const;
+
+  private:
+    template <typename Tree, typename Visitor, typename Ray, size_t StackSize>
+    friend class WideIntersector;
+
+    template <size_t Width>
+    friend class WideNodeTester;
+
+    static const std::uint32_t EmptyChild = ~std::uint32_t(0);
+    static const std::uint32_t LeafFlag = std::uint32_t(1) << 31;
+
+    // Bounding boxes of the children: for each dimension, Width minimum
+    // coordinates followed by Width maximum coordinates.
+    APPLESEED_SIMD4_ALIGN float     m_bbox_data[6 * N];
+
+    std::uint32_t                   m_children[N];
+};
+
+
+//
+// WideNode class implementation.
+//
+
+template <size_t N>
+inline void WideNode<N>::clear()
+{
+    for (size_t i = 0; i < N; ++i)
+        set_empty_child(i);
+}
+
+template <size_t N>
+inline void WideNode<N>::set_child_bbox(const size_t child, const AABB3d& bbox)
+{
+    assert(child < N);
+
+    for (size_t d = 0; d < 3; ++d)
+    {
+        float min_value = static_cast<float>(bbox.min[d]);
+        float max_value = static_cast<float>(bbox.max[d]);
+
+        // Round outward so that the single precision box encloses the double precision one.
+        if (static_cast<double>(min_value) > bbox.min[d])
+            min_value = std::nextafter(min_value, -std::numeric_limits<float>::infinity());
+        if (static_cast<double>(max_value) < bbox.max[d])
+            max_value = std::nextafter(max_value, +std::numeric_limits<float>::infinity());
+
+        m_bbox_data[d * 2 * N + child] = min_value;
+        m_bbox_data[d * 2 * N + N + child] = max_value;
+    }
+}
+
+template <size_t N>
+inline AABB3f WideNode<N>::get_child_bbox(const size_t child) const
+{
+    assert(child < N);
+
+    AABB3f bbox;
+
+    for (size_t d = 0; d < 3; ++d)
+    {
+        bbox.min[d] = m_bbox_data[d * 2 * N + child];
+        bbox.max[d] = m_bbox_data[d * 2 * N + N + child];
+    }
+
+    return bbox;
+}
+
+template <size_t N>
+inline void WideNode<N>::set_child_bboxes(const AABB3d bboxes[])
+{
+    for (size_t i = 0; i < N; ++i)
+    {
+        if (!is_empty_child(i))
+            set_child_bbox(i, bboxes[i]);
+    }
+}
+
+template <size_t N>
+inline void WideNode<N>::set_interior_child(const size_t child, const size_t node_index)
+{
+    assert(child < N);
+    assert(node_index < LeafFlag);
+    m_children[child] = static_cast<std::uint32_t>(node_index);
+}
+
+template <size_t N>
+inline void WideNode<N>::set_leaf_child(const size_t child, const size_t leaf_index)
+{
+    assert(child < N);
+    assert(leaf_index < LeafFlag - 1);
+    m_children[child] = static_cast<std::uint32_t>(leaf_index) | LeafFlag;
+}
+
+template <size_t N>
+inline void WideNode<N>::set_empty_child(const size_t child)
+{
+    assert(child < N);
+
+    m_children[child] = EmptyChild;
+
+    // An inverted box is never hit, regardless of the ray direction.
+    for (size_t d = 0; d < 3; ++d)
+    {
+        m_bbox_data[d * 2 * N + child] = std::numeric_limits<float>::infinity();
+        m_bbox_data[d * 2 * N + N + child] = -std::numeric_limits<float>::infinity();
+    }
+}
+
+template <size_t N>
+inline bool WideNode<N>::is_empty_child(const size_t child) const
+{
+    assert(child < N);
+    return m_children[child] == EmptyChild;
+}
+
+template <size_t N>
+inline bool WideNode<N>::is_leaf_child(const size_t child) const
+{
+    assert(child < N);
+    return m_children[child] != EmptyChild && (m_children[child] & LeafFlag) != 0;
+}
+
+template <size_t N>
+inline size_t WideNode<N>::get_child_index(const size_t child) const
+{
+    assert(child < N);
+    assert(!is_empty_child(child));
+    return static_cast<size_t>(m_children[child] & ~LeafFlag);
+}
+
+template <size_t N>
+inline size_t WideNode<N>::get_child_count() const
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < N; ++i)
+    {
+        if (m_children[i] != EmptyChild)
+            ++count;
+    }
+
+    return count;
+}
+
+}   // namespace bvh
+}   // namespace foundation
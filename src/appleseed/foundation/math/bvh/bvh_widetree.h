@@ -0,0 +1,144 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2019 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+// Standard headers.
+#include <cstddef>
+
+namespace foundation {
+namespace bvh {
+
+//
+// Wide (N-ary) Bounding Volume Hierarchy.
+//
+// A wide tree is obtained by collapsing a binary tree (see bvh::Collapser).
+// Interior nodes are wide nodes (see bvh::WideNode) while leaves are the leaf
+// nodes of the original binary tree, stored contiguously in their own array.
+//
+
+template <typename WideNodeVector, typename LeafNodeVector>
+class WideTree
+{
+  public:
+    typedef WideNodeVector WideNodeVectorType;
+    typedef LeafNodeVector LeafNodeVectorType;
+    typedef WideTree<WideNodeVectorType, LeafNodeVectorType> WideTreeType;
+    typedef typename WideNodeVectorType::value_type WideNodeType;
+    typedef typename LeafNodeVectorType::value_type LeafNodeType;
+    typedef typename WideNodeVectorType::allocator_type WideNodeAllocatorType;
+    typedef typename LeafNodeVectorType::allocator_type LeafNodeAllocatorType;
+
+    // Constructor.
+    explicit WideTree(
+        const WideNodeAllocatorType&    wide_node_allocator = WideNodeAllocatorType(),
+        const LeafNodeAllocatorType&    leaf_node_allocator = LeafNodeAllocatorType());
+
+    // Clear the tree.
+    void clear();
+
+    // Return true if the tree is empty.
+    bool empty() const;
+
+    // Return the number of wide nodes and of leaf nodes.
+    size_t get_wide_node_count() const;
+    size_t get_leaf_node_count() const;
+
+    // Return the size (in bytes) of this object in memory.
+    size_t get_memory_size() const;
+
+  protected:
+    template <typename Tree, typename WideTree>
+    friend class Collapser;
+
+    template <typename WideTree>
+    friend class WideTreeStatistics;
+
+    template <typename WideTree, typename LeafRefitter>
+    friend class WideRefitter;
+
+    template <typename WideTree>
+    friend class WideTreeSerializer;
+
+    template <typename Tree, typename Visitor, typename Ray, size_t StackSize>
+    friend class WideIntersector;
+
+    WideNodeVector  m_wide_nodes;
+    LeafNodeVector  m_leaf_nodes;
+};
+
+
+//
+// WideTree class implementation.
+//
+
+template <typename WideNodeVector, typename LeafNodeVector>
+WideTree<WideNodeVector, LeafNodeVector>::WideTree(
+    const WideNodeAllocatorType&        wide_node_allocator,
+    const LeafNodeAllocatorType&        leaf_node_allocator)
+  : m_wide_nodes(wide_node_allocator)
+  , m_leaf_nodes(leaf_node_allocator)
+{
+}
+
+template <typename WideNodeVector, typename LeafNodeVector>
+void WideTree<WideNodeVector, LeafNodeVector>::clear()
+{
+    m_wide_nodes.clear();
+    m_leaf_nodes.clear();
+}
+
+template <typename WideNodeVector, typename LeafNodeVector>
+inline bool WideTree<WideNodeVector, LeafNodeVector>::empty() const
+{
+    return m_wide_nodes.empty();
+}
+
+template <typename WideNodeVector, typename LeafNodeVector>
+inline size_t WideTree<WideNodeVector, LeafNodeVector>::get_wide_node_count() const
+{
+    return m_wide_nodes.size();
+}
+
+template <typename WideNodeVector, typename LeafNodeVector>
+inline size_t WideTree<WideNodeVector, LeafNodeVector>::get_leaf_node_count() const
+{
+    return m_leaf_nodes.size();
+}
+
+template <typename WideNodeVector, typename LeafNodeVector>
+size_t WideTree<WideNodeVector, LeafNodeVector>::get_memory_size() const
+{
+    return
+          sizeof(*this)
+        + m_wide_nodes.capacity() * sizeof(WideNodeType)
+        + m_leaf_nodes.capacity() * sizeof(LeafNodeType);
+}
+
+}   // namespace bvh
+}   // namespace foundation
@@ -0,0 +1,283 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2019 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+// appleseed.foundation headers.
+#include "foundation/math/minmax.h"
+#include "foundation/math/ray.h"
+#include "foundation/math/vector.h"
+#include "foundation/platform/compiler.h"
+
+// Standard headers.
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace foundation
+{
+
+//
+// Watertight ray-triangle intersection test.
+//
+// Contrary to the Moeller-Trumbore and Shevtsov-Soupikov-Kapustin tests, rays can
+// never slip between two triangles sharing an edge, even in single precision, as
+// long as the shared vertices are bit-identical. The vertices are thus stored as
+// is, without precomputing edges. Hits whose distance lies within the rounding
+// error bound of the ray origin are conservatively rejected.
+//
+// When the ray was converted from a higher precision ray, the rounding error of
+// its origin must be passed to intersect(): otherwise a ray leaving a surface
+// through an origin offset by a few double precision ULPs may hit that surface
+// again, since the offset is lost in the conversion.
+//
+// References:
+//
+//   http://jcgt.org/published/0002/01/05/paper.pdf
+//   http://www.pbr-book.org/3ed-2018/Shapes/Triangle_Meshes.html
+//
+
+template <typename T>
+struct TriangleWT
+{
+    // Types.
+    typedef T ValueType;
+    typedef Vector<T, 3> VectorType;
+    typedef Ray<T, 3> RayType;
+
+    // Vertices.
+    VectorType  m_v0;
+    VectorType  m_v1;
+    VectorType  m_v2;
+
+    // Constructors.
+    TriangleWT();
+    TriangleWT(
+        const VectorType&   v0,
+        const VectorType&   v1,
+        const VectorType&   v2);
+
+    // Construct a triangle from another triangle of a different type.
+    template <typename U>
+    TriangleWT(const TriangleWT<U>& rhs);
+
+    // The barycentric coordinates u and v are the weights of m_v1 and m_v2.
+    bool intersect(
+        const RayType&      ray,
+        ValueType&          t,
+        ValueType&          u,
+        ValueType&          v) const;
+
+    bool intersect(const RayType& ray) const;
+
+    // Same as above, for a ray whose origin is known up to an absolute error of org_error
+    // on each axis. Hits within that error of the origin are rejected as well.
+    bool intersect(
+        const RayType&      ray,
+        const VectorType&   org_error,
+        ValueType&          t,
+        ValueType&          u,
+        ValueType&          v) const;
+
+    bool intersect(
+        const RayType&      ray,
+        const VectorType&   org_error) const;
+
+    // Return a bound on the absolute error made when rounding a point to ValueType.
+    template <typename U>
+    static VectorType compute_rounding_error(const Vector<U, 3>& p);
+
+  private:
+    // Bound on the relative rounding error of n consecutive floating-point operations.
+    static ValueType gamma(const int n);
+};
+
+
+//
+// TriangleWT class implementation.
+//
+
+template <typename T>
+inline TriangleWT<T>::TriangleWT()
+{
+}
+
+template <typename T>
+inline TriangleWT<T>::TriangleWT(
+    const VectorType&       v0,
+    const VectorType&       v1,
+    const VectorType&       v2)
+  : m_v0(v0)
+  , m_v1(v1)
+  , m_v2(v2)
+{
+}
+
+template <typename T>
+template <typename U>
+APPLESEED_FORCE_INLINE TriangleWT<T>::TriangleWT(const TriangleWT<U>& rhs)
+  : m_v0(VectorType(rhs.m_v0))
+  , m_v1(VectorType(rhs.m_v1))
+  , m_v2(VectorType(rhs.m_v2))
+{
+}
+
+template <typename T>
+inline T TriangleWT<T>::gamma(const int n)
+{
+    const ValueType machine_eps = std::numeric_limits<ValueType>::epsilon() * ValueType(0.5);
+    return (n * machine_eps) / (ValueType(1.0) - n * machine_eps);
+}
+
+template <typename T>
+template <typename U>
+inline Vector<T, 3> TriangleWT<T>::compute_rounding_error(const Vector<U, 3>& p)
+{
+    // The difference is exact in U; rounding it to T may lose up to one ULP.
+    const ValueType scale = ValueType(1.0) + std::numeric_limits<ValueType>::epsilon();
+
+    VectorType error;
+
+    for (size_t i = 0; i < 3; ++i)
+        error[i] = static_cast<ValueType>(std::abs(p[i] - static_cast<U>(static_cast<ValueType>(p[i])))) * scale;
+
+    return error;
+}
+
+template <typename T>
+APPLESEED_FORCE_INLINE bool TriangleWT<T>::intersect(
+    const RayType&          ray,
+    ValueType&              t,
+    ValueType&              u,
+    ValueType&              v) const
+{
+    return intersect(ray, VectorType(ValueType(0.0)), t, u, v);
+}
+
+template <typename T>
+APPLESEED_FORCE_INLINE bool TriangleWT<T>::intersect(
+    const RayType&          ray,
+    const VectorType&       org_error,
+    ValueType&              t,
+    ValueType&              u,
+    ValueType&              v) const
+{
+    // Make the ray direction's largest component the z axis.
+    const size_t kz = max_abs_index(ray.m_dir);
+    const size_t kx = kz == 2 ? 0 : kz + 1;
+    const size_t ky = kx == 2 ? 0 : kx + 1;
+
+    // Translate the vertices so that the ray origin is at the origin, and permute their components.
+    const ValueType ox = ray.m_org[kx], oy = ray.m_org[ky], oz = ray.m_org[kz];
+    ValueType p0x = m_v0[kx] - ox, p0y = m_v0[ky] - oy, p0z = m_v0[kz] - oz;
+    ValueType p1x = m_v1[kx] - ox, p1y = m_v1[ky] - oy, p1z = m_v1[kz] - oz;
+    ValueType p2x = m_v2[kx] - ox, p2y = m_v2[ky] - oy, p2z = m_v2[kz] - oz;
+
+    // Shear the vertices so that the ray direction becomes the z axis.
+    const ValueType rcp_dz = ValueType(1.0) / ray.m_dir[kz];
+    const ValueType sx = -ray.m_dir[kx] * rcp_dz;
+    const ValueType sy = -ray.m_dir[ky] * rcp_dz;
+    p0x += sx * p0z;
+    p0y += sy * p0z;
+    p1x += sx * p1z;
+    p1y += sy * p1z;
+    p2x += sx * p2z;
+    p2y += sy * p2z;
+
+    // Compute the edge functions.
+    ValueType e0 = p1x * p2y - p1y * p2x;
+    ValueType e1 = p2x * p0y - p2y * p0x;
+    ValueType e2 = p0x * p1y - p0y * p1x;
+
+    // Recompute the edge functions in double precision when the ray seems to hit an edge exactly.
+    if (sizeof(ValueType) < sizeof(double) &&
+        (e0 == ValueType(0.0) || e1 == ValueType(0.0) || e2 == ValueType(0.0)))
+    {
+        e0 = static_cast<ValueType>(static_cast<double>(p1x) * p2y - static_cast<double>(p1y) * p2x);
+        e1 = static_cast<ValueType>(static_cast<double>(p2x) * p0y - static_cast<double>(p2y) * p0x);
+        e2 = static_cast<ValueType>(static_cast<double>(p0x) * p1y - static_cast<double>(p0y) * p1x);
+    }
+
+    // Check that the ray passes on the same side of all edges.
+    if ((e0 < ValueType(0.0) || e1 < ValueType(0.0) || e2 < ValueType(0.0)) &&
+        (e0 > ValueType(0.0) || e1 > ValueType(0.0) || e2 > ValueType(0.0)))
+        return false;
+
+    const ValueType det = e0 + e1 + e2;
+    if (det == ValueType(0.0))
+        return false;
+
+    // Calculate t parameter and test bounds.
+    p0z *= rcp_dz;
+    p1z *= rcp_dz;
+    p2z *= rcp_dz;
+    const ValueType rcp_det = ValueType(1.0) / det;
+    t = (e0 * p0z + e1 * p1z + e2 * p2z) * rcp_det;
+    if (t >= ray.m_tmax || t < ray.m_tmin)
+        return false;
+
+    // Conservatively reject hits that might lie behind the ray origin.
+    const ValueType max_zt = max(std::abs(p0z), std::abs(p1z), std::abs(p2z));
+    const ValueType max_xt = max(std::abs(p0x), std::abs(p1x), std::abs(p2x));
+    const ValueType max_yt = max(std::abs(p0y), std::abs(p1y), std::abs(p2y));
+    const ValueType max_e = max(std::abs(e0), std::abs(e1), std::abs(e2));
+    const ValueType err_z = org_error[kz] * std::abs(rcp_dz);
+    const ValueType delta_z = gamma(3) * max_zt + err_z;
+    const ValueType delta_x = gamma(5) * (max_xt + max_zt) + org_error[kx] + std::abs(sx) * org_error[kz];
+    const ValueType delta_y = gamma(5) * (max_yt + max_zt) + org_error[ky] + std::abs(sy) * org_error[kz];
+    const ValueType delta_e = ValueType(2.0) * (gamma(2) * max_xt * max_yt + delta_y * max_xt + delta_x * max_yt);
+    const ValueType delta_t =
+          ValueType(3.0)
+        * (gamma(3) * max_e * max_zt + delta_e * max_zt + delta_z * max_e)
+        * std::abs(rcp_det);
+    if (t <= delta_t)
+        return false;
+
+    // Calculate u and v parameters.
+    u = e1 * rcp_det;
+    v = e2 * rcp_det;
+    return true;
+}
+
+template <typename T>
+APPLESEED_FORCE_INLINE bool TriangleWT<T>::intersect(const RayType& ray) const
+{
+    ValueType t, u, v;
+    return intersect(ray, t, u, v);
+}
+
+template <typename T>
+APPLESEED_FORCE_INLINE bool TriangleWT<T>::intersect(
+    const RayType&          ray,
+    const VectorType&       org_error) const
+{
+    ValueType t, u, v;
+    return intersect(ray, org_error, t, u, v);
+}
+
+}   // namespace foundation
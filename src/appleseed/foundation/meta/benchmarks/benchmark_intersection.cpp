@@ -29,20 +29,26 @@
 
 // appleseed.foundation headers.
 #include "foundation/math/aabb.h"
+#include "foundation/math/bvh.h"
 #include "foundation/math/intersection/rayaabb.h"
 #include "foundation/math/intersection/raytrianglemt.h"
 #include "foundation/math/intersection/raytrianglessk.h"
+#include "foundation/math/intersection/raytrianglewt.h"
 #include "foundation/math/ray.h"
 #include "foundation/math/rng/distribution.h"
 #include "foundation/math/rng/mersennetwister.h"
 #include "foundation/math/sampling/mappings.h"
 #include "foundation/math/vector.h"
 #include "foundation/platform/compiler.h"
+#include "foundation/platform/timers.h"
+#include "foundation/utility/alignedallocator.h"
+#include "foundation/utility/alignedvector.h"
 #include "foundation/utility/benchmark.h"
 
 // Standard headers.
 #include <cstddef>
 #include <limits>
+#include <vector>
 
 using namespace foundation;
 
@@ -316,3 +322,241 @@ BENCHMARK_SUITE(Foundation_Math_Intersection_RayTriangleSSK)
     BENCHMARK_CASE_F(Intersect_DoublePrecision_HitRateIs66Percents, FixtureDouble66) { payload(); }
     BENCHMARK_CASE_F(Intersect_DoublePrecision_HitRateIs100Percents, FixtureDouble100) { payload(); }
 };
+
+BENCHMARK_SUITE(Foundation_Math_Intersection_RayTriangleWT)
+{
+    template <typename T, int TargetHitRate>
+    struct Fixture
+      : public RayTriangleFixture<TriangleWT<T>, T, TargetHitRate>
+    {
+    };
+
+    // We need these typedefs because we can't use commas in macro parameters.
+    typedef Fixture<float, 0>       FixtureFloat0;
+    typedef Fixture<float, 33>      FixtureFloat33;
+    typedef Fixture<float, 66>      FixtureFloat66;
+    typedef Fixture<float, 100>     FixtureFloat100;
+    typedef Fixture<double, 0>      FixtureDouble0;
+    typedef Fixture<double, 33>     FixtureDouble33;
+    typedef Fixture<double, 66>     FixtureDouble66;
+    typedef Fixture<double, 100>    FixtureDouble100;
+
+    BENCHMARK_CASE_F(Intersect_SinglePrecision_HitRateIs0Percent, FixtureFloat0) { payload(); }
+    BENCHMARK_CASE_F(Intersect_SinglePrecision_HitRateIs33Percents, FixtureFloat33) { payload(); }
+    BENCHMARK_CASE_F(Intersect_SinglePrecision_HitRateIs66Percents, FixtureFloat66) { payload(); }
+    BENCHMARK_CASE_F(Intersect_SinglePrecision_HitRateIs100Percents, FixtureFloat100) { payload(); }
+    BENCHMARK_CASE_F(Intersect_DoublePrecision_HitRateIs0Percent, FixtureDouble0) { payload(); }
+    BENCHMARK_CASE_F(Intersect_DoublePrecision_HitRateIs33Percents, FixtureDouble33) { payload(); }
+    BENCHMARK_CASE_F(Intersect_DoublePrecision_HitRateIs66Percents, FixtureDouble66) { payload(); }
+    BENCHMARK_CASE_F(Intersect_DoublePrecision_HitRateIs100Percents, FixtureDouble100) { payload(); }
+}
+
+BENCHMARK_SUITE(Foundation_Math_Intersection_RayBVH)
+{
+    typedef AlignedVector<bvh::Node<AABB3d>> NodeVector;
+    typedef bvh::Tree<NodeVector> BinaryTree;
+    typedef bvh::WideTree<AlignedVector<bvh::WideNode<4>>, NodeVector> WideTree4;
+    typedef bvh::WideTree<AlignedVector<bvh::WideNode<8>>, NodeVector> WideTree8;
+    typedef bvh::WideTree<AlignedVector<bvh::QuantizedWideNode<4>>, NodeVector> QuantizedWideTree4;
+    typedef bvh::WideTree<AlignedVector<bvh::QuantizedWideNode<8>>, NodeVector> QuantizedWideTree8;
+    typedef std::vector<AABB3d> AABBVector;
+
+    // Intersect the bounding boxes of the items of a leaf, keep the closest hit.
+    struct Visitor
+    {
+        const AABBVector&   m_bboxes;
+        size_t              m_hit_count;
+
+        explicit Visitor(const AABBVector& bboxes)
+          : m_bboxes(bboxes)
+          , m_hit_count(0)
+        {
+        }
+
+        bool visit(
+            const BinaryTree::NodeType& node,
+            const Ray3d&                ray,
+            const RayInfo3d&            ray_info,
+            double&                     distance
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+            , bvh::TraversalStatistics& stats
+#endif
+            )
+        {
+            distance = ray.m_tmax;
+
+            const size_t begin = node.get_item_index();
+            const size_t end = begin + node.get_item_count();
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                double tmin;
+                if (intersect(ray, ray_info, m_bboxes[i], tmin) && tmin < distance)
+                {
+                    distance = tmin;
+                    ++m_hit_count;
+                }
+            }
+
+            return true;
+        }
+    };
+
+    struct Fixture
+      : public FixtureBase<double>
+    {
+        static const size_t ItemCount = 100000;
+        static const size_t RayCount = 1000;
+
+        BinaryTree          m_binary_tree;
+        WideTree4           m_wide_tree_4;
+        WideTree8           m_wide_tree_8;
+        QuantizedWideTree4  m_quantized_wide_tree_4;
+        QuantizedWideTree8  m_quantized_wide_tree_8;
+        AABBVector          m_bboxes;
+        RayType             m_ray[RayCount];
+        RayInfoType         m_ray_info[RayCount];
+        Visitor             m_visitor;
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+        bvh::TraversalStatistics m_stats;
+#endif
+
+        Fixture()
+          : m_binary_tree(AlignedAllocator<void>(64))
+          , m_wide_tree_4(AlignedAllocator<void>(64), AlignedAllocator<void>(64))
+          , m_wide_tree_8(AlignedAllocator<void>(64), AlignedAllocator<void>(64))
+          , m_quantized_wide_tree_4(AlignedAllocator<void>(64), AlignedAllocator<void>(64))
+          , m_quantized_wide_tree_8(AlignedAllocator<void>(64), AlignedAllocator<void>(64))
+          , m_visitor(m_bboxes)
+        {
+            MersenneTwister rng;
+
+            // Generate small boxes randomly distributed inside the unit sphere.
+            AABBVector bboxes;
+            AABB3d tree_bbox;
+            tree_bbox.invalidate();
+            for (size_t i = 0; i < ItemCount; ++i)
+            {
+                const VectorType center = get_random_vector<3>(rng, -1.0, 1.0);
+                const VectorType extent = get_random_vector<3>(rng, 0.001, 0.01);
+                const AABB3d bbox(center - extent, center + extent);
+                bboxes.push_back(bbox);
+                tree_bbox.insert(bbox);
+            }
+
+            // Build the binary tree.
+            bvh::SAHPartitioner<AABBVector> partitioner(bboxes, 4);
+            bvh::Builder<BinaryTree, bvh::SAHPartitioner<AABBVector>> builder;
+            builder.build<DefaultWallclockTimer>(m_binary_tree, partitioner, ItemCount, 4);
+
+            // Store the bounding boxes in tree order.
+            const std::vector<size_t>& ordering = partitioner.get_item_ordering();
+            m_bboxes.reserve(ItemCount);
+            for (size_t i = 0; i < ItemCount; ++i)
+                m_bboxes.push_back(bboxes[ordering[i]]);
+
+            // Collapse the binary tree into wide trees.
+            bvh::Collapser<BinaryTree, WideTree4> collapser4;
+            collapser4.collapse<DefaultWallclockTimer>(m_binary_tree, tree_bbox, m_wide_tree_4);
+            bvh::Collapser<BinaryTree, WideTree8> collapser8;
+            collapser8.collapse<DefaultWallclockTimer>(m_binary_tree, tree_bbox, m_wide_tree_8);
+            bvh::Collapser<BinaryTree, QuantizedWideTree4> quantized_collapser4;
+            quantized_collapser4.collapse<DefaultWallclockTimer>(m_binary_tree, tree_bbox, m_quantized_wide_tree_4);
+            bvh::Collapser<BinaryTree, QuantizedWideTree8> quantized_collapser8;
+            quantized_collapser8.collapse<DefaultWallclockTimer>(m_binary_tree, tree_bbox, m_quantized_wide_tree_8);
+
+            for (size_t i = 0; i < RayCount; ++i)
+                get_random_ray(rng, 2.0, m_ray[i], m_ray_info[i]);
+        }
+    };
+
+    BENCHMARK_CASE_F(Intersect_BinaryTree, Fixture)
+    {
+        bvh::Intersector<BinaryTree, Visitor, Ray3d> intersector;
+
+        for (size_t i = 0; i < RayCount; ++i)
+        {
+            intersector.intersect_no_motion(
+                m_binary_tree,
+                m_ray[i],
+                m_ray_info[i],
+                m_visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                , m_stats
+#endif
+                );
+        }
+    }
+
+    BENCHMARK_CASE_F(Intersect_4WideTree, Fixture)
+    {
+        bvh::WideIntersector<WideTree4, Visitor, Ray3d> intersector;
+
+        for (size_t i = 0; i < RayCount; ++i)
+        {
+            intersector.intersect(
+                m_wide_tree_4,
+                m_ray[i],
+                m_ray_info[i],
+                m_visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                , m_stats
+#endif
+                );
+        }
+    }
+
+    BENCHMARK_CASE_F(Intersect_8WideTree, Fixture)
+    {
+        bvh::WideIntersector<WideTree8, Visitor, Ray3d> intersector;
+
+        for (size_t i = 0; i < RayCount; ++i)
+        {
+            intersector.intersect(
+                m_wide_tree_8,
+                m_ray[i],
+                m_ray_info[i],
+                m_visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                , m_stats
+#endif
+                );
+        }
+    }
+
+    BENCHMARK_CASE_F(Intersect_Quantized4WideTree, Fixture)
+    {
+        bvh::WideIntersector<QuantizedWideTree4, Visitor, Ray3d> intersector;
+
+        for (size_t i = 0; i < RayCount; ++i)
+        {
+            intersector.intersect(
+                m_quantized_wide_tree_4,
+                m_ray[i],
+                m_ray_info[i],
+                m_visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                , m_stats
+#endif
+                );
+        }
+    }
+
+    BENCHMARK_CASE_F(Intersect_Quantized8WideTree, Fixture)
+    {
+        bvh::WideIntersector<QuantizedWideTree8, Visitor, Ray3d> intersector;
+
+        for (size_t i = 0; i < RayCount; ++i)
+        {
+            intersector.intersect(
+                m_quantized_wide_tree_8,
+                m_ray[i],
+                m_ray_info[i],
+                m_visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                , m_stats
+#endif
+                );
+        }
+    }
+}
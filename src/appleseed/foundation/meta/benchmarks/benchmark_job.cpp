@@ -34,6 +34,7 @@
 
 // Standard headers.
 #include <cstddef>
+#include <cstdint>
 
 using namespace foundation;
 
@@ -47,7 +48,28 @@ BENCHMARK_SUITE(Foundation_Utility_Job)
         }
     };
 
-    template <size_t ThreadCount>
+    // A job performing a small, fixed amount of work, to measure scaling with the number of threads.
+    struct BusyJob
+      : public IJob
+    {
+        volatile std::uint32_t m_result;
+
+        void execute(const size_t thread_index) override
+        {
+            std::uint32_t x = 2463534242UL;
+
+            for (size_t i = 0; i < 10000; ++i)
+            {
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+            }
+
+            m_result = x;
+        }
+    };
+
+    template <typename Job, size_t ThreadCount>
     struct Fixture
     {
         Logger      m_logger;
@@ -63,7 +85,7 @@ BENCHMARK_SUITE(Foundation_Utility_Job)
         void payload()
         {
             const size_t JobCount = 256;
-            EmptyJob jobs[JobCount];
+            Job jobs[JobCount];
 
             for (size_t i = 0; i < JobCount; ++i)
                 m_job_queue.schedule(&jobs[i], false);
@@ -72,12 +94,64 @@ BENCHMARK_SUITE(Foundation_Utility_Job)
         }
     };
 
-    BENCHMARK_CASE_F(SingleThreadedJobExecution, Fixture<1>)
+    template <size_t ThreadCount>
+    struct EmptyJobFixture
+      : public Fixture<EmptyJob, ThreadCount>
+    {
+    };
+
+    template <size_t ThreadCount>
+    struct BusyJobFixture
+      : public Fixture<BusyJob, ThreadCount>
+    {
+    };
+
+    BENCHMARK_CASE_F(SingleThreadedJobExecution, EmptyJobFixture<1>)
+    {
+        payload();
+    }
+
+    BENCHMARK_CASE_F(DoubleThreadedJobExecution, EmptyJobFixture<2>)
+    {
+        payload();
+    }
+
+    BENCHMARK_CASE_F(QuadThreadedJobExecution, EmptyJobFixture<4>)
+    {
+        payload();
+    }
+
+    BENCHMARK_CASE_F(OctoThreadedJobExecution, EmptyJobFixture<8>)
+    {
+        payload();
+    }
+
+    BENCHMARK_CASE_F(SixteenThreadedJobExecution, EmptyJobFixture<16>)
+    {
+        payload();
+    }
+
+    BENCHMARK_CASE_F(SingleThreadedBusyJobExecution, BusyJobFixture<1>)
+    {
+        payload();
+    }
+
+    BENCHMARK_CASE_F(DoubleThreadedBusyJobExecution, BusyJobFixture<2>)
+    {
+        payload();
+    }
+
+    BENCHMARK_CASE_F(QuadThreadedBusyJobExecution, BusyJobFixture<4>)
+    {
+        payload();
+    }
+
+    BENCHMARK_CASE_F(OctoThreadedBusyJobExecution, BusyJobFixture<8>)
     {
         payload();
     }
 
-    BENCHMARK_CASE_F(DoubleThreadedJobExecution, Fixture<2>)
+    BENCHMARK_CASE_F(SixteenThreadedBusyJobExecution, BusyJobFixture<16>)
     {
         payload();
     }
@@ -31,13 +31,24 @@
 #include "foundation/math/aabb.h"
 #include "foundation/math/bvh.h"
 #include "foundation/math/ray.h"
+#include "foundation/math/rng/distribution.h"
+#include "foundation/math/rng/mersennetwister.h"
 #include "foundation/math/vector.h"
+#include "foundation/platform/timers.h"
+#include "foundation/utility/alignedallocator.h"
 #include "foundation/utility/alignedvector.h"
+#include "foundation/utility/bufferedfile.h"
 #include "foundation/utility/iostreamop.h"
+#include "foundation/utility/job/jobmanager.h"
+#include "foundation/utility/job/jobqueue.h"
+#include "foundation/utility/log/logger.h"
 #include "foundation/utility/test.h"
 
 // Standard headers.
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <vector>
 
 using namespace foundation;
@@ -75,6 +86,98 @@ TEST_SUITE(Foundation_Math_BVH_Node)
     }
 }
 
+TEST_SUITE(Foundation_Math_BVH_Builder)
+{
+    typedef AlignedVector<bvh::Node<AABB3d>> NodeVector;
+    typedef std::vector<AABB3d> AABBVector;
+    typedef bvh::SAHPartitioner<AABBVector> Partitioner;
+
+    struct TestTree
+      : public bvh::Tree<NodeVector>
+    {
+        using bvh::Tree<NodeVector>::m_nodes;
+    };
+
+    typedef bvh::Builder<TestTree, Partitioner> Builder;
+
+    void make_random_bboxes(AABBVector& bboxes, const size_t count)
+    {
+        MersenneTwister rng;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            Vector3d center;
+            center[0] = rand_double1(rng, -10.0, 10.0);
+            center[1] = rand_double1(rng, -10.0, 10.0);
+            center[2] = rand_double1(rng, -10.0, 10.0);
+
+            const Vector3d extent(rand_double1(rng, 0.01, 0.1));
+
+            bboxes.emplace_back(center - extent, center + extent);
+        }
+    }
+
+    bool are_identical(const TestTree& lhs, const TestTree& rhs)
+    {
+        if (lhs.m_nodes.size() != rhs.m_nodes.size())
+            return false;
+
+        for (size_t i = 0, e = lhs.m_nodes.size(); i < e; ++i)
+        {
+            const bvh::Node<AABB3d>& lhs_node = lhs.m_nodes[i];
+            const bvh::Node<AABB3d>& rhs_node = rhs.m_nodes[i];
+
+            if (lhs_node.is_leaf() != rhs_node.is_leaf())
+                return false;
+
+            if (lhs_node.is_leaf())
+            {
+                if (lhs_node.get_item_index() != rhs_node.get_item_index() ||
+                    lhs_node.get_item_count() != rhs_node.get_item_count())
+                    return false;
+            }
+            else
+            {
+                if (lhs_node.get_child_node_index() != rhs_node.get_child_node_index() ||
+                    lhs_node.get_left_bbox() != rhs_node.get_left_bbox() ||
+                    lhs_node.get_right_bbox() != rhs_node.get_right_bbox())
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    TEST_CASE(ParallelBuild_ProducesSameTreeAsSerialBuild)
+    {
+        const size_t ItemCount = 10000;
+
+        AABBVector bboxes;
+        make_random_bboxes(bboxes, ItemCount);
+
+        TestTree serial_tree;
+        Partitioner serial_partitioner(bboxes, 2);
+        Builder serial_builder;
+        serial_builder.build<DefaultWallclockTimer>(serial_tree, serial_partitioner, ItemCount, 2);
+
+        Logger logger;
+        JobQueue job_queue;
+        JobManager job_manager(logger, job_queue, 4, JobManager::KeepRunningOnEmptyQueue);
+        job_manager.start();
+
+        TestTree parallel_tree;
+        Partitioner parallel_partitioner(bboxes, 2);
+        Builder parallel_builder;
+        parallel_builder.build<DefaultWallclockTimer>(parallel_tree, parallel_partitioner, ItemCount, 2, job_queue, 4);
+
+        job_manager.stop();
+
+        EXPECT_GT(1, parallel_builder.get_subtree_count());
+        EXPECT_TRUE(are_identical(serial_tree, parallel_tree));
+        EXPECT_EQ(serial_partitioner.get_item_ordering(), parallel_partitioner.get_item_ordering());
+    }
+}
+
 TEST_SUITE(Foundation_Math_BVH_SpatialBuilder)
 {
     struct ItemHandler
@@ -149,3 +252,838 @@ TEST_SUITE(Foundation_Math_BVH_Intersector_2D)
         > intersector;
     }
 }
+
+TEST_SUITE(Foundation_Math_BVH_WideNode)
+{
+    TEST_CASE(ChildBoundingBoxesAreRoundedOutward)
+    {
+        static const AABB3d BBox(Vector3d(0.1, 0.2, 0.3), Vector3d(0.4, 0.5, 0.6));
+
+        bvh::WideNode<4> node;
+        node.clear();
+        node.set_child_bbox(2, BBox);
+
+        const AABB3f stored_bbox = node.get_child_bbox(2);
+
+        for (size_t d = 0; d < 3; ++d)
+        {
+            EXPECT_TRUE(stored_bbox.min[d] <= BBox.min[d]);
+            EXPECT_TRUE(stored_bbox.max[d] >= BBox.max[d]);
+        }
+    }
+
+    TEST_CASE(TestStorageAndRetrievalOfChildren)
+    {
+        bvh::WideNode<4> node;
+        node.clear();
+        node.set_interior_child(0, 12);
+        node.set_leaf_child(1, 34);
+
+        EXPECT_FALSE(node.is_leaf_child(0));
+        EXPECT_EQ(12, node.get_child_index(0));
+        EXPECT_TRUE(node.is_leaf_child(1));
+        EXPECT_EQ(34, node.get_child_index(1));
+        EXPECT_TRUE(node.is_empty_child(2));
+        EXPECT_TRUE(node.is_empty_child(3));
+        EXPECT_EQ(2, node.get_child_count());
+    }
+}
+
+TEST_SUITE(Foundation_Math_BVH_QuantizedWideNode)
+{
+    TEST_CASE(SizeIsHalfTheSizeOfWideNode)
+    {
+        EXPECT_EQ(64, sizeof(bvh::QuantizedWideNode<4>));
+        EXPECT_EQ(128, sizeof(bvh::QuantizedWideNode<8>));
+    }
+
+    TEST_CASE(ChildBoundingBoxesAreRoundedOutward)
+    {
+        static const AABB3d NodeBBox(Vector3d(-1.0, 2.0, 1000.0), Vector3d(3.0, 2.5, 1000.001));
+        static const AABB3d ChildBBox(Vector3d(0.1, 2.2, 1000.0003), Vector3d(0.4, 2.3, 1000.0007));
+
+        bvh::QuantizedWideNode<4> node;
+        node.clear();
+        node.set_bbox(NodeBBox);
+        node.set_child_bbox(2, ChildBBox);
+
+        const AABB3f stored_bbox = node.get_child_bbox(2);
+
+        for (size_t d = 0; d < 3; ++d)
+        {
+            EXPECT_TRUE(stored_bbox.min[d] <= ChildBBox.min[d]);
+            EXPECT_TRUE(stored_bbox.max[d] >= ChildBBox.max[d]);
+            EXPECT_LT(0.1, stored_bbox.extent(d) - ChildBBox.extent(d));
+        }
+    }
+
+    TEST_CASE(SetChildBBoxes_EnclosesAllNonEmptyChildren)
+    {
+        static const AABB3d ChildBBoxes[4] =
+        {
+            AABB3d(Vector3d(-1.0, 2.0, 1000.0), Vector3d(0.0, 2.5, 1000.001)),
+            AABB3d(Vector3d(2.0, 2.1, 1000.0003), Vector3d(3.0, 2.2, 1000.0007)),
+            AABB3d(Vector3d(-9.0), Vector3d(9.0)),
+            AABB3d(Vector3d(-9.0), Vector3d(9.0))
+        };
+
+        bvh::QuantizedWideNode<4> node;
+        node.clear();
+        node.set_leaf_child(0, 0);
+        node.set_leaf_child(1, 1);
+        node.set_child_bboxes(ChildBBoxes);
+
+        for (size_t i = 0; i < 2; ++i)
+        {
+            const AABB3f stored_bbox = node.get_child_bbox(i);
+
+            for (size_t d = 0; d < 3; ++d)
+            {
+                EXPECT_TRUE(stored_bbox.min[d] <= ChildBBoxes[i].min[d]);
+                EXPECT_TRUE(stored_bbox.max[d] >= ChildBBoxes[i].max[d]);
+                EXPECT_LT(1.0, stored_bbox.extent(d) - ChildBBoxes[i].extent(d));
+            }
+        }
+    }
+
+    TEST_CASE(FlatChildBoundingBoxIsPreserved)
+    {
+        static const AABB3d NodeBBox(Vector3d(0.0, 0.0, 5.0), Vector3d(1.0, 1.0, 5.0));
+
+        bvh::QuantizedWideNode<4> node;
+        node.clear();
+        node.set_bbox(NodeBBox);
+        node.set_child_bbox(0, NodeBBox);
+
+        const AABB3f stored_bbox = node.get_child_bbox(0);
+
+        EXPECT_EQ(5.0f, stored_bbox.min[2]);
+        EXPECT_TRUE(stored_bbox.max[2] >= 5.0f);
+    }
+
+    TEST_CASE(TestStorageAndRetrievalOfChildren)
+    {
+        bvh::QuantizedWideNode<4> node;
+        node.clear();
+        node.set_interior_child(0, 12);
+        node.set_leaf_child(1, 34);
+
+        EXPECT_FALSE(node.is_leaf_child(0));
+        EXPECT_EQ(12, node.get_child_index(0));
+        EXPECT_TRUE(node.is_leaf_child(1));
+        EXPECT_EQ(34, node.get_child_index(1));
+        EXPECT_TRUE(node.is_empty_child(2));
+        EXPECT_TRUE(node.is_empty_child(3));
+        EXPECT_EQ(2, node.get_child_count());
+    }
+}
+
+TEST_SUITE(Foundation_Math_BVH_WideIntersector)
+{
+    typedef AlignedVector<bvh::Node<AABB3d>> NodeVector;
+    typedef bvh::Tree<NodeVector> Tree;
+    typedef std::vector<AABB3d> AABBVector;
+    typedef bvh::SAHPartitioner<AABBVector> Partitioner;
+
+    // Collect the leaves visited during traversal.
+    struct Visitor
+    {
+        std::vector<size_t> m_items;
+
+        bool visit(
+            const Tree::NodeType&       node,
+            const Ray3d&                ray,
+            const RayInfo3d&            ray_info,
+            double&                     distance
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+            , bvh::TraversalStatistics& stats
+#endif
+            )
+        {
+            m_items.push_back(node.get_item_index());
+            distance = ray.m_tmax;
+            return true;
+        }
+    };
+
+    void build_tree(Tree& tree, AABB3d& tree_bbox)
+    {
+        MersenneTwister rng;
+
+        AABBVector bboxes;
+        tree_bbox.invalidate();
+
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            Vector3d center;
+            center[0] = rand_double1(rng, -10.0, 10.0);
+            center[1] = rand_double1(rng, -10.0, 10.0);
+            center[2] = rand_double1(rng, -10.0, 10.0);
+
+            const AABB3d bbox(center - Vector3d(0.1), center + Vector3d(0.1));
+            bboxes.push_back(bbox);
+            tree_bbox.insert(bbox);
+        }
+
+        Partitioner partitioner(bboxes);
+        bvh::Builder<Tree, Partitioner> builder;
+        builder.build<DefaultWallclockTimer>(tree, partitioner, bboxes.size(), 1);
+    }
+
+    template <typename WideTree>
+    bool wide_traversal_visits_all_leaves_of_binary_traversal()
+    {
+        // Wide nodes are loaded with aligned SIMD instructions.
+        const AlignedAllocator<void> allocator(64);
+
+        Tree tree(allocator);
+        AABB3d tree_bbox;
+        build_tree(tree, tree_bbox);
+
+        WideTree wide_tree(allocator, allocator);
+        bvh::Collapser<Tree, WideTree> collapser;
+        collapser.template collapse<DefaultWallclockTimer>(tree, tree_bbox, wide_tree);
+
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+        bvh::TraversalStatistics stats;
+#endif
+
+        MersenneTwister rng;
+
+        for (size_t i = 0; i < 100; ++i)
+        {
+            Vector3d dir;
+            dir[0] = rand_double1(rng, -1.0, 1.0);
+            dir[1] = rand_double1(rng, -1.0, 1.0);
+            dir[2] = rand_double1(rng, -1.0, 1.0);
+
+            const Ray3d ray(Vector3d(0.0), normalize(dir));
+            const RayInfo3d ray_info(ray);
+
+            Visitor binary_visitor;
+            bvh::Intersector<Tree, Visitor, Ray3d> binary_intersector;
+            binary_intersector.intersect_no_motion(
+                tree,
+                ray,
+                ray_info,
+                binary_visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                , stats
+#endif
+                );
+
+            Visitor wide_visitor;
+            bvh::WideIntersector<WideTree, Visitor, Ray3d> wide_intersector;
+            wide_intersector.intersect(
+                wide_tree,
+                ray,
+                ray_info,
+                wide_visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                , stats
+#endif
+                );
+
+            std::sort(binary_visitor.m_items.begin(), binary_visitor.m_items.end());
+            std::sort(wide_visitor.m_items.begin(), wide_visitor.m_items.end());
+
+            if (!std::includes(
+                    wide_visitor.m_items.begin(), wide_visitor.m_items.end(),
+                    binary_visitor.m_items.begin(), binary_visitor.m_items.end()))
+                return false;
+        }
+
+        return true;
+    }
+
+    template <typename WideTree>
+    bool wide_traversal_visits_box_grazed_by_ray_far_from_origin()
+    {
+        // Single precision numbers around 1e7 are one unit apart.
+        const double Y = 1.0e7;
+
+        AABBVector bboxes;
+        bboxes.push_back(AABB3d(Vector3d(0.0, Y, 0.0), Vector3d(10.0, Y + 1.0, 1.0)));
+        bboxes.push_back(AABB3d(Vector3d(100.0, Y, 0.0), Vector3d(101.0, Y + 1.0, 1.0)));
+
+        AABB3d tree_bbox;
+        tree_bbox.invalidate();
+        tree_bbox.insert(bboxes[0]);
+        tree_bbox.insert(bboxes[1]);
+
+        const AlignedAllocator<void> allocator(64);
+
+        Tree tree(allocator);
+        Partitioner partitioner(bboxes);
+        bvh::Builder<Tree, Partitioner> builder;
+        builder.build<DefaultWallclockTimer>(tree, partitioner, bboxes.size(), 1);
+
+        WideTree wide_tree(allocator, allocator);
+        bvh::Collapser<Tree, WideTree> collapser;
+        collapser.template collapse<DefaultWallclockTimer>(tree, tree_bbox, wide_tree);
+
+        // The ray enters the first box and leaves it through its top face. Its origin is below
+        // the top face but rounds to it in single precision.
+        const Ray3d ray(Vector3d(-1.0, Y + 0.7, 0.5), normalize(Vector3d(1.0, 0.1, 0.0)));
+        const RayInfo3d ray_info(ray);
+
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+        bvh::TraversalStatistics stats;
+#endif
+
+        Visitor visitor;
+        bvh::WideIntersector<WideTree, Visitor, Ray3d> intersector;
+        intersector.intersect(
+            wide_tree,
+            ray,
+            ray_info,
+            visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+            , stats
+#endif
+            );
+
+        return std::find(visitor.m_items.begin(), visitor.m_items.end(), 0) != visitor.m_items.end();
+    }
+
+    TEST_CASE(FourWideTraversalVisitsAllLeavesOfBinaryTraversal)
+    {
+        typedef bvh::WideTree<AlignedVector<bvh::WideNode<4>>, NodeVector> WideTree;
+
+        EXPECT_TRUE(wide_traversal_visits_all_leaves_of_binary_traversal<WideTree>());
+    }
+
+    TEST_CASE(EightWideTraversalVisitsAllLeavesOfBinaryTraversal)
+    {
+        typedef bvh::WideTree<AlignedVector<bvh::WideNode<8>>, NodeVector> WideTree;
+
+        EXPECT_TRUE(wide_traversal_visits_all_leaves_of_binary_traversal<WideTree>());
+    }
+
+    TEST_CASE(QuantizedFourWideTraversalVisitsAllLeavesOfBinaryTraversal)
+    {
+        typedef bvh::WideTree<AlignedVector<bvh::QuantizedWideNode<4>>, NodeVector> WideTree;
+
+        EXPECT_TRUE(wide_traversal_visits_all_leaves_of_binary_traversal<WideTree>());
+    }
+
+    TEST_CASE(QuantizedEightWideTraversalVisitsAllLeavesOfBinaryTraversal)
+    {
+        typedef bvh::WideTree<AlignedVector<bvh::QuantizedWideNode<8>>, NodeVector> WideTree;
+
+        EXPECT_TRUE(wide_traversal_visits_all_leaves_of_binary_traversal<WideTree>());
+    }
+
+    TEST_CASE(FourWideTraversalVisitsBoxGrazedByRayFarFromOrigin)
+    {
+        typedef bvh::WideTree<AlignedVector<bvh::WideNode<4>>, NodeVector> WideTree;
+
+        EXPECT_TRUE(wide_traversal_visits_box_grazed_by_ray_far_from_origin<WideTree>());
+    }
+
+    TEST_CASE(EightWideTraversalVisitsBoxGrazedByRayFarFromOrigin)
+    {
+        typedef bvh::WideTree<AlignedVector<bvh::WideNode<8>>, NodeVector> WideTree;
+
+        EXPECT_TRUE(wide_traversal_visits_box_grazed_by_ray_far_from_origin<WideTree>());
+    }
+
+    TEST_CASE(QuantizedFourWideTraversalVisitsBoxGrazedByRayFarFromOrigin)
+    {
+        typedef bvh::WideTree<AlignedVector<bvh::QuantizedWideNode<4>>, NodeVector> WideTree;
+
+        EXPECT_TRUE(wide_traversal_visits_box_grazed_by_ray_far_from_origin<WideTree>());
+    }
+}
+
+TEST_SUITE(Foundation_Math_BVH_Refitter)
+{
+    typedef AlignedVector<bvh::Node<AABB3d>> NodeVector;
+    typedef std::vector<AABB3d> AABBVector;
+    typedef bvh::SAHPartitioner<AABBVector> Partitioner;
+
+    struct TestTree
+      : public bvh::Tree<NodeVector>
+    {
+        using bvh::Tree<NodeVector>::m_nodes;
+    };
+
+    // Compute the bounding box of the items of a leaf.
+    struct LeafRefitter
+    {
+        const AABBVector&           m_bboxes;
+        const std::vector<size_t>&  m_ordering;
+
+        LeafRefitter(
+            const AABBVector&           bboxes,
+            const std::vector<size_t>&  ordering)
+          : m_bboxes(bboxes)
+          , m_ordering(ordering)
+        {
+        }
+
+        AABB3d operator()(bvh::Node<AABB3d>& leaf) const
+        {
+            AABB3d bbox;
+            bbox.invalidate();
+
+            for (size_t i = 0, e = leaf.get_item_count(); i < e; ++i)
+                bbox.insert(m_bboxes[m_ordering[leaf.get_item_index() + i]]);
+
+            return bbox;
+        }
+    };
+
+    typedef bvh::Refitter<TestTree, LeafRefitter> Refitter;
+
+    void make_random_bboxes(AABBVector& bboxes, const size_t count)
+    {
+        MersenneTwister rng;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            Vector3d center;
+            center[0] = rand_double1(rng, -10.0, 10.0);
+            center[1] = rand_double1(rng, -10.0, 10.0);
+            center[2] = rand_double1(rng, -10.0, 10.0);
+
+            const Vector3d extent(rand_double1(rng, 0.01, 0.1));
+
+            bboxes.emplace_back(center - extent, center + extent);
+        }
+    }
+
+    void build_tree(
+        TestTree&                   tree,
+        const AABBVector&           bboxes,
+        std::vector<size_t>&        ordering)
+    {
+        Partitioner partitioner(bboxes, 2);
+        bvh::Builder<TestTree, Partitioner> builder;
+        builder.build<DefaultWallclockTimer>(tree, partitioner, bboxes.size(), 2);
+        ordering = partitioner.get_item_ordering();
+    }
+
+    bool have_same_bboxes(const TestTree& lhs, const TestTree& rhs)
+    {
+        if (lhs.m_nodes.size() != rhs.m_nodes.size())
+            return false;
+
+        for (size_t i = 0, e = lhs.m_nodes.size(); i < e; ++i)
+        {
+            if (lhs.m_nodes[i].is_leaf())
+                continue;
+
+            if (lhs.m_nodes[i].get_left_bbox() != rhs.m_nodes[i].get_left_bbox() ||
+                lhs.m_nodes[i].get_right_bbox() != rhs.m_nodes[i].get_right_bbox())
+                return false;
+        }
+
+        return true;
+    }
+
+    TEST_CASE(Refit_GivenUnchangedItems_LeavesTreeUnchanged)
+    {
+        AABBVector bboxes;
+        make_random_bboxes(bboxes, 1000);
+
+        TestTree tree;
+        std::vector<size_t> ordering;
+        build_tree(tree, bboxes, ordering);
+
+        TestTree refit_tree;
+        refit_tree.m_nodes = tree.m_nodes;
+
+        Refitter refitter;
+        refitter.refit<DefaultWallclockTimer>(refit_tree, LeafRefitter(bboxes, ordering));
+
+        EXPECT_TRUE(have_same_bboxes(tree, refit_tree));
+        EXPECT_FEQ(refitter.get_initial_cost(), refitter.get_cost());
+    }
+
+    TEST_CASE(Refit_GivenTranslatedItems_TranslatesBoundingBoxesAndPreservesCost)
+    {
+        AABBVector bboxes;
+        make_random_bboxes(bboxes, 1000);
+
+        TestTree tree;
+        std::vector<size_t> ordering;
+        build_tree(tree, bboxes, ordering);
+
+        const Vector3d Offset(1.0, 2.0, 3.0);
+        AABBVector moved_bboxes;
+        for (size_t i = 0, e = bboxes.size(); i < e; ++i)
+            moved_bboxes.emplace_back(bboxes[i].min + Offset, bboxes[i].max + Offset);
+
+        Refitter refitter;
+        refitter.refit<DefaultWallclockTimer>(tree, LeafRefitter(moved_bboxes, ordering));
+
+        AABB3d expected_bbox;
+        expected_bbox.invalidate();
+        for (size_t i = 0, e = moved_bboxes.size(); i < e; ++i)
+            expected_bbox.insert(moved_bboxes[i]);
+
+        EXPECT_FEQ(expected_bbox.min, refitter.get_tree_bbox().min);
+        EXPECT_FEQ(expected_bbox.max, refitter.get_tree_bbox().max);
+        EXPECT_FEQ_EPS(refitter.get_initial_cost(), refitter.get_cost(), 1.0e-6);
+    }
+
+    TEST_CASE(Refit_GivenShuffledItems_IncreasesCost)
+    {
+        AABBVector bboxes;
+        make_random_bboxes(bboxes, 1000);
+
+        TestTree tree;
+        std::vector<size_t> ordering;
+        build_tree(tree, bboxes, ordering);
+
+        AABBVector shuffled_bboxes(bboxes);
+        std::reverse(shuffled_bboxes.begin(), shuffled_bboxes.end());
+
+        Refitter refitter;
+        refitter.refit<DefaultWallclockTimer>(tree, LeafRefitter(shuffled_bboxes, ordering));
+
+        EXPECT_GT(2.0 * refitter.get_initial_cost(), refitter.get_cost());
+    }
+
+    TEST_CASE(ParallelRefit_ProducesSameTreeAsSerialRefit)
+    {
+        const size_t ItemCount = 10000;
+
+        AABBVector bboxes;
+        make_random_bboxes(bboxes, ItemCount);
+
+        TestTree serial_tree;
+        std::vector<size_t> ordering;
+        build_tree(serial_tree, bboxes, ordering);
+
+        TestTree parallel_tree;
+        parallel_tree.m_nodes = serial_tree.m_nodes;
+
+        AABBVector moved_bboxes;
+        make_random_bboxes(moved_bboxes, ItemCount);
+        const LeafRefitter leaf_refitter(moved_bboxes, ordering);
+
+        Refitter serial_refitter;
+        serial_refitter.refit<DefaultWallclockTimer>(serial_tree, leaf_refitter);
+
+        Logger logger;
+        JobQueue job_queue;
+        JobManager job_manager(logger, job_queue, 4, JobManager::KeepRunningOnEmptyQueue);
+        job_manager.start();
+
+        Refitter parallel_refitter;
+        parallel_refitter.refit<DefaultWallclockTimer>(parallel_tree, leaf_refitter, job_queue, 4);
+
+        job_manager.stop();
+
+        EXPECT_TRUE(have_same_bboxes(serial_tree, parallel_tree));
+        EXPECT_EQ(serial_refitter.get_cost(), parallel_refitter.get_cost());
+    }
+
+    template <typename WideTree>
+    bool wide_refit_matches_binary_refit()
+    {
+        // Wide nodes are loaded with aligned SIMD instructions.
+        const AlignedAllocator<void> allocator(64);
+
+        AABBVector bboxes;
+        make_random_bboxes(bboxes, 1000);
+
+        TestTree tree;
+        std::vector<size_t> ordering;
+        build_tree(tree, bboxes, ordering);
+
+        AABB3d tree_bbox;
+        tree_bbox.invalidate();
+        for (size_t i = 0, e = bboxes.size(); i < e; ++i)
+            tree_bbox.insert(bboxes[i]);
+
+        WideTree wide_tree(allocator, allocator);
+        bvh::Collapser<TestTree, WideTree> collapser;
+        collapser.template collapse<DefaultWallclockTimer>(tree, tree_bbox, wide_tree);
+
+        AABBVector moved_bboxes;
+        for (size_t i = 0, e = bboxes.size(); i < e; ++i)
+            moved_bboxes.emplace_back(bboxes[i].min * 2.0, bboxes[i].max * 2.0);
+        const LeafRefitter leaf_refitter(moved_bboxes, ordering);
+
+        Refitter refitter;
+        refitter.refit<DefaultWallclockTimer>(tree, leaf_refitter);
+
+        bvh::WideRefitter<WideTree, LeafRefitter> wide_refitter;
+        wide_refitter.template refit<DefaultWallclockTimer>(wide_tree, leaf_refitter);
+
+        return
+            refitter.get_tree_bbox().min == wide_refitter.get_tree_bbox().min &&
+            refitter.get_tree_bbox().max == wide_refitter.get_tree_bbox().max;
+    }
+
+    TEST_CASE(FourWideRefit_MatchesBinaryRefit)
+    {
+        typedef bvh::WideTree<AlignedVector<bvh::WideNode<4>>, NodeVector> WideTree;
+
+        EXPECT_TRUE(wide_refit_matches_binary_refit<WideTree>());
+    }
+
+    TEST_CASE(QuantizedEightWideRefit_MatchesBinaryRefit)
+    {
+        typedef bvh::WideTree<AlignedVector<bvh::QuantizedWideNode<8>>, NodeVector> WideTree;
+
+        EXPECT_TRUE(wide_refit_matches_binary_refit<WideTree>());
+    }
+}
+
+TEST_SUITE(Foundation_Math_BVH_Serializer)
+{
+    typedef AlignedVector<bvh::Node<AABB3d>> NodeVector;
+    typedef std::vector<AABB3d> AABBVector;
+    typedef bvh::SAHPartitioner<AABBVector> Partitioner;
+
+    struct TestTree
+      : public bvh::Tree<NodeVector>
+    {
+        using bvh::Tree<NodeVector>::m_nodes;
+    };
+
+    struct MemoryWriterAdapter
+      : public WriterAdapter
+    {
+        std::vector<std::uint8_t> m_bytes;
+
+        size_t write(const void* inbuf, const size_t size) override
+        {
+            const std::uint8_t* bytes = static_cast<const std::uint8_t*>(inbuf);
+            m_bytes.insert(m_bytes.end(), bytes, bytes + size);
+            return size;
+        }
+    };
+
+    struct MemoryReaderAdapter
+      : public ReaderAdapter
+    {
+        const std::vector<std::uint8_t>&    m_bytes;
+        size_t                              m_index;
+
+        explicit MemoryReaderAdapter(const std::vector<std::uint8_t>& bytes)
+          : m_bytes(bytes)
+          , m_index(0)
+        {
+        }
+
+        size_t read(void* outbuf, const size_t size) override
+        {
+            const size_t count = std::min(size, m_bytes.size() - m_index);
+            if (count > 0)
+                std::memcpy(outbuf, &m_bytes[m_index], count);
+            m_index += count;
+            return count;
+        }
+    };
+
+    void build_tree(TestTree& tree, const size_t item_count)
+    {
+        MersenneTwister rng;
+
+        AABBVector bboxes;
+        for (size_t i = 0; i < item_count; ++i)
+        {
+            const Vector3d center(
+                rand_double1(rng, -10.0, 10.0),
+                rand_double1(rng, -10.0, 10.0),
+                rand_double1(rng, -10.0, 10.0));
+            bboxes.emplace_back(center - Vector3d(0.1), center + Vector3d(0.1));
+        }
+
+        Partitioner partitioner(bboxes, 2);
+        bvh::Builder<TestTree, Partitioner> builder;
+        builder.build<DefaultWallclockTimer>(tree, partitioner, bboxes.size(), 2);
+    }
+
+    template <typename Vector>
+    bool have_same_bytes(const Vector& lhs, const Vector& rhs)
+    {
+        typedef typename Vector::value_type ValueType;
+
+        return
+            lhs.size() == rhs.size() &&
+            (lhs.empty() || std::memcmp(&lhs[0], &rhs[0], lhs.size() * sizeof(ValueType)) == 0);
+    }
+
+    TEST_CASE(WriteThenRead_ProducesIdenticalTree)
+    {
+        TestTree tree;
+        build_tree(tree, 1000);
+
+        MemoryWriterAdapter writer;
+        const bool written = bvh::TreeSerializer<TestTree>::write(writer, tree);
+
+        TestTree read_tree;
+        MemoryReaderAdapter reader(writer.m_bytes);
+        const bool read = bvh::TreeSerializer<TestTree>::read(reader, read_tree);
+
+        ASSERT_TRUE(written);
+        ASSERT_TRUE(read);
+        EXPECT_EQ(writer.m_bytes.size(), reader.m_index);
+        EXPECT_TRUE(have_same_bytes(tree.m_nodes, read_tree.m_nodes));
+    }
+
+    TEST_CASE(WriteThenRead_ProducesIdenticalWideTree)
+    {
+        typedef bvh::WideTree<AlignedVector<bvh::QuantizedWideNode<4>>, NodeVector> WideTree;
+
+        struct TestWideTree
+          : public WideTree
+        {
+            TestWideTree()
+              : WideTree(AlignedAllocator<void>(64), AlignedAllocator<void>(64))
+            {
+            }
+
+            using WideTree::m_wide_nodes;
+            using WideTree::m_leaf_nodes;
+        };
+
+        TestTree tree;
+        build_tree(tree, 1000);
+
+        TestWideTree wide_tree;
+        bvh::Collapser<TestTree, WideTree> collapser;
+        collapser.collapse<DefaultWallclockTimer>(
+            tree,
+            AABB3d(Vector3d(-11.0), Vector3d(11.0)),
+            wide_tree);
+
+        MemoryWriterAdapter writer;
+        const bool written = bvh::WideTreeSerializer<WideTree>::write(writer, wide_tree);
+
+        TestWideTree read_tree;
+        MemoryReaderAdapter reader(writer.m_bytes);
+        const bool read = bvh::WideTreeSerializer<WideTree>::read(reader, read_tree);
+
+        ASSERT_TRUE(written);
+        ASSERT_TRUE(read);
+        EXPECT_TRUE(have_same_bytes(wide_tree.m_wide_nodes, read_tree.m_wide_nodes));
+        EXPECT_TRUE(have_same_bytes(wide_tree.m_leaf_nodes, read_tree.m_leaf_nodes));
+    }
+
+    TEST_CASE(Read_GivenTruncatedData_ReturnsFalse)
+    {
+        TestTree tree;
+        build_tree(tree, 100);
+
+        MemoryWriterAdapter writer;
+        bvh::TreeSerializer<TestTree>::write(writer, tree);
+        writer.m_bytes.resize(writer.m_bytes.size() / 2);
+
+        TestTree read_tree;
+        MemoryReaderAdapter reader(writer.m_bytes);
+
+        EXPECT_FALSE(bvh::TreeSerializer<TestTree>::read(reader, read_tree));
+    }
+
+    TEST_CASE(Read_GivenChildIndexPointingBackward_ReturnsFalse)
+    {
+        TestTree tree;
+        build_tree(tree, 100);
+        ASSERT_TRUE(tree.m_nodes[0].is_interior());
+
+        // Make the root its own child.
+        tree.m_nodes[0].set_child_node_index(0);
+
+        MemoryWriterAdapter writer;
+        bvh::TreeSerializer<TestTree>::write(writer, tree);
+
+        TestTree read_tree;
+        MemoryReaderAdapter reader(writer.m_bytes);
+
+        EXPECT_FALSE(bvh::TreeSerializer<TestTree>::read(reader, read_tree));
+    }
+
+    TEST_CASE(Read_GivenChildIndexPastLastNode_ReturnsFalse)
+    {
+        TestTree tree;
+        build_tree(tree, 100);
+        ASSERT_TRUE(tree.m_nodes[0].is_interior());
+
+        // The right child would be one past the last node.
+        tree.m_nodes[0].set_child_node_index(tree.m_nodes.size() - 1);
+
+        MemoryWriterAdapter writer;
+        bvh::TreeSerializer<TestTree>::write(writer, tree);
+
+        TestTree read_tree;
+        MemoryReaderAdapter reader(writer.m_bytes);
+
+        EXPECT_FALSE(bvh::TreeSerializer<TestTree>::read(reader, read_tree));
+    }
+
+    struct RejectLargeLeaves
+    {
+        bool operator()(const bvh::Node<AABB3d>& leaf) const
+        {
+            return leaf.get_item_count() < 2;
+        }
+    };
+
+    TEST_CASE(Read_GivenLeafRejectedByLeafChecker_ReturnsFalse)
+    {
+        TestTree tree;
+        build_tree(tree, 100);
+
+        MemoryWriterAdapter writer;
+        bvh::TreeSerializer<TestTree>::write(writer, tree);
+
+        TestTree read_tree;
+        MemoryReaderAdapter reader(writer.m_bytes);
+
+        EXPECT_FALSE(bvh::TreeSerializer<TestTree>::read(reader, read_tree, RejectLargeLeaves()));
+    }
+
+    TEST_CASE(Read_GivenWideTreeLeafIndexPastLastLeaf_ReturnsFalse)
+    {
+        typedef bvh::WideTree<AlignedVector<bvh::QuantizedWideNode<4>>, NodeVector> WideTree;
+
+        struct TestWideTree
+          : public WideTree
+        {
+            TestWideTree()
+              : WideTree(AlignedAllocator<void>(64), AlignedAllocator<void>(64))
+            {
+            }
+
+            using WideTree::m_wide_nodes;
+            using WideTree::m_leaf_nodes;
+        };
+
+        TestTree tree;
+        build_tree(tree, 1000);
+
+        TestWideTree wide_tree;
+        bvh::Collapser<TestTree, WideTree> collapser;
+        collapser.collapse<DefaultWallclockTimer>(
+            tree,
+            AABB3d(Vector3d(-11.0), Vector3d(11.0)),
+            wide_tree);
+
+        // Redirect a child of some wide node to a leaf that does not exist.
+        bool corrupted = false;
+        for (size_t i = 0; i < wide_tree.m_wide_nodes.size() && !corrupted; ++i)
+        {
+            if (!wide_tree.m_wide_nodes[i].is_empty_child(0))
+            {
+                wide_tree.m_wide_nodes[i].set_leaf_child(0, wide_tree.m_leaf_nodes.size());
+                corrupted = true;
+            }
+        }
+        ASSERT_TRUE(corrupted);
+
+        MemoryWriterAdapter writer;
+        bvh::WideTreeSerializer<WideTree>::write(writer, wide_tree);
+
+        TestWideTree read_tree;
+        MemoryReaderAdapter reader(writer.m_bytes);
+
+        EXPECT_FALSE(bvh::WideTreeSerializer<WideTree>::read(reader, read_tree));
+    }
+}
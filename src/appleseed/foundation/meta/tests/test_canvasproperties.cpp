@@ -0,0 +1,78 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// appleseed.foundation headers.
+#include "foundation/image/canvasproperties.h"
+#include "foundation/image/pixel.h"
+#include "foundation/utility/test.h"
+
+using namespace foundation;
+
+TEST_SUITE(Foundation_Image_CanvasProperties)
+{
+    TEST_CASE(GetMipLevelCount_GivenSinglePixelCanvas_ReturnsOne)
+    {
+        const CanvasProperties props(1, 1, 32, 32, 4, PixelFormatFloat);
+
+        EXPECT_EQ(1, props.get_mip_level_count());
+    }
+
+    TEST_CASE(GetMipLevelCount_GivenNonSquareCanvas_CountsLevelsOfLongestSide)
+    {
+        const CanvasProperties props(300, 20, 32, 32, 4, PixelFormatFloat);
+
+        // 300, 150, 75, 37, 18, 9, 4, 2, 1.
+        EXPECT_EQ(9, props.get_mip_level_count());
+    }
+
+    TEST_CASE(GetMipLevel_HalvesCanvasAndKeepsTileSize)
+    {
+        const CanvasProperties props(300, 20, 32, 16, 3, PixelFormatHalf);
+
+        const CanvasProperties level = props.get_mip_level(2);
+
+        EXPECT_EQ(75, level.m_canvas_width);
+        EXPECT_EQ(5, level.m_canvas_height);
+        EXPECT_EQ(32, level.m_tile_width);
+        EXPECT_EQ(16, level.m_tile_height);
+        EXPECT_EQ(3, level.m_tile_count_x);
+        EXPECT_EQ(1, level.m_tile_count_y);
+        EXPECT_EQ(3, level.m_channel_count);
+        EXPECT_EQ(PixelFormatHalf, level.m_pixel_format);
+    }
+
+    TEST_CASE(GetMipLevel_GivenLastLevel_ReturnsSinglePixelCanvas)
+    {
+        const CanvasProperties props(300, 20, 32, 32, 4, PixelFormatFloat);
+
+        const CanvasProperties level = props.get_mip_level(props.get_mip_level_count() - 1);
+
+        EXPECT_EQ(1, level.m_canvas_width);
+        EXPECT_EQ(1, level.m_canvas_height);
+    }
+}
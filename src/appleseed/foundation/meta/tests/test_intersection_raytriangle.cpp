@@ -30,10 +30,18 @@
 // appleseed.foundation headers.
 #include "foundation/math/intersection/raytrianglemt.h"
 #include "foundation/math/intersection/raytrianglessk.h"
+#include "foundation/math/intersection/raytrianglewt.h"
 #include "foundation/math/ray.h"
+#include "foundation/math/rng/distribution.h"
+#include "foundation/math/rng/mersennetwister.h"
 #include "foundation/math/vector.h"
+#include "foundation/utility/casts.h"
 #include "foundation/utility/test.h"
 
+// Standard headers.
+#include <cstddef>
+#include <cstdint>
+
 using namespace foundation;
 
 namespace
@@ -166,3 +174,170 @@ TEST_SUITE(Foundation_Math_Intersection_RayTriangleSSK)
         EXPECT_FEQ(0.5, v);
     }
 }
+
+TEST_SUITE(Foundation_Math_Intersection_RayTriangleWT)
+{
+    typedef RayTriangleFixture<TriangleWT<double>> Fixture;
+
+    TEST_CASE_F(Intersect_GivenRayWithTMinEqualToHitDistance_ReturnsTrue, Fixture)
+    {
+        const Ray3d ray(Vector3d(-0.2, 1.0, 0.2), Vector3d(0.0, -1.0, 0.0), 1.0, 10.0);
+
+        const bool hit = m_triangle.intersect(ray);
+
+        ASSERT_TRUE(hit);
+    }
+
+    TEST_CASE_F(Intersect_GivenRayWithTMaxEqualToHitDistance_ReturnsFalse, Fixture)
+    {
+        const Ray3d ray(Vector3d(-0.2, 1.0, 0.2), Vector3d(0.0, -1.0, 0.0), 0.0, 1.0);
+
+        const bool hit = m_triangle.intersect(ray);
+
+        ASSERT_FALSE(hit);
+    }
+
+    TEST_CASE_F(Intersect_GivenRayWithTMinEqualToHitDistance_ReturnsHit, Fixture)
+    {
+        const Ray3d ray(Vector3d(-0.2, 1.0, 0.2), Vector3d(0.0, -1.0, 0.0), 1.0, 10.0);
+
+        double t, u, v;
+        const bool hit = m_triangle.intersect(ray, t, u, v);
+
+        ASSERT_TRUE(hit);
+        EXPECT_FEQ(1.0, t);
+    }
+
+    TEST_CASE_F(Intersect_GivenRayWithTMaxEqualToHitDistance_ReturnsNoHit, Fixture)
+    {
+        const Ray3d ray(Vector3d(-0.2, 1.0, 0.2), Vector3d(0.0, -1.0, 0.0), 0.0, 1.0);
+
+        double t, u, v;
+        const bool hit = m_triangle.intersect(ray, t, u, v);
+
+        ASSERT_FALSE(hit);
+    }
+
+    TEST_CASE_F(Intersect_GivenRayHittingDiagonalOfQuad_ReturnsHit, Fixture)
+    {
+        const Ray3d ray(Vector3d(0.0, 1.0, 0.0), Vector3d(0.0, -1.0, 0.0));
+
+        double t, u, v;
+        const bool hit = m_triangle.intersect(ray, t, u, v);
+
+        ASSERT_TRUE(hit);
+        EXPECT_FEQ(1.0, t);
+        EXPECT_FEQ(0.0, u);
+        EXPECT_FEQ(0.5, v);
+    }
+
+    TEST_CASE(Intersect_GivenRayStartingOnTriangle_ReturnsNoHit)
+    {
+        const TriangleWT<float> triangle(
+            Vector3f(0.5f, 0.0f, 0.5f),
+            Vector3f(-0.5f, 0.0f, 0.5f),
+            Vector3f(-0.5f, 0.0f, -0.5f));
+        const Ray3f ray(Vector3f(-0.2f, 0.0f, 0.2f), Vector3f(0.0f, 1.0f, 0.0f));
+
+        const bool hit = triangle.intersect(ray);
+
+        EXPECT_FALSE(hit);
+    }
+
+    TEST_CASE(Intersect_GivenRaysHittingSharedEdgeOfTwoTriangles_AlwaysReturnsHitInSinglePrecision)
+    {
+        // A thin quad with an awkwardly oriented diagonal, far from the origin.
+        const Vector3f a(1000.1f, 3.7f, -200.3f);
+        const Vector3f b(1003.9f, 3.1f, -200.9f);
+        const Vector3f c(1000.3f, 4.9f, -197.7f);
+        const Vector3f d(1004.7f, 4.3f, -198.1f);
+        const TriangleWT<float> t0(a, b, c);
+        const TriangleWT<float> t1(c, b, d);
+
+        const Vector3f org(1001.0f, 20.0f, -190.0f);
+        const size_t RayCount = 10000;
+        size_t miss_count = 0;
+
+        for (size_t i = 0; i < RayCount; ++i)
+        {
+            // Aim at points along the shared edge.
+            const float s = (i + 0.5f) / RayCount;
+            const Vector3f target = b + (c - b) * s;
+            const Ray3f ray(org, target - org);
+
+            if (!t0.intersect(ray) && !t1.intersect(ray))
+                ++miss_count;
+        }
+
+        EXPECT_EQ(0, miss_count);
+    }
+
+    // Offset a point by a few ULPs along a direction, as done when spawning secondary rays.
+    Vector3d offset_point(const Vector3d& p, const Vector3d& n)
+    {
+        Vector3d result;
+
+        for (size_t i = 0; i < 3; ++i)
+        {
+            const std::uint64_t pi = binary_cast<std::uint64_t>(p[i]);
+            const bool toward_zero = ((pi ^ binary_cast<std::uint64_t>(n[i])) >> 63) != 0;
+            result[i] = binary_cast<double>(toward_zero ? pi - 8 : pi + 8);
+        }
+
+        return result;
+    }
+
+    TEST_CASE(Intersect_GivenSinglePrecisionRaysLeavingTriangleFarFromOrigin_ReturnsNoHitWhenGivenOriginError)
+    {
+        const TriangleWT<float> triangle(
+            Vector3f(100.0f, 37.0f, -250.0f),
+            Vector3f(100.007f, 37.002f, -249.996f),
+            Vector3f(100.001f, 37.008f, -249.995f));
+        const Vector3d v0(triangle.m_v0), v1(triangle.m_v1), v2(triangle.m_v2);
+        const Vector3d n = normalize(cross(v1 - v0, v2 - v0));
+
+        MersenneTwister rng;
+        const size_t RayCount = 10000;
+        size_t hit_count = 0;
+
+        for (size_t i = 0; i < RayCount; ++i)
+        {
+            // Pick a point on the triangle and a direction in the hemisphere above it.
+            double a = rand_double1(rng), b = rand_double1(rng);
+            if (a + b > 1.0)
+            {
+                a = 1.0 - a;
+                b = 1.0 - b;
+            }
+            const Vector3d p = v0 + a * (v1 - v0) + b * (v2 - v0);
+            Vector3d d(rand_double1(rng, -1.0, 1.0), rand_double1(rng, -1.0, 1.0), rand_double1(rng, -1.0, 1.0));
+            if (dot(d, n) < 0.0)
+                d = -d;
+
+            const Ray3d ray(offset_point(p, n), d);
+            if (triangle.intersect(Ray3f(ray), TriangleWT<float>::compute_rounding_error(ray.m_org)))
+                ++hit_count;
+        }
+
+        EXPECT_EQ(0, hit_count);
+    }
+
+    TEST_CASE(Intersect_GivenSinglePrecisionRayHittingTriangleFarFromOrigin_ReturnsHitWhenGivenOriginError)
+    {
+        const TriangleWT<float> triangle(
+            Vector3f(100.0f, 37.0f, -250.0f),
+            Vector3f(100.007f, 37.002f, -249.996f),
+            Vector3f(100.001f, 37.008f, -249.995f));
+        const Vector3d v0(triangle.m_v0), v1(triangle.m_v1), v2(triangle.m_v2);
+        const Vector3d n = normalize(cross(v1 - v0, v2 - v0));
+        const Vector3d center = (v0 + v1 + v2) / 3.0;
+
+        const Ray3d ray(center + 0.01 * n, -n);
+
+        float t, u, v;
+        const bool hit = triangle.intersect(Ray3f(ray), TriangleWT<float>::compute_rounding_error(ray.m_org), t, u, v);
+
+        ASSERT_TRUE(hit);
+        EXPECT_FEQ_EPS(0.01f, t, 1.0e-3f);
+    }
+}
@@ -30,6 +30,7 @@
 // appleseed.foundation headers.
 #include "foundation/platform/atomic.h"
 #include "foundation/platform/compiler.h"
+#include "foundation/platform/system.h"
 #include "foundation/platform/timers.h"
 #include "foundation/utility/job/abortswitch.h"
 #include "foundation/utility/job/ijob.h"
@@ -40,10 +41,12 @@
 #include "foundation/utility/test.h"
 
 // Standard headers.
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <new>
 #include <utility>
+#include <vector>
 
 using namespace foundation;
 
@@ -281,6 +284,27 @@ TEST_SUITE(Foundation_Utility_Job_JobQueue)
         EXPECT_EQ(1, destruction_count);
     }
 
+    TEST_CASE(AcquireScheduledJobReturnsJobsInSchedulingOrder)
+    {
+        IJob* job1 = new EmptyJob();
+        IJob* job2 = new EmptyJob();
+
+        JobQueue job_queue;
+        job_queue.schedule(job1);
+        job_queue.schedule(job2);
+
+        const JobQueue::RunningJobInfo running_job_info1 =
+            job_queue.acquire_scheduled_job();
+        const JobQueue::RunningJobInfo running_job_info2 =
+            job_queue.acquire_scheduled_job();
+
+        EXPECT_EQ(job1, running_job_info1.first.m_job);
+        EXPECT_EQ(job2, running_job_info2.first.m_job);
+
+        job_queue.retire_running_job(running_job_info1);
+        job_queue.retire_running_job(running_job_info2);
+    }
+
     TEST_CASE(RunningJobNotOwnedByQueueIsNotDestructedWhenRetired)
     {
         volatile std::uint32_t destruction_count = 0;
@@ -373,6 +397,212 @@ TEST_SUITE(Foundation_Utility_Job_JobManager)
 
         EXPECT_EQ(1, execution_count);
     }
+
+    struct FixtureMultithreadedJobManager
+    {
+        Logger      logger;
+        JobQueue    job_queue;
+        JobManager  job_manager;
+
+        FixtureMultithreadedJobManager()
+          : job_manager(logger, job_queue, 4, JobManager::KeepRunningOnEmptyQueue)
+        {
+        }
+    };
+
+    class JobCreatingManyJobs
+      : public IJob
+    {
+      public:
+        JobCreatingManyJobs(
+            JobQueue&               job_queue,
+            const size_t            job_count,
+            volatile std::uint32_t* execution_count)
+          : m_job_queue(job_queue)
+          , m_job_count(job_count)
+          , m_execution_count(execution_count)
+        {
+        }
+
+        void execute(const size_t thread_index) override
+        {
+            for (size_t i = 0; i < m_job_count; ++i)
+            {
+                m_job_queue.schedule(
+                    new JobNotifyingAboutExecution(m_execution_count));
+            }
+        }
+
+      private:
+        JobQueue&               m_job_queue;
+        const size_t            m_job_count;
+        volatile std::uint32_t* m_execution_count;
+    };
+
+    TEST_CASE_F(MultithreadedJobManagerExecutesJobsScheduledBeforeStart, FixtureMultithreadedJobManager)
+    {
+        volatile std::uint32_t execution_count = 0;
+
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            job_queue.schedule(
+                new JobNotifyingAboutExecution(&execution_count));
+        }
+
+        job_manager.start();
+        job_queue.wait_until_completion();
+
+        EXPECT_EQ(1000, execution_count);
+        EXPECT_FALSE(job_queue.has_scheduled_or_running_jobs());
+    }
+
+    TEST_CASE_F(MultithreadedJobManagerExecutesJobsScheduledAfterStart, FixtureMultithreadedJobManager)
+    {
+        volatile std::uint32_t execution_count = 0;
+
+        job_manager.start();
+
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            job_queue.schedule(
+                new JobNotifyingAboutExecution(&execution_count));
+        }
+
+        job_queue.wait_until_completion();
+
+        EXPECT_EQ(1000, execution_count);
+        EXPECT_FALSE(job_queue.has_scheduled_or_running_jobs());
+    }
+
+    TEST_CASE_F(MultithreadedJobManagerExecutesSubJobs, FixtureMultithreadedJobManager)
+    {
+        volatile std::uint32_t execution_count = 0;
+
+        job_queue.schedule(
+            new JobCreatingManyJobs(job_queue, 1000, &execution_count));
+
+        job_manager.start();
+        job_queue.wait_until_completion();
+
+        EXPECT_EQ(1000, execution_count);
+        EXPECT_FALSE(job_queue.has_scheduled_or_running_jobs());
+    }
+
+    class JobCountingExecutionsPerThread
+      : public IJob
+    {
+      public:
+        explicit JobCountingExecutionsPerThread(volatile std::uint32_t* execution_counts)
+          : m_execution_counts(execution_counts)
+        {
+        }
+
+        void execute(const size_t thread_index) override
+        {
+            atomic_inc(&m_execution_counts[thread_index]);
+        }
+
+      private:
+        volatile std::uint32_t* m_execution_counts;
+    };
+
+    TEST_CASE_F(ExecuteOnEachThread_ExecutesJobOnceInEachThread, FixtureMultithreadedJobManager)
+    {
+        volatile std::uint32_t execution_counts[4] = { 0, 0, 0, 0 };
+        JobCountingExecutionsPerThread job(execution_counts);
+
+        job_manager.start();
+        job_manager.execute_on_each_thread(job);
+
+        EXPECT_EQ(1, execution_counts[0]);
+        EXPECT_EQ(1, execution_counts[1]);
+        EXPECT_EQ(1, execution_counts[2]);
+        EXPECT_EQ(1, execution_counts[3]);
+        EXPECT_FALSE(job_queue.has_scheduled_or_running_jobs());
+    }
+
+    TEST_CASE(GetThreadLogicalCore_WorkerThreadsNotPinned_ReturnsNoLogicalCore)
+    {
+        Logger logger;
+        JobQueue job_queue;
+        JobManager job_manager(logger, job_queue, 2);
+
+        EXPECT_EQ(WorkerThread::NoLogicalCore, job_manager.get_thread_logical_core(0));
+        EXPECT_EQ(WorkerThread::NoLogicalCore, job_manager.get_thread_logical_core(1));
+    }
+
+    TEST_CASE(GetThreadLogicalCore_WorkerThreadsPinned_ReturnsValidLogicalCores)
+    {
+        Logger logger;
+        JobQueue job_queue;
+        JobManager job_manager(logger, job_queue, 8, JobManager::PinWorkerThreads);
+
+        const size_t core_count = System::get_logical_cpu_core_count();
+
+        for (size_t i = 0; i < 8; ++i)
+            EXPECT_LT(core_count, job_manager.get_thread_logical_core(i));
+    }
+
+    TEST_CASE(GetThreadLogicalCore_WorkerThreadsPinned_ReturnsCoresTheProcessIsAllowedToRunOn)
+    {
+        Logger logger;
+        JobQueue job_queue;
+        JobManager job_manager(logger, job_queue, 8, JobManager::PinWorkerThreads);
+
+        const std::vector<size_t> allowed_cores = System::get_allowed_logical_cpu_cores();
+
+        for (size_t i = 0; i < 8; ++i)
+        {
+            const size_t core = job_manager.get_thread_logical_core(i);
+            EXPECT_TRUE(
+                allowed_cores.empty() ||
+                std::find(allowed_cores.begin(), allowed_cores.end(), core) != allowed_cores.end());
+        }
+    }
+
+    TEST_CASE(PinnedWorkerThreadsExecuteJobs)
+    {
+        Logger logger;
+        JobQueue job_queue;
+        JobManager job_manager(
+            logger,
+            job_queue,
+            4,
+            JobManager::KeepRunningOnEmptyQueue | JobManager::PinWorkerThreads);
+
+        volatile std::uint32_t execution_count = 0;
+
+        for (size_t i = 0; i < 100; ++i)
+        {
+            job_queue.schedule(
+                new JobNotifyingAboutExecution(&execution_count));
+        }
+
+        job_manager.start();
+        job_queue.wait_until_completion();
+
+        EXPECT_EQ(100, execution_count);
+    }
+
+    TEST_CASE_F(MultithreadedJobManagerExecutesJobsAcrossRestarts, FixtureMultithreadedJobManager)
+    {
+        volatile std::uint32_t execution_count = 0;
+
+        for (size_t pass = 0; pass < 3; ++pass)
+        {
+            for (size_t i = 0; i < 100; ++i)
+            {
+                job_queue.schedule(
+                    new JobNotifyingAboutExecution(&execution_count));
+            }
+
+            job_manager.start();
+            job_queue.wait_until_completion();
+            job_manager.stop();
+        }
+
+        EXPECT_EQ(300, execution_count);
+    }
 }
 
 TEST_SUITE(Foundation_Utility_Job_WorkerThread)
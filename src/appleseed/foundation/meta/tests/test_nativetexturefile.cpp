@@ -0,0 +1,225 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// appleseed.foundation headers.
+#include "foundation/core/exceptions/exceptionioerror.h"
+#include "foundation/image/canvasproperties.h"
+#include "foundation/image/color.h"
+#include "foundation/image/image.h"
+#include "foundation/image/nativetexturefile.h"
+#include "foundation/image/pixel.h"
+#include "foundation/image/tile.h"
+#include "foundation/utility/iostreamop.h"
+#include "foundation/utility/test.h"
+
+// Standard headers.
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+using namespace foundation;
+
+TEST_SUITE(Foundation_Image_NativeTextureFile)
+{
+    // Write a single-level 8x8 RGBA float texture made of 2x2 tiles of 4x4 pixels.
+    std::vector<char> write_texture(const char* filepath)
+    {
+        Image image(8, 8, 8, 8, 4, PixelFormatFloat);
+        image.clear(Color4f(1.0f));
+
+        NativeTextureFileWriter::Options options;
+        options.m_tile_width = 4;
+        options.m_tile_height = 4;
+        options.m_pixel_format = PixelFormatFloat;
+        options.m_mip_levels = false;
+        NativeTextureFileWriter::write(filepath, image, options);
+
+        std::ifstream file(filepath, std::ios::in | std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    void write_bytes(const char* filepath, const std::vector<char>& bytes, const size_t size)
+    {
+        std::ofstream file(filepath, std::ios::out | std::ios::binary);
+        file.write(&bytes[0], size);
+    }
+
+    // Byte offsets of fields of a single-level texture file.
+    const size_t LevelHeaderOffset = 8 * sizeof(std::uint32_t);
+    const size_t TileOffsetsOffset = LevelHeaderOffset + 2 * sizeof(std::uint32_t);
+
+    TEST_CASE(WriteThenRead_PreservesPixelsOfFirstLevel)
+    {
+        const char* FilePath = "unit tests/outputs/test_nativetexturefile_pixels.astx";
+
+        Image image(5, 3, 2, 2, 4, PixelFormatFloat);
+
+        for (size_t y = 0; y < 3; ++y)
+        {
+            for (size_t x = 0; x < 5; ++x)
+                image.set_pixel(x, y, Color4f(0.25f * x, 0.5f * y, 1.0f, 0.5f));
+        }
+
+        NativeTextureFileWriter::Options options;
+        options.m_tile_width = 4;
+        options.m_tile_height = 2;
+        options.m_pixel_format = PixelFormatFloat;
+        NativeTextureFileWriter::write(FilePath, image, options);
+
+        ASSERT_TRUE(NativeTextureFile::is_native_texture_file(FilePath));
+
+        const NativeTextureFile file(FilePath);
+        const CanvasProperties& props = file.get_level_properties(0);
+
+        ASSERT_EQ(5, props.m_canvas_width);
+        ASSERT_EQ(3, props.m_canvas_height);
+        ASSERT_EQ(2, props.m_tile_count_x);
+        ASSERT_EQ(2, props.m_tile_count_y);
+
+        for (size_t y = 0; y < 3; ++y)
+        {
+            for (size_t x = 0; x < 5; ++x)
+            {
+                const std::unique_ptr<Tile> tile(file.get_tile(0, x / 4, y / 2));
+
+                Color4f c;
+                tile->get_pixel(x % 4, y % 2, c);
+                EXPECT_EQ(Color4f(0.25f * x, 0.5f * y, 1.0f, 0.5f), c);
+            }
+        }
+    }
+
+    TEST_CASE(WriteThenRead_BuildsMipLevelsDownToSinglePixel)
+    {
+        const char* FilePath = "unit tests/outputs/test_nativetexturefile_miplevels.astx";
+
+        Image image(8, 4, 8, 4, 3, PixelFormatFloat);
+        image.clear(Color3f(0.5f, 1.0f, 2.0f));
+
+        NativeTextureFileWriter::write(FilePath, image);
+
+        const NativeTextureFile file(FilePath);
+
+        ASSERT_EQ(4, file.get_level_count());
+        EXPECT_EQ(4, file.get_level_properties(1).m_canvas_width);
+        EXPECT_EQ(2, file.get_level_properties(1).m_canvas_height);
+        EXPECT_EQ(1, file.get_level_properties(3).m_canvas_width);
+        EXPECT_EQ(1, file.get_level_properties(3).m_canvas_height);
+        EXPECT_EQ(PixelFormatHalf, file.get_level_properties(3).m_pixel_format);
+
+        const std::unique_ptr<Tile> tile(file.get_tile(3, 0, 0));
+
+        Color3f c;
+        tile->get_pixel(0, 0, c);
+        EXPECT_EQ(Color3f(0.5f, 1.0f, 2.0f), c);
+    }
+
+    TEST_CASE(IsNativeTextureFile_GivenOtherFile_ReturnsFalse)
+    {
+        const char* FilePath = "unit tests/outputs/test_nativetexturefile_other.txt";
+
+        {
+            std::ofstream file(FilePath);
+            file << "not a texture";
+        }
+
+        EXPECT_FALSE(NativeTextureFile::is_native_texture_file(FilePath));
+    }
+
+    TEST_CASE(Constructor_GivenOtherFile_ThrowsExceptionIOError)
+    {
+        const char* FilePath = "unit tests/outputs/test_nativetexturefile_other.txt";
+
+        {
+            std::ofstream file(FilePath);
+            file << "not a texture, but long enough to hold a header";
+        }
+
+        EXPECT_EXCEPTION(ExceptionIOError, { NativeTextureFile file(FilePath); });
+    }
+
+    TEST_CASE(Constructor_GivenValidFile_DoesNotThrow)
+    {
+        const char* FilePath = "unit tests/outputs/test_nativetexturefile_valid.astx";
+
+        const std::vector<char> bytes = write_texture(FilePath);
+        write_bytes(FilePath, bytes, bytes.size());
+
+        const NativeTextureFile file(FilePath);
+
+        EXPECT_EQ(4, file.get_level_properties(0).m_tile_count);
+    }
+
+    TEST_CASE(Constructor_GivenFileTruncatedInLastTile_ThrowsExceptionIOError)
+    {
+        const char* FilePath = "unit tests/outputs/test_nativetexturefile_truncated_tile.astx";
+
+        const std::vector<char> bytes = write_texture(FilePath);
+        write_bytes(FilePath, bytes, bytes.size() - 16);
+
+        EXPECT_EXCEPTION(ExceptionIOError, { NativeTextureFile file(FilePath); });
+    }
+
+    TEST_CASE(Constructor_GivenFileTruncatedInTileTable_ThrowsExceptionIOError)
+    {
+        const char* FilePath = "unit tests/outputs/test_nativetexturefile_truncated_table.astx";
+
+        const std::vector<char> bytes = write_texture(FilePath);
+        write_bytes(FilePath, bytes, TileOffsetsOffset + 4);
+
+        EXPECT_EXCEPTION(ExceptionIOError, { NativeTextureFile file(FilePath); });
+    }
+
+    TEST_CASE(Constructor_GivenTileOffsetWrappingAroundWhenAddedToTileSize_ThrowsExceptionIOError)
+    {
+        const char* FilePath = "unit tests/outputs/test_nativetexturefile_bad_offset.astx";
+
+        std::vector<char> bytes = write_texture(FilePath);
+        const std::uint64_t offset = ~std::uint64_t(63);    // 64-byte aligned, offset + tile size wraps around
+        std::memcpy(&bytes[TileOffsetsOffset], &offset, sizeof(offset));
+        write_bytes(FilePath, bytes, bytes.size());
+
+        EXPECT_EXCEPTION(ExceptionIOError, { NativeTextureFile file(FilePath); });
+    }
+
+    TEST_CASE(Constructor_GivenHugeLevelDimensions_ThrowsExceptionIOError)
+    {
+        const char* FilePath = "unit tests/outputs/test_nativetexturefile_huge_level.astx";
+
+        std::vector<char> bytes = write_texture(FilePath);
+        const std::uint32_t dimensions[2] = { 0xFFFFFFFFu, 0xFFFFFFFFu };
+        std::memcpy(&bytes[LevelHeaderOffset], dimensions, sizeof(dimensions));
+        write_bytes(FilePath, bytes, bytes.size());
+
+        EXPECT_EXCEPTION(ExceptionIOError, { NativeTextureFile file(FilePath); });
+    }
+}
@@ -53,6 +53,7 @@
     #include "foundation/platform/windows.h"
 
     // Standard headers.
+    #include <algorithm>
     #include <cassert>
     #include <cstdlib>
     #include <string>
@@ -78,8 +79,11 @@
 
     // Standard headers.
     #include <cstdio>
+    #include <string>
+    #include <vector>
 
     // Platform headers.
+    #include <sched.h>
     #include <sys/sysinfo.h>
     #include <sys/types.h>
     #include <cpuid.h>
@@ -88,6 +92,12 @@
 // FreeBSD.
 #elif defined __FreeBSD__
 
+    // Standard headers.
+    #include <cstdio>
+
+    // Platform headers.
+    #include <sys/param.h>
+    #include <sys/cpuset.h>
     #include <sys/types.h>
     #include <sys/resource.h>
     #include <sys/sysctl.h>
@@ -261,6 +271,100 @@ std::uint64_t System::get_peak_process_virtual_memory_size()
     return pmc.PeakPagefileUsage;
 }
 
+size_t System::get_numa_node_count()
+{
+    ULONG highest_node_number = 0;
+    if (GetNumaHighestNodeNumber(&highest_node_number) == FALSE)
+        return 1;
+
+    return static_cast<size_t>(highest_node_number) + 1;
+}
+
+size_t System::get_numa_node_of_logical_cpu_core(const size_t logical_core)
+{
+    std::uint16_t group;
+    std::uint8_t number;
+    if (!get_processor_number_of_logical_cpu_core(logical_core, group, number))
+        return 0;
+
+    PROCESSOR_NUMBER processor;
+    processor.Group = static_cast<WORD>(group);
+    processor.Number = static_cast<BYTE>(number);
+    processor.Reserved = 0;
+
+    USHORT node_number = 0;
+    if (GetNumaProcessorNodeEx(&processor, &node_number) == FALSE || node_number == MAXUSHORT)
+        return 0;
+
+    return static_cast<size_t>(node_number);
+}
+
+bool System::get_processor_number_of_logical_cpu_core(
+    const size_t            logical_core,
+    std::uint16_t&          group,
+    std::uint8_t&           number)
+{
+    // Processor groups hold at most 64 logical cores, but Windows balances cores across
+    // groups so a group may hold fewer (for instance, 96 cores form two groups of 48).
+    size_t first_core = 0;
+
+    for (WORD g = 0, e = GetActiveProcessorGroupCount(); g < e; ++g)
+    {
+        const size_t group_core_count = static_cast<size_t>(GetActiveProcessorCount(g));
+
+        if (logical_core < first_core + group_core_count)
+        {
+            group = static_cast<std::uint16_t>(g);
+            number = static_cast<std::uint8_t>(logical_core - first_core);
+            return true;
+        }
+
+        first_core += group_core_count;
+    }
+
+    return false;
+}
+
+std::vector<size_t> System::get_allowed_logical_cpu_cores()
+{
+    std::vector<size_t> cores;
+    const HANDLE process = GetCurrentProcess();
+
+    // Find the processor groups the process is assigned to.
+    USHORT group_count = 0;
+    GetProcessGroupAffinity(process, &group_count, nullptr);
+    std::vector<USHORT> groups(group_count);
+    if (group_count == 0 || GetProcessGroupAffinity(process, &group_count, &groups[0]) == FALSE)
+        return cores;
+
+    // A process that lives in a single group may be further restricted to some of its cores.
+    DWORD_PTR process_mask = 0, system_mask = 0;
+    const bool has_process_mask =
+        group_count == 1 &&
+        GetProcessAffinityMask(process, &process_mask, &system_mask) != FALSE &&
+        process_mask != 0;
+
+    size_t first_core = 0;
+
+    for (WORD g = 0, e = GetActiveProcessorGroupCount(); g < e; ++g)
+    {
+        const size_t group_core_count = static_cast<size_t>(GetActiveProcessorCount(g));
+
+        if (std::find(groups.begin(), groups.end(), g) != groups.end())
+        {
+            for (size_t i = 0; i < group_core_count; ++i)
+            {
+                if (!has_process_mask || (process_mask & (static_cast<DWORD_PTR>(1) << i)) != 0)
+                    cores.push_back(first_core + i);
+            }
+        }
+
+        first_core += group_core_count;
+    }
+
+    return cores;
+}
+
 // ------------------------------------------------------------------------------------------------
 // macOS.
 // ------------------------------------------------------------------------------------------------
@@ -387,6 +491,23 @@ std::uint64_t System::get_peak_process_virtual_memory_size()
     return 0;
 }
 
+size_t System::get_numa_node_count()
+{
+    // macOS does not expose NUMA topology.
+    return 1;
+}
+
+size_t System::get_numa_node_of_logical_cpu_core(const size_t logical_core)
+{
+    return 0;
+}
+
+std::vector<size_t> System::get_allowed_logical_cpu_cores()
+{
+    // macOS does not restrict processes to a subset of the cores.
+    return std::vector<size_t>();
+}
+
 // ------------------------------------------------------------------------------------------------
 // Linux.
 // ------------------------------------------------------------------------------------------------
@@ -417,6 +538,89 @@ namespace
         __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
         return (static_cast<std::uint64_t>(edx) << 32) | eax;
     }
+
+    // Read the first line of a sysfs file.
+    bool read_sysfs_line(const std::string& path, std::string& line)
+    {
+        FILE* fp = fopen(path.c_str(), "r");
+        if (fp == nullptr)
+            return false;
+
+        char buffer[4096];
+        const bool success = fgets(buffer, sizeof(buffer), fp) != nullptr;
+        fclose(fp);
+
+        if (success)
+            line = trim_right(buffer);
+
+        return success;
+    }
+
+    // Parse a sysfs list of ranges such as "0-3,8-11".
+    void parse_sysfs_list(const std::string& list, std::vector<size_t>& values)
+    {
+        std::vector<std::string> ranges;
+        split(list, ",", ranges);
+
+        for (size_t i = 0, e = ranges.size(); i < e; ++i)
+        {
+            size_t first, last;
+
+            if (sscanf(ranges[i].c_str(), "%zu-%zu", &first, &last) == 2)
+            {
+                for (size_t value = first; value <= last; ++value)
+                    values.push_back(value);
+            }
+            else if (sscanf(ranges[i].c_str(), "%zu", &first) == 1)
+                values.push_back(first);
+        }
+    }
+
+    struct LinuxNumaTopology
+    {
+        size_t              m_node_count;
+        std::vector<size_t> m_core_nodes;       // NUMA node of each logical core
+
+        LinuxNumaTopology()
+          : m_node_count(1)
+        {
+            // Node identifiers are not necessarily contiguous.
+            std::string online_nodes;
+            if (!read_sysfs_line("/sys/devices/system/node/online", online_nodes))
+                return;
+
+            std::vector<size_t> node_ids;
+            parse_sysfs_list(online_nodes, node_ids);
+            if (node_ids.empty())
+                return;
+
+            m_node_count = node_ids.size();
+
+            for (size_t node = 0; node < m_node_count; ++node)
+            {
+                std::string cpu_list;
+                if (!read_sysfs_line("/sys/devices/system/node/node" + to_string(node_ids[node]) + "/cpulist", cpu_list))
+                    continue;
+
+                std::vector<size_t> cores;
+                parse_sysfs_list(cpu_list, cores);
+
+                for (size_t i = 0, e = cores.size(); i < e; ++i)
+                {
+                    if (cores[i] >= m_core_nodes.size())
+                        m_core_nodes.resize(cores[i] + 1, 0);
+
+                    m_core_nodes[cores[i]] = node;
+                }
+            }
+        }
+    };
+
+    const LinuxNumaTopology& get_linux_numa_topology()
+    {
+        static const LinuxNumaTopology topology;
+        return topology;
+    }
 }
 
 size_t System::get_l1_data_cache_size()
@@ -501,6 +705,36 @@ std::uint64_t System::get_peak_process_virtual_memory_size()
     return 0;
 }
 
+size_t System::get_numa_node_count()
+{
+    return get_linux_numa_topology().m_node_count;
+}
+
+size_t System::get_numa_node_of_logical_cpu_core(const size_t logical_core)
+{
+    const std::vector<size_t>& core_nodes = get_linux_numa_topology().m_core_nodes;
+    return logical_core < core_nodes.size() ? core_nodes[logical_core] : 0;
+}
+
+std::vector<size_t> System::get_allowed_logical_cpu_cores()
+{
+    // The affinity mask reflects taskset, cpusets and container limits.
+    std::vector<size_t> cores;
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) != 0)
+        return cores;
+
+    for (size_t i = 0; i < CPU_SETSIZE; ++i)
+    {
+        if (CPU_ISSET(i, &cpu_set))
+            cores.push_back(i);
+    }
+
+    return cores;
+}
+
 // ------------------------------------------------------------------------------------------------
 // FreeBSD.
 // ------------------------------------------------------------------------------------------------
@@ -894,6 +1128,49 @@ std::uint64_t System::get_peak_process_virtual_memory_size()
     return 0;
 }
 
+size_t System::get_numa_node_count()
+{
+    // vm.ndomains is the number of memory domains (NUMA nodes) known to the kernel.
+    int domain_count = 0;
+    size_t len = sizeof(domain_count);
+    if (sysctlbyname("vm.ndomains", &domain_count, &len, 0x0, 0) != 0 || domain_count < 1)
+        return 1;
+
+    return static_cast<size_t>(domain_count);
+}
+
+size_t System::get_numa_node_of_logical_cpu_core(const size_t logical_core)
+{
+    // Each CPU device reports the memory domain it belongs to.
+    char name[64];
+    std::snprintf(name, sizeof(name), "dev.cpu.%lu.%%domain", static_cast<unsigned long>(logical_core));
+
+    int domain = 0;
+    size_t len = sizeof(domain);
+    if (sysctlbyname(name, &domain, &len, 0x0, 0) != 0 || domain < 0)
+        return 0;
+
+    return static_cast<size_t>(domain);
+}
+
+std::vector<size_t> System::get_allowed_logical_cpu_cores()
+{
+    std::vector<size_t> cores;
+
+    cpuset_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (cpuset_getaffinity(CPU_LEVEL_WHICH, CPU_WHICH_PID, -1, sizeof(cpu_set), &cpu_set) != 0)
+        return cores;
+
+    for (size_t i = 0; i < CPU_SETSIZE; ++i)
+    {
+        if (CPU_ISSET(i, &cpu_set))
+            cores.push_back(i);
+    }
+
+    return cores;
+}
+
 #endif
 
 // ------------------------------------------------------------------------------------------------
@@ -986,6 +1263,7 @@ void System::print_information(Logger& logger)
         "  vendor                        %s\n"
 #endif
         "  logical cores                 %s\n"
+        "  NUMA nodes                    %s\n"
         "  L1 data cache                 size %s, line size %s\n"
         "  L2 cache                      size %s, line size %s\n"
         "  L3 cache                      size %s, line size %s\n"
@@ -1001,6 +1279,7 @@ void System::print_information(Logger& logger)
         "unknown",
 #endif
         pretty_uint(get_logical_cpu_core_count()).c_str(),
+        pretty_uint(get_numa_node_count()).c_str(),
         pretty_size(get_l1_data_cache_size()).c_str(),
         pretty_size(get_l1_data_cache_line_size()).c_str(),
         pretty_size(get_l2_cache_size()).c_str(),
@@ -39,6 +39,7 @@
 // Standard headers.
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
 // Forward declarations.
 namespace foundation    { class Logger; }
@@ -70,6 +71,31 @@ class APPLESEED_DLLSYMBOL System
     // Return the number of logical CPU cores available in the system.
     static size_t get_logical_cpu_core_count();
 
+    //
+    // NUMA topology.
+    //
+
+    // Return the number of NUMA nodes in the system (1 on non-NUMA systems).
+    static size_t get_numa_node_count();
+
+    // Return the NUMA node a given logical CPU core belongs to.
+    static size_t get_numa_node_of_logical_cpu_core(const size_t logical_core);
+
+    // Return the logical CPU cores the current process is allowed to run on, in increasing
+    // order, or an empty vector if the process may run on any core or if this is unknown.
+    static std::vector<size_t> get_allowed_logical_cpu_cores();
+
+#ifdef _WIN32
+
+    // Find the processor group of a given logical CPU core and the core's index in that group.
+    // Logical cores are numbered group by group. Return false if there is no such core.
+    static bool get_processor_number_of_logical_cpu_core(
+        const size_t            logical_core,
+        std::uint16_t&          group,
+        std::uint8_t&           number);
+
+#endif
+
     //
     // CPU caches.
     //
@@ -33,6 +33,7 @@
 // appleseed.foundation headers.
 #include "foundation/platform/compiler.h"
 #include "foundation/platform/defaulttimers.h"
+#include "foundation/platform/system.h"
 #ifdef _WIN32
 #include "foundation/platform/windows.h"
 #endif
@@ -44,6 +45,7 @@
 
 // Standard headers.
 #include <cassert>
+#include <cstring>
 
 // Platform headers.
 #if defined __APPLE__
@@ -52,6 +54,8 @@
 #include <pthread.h>
 #include <pthread_np.h>
 #elif defined __linux__
+#include <pthread.h>
+#include <sched.h>
 #include <sys/prctl.h>
 #endif
 
@@ -107,6 +111,21 @@ namespace foundation
         }
     }
 
+    bool set_current_thread_affinity(const size_t logical_core)
+    {
+        std::uint16_t group;
+        std::uint8_t number;
+        if (!System::get_processor_number_of_logical_cpu_core(logical_core, group, number))
+            return false;
+
+        GROUP_AFFINITY affinity;
+        std::memset(&affinity, 0, sizeof(affinity));
+        affinity.Group = static_cast<WORD>(group);
+        affinity.Mask = static_cast<KAFFINITY>(1) << number;
+
+        return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+    }
+
 // macOS.
 #elif defined __APPLE__
 
@@ -115,6 +134,12 @@ namespace foundation
         pthread_setname_np(name);
     }
 
+    bool set_current_thread_affinity(const size_t logical_core)
+    {
+        // macOS only supports affinity hints, not binding threads to cores.
+        return false;
+    }
+
 // FreeBSD.
 #elif defined __FreeBSD__
 
@@ -123,6 +148,18 @@ namespace foundation
         pthread_set_name_np(pthread_self(), name);
     }
 
+    bool set_current_thread_affinity(const size_t logical_core)
+    {
+        if (logical_core >= CPU_SETSIZE)
+            return false;
+
+        cpuset_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(logical_core, &cpu_set);
+
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+    }
+
 // Linux.
 #elif defined __linux__
 
@@ -131,6 +168,18 @@ namespace foundation
         prctl(PR_SET_NAME, (unsigned long)name, 0, 0, 0);
     }
 
+    bool set_current_thread_affinity(const size_t logical_core)
+    {
+        if (logical_core >= CPU_SETSIZE)
+            return false;
+
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(logical_core, &cpu_set);
+
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+    }
+
 // Other platforms.
 #else
 
@@ -139,6 +188,11 @@ namespace foundation
         // Do nothing.
     }
 
+    bool set_current_thread_affinity(const size_t logical_core)
+    {
+        return false;
+    }
+
 #endif
 
 void sleep(const std::uint32_t ms)
@@ -43,6 +43,7 @@
 #include "boost/thread/thread.hpp"
 
 // Standard headers.
+#include <cstddef>
 #include <cstdint>
 
 // Forward declarations.
@@ -60,6 +61,10 @@ namespace foundation
 // For portability, limit the name to 16 characters, including the terminating zero.
 APPLESEED_DLLSYMBOL void set_current_thread_name(const char* name);
 
+// Restrict the current thread to run on a given logical CPU core.
+// Return false if the operation failed or is not supported on this platform.
+APPLESEED_DLLSYMBOL bool set_current_thread_affinity(const size_t logical_core);
+
 // Suspend the current thread for a given number of milliseconds.
 APPLESEED_DLLSYMBOL void sleep(const std::uint32_t ms);
 APPLESEED_DLLSYMBOL void sleep(const std::uint32_t ms, IAbortSwitch& abort_switch);
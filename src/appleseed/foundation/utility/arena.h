@@ -53,6 +53,12 @@ class Arena
 
     void clear();
 
+    // Return the number of bytes allocated since the last call to clear().
+    size_t get_allocated_size() const;
+
+    // Release all memory allocated since the arena held a given number of bytes.
+    void rewind(const size_t allocated_size);
+
     void* allocate(const size_t size);
 
     template <typename T> T* allocate();
@@ -84,6 +90,17 @@ inline void Arena::clear()
     m_current = m_storage;
 }
 
+inline size_t Arena::get_allocated_size() const
+{
+    return static_cast<size_t>(m_current - m_storage);
+}
+
+inline void Arena::rewind(const size_t allocated_size)
+{
+    assert(allocated_size <= get_allocated_size());
+    m_current = m_storage + allocated_size;
+}
+
 inline void* Arena::allocate(const size_t size)
 {
     if (m_current + size > m_end)
@@ -268,6 +268,8 @@ class PassthroughWriterAdapter
   public:
     explicit PassthroughWriterAdapter(BufferedFile& file);
 
+    using WriterAdapter::write;
+
     size_t write(
         const void*         inbuf,
         const size_t        size) override;
@@ -282,6 +284,8 @@ class PassthroughReaderAdapter
   public:
     explicit PassthroughReaderAdapter(BufferedFile& file);
 
+    using ReaderAdapter::read;
+
     size_t read(
         void*               outbuf,
         const size_t        size) override;
@@ -305,6 +309,8 @@ class CompressedWriterAdapter
 
     ~CompressedWriterAdapter() override;
 
+    using WriterAdapter::write;
+
     size_t write(
         const void*             inbuf,
         const size_t            size) override;
@@ -324,6 +330,8 @@ class CompressedReaderAdapter
   public:
     explicit CompressedReaderAdapter(BufferedFile& file);
 
+    using ReaderAdapter::read;
+
     size_t read(
         void*                   outbuf,
         const size_t            size) override;
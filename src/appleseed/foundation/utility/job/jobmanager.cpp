@@ -31,13 +31,25 @@
 #include "jobmanager.h"
 
 // appleseed.foundation headers.
+#include "foundation/platform/snprintf.h"
+#include "foundation/platform/system.h"
+#include "foundation/platform/thread.h"
 #include "foundation/utility/foreach.h"
+#include "foundation/utility/job/ijob.h"
 #include "foundation/utility/job/jobqueue.h"
 #include "foundation/utility/job/workerthread.h"
 #include "foundation/utility/log.h"
+#include "foundation/utility/statistics.h"
+#include "foundation/utility/string.h"
+
+// Boost headers.
+#include "boost/thread/condition_variable.hpp"
+#include "boost/thread/mutex.hpp"
 
 // Standard headers.
 #include <cassert>
+#include <cstdint>
+#include <string>
 #include <vector>
 
 using namespace boost;
@@ -49,15 +61,161 @@ namespace foundation
 // JobManager class implementation.
 //
 
+namespace
+{
+    // Assign a logical core to each worker thread. Only the cores the process is allowed to run
+    // on are used. Threads are distributed over NUMA nodes in proportion to their number of such
+    // cores, and consecutive threads share the same node.
+    std::vector<size_t> assign_logical_cores(const size_t thread_count)
+    {
+        std::vector<size_t> allowed_cores = System::get_allowed_logical_cpu_cores();
+        if (allowed_cores.empty())
+        {
+            for (size_t core = 0, e = System::get_logical_cpu_core_count(); core < e; ++core)
+                allowed_cores.push_back(core);
+        }
+
+        const size_t core_count = allowed_cores.size();
+        const size_t node_count = System::get_numa_node_count();
+
+        // Group logical cores by NUMA node.
+        std::vector<std::vector<size_t>> node_cores(node_count);
+        for (const size_t core : allowed_cores)
+        {
+            const size_t node = System::get_numa_node_of_logical_cpu_core(core);
+            node_cores[node < node_count ? node : 0].push_back(core);
+        }
+
+        std::vector<size_t> thread_cores;
+        thread_cores.reserve(thread_count);
+
+        size_t preceding_core_count = 0;
+
+        for (size_t node = 0; node < node_count; ++node)
+        {
+            const std::vector<size_t>& cores = node_cores[node];
+            const size_t begin = thread_count * preceding_core_count / core_count;
+            const size_t end = thread_count * (preceding_core_count + cores.size()) / core_count;
+
+            // Wrap around if there are more threads than cores.
+            for (size_t i = begin; i < end; ++i)
+                thread_cores.push_back(cores[(i - begin) % cores.size()]);
+
+            preceding_core_count += cores.size();
+        }
+
+        assert(thread_cores.size() == thread_count);
+
+        return thread_cores;
+    }
+
+    // Number of threads that still have to execute a job given to each thread.
+    struct EachThreadBarrier
+    {
+        boost::mutex                m_mutex;
+        boost::condition_variable   m_event;
+        size_t                      m_remaining_count;
+
+        explicit EachThreadBarrier(const size_t thread_count)
+          : m_remaining_count(thread_count)
+        {
+        }
+    };
+
+    // Execute a job and keep the thread from picking up another job until all threads
+    // have executed it, so that each instance of this job is executed by a different thread.
+    class EachThreadJob
+      : public IJob
+    {
+      public:
+        EachThreadJob(
+            IJob&                   job,
+            EachThreadBarrier&      barrier)
+          : m_job(job)
+          , m_barrier(barrier)
+        {
+        }
+
+        void execute(const size_t thread_index) override
+        {
+            try
+            {
+                m_job.execute(thread_index);
+            }
+            catch (...)
+            {
+                // Release the other threads.
+                boost::mutex::scoped_lock lock(m_barrier.m_mutex);
+                m_barrier.m_remaining_count = 0;
+                m_barrier.m_event.notify_all();
+                throw;
+            }
+
+            boost::mutex::scoped_lock lock(m_barrier.m_mutex);
+
+            if (m_barrier.m_remaining_count > 0 && --m_barrier.m_remaining_count == 0)
+                m_barrier.m_event.notify_all();
+
+            while (m_barrier.m_remaining_count > 0)
+                m_barrier.m_event.wait(lock);
+        }
+
+      private:
+        IJob&                       m_job;
+        EachThreadBarrier&          m_barrier;
+    };
+}
+
 struct JobManager::Impl
 {
     typedef std::vector<WorkerThread*> WorkerThreads;
 
-    Logger&             m_logger;
-    JobQueue&           m_job_queue;
-    size_t              m_thread_count;
-    const int           m_flags;
-    WorkerThreads       m_worker_threads;
+    struct WorkerStatistics
+    {
+        std::uint64_t   m_executed_job_count;
+        std::uint64_t   m_stolen_job_count;
+        double          m_idle_time;
+
+        WorkerStatistics()
+          : m_executed_job_count(0)
+          , m_stolen_job_count(0)
+          , m_idle_time(0.0)
+        {
+        }
+
+        void add(const WorkerThread& worker)
+        {
+            m_executed_job_count += worker.get_executed_job_count();
+            m_stolen_job_count += worker.get_stolen_job_count();
+            m_idle_time += worker.get_idle_time();
+        }
+
+        void add(const WorkerStatistics& other)
+        {
+            m_executed_job_count += other.m_executed_job_count;
+            m_stolen_job_count += other.m_stolen_job_count;
+            m_idle_time += other.m_idle_time;
+        }
+
+        std::string to_string() const
+        {
+            return
+                "jobs " + pretty_uint(m_executed_job_count) + "  "
+                "stolen " + pretty_uint(m_stolen_job_count) + " (" + pretty_percent(m_stolen_job_count, m_executed_job_count) + ")  "
+                "idle " + pretty_time(m_idle_time);
+        }
+    };
+
+    typedef std::vector<WorkerStatistics> WorkerStatisticsVector;
+
+    Logger&                 m_logger;
+    JobQueue&               m_job_queue;
+    size_t                  m_thread_count;
+    const int               m_flags;
+    WorkerThreads           m_worker_threads;
+    WorkerStatisticsVector  m_stopped_worker_stats;     // statistics of worker threads that were stopped
+    std::vector<size_t>     m_thread_cores;             // logical core of each worker thread, if pinned
+    std::vector<bool>       m_thread_pinned;            // whether each worker thread was successfully pinned
 
     // Constructor.
     Impl(
@@ -69,7 +227,11 @@ struct JobManager::Impl
       , m_job_queue(job_queue)
       , m_thread_count(thread_count)
       , m_flags(flags)
+      , m_stopped_worker_stats(thread_count)
+      , m_thread_pinned(thread_count, false)
     {
+        if (m_flags & PinWorkerThreads)
+            m_thread_cores = assign_logical_cores(m_thread_count);
     }
 };
 
@@ -102,6 +264,9 @@ void JobManager::start()
     // Create worker threads if they don't already exist.
     if (impl->m_worker_threads.empty())
     {
+        // Create one queue per worker thread.
+        impl->m_job_queue.set_worker_count(impl->m_thread_count);
+
         for (size_t i = 0; i < impl->m_thread_count; ++i)
         {
             impl->m_worker_threads.push_back(
@@ -109,7 +274,8 @@ void JobManager::start()
                     i,
                     impl->m_logger,
                     impl->m_job_queue,
-                    impl->m_flags));
+                    impl->m_flags,
+                    get_thread_logical_core(i)));
         }
     }
 
@@ -120,9 +286,15 @@ void JobManager::start()
 
 void JobManager::stop()
 {
-    // Stop and delete worker threads.
-    for (each<Impl::WorkerThreads> i = impl->m_worker_threads; i; ++i)
-        delete *i;
+    // Stop and delete worker threads, keeping their statistics.
+    for (size_t i = 0, e = impl->m_worker_threads.size(); i < e; ++i)
+    {
+        impl->m_worker_threads[i]->stop();
+        impl->m_stopped_worker_stats[i].add(*impl->m_worker_threads[i]);
+        if (impl->m_worker_threads[i]->is_pinned())
+            impl->m_thread_pinned[i] = true;
+        delete impl->m_worker_threads[i];
+    }
     impl->m_worker_threads.clear();
 }
 
@@ -138,4 +310,66 @@ void JobManager::resume()
         (*i)->resume();
 }
 
+void JobManager::execute_on_each_thread(IJob& job)
+{
+    assert(impl->m_worker_threads.size() == impl->m_thread_count);
+    assert(!impl->m_job_queue.has_scheduled_or_running_jobs());
+
+    EachThreadBarrier barrier(impl->m_thread_count);
+
+    for (size_t i = 0; i < impl->m_thread_count; ++i)
+        impl->m_job_queue.schedule(new EachThreadJob(job, barrier));
+
+    impl->m_job_queue.wait_until_completion();
+}
+
+size_t JobManager::get_thread_logical_core(const size_t thread_index) const
+{
+    assert(thread_index < impl->m_thread_count);
+
+    return
+        impl->m_thread_cores.empty()
+            ? WorkerThread::NoLogicalCore
+            : impl->m_thread_cores[thread_index];
+}
+
+StatisticsVector JobManager::get_statistics() const
+{
+    Statistics stats;
+    Impl::WorkerStatistics total_stats;
+
+    for (size_t i = 0; i < impl->m_thread_count; ++i)
+    {
+        Impl::WorkerStatistics worker_stats = impl->m_stopped_worker_stats[i];
+
+        if (i < impl->m_worker_threads.size())
+            worker_stats.add(*impl->m_worker_threads[i]);
+
+        total_stats.add(worker_stats);
+
+        std::string value = worker_stats.to_string();
+
+        if (!impl->m_thread_cores.empty())
+        {
+            const bool pinned =
+                impl->m_thread_pinned[i] ||
+                (i < impl->m_worker_threads.size() && impl->m_worker_threads[i]->is_pinned());
+            const size_t core = impl->m_thread_cores[i];
+
+            value +=
+                pinned
+                    ? "  core " + to_string(core) + " (numa node " + to_string(System::get_numa_node_of_logical_cpu_core(core)) + ")"
+                    : "  not pinned";
+        }
+
+        char name[32];
+        portable_snprintf(name, sizeof(name), "thread %03lu", (long unsigned int)i);
+        stats.insert(name, value);
+    }
+
+    stats.insert("total", total_stats.to_string());
+
+    return StatisticsVector::make("job manager statistics", stats);
+}
+
 }   // namespace foundation
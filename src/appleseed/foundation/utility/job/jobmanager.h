@@ -39,8 +39,10 @@
 #include <cstddef>
 
 // Forward declarations.
+namespace foundation    { class IJob; }
 namespace foundation    { class JobQueue; }
 namespace foundation    { class Logger; }
+namespace foundation    { class StatisticsVector; }
 
 namespace foundation
 {
@@ -58,7 +60,8 @@ class APPLESEED_DLLSYMBOL JobManager
     enum Flags
     {
         KeepRunningOnEmptyQueue = 1UL << 0,     // the worker thread keeps running even if the job queue is empty
-        KeepRunningOnJobFailure = 1UL << 1      // the worker thread keeps executing jobs from the work queue even if one or more jobs failed
+        KeepRunningOnJobFailure = 1UL << 1,     // the worker thread keeps executing jobs from the work queue even if one or more jobs failed
+        PinWorkerThreads        = 1UL << 2      // pin each worker thread to a logical core, keeping consecutive threads on the same NUMA node
     };
 
     // Constructor.
@@ -87,6 +90,18 @@ class APPLESEED_DLLSYMBOL JobManager
     // Resume job execution.
     void resume();
 
+    // Execute a given job exactly once in each worker thread, and return once all executions
+    // are completed. Job execution must be started and not paused, and the job queue must be
+    // empty. This is typically used to allocate per-thread data in the thread that will use it.
+    void execute_on_each_thread(IJob& job);
+
+    // Return the logical core a given worker thread is pinned to, or ~0 if worker threads are not pinned.
+    size_t get_thread_logical_core(const size_t thread_index) const;
+
+    // Return per-thread statistics (executed and stolen jobs, idle time, pinning),
+    // accumulated since the construction of the job manager.
+    StatisticsVector get_statistics() const;
+
   private:
     struct Impl;
     Impl* impl;
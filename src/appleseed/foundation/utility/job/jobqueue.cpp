@@ -31,17 +31,21 @@
 #include "jobqueue.h"
 
 // appleseed.foundation headers.
+#include "foundation/math/rng/xorshift32.h"
+#include "foundation/platform/compiler.h"
 #include "foundation/platform/thread.h"
-#include "foundation/utility/foreach.h"
-#include "foundation/utility/iterators.h"
 #include "foundation/utility/job/abortswitch.h"
 #include "foundation/utility/job/ijob.h"
 
 // Boost headers.
+#include "boost/atomic/atomic.hpp"
 #include "boost/thread/condition_variable.hpp"
 
 // Standard headers.
 #include <cassert>
+#include <cstdint>
+#include <deque>
+#include <vector>
 
 namespace foundation
 {
@@ -50,22 +54,146 @@ namespace foundation
 // JobQueue class implementation.
 //
 
+namespace
+{
+    // Job queue and worker queue index the calling thread is bound to, if any.
+    APPLESEED_TLS const JobQueue* t_bound_job_queue = nullptr;
+    APPLESEED_TLS size_t t_bound_worker_index = 0;
+}
+
 struct JobQueue::Impl
 {
+    typedef std::deque<JobInfo> JobDeque;
+
+    struct WorkerQueue
+    {
+        Spinlock                    m_lock;
+        JobDeque                    m_jobs;
+        boost::atomic<size_t>       m_size;         // allows skipping empty queues without locking
+        Xorshift32                  m_rng;          // only used by the worker thread owning this queue
+
+        // Keep queues of different worker threads on different cache lines.
+        std::uint8_t                m_padding[64];
+
+        explicit WorkerQueue(const std::uint32_t seed)
+          : m_size(0)
+          , m_rng(seed)
+        {
+        }
+    };
+
+    std::vector<WorkerQueue*>       m_worker_queues;
+    boost::atomic<size_t>           m_next_worker_queue;
+
+    boost::atomic<size_t>           m_scheduled_job_count;
+    boost::atomic<size_t>           m_running_job_count;
+    boost::atomic<size_t>           m_pending_job_count;    // scheduled or running
+    boost::atomic<size_t>           m_sleeping_worker_count;
+
+    // Only used to put idle worker threads and threads waiting for completion to sleep.
     mutable boost::mutex            m_mutex;
     boost::condition_variable_any   m_event;
-    JobList                         m_scheduled_jobs;
-    JobList                         m_running_jobs;
 
-    static void delete_jobs(JobList& list)
+    Impl()
+      : m_next_worker_queue(0)
+      , m_scheduled_job_count(0)
+      , m_running_job_count(0)
+      , m_pending_job_count(0)
+      , m_sleeping_worker_count(0)
+    {
+        create_worker_queues(1);
+    }
+
+    ~Impl()
     {
-        for (each<JobList> i = list; i; ++i)
+        delete_worker_queues();
+    }
+
+    void create_worker_queues(const size_t count)
+    {
+        assert(m_worker_queues.empty());
+
+        m_worker_queues.reserve(count);
+
+        for (size_t i = 0; i < count; ++i)
+            m_worker_queues.push_back(new WorkerQueue(static_cast<std::uint32_t>(i + 1)));
+    }
+
+    void delete_worker_queues()
+    {
+        for (size_t i = 0, e = m_worker_queues.size(); i < e; ++i)
+            delete m_worker_queues[i];
+
+        m_worker_queues.clear();
+    }
+
+    static void delete_jobs(JobDeque& jobs)
+    {
+        for (size_t i = 0, e = jobs.size(); i < e; ++i)
         {
-            if (i->m_owned)
-                delete i->m_job;
+            if (jobs[i].m_owned)
+                delete jobs[i].m_job;
         }
 
-        list.clear();
+        jobs.clear();
+    }
+
+    void push_job(WorkerQueue& queue, const JobInfo& job_info)
+    {
+        Spinlock::ScopedLock lock(queue.m_lock);
+        queue.m_jobs.push_back(job_info);
+        ++queue.m_size;
+    }
+
+    static bool pop_front_job(WorkerQueue& queue, IJob*& job, bool& owned)
+    {
+        if (queue.m_size == 0)
+            return false;
+
+        Spinlock::ScopedLock lock(queue.m_lock);
+
+        if (queue.m_jobs.empty())
+            return false;
+
+        job = queue.m_jobs.front().m_job;
+        owned = queue.m_jobs.front().m_owned;
+        queue.m_jobs.pop_front();
+        --queue.m_size;
+
+        return true;
+    }
+
+    static bool pop_back_job(WorkerQueue& queue, IJob*& job, bool& owned)
+    {
+        if (queue.m_size == 0)
+            return false;
+
+        Spinlock::ScopedLock lock(queue.m_lock);
+
+        if (queue.m_jobs.empty())
+            return false;
+
+        job = queue.m_jobs.back().m_job;
+        owned = queue.m_jobs.back().m_owned;
+        queue.m_jobs.pop_back();
+        --queue.m_size;
+
+        return true;
+    }
+
+    RunningJobInfo make_running(IJob* job, const bool owned, const bool stolen)
+    {
+        // Increment the number of running jobs first so that a job is always counted.
+        ++m_running_job_count;
+        --m_scheduled_job_count;
+
+        return RunningJobInfo(JobInfo(job, owned), stolen);
+    }
+
+    void notify()
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_event.notify_all();
     }
 };
 
@@ -79,76 +207,91 @@ JobQueue::~JobQueue()
     // We assume that worker threads are not running, so we don't lock.
 
     // At this point, no job must be running.
-    assert(impl->m_running_jobs.empty());
+    assert(impl->m_running_job_count == 0);
 
     // Delete all scheduled jobs that the queue owns.
-    Impl::delete_jobs(impl->m_scheduled_jobs);
+    for (size_t i = 0, e = impl->m_worker_queues.size(); i < e; ++i)
+        Impl::delete_jobs(impl->m_worker_queues[i]->m_jobs);
 
     delete impl;
 }
 
 void JobQueue::clear_scheduled_jobs()
 {
-    boost::mutex::scoped_lock lock(impl->m_mutex);
+    for (size_t i = 0, e = impl->m_worker_queues.size(); i < e; ++i)
+    {
+        Impl::WorkerQueue& queue = *impl->m_worker_queues[i];
+        Impl::JobDeque jobs;
 
-    impl->delete_jobs(impl->m_scheduled_jobs);
+        {
+            Spinlock::ScopedLock lock(queue.m_lock);
+            jobs.swap(queue.m_jobs);
+            queue.m_size = 0;
+        }
+
+        impl->m_scheduled_job_count -= jobs.size();
+        impl->m_pending_job_count -= jobs.size();
+
+        Impl::delete_jobs(jobs);
+    }
 
     // Notify worker threads that all scheduled jobs are gone.
-    impl->m_event.notify_all();
+    impl->notify();
 }
 
 bool JobQueue::has_scheduled_jobs() const
 {
-    boost::mutex::scoped_lock lock(impl->m_mutex);
-
-    return !impl->m_scheduled_jobs.empty();
+    return impl->m_scheduled_job_count > 0;
 }
 
 bool JobQueue::has_running_jobs() const
 {
-    boost::mutex::scoped_lock lock(impl->m_mutex);
-
-    return !impl->m_running_jobs.empty();
+    return impl->m_running_job_count > 0;
 }
 
 bool JobQueue::has_scheduled_or_running_jobs() const
 {
-    boost::mutex::scoped_lock lock(impl->m_mutex);
-
-    return !impl->m_scheduled_jobs.empty() || !impl->m_running_jobs.empty();
+    return impl->m_pending_job_count > 0;
 }
 
 size_t JobQueue::get_scheduled_job_count() const
 {
-    boost::mutex::scoped_lock lock(impl->m_mutex);
-
-    return impl->m_scheduled_jobs.size();
+    return impl->m_scheduled_job_count;
 }
 
 size_t JobQueue::get_running_job_count() const
 {
-    boost::mutex::scoped_lock lock(impl->m_mutex);
-
-    return impl->m_running_jobs.size();
+    return impl->m_running_job_count;
 }
 
 size_t JobQueue::get_total_job_count() const
 {
-    boost::mutex::scoped_lock lock(impl->m_mutex);
-
-    return impl->m_scheduled_jobs.size() + impl->m_running_jobs.size();
+    return impl->m_pending_job_count;
 }
 
 void JobQueue::schedule(IJob* job, const bool transfer_ownership)
 {
     assert(job);
 
-    boost::mutex::scoped_lock lock(impl->m_mutex);
-
-    impl->m_scheduled_jobs.push_back(JobInfo(job, transfer_ownership));
-
-    // Notify worker threads that a new scheduled job is available.
-    impl->m_event.notify_all();
+    // Jobs scheduled by a worker thread go to its own queue, others are distributed.
+    const size_t worker_queue_count = impl->m_worker_queues.size();
+    const size_t worker_queue_index =
+        t_bound_job_queue == this
+            ? t_bound_worker_index
+            : impl->m_next_worker_queue++ % worker_queue_count;
+    assert(worker_queue_index < worker_queue_count);
+
+    // Count the job before it becomes visible so that counters never underflow.
+    ++impl->m_pending_job_count;
+    ++impl->m_scheduled_job_count;
+
+    impl->push_job(
+        *impl->m_worker_queues[worker_queue_index],
+        JobInfo(job, transfer_ownership));
+
+    // Notify sleeping worker threads that a new scheduled job is available.
+    if (impl->m_sleeping_worker_count > 0)
+        impl->notify();
 }
 
 void JobQueue::wait_until_completion()
@@ -156,65 +299,144 @@ void JobQueue::wait_until_completion()
     boost::mutex::scoped_lock lock(impl->m_mutex);
 
     // Wait until there is no more scheduled or running jobs.
-    while (!impl->m_scheduled_jobs.empty() || !impl->m_running_jobs.empty())
+    while (impl->m_pending_job_count > 0)
         impl->m_event.wait(lock);
 }
 
-JobQueue::RunningJobInfo JobQueue::acquire_scheduled_job()
+void JobQueue::set_worker_count(const size_t worker_count)
 {
-    boost::mutex::scoped_lock lock(impl->m_mutex);
+    const size_t worker_queue_count = worker_count > 0 ? worker_count : 1;
+
+    if (worker_queue_count == impl->m_worker_queues.size())
+        return;
+
+    // Collect scheduled jobs in their scheduling order, as far as it can be recovered.
+    Impl::JobDeque jobs;
+    bool found_jobs = true;
+    for (size_t rank = 0; found_jobs; ++rank)
+    {
+        found_jobs = false;
+
+        for (size_t i = 0, e = impl->m_worker_queues.size(); i < e; ++i)
+        {
+            const Impl::JobDeque& queue_jobs = impl->m_worker_queues[i]->m_jobs;
 
-    return acquire_scheduled_job_no_lock();
+            if (rank < queue_jobs.size())
+            {
+                jobs.push_back(queue_jobs[rank]);
+                found_jobs = true;
+            }
+        }
+    }
+
+    // Recreate the worker queues and redistribute the jobs.
+    impl->delete_worker_queues();
+    impl->create_worker_queues(worker_queue_count);
+    impl->m_next_worker_queue = 0;
+
+    for (size_t i = 0, e = jobs.size(); i < e; ++i)
+    {
+        impl->push_job(
+            *impl->m_worker_queues[impl->m_next_worker_queue++ % worker_queue_count],
+            jobs[i]);
+    }
 }
 
-JobQueue::RunningJobInfo JobQueue::acquire_scheduled_job_no_lock()
+void JobQueue::bind_worker_thread(const size_t worker_index)
 {
-    // Bail out if there is no scheduled job.
-    if (impl->m_scheduled_jobs.empty())
-        return RunningJobInfo(JobInfo(nullptr, false), impl->m_running_jobs.end());
+    assert(worker_index < impl->m_worker_queues.size());
+
+    t_bound_job_queue = this;
+    t_bound_worker_index = worker_index;
+}
 
-    // Move the next scheduled job to the end of the queue of running jobs.
-    const JobInfo job_info = impl->m_scheduled_jobs.front();
-    impl->m_scheduled_jobs.pop_front();
-    impl->m_running_jobs.push_back(job_info);
+JobQueue::RunningJobInfo JobQueue::acquire_scheduled_job()
+{
+    IJob* job;
+    bool owned;
 
-    // Notify worker threads that a job has moved from the scheduled to the running state.
-    impl->m_event.notify_all();
+    for (size_t i = 0, e = impl->m_worker_queues.size(); i < e; ++i)
+    {
+        if (Impl::pop_front_job(*impl->m_worker_queues[i], job, owned))
+            return impl->make_running(job, owned, false);
+    }
 
-    return RunningJobInfo(job_info, pred(impl->m_running_jobs.end()));
+    return RunningJobInfo(JobInfo(nullptr, false), false);
 }
 
-JobQueue::RunningJobInfo JobQueue::wait_for_scheduled_job(AbortSwitch& abort_switch)
+JobQueue::RunningJobInfo JobQueue::acquire_scheduled_job(const size_t worker_index)
 {
-    boost::mutex::scoped_lock lock(impl->m_mutex);
+    const size_t worker_queue_count = impl->m_worker_queues.size();
+    assert(worker_index < worker_queue_count);
 
-    // Wait for a scheduled job to be available.
-    while (!abort_switch.is_aborted() && impl->m_scheduled_jobs.empty())    // order matters
-        impl->m_event.wait(lock);
+    Impl::WorkerQueue& own_queue = *impl->m_worker_queues[worker_index];
+
+    IJob* job;
+    bool owned;
 
-    return acquire_scheduled_job_no_lock();
+    // Take the oldest job from the worker's own queue.
+    if (Impl::pop_front_job(own_queue, job, owned))
+        return impl->make_running(job, owned, false);
+
+    // Steal the newest job from another worker's queue, starting at a random one.
+    if (worker_queue_count > 1)
+    {
+        const size_t first_victim = own_queue.m_rng.rand_uint32() % worker_queue_count;
+
+        for (size_t i = 0; i < worker_queue_count; ++i)
+        {
+            const size_t victim = (first_victim + i) % worker_queue_count;
+
+            if (victim != worker_index &&
+                Impl::pop_back_job(*impl->m_worker_queues[victim], job, owned))
+                return impl->make_running(job, owned, true);
+        }
+    }
+
+    return RunningJobInfo(JobInfo(nullptr, false), false);
 }
 
-void JobQueue::retire_running_job(const RunningJobInfo& running_job_info)
+JobQueue::RunningJobInfo JobQueue::wait_for_scheduled_job(
+    const size_t    worker_index,
+    AbortSwitch&    abort_switch)
 {
-    boost::mutex::scoped_lock lock(impl->m_mutex);
+    while (true)
+    {
+        const RunningJobInfo running_job_info = acquire_scheduled_job(worker_index);
+
+        if (running_job_info.first.m_job)
+            return running_job_info;
+
+        boost::mutex::scoped_lock lock(impl->m_mutex);
+
+        if (abort_switch.is_aborted())
+            return running_job_info;
 
-    // Remove the job from the running list.
-    impl->m_running_jobs.erase(running_job_info.second);
+        // Sleep until a job is scheduled. The job could have been scheduled right
+        // after our last attempt, but then the scheduling thread sees us sleeping.
+        ++impl->m_sleeping_worker_count;
+        if (impl->m_scheduled_job_count == 0)
+            impl->m_event.wait(lock);
+        --impl->m_sleeping_worker_count;
+    }
+}
 
+void JobQueue::retire_running_job(const RunningJobInfo& running_job_info)
+{
     // Delete the job.
     if (running_job_info.first.m_owned)
         delete running_job_info.first.m_job;
 
-    // Notify worker threads that a scheduled job was retired.
-    impl->m_event.notify_all();
+    --impl->m_running_job_count;
+
+    // Notify threads waiting for completion that the last job was retired.
+    if (--impl->m_pending_job_count == 0)
+        impl->notify();
 }
 
 void JobQueue::signal_event()
 {
-    boost::mutex::scoped_lock lock(impl->m_mutex);
-
-    impl->m_event.notify_all();
+    impl->notify();
 }
 
 }   // namespace foundation
@@ -31,7 +31,6 @@
 
 // appleseed.foundation headers.
 #include "foundation/core/concepts/noncopyable.h"
-#include "foundation/utility/poolallocator.h"
 #include "foundation/utility/test.h"
 
 // appleseed.main headers.
@@ -39,7 +38,6 @@
 
 // Standard headers.
 #include <cstddef>
-#include <list>
 #include <utility>
 
 // Forward declarations.
@@ -49,6 +47,7 @@ namespace foundation    { class IJob; }
 // Unit test case declarations.
 DECLARE_TEST_CASE(Foundation_Utility_Job_JobQueue, AcquireScheduledJobWorksOnEmptyJobQueue);
 DECLARE_TEST_CASE(Foundation_Utility_Job_JobQueue, AcquireScheduledJobWorksOnNonEmptyJobQueue);
+DECLARE_TEST_CASE(Foundation_Utility_Job_JobQueue, AcquireScheduledJobReturnsJobsInSchedulingOrder);
 DECLARE_TEST_CASE(Foundation_Utility_Job_JobQueue, RetiringRunningJobWorks);
 DECLARE_TEST_CASE(Foundation_Utility_Job_JobQueue, RunningJobOwnedByQueueIsDestructedWhenRetired);
 DECLARE_TEST_CASE(Foundation_Utility_Job_JobQueue, RunningJobNotOwnedByQueueIsNotDestructedWhenRetired);
@@ -66,6 +65,13 @@ namespace foundation
 //   - scheduled: the job was inserted into the job queue, but hasn't yet been executed
 //   - running: the job is currently being executed
 //
+// Scheduled jobs are stored in one double-ended queue per worker thread, each with its
+// own lock. Jobs scheduled from outside the worker threads are distributed over these
+// queues in a round-robin fashion, while jobs scheduled by a running job are appended
+// to the queue of the worker thread executing it. Worker threads take jobs from the
+// front of their own queue, and steal jobs from the back of the queue of a randomly
+// chosen worker thread when their own queue is empty.
+//
 
 class APPLESEED_DLLSYMBOL JobQueue
   : public NonCopyable
@@ -106,6 +112,7 @@ class APPLESEED_DLLSYMBOL JobQueue
     void wait_until_completion();
 
   private:
+    friend class JobManager;
     friend class WorkerThread;
 
     struct Impl;
@@ -113,6 +120,7 @@ class APPLESEED_DLLSYMBOL JobQueue
 
     GRANT_ACCESS_TO_TEST_CASE(Foundation_Utility_Job_JobQueue, AcquireScheduledJobWorksOnEmptyJobQueue);
     GRANT_ACCESS_TO_TEST_CASE(Foundation_Utility_Job_JobQueue, AcquireScheduledJobWorksOnNonEmptyJobQueue);
+    GRANT_ACCESS_TO_TEST_CASE(Foundation_Utility_Job_JobQueue, AcquireScheduledJobReturnsJobsInSchedulingOrder);
     GRANT_ACCESS_TO_TEST_CASE(Foundation_Utility_Job_JobQueue, RetiringRunningJobWorks);
     GRANT_ACCESS_TO_TEST_CASE(Foundation_Utility_Job_JobQueue, RunningJobOwnedByQueueIsDestructedWhenRetired);
     GRANT_ACCESS_TO_TEST_CASE(Foundation_Utility_Job_JobQueue, RunningJobNotOwnedByQueueIsNotDestructedWhenRetired);
@@ -129,18 +137,28 @@ class APPLESEED_DLLSYMBOL JobQueue
         }
     };
 
-    typedef std::list<JobInfo, PoolAllocator<JobInfo, 64>> JobList;
+    // A running job, and whether it was stolen from the queue of another worker thread.
+    typedef std::pair<JobInfo, bool> RunningJobInfo;
+
+    // Set the number of worker threads, i.e. the number of per-thread queues.
+    // Scheduled jobs are redistributed. Must not be called while worker threads are running.
+    void set_worker_count(const size_t worker_count);
 
-    typedef std::pair<JobInfo, JobList::iterator> RunningJobInfo;
+    // Bind the calling thread to a given worker queue so that the jobs it schedules
+    // are appended to this queue.
+    void bind_worker_thread(const size_t worker_index);
 
     // Acquire a scheduled job and change its state from 'scheduled' to 'running'.
     RunningJobInfo acquire_scheduled_job();
 
-    // Acquire a scheduled job without any locking.
-    RunningJobInfo acquire_scheduled_job_no_lock();
+    // Acquire a scheduled job on behalf of a given worker thread, stealing it
+    // from another worker thread if the worker's own queue is empty.
+    RunningJobInfo acquire_scheduled_job(const size_t worker_index);
 
     // Wait for a scheduled job to be available.
-    RunningJobInfo wait_for_scheduled_job(AbortSwitch& abort_switch);
+    RunningJobInfo wait_for_scheduled_job(
+        const size_t    worker_index,
+        AbortSwitch&    abort_switch);
 
     // Retire a running job. The job is deleted if it is owned by the queue.
     void retire_running_job(const RunningJobInfo& running_job_info);
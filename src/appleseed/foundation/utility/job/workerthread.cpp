@@ -54,17 +54,26 @@ namespace foundation
 // WorkerThread class implementation.
 //
 
+const size_t WorkerThread::NoLogicalCore;
+
 WorkerThread::WorkerThread(
     const size_t    index,
     Logger&         logger,
     JobQueue&       job_queue,
-    const int       flags)
+    const int       flags,
+    const size_t    logical_core)
   : m_index(index)
   , m_logger(logger)
   , m_job_queue(job_queue)
   , m_flags(flags)
+  , m_logical_core(logical_core)
   , m_thread_func(*this)
   , m_thread(nullptr)
+  , m_timer_frequency(m_timer.frequency())
+  , m_executed_job_count(0)
+  , m_stolen_job_count(0)
+  , m_idle_ticks(0)
+  , m_pinned(false)
 {
 }
 
@@ -128,6 +137,28 @@ void WorkerThread::resume()
     m_pause_event.notify_all();
 }
 
+std::uint64_t WorkerThread::get_executed_job_count() const
+{
+    return m_executed_job_count.load(boost::memory_order_relaxed);
+}
+
+std::uint64_t WorkerThread::get_stolen_job_count() const
+{
+    return m_stolen_job_count.load(boost::memory_order_relaxed);
+}
+
+double WorkerThread::get_idle_time() const
+{
+    return
+        static_cast<double>(m_idle_ticks.load(boost::memory_order_relaxed)) /
+        static_cast<double>(m_timer_frequency);
+}
+
+bool WorkerThread::is_pinned() const
+{
+    return m_pinned;
+}
+
 void WorkerThread::set_thread_name()
 {
     char thread_name[16];
@@ -135,9 +166,30 @@ void WorkerThread::set_thread_name()
     set_current_thread_name(thread_name);
 }
 
+void WorkerThread::pin_to_logical_core()
+{
+    if (m_logical_core == NoLogicalCore)
+        return;
+
+    m_pinned = set_current_thread_affinity(m_logical_core);
+
+    if (!m_pinned)
+    {
+        LOG_WARNING(
+            m_logger,
+            "worker thread " FMT_SIZE_T ": failed to pin thread to logical core " FMT_SIZE_T ".",
+            m_index,
+            m_logical_core);
+    }
+}
+
 void WorkerThread::run()
 {
     set_thread_name();
+    pin_to_logical_core();
+
+    // Jobs scheduled by jobs running in this thread go to this thread's own queue.
+    m_job_queue.bind_worker_thread(m_index);
 
 #if defined APPLESEED_WITH_EMBREE && defined APPLESEED_USE_SSE42
 
@@ -169,8 +221,10 @@ void WorkerThread::run()
         }
 
         // Acquire a job.
+        const std::uint64_t wait_begin = m_timer.read();
         const JobQueue::RunningJobInfo running_job_info =
-            m_job_queue.wait_for_scheduled_job(m_abort_switch);
+            m_job_queue.wait_for_scheduled_job(m_index, m_abort_switch);
+        m_idle_ticks.fetch_add(m_timer.read() - wait_begin, boost::memory_order_relaxed);
 
         // Handle the case where the job queue is empty.
         if (running_job_info.first.m_job == nullptr)
@@ -187,6 +241,11 @@ void WorkerThread::run()
             }
         }
 
+        // Update statistics.
+        m_executed_job_count.fetch_add(1, boost::memory_order_relaxed);
+        if (running_job_info.second)
+            m_stolen_job_count.fetch_add(1, boost::memory_order_relaxed);
+
         // Execute the job.
         const bool success = execute_job(*running_job_info.first.m_job);
 
@@ -31,14 +31,17 @@
 
 // appleseed.foundation headers.
 #include "foundation/core/concepts/noncopyable.h"
+#include "foundation/platform/defaulttimers.h"
 #include "foundation/platform/thread.h"
 #include "foundation/utility/job/abortswitch.h"
 
 // Boost headers.
+#include "boost/atomic/atomic.hpp"
 #include "boost/thread/condition_variable.hpp"
 
 // Standard headers.
 #include <cstddef>
+#include <cstdint>
 
 // Forward declarations.
 namespace boost         { class thread; }
@@ -57,12 +60,16 @@ class WorkerThread
   : public NonCopyable
 {
   public:
+    // Value of the logical core when the worker thread is not pinned to a core.
+    static const size_t NoLogicalCore = ~size_t(0);
+
     // Constructor.
     WorkerThread(
         const size_t    index,
         Logger&         logger,
         JobQueue&       job_queue,
-        const int       flags);     // see foundation::JobManager::Flags
+        const int       flags,      // see foundation::JobManager::Flags
+        const size_t    logical_core = NoLogicalCore);
 
     // Destructor.
     ~WorkerThread();
@@ -79,6 +86,18 @@ class WorkerThread
     // Resume the worker thread.
     void resume();
 
+    // Return the number of jobs executed by this worker thread.
+    std::uint64_t get_executed_job_count() const;
+
+    // Return the number of jobs this worker thread stole from other worker threads.
+    std::uint64_t get_stolen_job_count() const;
+
+    // Return the time in seconds this worker thread spent waiting for jobs.
+    double get_idle_time() const;
+
+    // Return whether the worker thread was successfully pinned to its logical core.
+    bool is_pinned() const;
+
   private:
     // A helper class that encapsulates the run() method of the worker thread
     // into an object that can be passed to the constructor of boost::thread.
@@ -101,6 +120,7 @@ class WorkerThread
     Logger&                         m_logger;
     JobQueue&                       m_job_queue;
     const int                       m_flags;
+    const size_t                    m_logical_core;
 
     AbortSwitch                     m_abort_switch;
 
@@ -111,6 +131,15 @@ class WorkerThread
     boost::condition_variable_any   m_pause_event;
     boost::mutex                    m_pause_mutex;
 
+    DefaultWallclockTimer           m_timer;
+    const std::uint64_t             m_timer_frequency;
+    boost::atomic<std::uint64_t>    m_executed_job_count;
+    boost::atomic<std::uint64_t>    m_stolen_job_count;
+    boost::atomic<std::uint64_t>    m_idle_ticks;
+    boost::atomic<bool>             m_pinned;
+
+    void pin_to_logical_core();
+
     void set_thread_name();
 
     // Main line of the worker thread.
@@ -50,4 +50,5 @@
 #include "renderer/modeling/aov/pixelvariationaov.h"
 #include "renderer/modeling/aov/positionaov.h"
 #include "renderer/modeling/aov/screenspacevelocityaov.h"
+#include "renderer/modeling/aov/texturecostaov.h"
 #include "renderer/modeling/aov/uvaov.h"
@@ -277,6 +277,11 @@ IRendererController::Status CPURenderDevice::render_frame(
 
     assert(!frame_renderer.is_rendering());
 
+    // Report texture usage once the frame is done with.
+    if (status == IRendererController::TerminateRendering ||
+        status == IRendererController::AbortRendering)
+        m_texture_store.write_usage_report();
+
     return status;
 }
 
@@ -38,6 +38,7 @@
 #include "renderer/modeling/entity/entityvector.h"
 #include "renderer/modeling/object/curveobject.h"
 #include "renderer/modeling/object/meshobject.h"
+#include "renderer/modeling/object/meshobjectoperations.h"
 #include "renderer/modeling/object/object.h"
 #include "renderer/modeling/object/proceduralobject.h"
 #include "renderer/modeling/scene/assemblyinstance.h"
@@ -47,6 +48,7 @@
 
 // appleseed.foundation headers.
 #include "foundation/math/beziercurve.h"
+#include "foundation/math/hash.h"
 #include "foundation/math/permutation.h"
 #include "foundation/math/ray.h"
 #include "foundation/math/transform.h"
@@ -56,19 +58,27 @@
 #include "foundation/utility/alignedallocator.h"
 #include "foundation/utility/foreach.h"
 #include "foundation/utility/lazy.h"
+#include "foundation/utility/murmurhash.h"
 #include "foundation/utility/siphash.h"
 #include "foundation/utility/statistics.h"
 #include "foundation/utility/string.h"
 
+// Boost headers.
+#include "boost/filesystem.hpp"
+
 // Standard headers.
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <cstring>
+#include <iomanip>
 #include <set>
+#include <sstream>
+#include <string>
 #include <utility>
 
 using namespace foundation;
+namespace bf = boost::filesystem;
 
 namespace renderer
 {
@@ -80,9 +90,12 @@ namespace renderer
 AssemblyTree::AssemblyTree(const Scene& scene)
   : TreeType(AlignedAllocator<void>(System::get_l1_data_cache_line_size()))
   , m_scene(scene)
+  , m_triangle_tree_node_width(TriangleTreeDefaultNodeWidth)
+  , m_triangle_tree_single_precision(TriangleTreeDefaultSinglePrecision)
+  , m_quantized_bvh_nodes(TriangleTreeDefaultQuantizedNodes)
+  , m_dirty(false)
 #ifdef APPLESEED_WITH_EMBREE
   , m_use_embree(false)
-  , m_dirty(false)
 #endif
 {
 }
@@ -268,16 +281,19 @@ void AssemblyTree::update_tree_hierarchy()
 
         if (stored_version_it != m_assembly_versions.end())
         {
-            if ((stored_version_it->second == current_version_id)
-#ifdef APPLESEED_WITH_EMBREE
-                && !m_dirty
-#endif
-                )
+            if (stored_version_it->second == current_version_id && !m_dirty)
             {
                 // The child trees of this assembly are up-to-date.
                 continue;
             }
 
+            // Only vertices may have moved: try to refit the existing child trees.
+            if (!m_dirty && refit_child_trees(assembly))
+            {
+                m_assembly_versions[assembly.get_uid()] = current_version_id;
+                continue;
+            }
+
             // The child trees of this assembly are out-of-date: delete them.
             delete_child_trees(assembly.get_uid());
         }
@@ -289,12 +305,16 @@ void AssemblyTree::update_tree_hierarchy()
         m_assembly_versions[assembly.get_uid()] = current_version_id;
     }
 
+    // Make sure shared triangle trees are still owned by one of the assemblies referencing them.
+    rebuild_orphaned_child_trees(assemblies);
+
+    // Mesh objects may change before the next update.
+    m_mesh_signatures.clear();
+
     // Update child trees.
     update_triangle_trees();
 
-#ifdef APPLESEED_WITH_EMBREE
     m_dirty = false;
-#endif
 }
 
 void AssemblyTree::collect_unique_assemblies(AssemblyVector& assemblies) const
@@ -334,6 +354,39 @@ void AssemblyTree::delete_unused_child_trees(const AssemblyVector& assemblies)
     }
 }
 
+void AssemblyTree::rebuild_orphaned_child_trees(const AssemblyVector& assemblies)
+{
+    // A triangle tree shared by several assemblies refers to the assembly it was built from.
+    // Once that assembly has been deleted or has got a new tree, the others need new trees too.
+    AssemblyVector orphaned_assemblies;
+
+    for (const_each<AssemblyVector> i = assemblies; i; ++i)
+    {
+        const UniqueID assembly_uid = (*i)->get_uid();
+
+        const TriangleTreeContainer::const_iterator it = m_triangle_trees.find(assembly_uid);
+        if (it == m_triangle_trees.end())
+            continue;
+
+        const TriangleTreeOwnerMap::const_iterator owner_it = m_triangle_tree_owners.find(it->second);
+        assert(owner_it != m_triangle_tree_owners.end());
+
+        if (owner_it->second == assembly_uid)
+            continue;
+
+        const TriangleTreeContainer::const_iterator owner_tree_it = m_triangle_trees.find(owner_it->second);
+        if (owner_tree_it == m_triangle_trees.end() || owner_tree_it->second != it->second)
+            orphaned_assemblies.push_back(*i);
+    }
+
+    // Release all orphaned trees before creating new ones, otherwise they would be shared again.
+    for (const_each<AssemblyVector> i = orphaned_assemblies; i; ++i)
+        delete_child_trees((*i)->get_uid());
+
+    for (const_each<AssemblyVector> i = orphaned_assemblies; i; ++i)
+        create_child_trees(**i);
+}
+
 namespace
 {
     bool has_object_instances_of_type(const Assembly& assembly, const char* model)
@@ -367,6 +420,71 @@ namespace
 
         return hash;
     }
+
+    std::uint64_t hash_assembly_mesh_geometry(
+        const Assembly&                         assembly,
+        std::map<UniqueID, std::uint64_t>&      mesh_signatures)
+    {
+        std::uint64_t hash = 0;
+
+        for (size_t i = 0, e = assembly.object_instances().size(); i < e; ++i)
+        {
+            const ObjectInstance* object_instance = assembly.object_instances().get_by_index(i);
+            assert(object_instance);
+
+            const Object& object = object_instance->get_object();
+
+            if (strcmp(object.get_model(), MeshObjectFactory().get_model()) != 0)
+                continue;
+
+            // Hash the content of each mesh object only once, no matter how many times it is instantiated.
+            std::map<UniqueID, std::uint64_t>::const_iterator signature_it = mesh_signatures.find(object.get_uid());
+            if (signature_it == mesh_signatures.end())
+            {
+                MurmurHash signature;
+                compute_signature(signature, static_cast<const MeshObject&>(object));
+                signature_it =
+                    mesh_signatures.insert(
+                        std::make_pair(
+                            object.get_uid(),
+                            combine_hashes(signature.h1(), signature.h2()))).first;
+            }
+
+            // Triangles refer to their object instance by index, and inherit its transform and visibility flags.
+            std::uint64_t values[4 + 16];
+            values[0] = hash;
+            values[1] = signature_it->second;
+            values[2] = static_cast<std::uint64_t>(i);
+            values[3] = static_cast<std::uint64_t>(object_instance->get_vis_flags());
+            memcpy(&values[4], &object_instance->get_transform().get_local_to_parent()[0], 16 * 8);
+            hash = siphash24(&values, sizeof(values));
+        }
+
+        return hash;
+    }
+
+    std::uint64_t hash_acceleration_structure_params(const Assembly& assembly)
+    {
+        const StringDictionary& params =
+            assembly.get_parameters().child("acceleration_structure").strings();
+
+        MurmurHash hash;
+
+        for (const_each<StringDictionary> i = params; i; ++i)
+        {
+            hash.append(i->key());
+            hash.append(i->value());
+        }
+
+        return combine_hashes(hash.h1(), hash.h2());
+    }
+
+    std::string make_bvh_cache_filename(const std::uint64_t key, const char* extension)
+    {
+        std::stringstream sstr;
+        sstr << std::hex << std::setw(16) << std::setfill('0') << key << '.' << extension;
+        return sstr.str();
+    }
 }
 
 void AssemblyTree::create_child_trees(const Assembly& assembly)
@@ -391,9 +509,25 @@ void AssemblyTree::create_child_trees(const Assembly& assembly)
     }
 }
 
+std::uint64_t AssemblyTree::compute_triangle_tree_key(const Assembly& assembly) const
+{
+    // Assemblies with the same mesh geometry share a single triangle tree, unless they were
+    // built with different parameters, node widths, precisions or node formats.
+    return
+        combine_hashes(
+            combine_hashes(
+                hash_assembly_mesh_geometry(assembly, m_mesh_signatures),
+                hash_acceleration_structure_params(assembly)),
+            combine_hashes(
+                static_cast<std::uint64_t>(m_triangle_tree_node_width),
+                combine_hashes(
+                    static_cast<std::uint64_t>(m_triangle_tree_single_precision),
+                    static_cast<std::uint64_t>(m_quantized_bvh_nodes))));
+}
+
 void AssemblyTree::create_triangle_tree(const Assembly& assembly)
 {
-    const std::uint64_t hash = hash_assembly_geometry(assembly, MeshObjectFactory().get_model());
+    const std::uint64_t hash = compute_triangle_tree_key(assembly);
     Lazy<TriangleTree>* tree = m_triangle_tree_repository.acquire(hash);
 
     if (tree == nullptr)
@@ -404,16 +538,29 @@ void AssemblyTree::create_triangle_tree(const Assembly& assembly)
                 assembly.object_instances().begin(),
                 assembly.object_instances().end());
 
+        // Cached trees are identified by the same key as in the repository.
+        const std::string cache_filepath =
+            m_bvh_cache_directory.empty()
+                ? std::string()
+                : (bf::path(m_bvh_cache_directory) / make_bvh_cache_filename(hash, "triangletree")).string();
+
         std::unique_ptr<ILazyFactory<TriangleTree>> triangle_tree_factory(
             new TriangleTreeFactory(
                 TriangleTree::Arguments(
                     m_scene,
                     assembly.get_uid(),
                     assembly_bbox,
-                    assembly)));
+                    assembly,
+                    m_triangle_tree_node_width,
+                    m_triangle_tree_single_precision,
+                    m_quantized_bvh_nodes,
+                    cache_filepath,
+                    hash_assembly_mesh_geometry(assembly, m_mesh_signatures),
+                    hash_acceleration_structure_params(assembly))));
 
         tree = new Lazy<TriangleTree>(std::move(triangle_tree_factory));
         m_triangle_tree_repository.insert(hash, tree);
+        m_triangle_tree_owners.insert(std::make_pair(tree, assembly.get_uid()));
     }
 
     m_triangle_trees.insert(std::make_pair(assembly.get_uid(), tree));
@@ -421,7 +568,11 @@ void AssemblyTree::create_triangle_tree(const Assembly& assembly)
 
 void AssemblyTree::create_curve_tree(const Assembly& assembly)
 {
-    const std::uint64_t hash = hash_assembly_geometry(assembly, CurveObjectFactory().get_model());
+    // Trees with different node formats cannot be shared.
+    const std::uint64_t hash =
+        combine_hashes(
+            hash_assembly_geometry(assembly, CurveObjectFactory().get_model()),
+            static_cast<std::uint64_t>(m_quantized_bvh_nodes));
     Lazy<CurveTree>* tree = m_curve_tree_repository.acquire(hash);
 
     if (tree == nullptr)
@@ -438,7 +589,8 @@ void AssemblyTree::create_curve_tree(const Assembly& assembly)
                     m_scene,
                     assembly.get_uid(),
                     assembly_bbox,
-                    assembly)));
+                    assembly,
+                    m_quantized_bvh_nodes)));
 
         tree = new Lazy<CurveTree>(std::move(curve_tree_factory));
         m_curve_tree_repository.insert(hash, tree);
@@ -447,6 +599,61 @@ void AssemblyTree::create_curve_tree(const Assembly& assembly)
     m_curve_trees.insert(std::make_pair(assembly.get_uid(), tree));
 }
 
+size_t AssemblyTree::get_triangle_tree_node_width() const
+{
+    return m_triangle_tree_node_width;
+}
+
+void AssemblyTree::set_triangle_tree_node_width(const size_t value)
+{
+    assert(value == 2 || value == 4 || value == 8);
+
+    if (value != m_triangle_tree_node_width)
+    {
+        m_dirty = true;
+        m_triangle_tree_node_width = value;
+    }
+}
+
+bool AssemblyTree::get_triangle_tree_single_precision() const
+{
+    return m_triangle_tree_single_precision;
+}
+
+void AssemblyTree::set_triangle_tree_single_precision(const bool value)
+{
+    if (value != m_triangle_tree_single_precision)
+    {
+        m_dirty = true;
+        m_triangle_tree_single_precision = value;
+    }
+}
+
+bool AssemblyTree::get_quantized_bvh_nodes() const
+{
+    return m_quantized_bvh_nodes;
+}
+
+void AssemblyTree::set_quantized_bvh_nodes(const bool value)
+{
+    if (value != m_quantized_bvh_nodes)
+    {
+        m_dirty = true;
+        m_quantized_bvh_nodes = value;
+    }
+}
+
+const std::string& AssemblyTree::get_bvh_cache_directory() const
+{
+    return m_bvh_cache_directory;
+}
+
+void AssemblyTree::set_bvh_cache_directory(const std::string& path)
+{
+    // Existing trees remain valid, only trees built from now on are affected.
+    m_bvh_cache_directory = path;
+}
+
 #ifdef APPLESEED_WITH_EMBREE
 
 bool AssemblyTree::use_embree() const
@@ -496,6 +703,52 @@ void AssemblyTree::delete_embree_scene(const UniqueID assembly_id)
 
 #endif
 
+bool AssemblyTree::refit_child_trees(const Assembly& assembly)
+{
+#ifdef APPLESEED_WITH_EMBREE
+
+    if (use_embree())
+        return false;
+
+#endif
+
+    if (!refit_triangle_tree(assembly))
+        return false;
+
+    // Curve trees are always rebuilt.
+    delete_curve_tree(assembly.get_uid());
+    if (has_object_instances_of_type(assembly, CurveObjectFactory().get_model()))
+        create_curve_tree(assembly);
+
+    return true;
+}
+
+bool AssemblyTree::refit_triangle_tree(const Assembly& assembly)
+{
+    const TriangleTreeContainer::iterator it = m_triangle_trees.find(assembly.get_uid());
+    if (it == m_triangle_trees.end())
+        return false;
+
+    // Don't refit trees shared with other assemblies, or built from another assembly.
+    if (m_triangle_tree_repository.get_ref_count(it->second) > 1 ||
+        m_triangle_tree_owners.find(it->second)->second != assembly.get_uid())
+        return false;
+
+    // The tree is keyed by its content. If another tree already holds the new geometry,
+    // rebuild instead so that the existing tree gets shared.
+    if (!m_triangle_tree_repository.rekey(it->second, compute_triangle_tree_key(assembly)))
+        return false;
+
+    // Compute the assembly space bounding box of the assembly.
+    const GAABB3 assembly_bbox =
+        compute_parent_bbox<GAABB3>(
+            assembly.object_instances().begin(),
+            assembly.object_instances().end());
+
+    Access<TriangleTree> tree(it->second);
+    return tree->refit(assembly_bbox);
+}
+
 void AssemblyTree::delete_child_trees(const UniqueID assembly_id)
 {
     delete_triangle_tree(assembly_id);
@@ -510,6 +763,9 @@ void AssemblyTree::delete_triangle_tree(const UniqueID assembly_id)
     const TriangleTreeContainer::iterator it = m_triangle_trees.find(assembly_id);
     if (it != m_triangle_trees.end())
     {
+        if (m_triangle_tree_repository.get_ref_count(it->second) == 1)
+            m_triangle_tree_owners.erase(it->second);
+
         m_triangle_tree_repository.release(it->second);
         m_triangle_trees.erase(it);
     }
@@ -672,10 +928,10 @@ bool AssemblyLeafVisitor::visit(
             if (triangle_tree)
             {
                 // Check the intersection between the ray and the triangle tree.
-                TriangleTreeIntersector intersector;
                 TriangleLeafVisitor visitor(*triangle_tree, asm_inst_shading_point);
                 if (triangle_tree->get_moving_triangle_count() > 0)
                 {
+                    TriangleTreeIntersector intersector;
                     intersector.intersect_motion(
                         *triangle_tree,
                         asm_inst_shading_point.m_ray,
@@ -684,11 +940,64 @@ bool AssemblyLeafVisitor::visit(
                         visitor
 #ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
                         , m_triangle_tree_stats
+#endif
+                        );
+                }
+                else if (triangle_tree->get_node_width() == 4 && triangle_tree->has_quantized_nodes())
+                {
+                    TriangleTreeQuantized4Intersector intersector;
+                    intersector.intersect(
+                        triangle_tree->get_quantized_wide_tree_4(),
+                        asm_inst_shading_point.m_ray,
+                        asm_inst_ray_info,
+                        visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                        , m_triangle_tree_stats
+#endif
+                        );
+                }
+                else if (triangle_tree->get_node_width() == 8 && triangle_tree->has_quantized_nodes())
+                {
+                    TriangleTreeQuantized8Intersector intersector;
+                    intersector.intersect(
+                        triangle_tree->get_quantized_wide_tree_8(),
+                        asm_inst_shading_point.m_ray,
+                        asm_inst_ray_info,
+                        visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                        , m_triangle_tree_stats
+#endif
+                        );
+                }
+                else if (triangle_tree->get_node_width() == 4)
+                {
+                    TriangleTree4Intersector intersector;
+                    intersector.intersect(
+                        triangle_tree->get_wide_tree_4(),
+                        asm_inst_shading_point.m_ray,
+                        asm_inst_ray_info,
+                        visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                        , m_triangle_tree_stats
+#endif
+                        );
+                }
+                else if (triangle_tree->get_node_width() == 8)
+                {
+                    TriangleTree8Intersector intersector;
+                    intersector.intersect(
+                        triangle_tree->get_wide_tree_8(),
+                        asm_inst_shading_point.m_ray,
+                        asm_inst_ray_info,
+                        visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                        , m_triangle_tree_stats
 #endif
                         );
                 }
                 else
                 {
+                    TriangleTreeIntersector intersector;
                     intersector.intersect_no_motion(
                         *triangle_tree,
                         asm_inst_shading_point.m_ray,
@@ -717,16 +1026,32 @@ bool AssemblyLeafVisitor::visit(
             CurveMatrixType xfm_matrix;
             make_curve_projection_transform(xfm_matrix, ray);
             CurveLeafVisitor visitor(*curve_tree, xfm_matrix, asm_inst_shading_point);
-            CurveTreeIntersector intersector;
-            intersector.intersect_no_motion(
-                *curve_tree,
-                ray,
-                ray_info,
-                visitor
+            if (curve_tree->has_quantized_nodes())
+            {
+                CurveTreeQuantized4Intersector intersector;
+                intersector.intersect(
+                    curve_tree->get_quantized_wide_tree_4(),
+                    ray,
+                    ray_info,
+                    visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                    , m_curve_tree_stats
+#endif
+                    );
+            }
+            else
+            {
+                CurveTreeIntersector intersector;
+                intersector.intersect_no_motion(
+                    *curve_tree,
+                    ray,
+                    ray_info,
+                    visitor
 #ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
-                , m_curve_tree_stats
+                    , m_curve_tree_stats
 #endif
-                );
+                    );
+            }
         }
 
         // Keep track of the closest hit.
@@ -914,10 +1239,10 @@ bool AssemblyLeafProbeVisitor::visit(
             if (triangle_tree)
             {
                 // Check the intersection between the ray and the triangle tree.
-                TriangleTreeProbeIntersector intersector;
                 TriangleLeafProbeVisitor visitor(*triangle_tree, asm_inst_ray.m_time.m_normalized, asm_inst_ray.m_flags);
                 if (triangle_tree->get_moving_triangle_count() > 0)
                 {
+                    TriangleTreeProbeIntersector intersector;
                     intersector.intersect_motion(
                         *triangle_tree,
                         asm_inst_ray,
@@ -926,11 +1251,64 @@ bool AssemblyLeafProbeVisitor::visit(
                         visitor
 #ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
                         , m_triangle_tree_stats
+#endif
+                        );
+                }
+                else if (triangle_tree->get_node_width() == 4 && triangle_tree->has_quantized_nodes())
+                {
+                    TriangleTreeQuantized4ProbeIntersector intersector;
+                    intersector.intersect(
+                        triangle_tree->get_quantized_wide_tree_4(),
+                        asm_inst_ray,
+                        asm_inst_ray_info,
+                        visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                        , m_triangle_tree_stats
+#endif
+                        );
+                }
+                else if (triangle_tree->get_node_width() == 8 && triangle_tree->has_quantized_nodes())
+                {
+                    TriangleTreeQuantized8ProbeIntersector intersector;
+                    intersector.intersect(
+                        triangle_tree->get_quantized_wide_tree_8(),
+                        asm_inst_ray,
+                        asm_inst_ray_info,
+                        visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                        , m_triangle_tree_stats
+#endif
+                        );
+                }
+                else if (triangle_tree->get_node_width() == 4)
+                {
+                    TriangleTree4ProbeIntersector intersector;
+                    intersector.intersect(
+                        triangle_tree->get_wide_tree_4(),
+                        asm_inst_ray,
+                        asm_inst_ray_info,
+                        visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                        , m_triangle_tree_stats
+#endif
+                        );
+                }
+                else if (triangle_tree->get_node_width() == 8)
+                {
+                    TriangleTree8ProbeIntersector intersector;
+                    intersector.intersect(
+                        triangle_tree->get_wide_tree_8(),
+                        asm_inst_ray,
+                        asm_inst_ray_info,
+                        visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                        , m_triangle_tree_stats
 #endif
                         );
                 }
                 else
                 {
+                    TriangleTreeProbeIntersector intersector;
                     intersector.intersect_no_motion(
                         *triangle_tree,
                         asm_inst_ray,
@@ -965,16 +1343,32 @@ bool AssemblyLeafProbeVisitor::visit(
             CurveMatrixType xfm_matrix;
             make_curve_projection_transform(xfm_matrix, ray);
             CurveLeafProbeVisitor visitor(*curve_tree, xfm_matrix);
-            CurveTreeProbeIntersector intersector;
-            intersector.intersect_no_motion(
-                *curve_tree,
-                ray,
-                ray_info,
-                visitor
+            if (curve_tree->has_quantized_nodes())
+            {
+                CurveTreeQuantized4ProbeIntersector intersector;
+                intersector.intersect(
+                    curve_tree->get_quantized_wide_tree_4(),
+                    ray,
+                    ray_info,
+                    visitor
 #ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
-                , m_curve_tree_stats
+                    , m_curve_tree_stats
 #endif
-                );
+                    );
+            }
+            else
+            {
+                CurveTreeProbeIntersector intersector;
+                intersector.intersect_no_motion(
+                    *curve_tree,
+                    ray,
+                    ray_info,
+                    visitor
+#ifdef FOUNDATION_BVH_ENABLE_TRAVERSAL_STATS
+                    , m_curve_tree_stats
+#endif
+                    );
+            }
 
             // Terminate traversal if there was a hit.
             if (visitor.hit())
@@ -52,7 +52,9 @@
 
 // Standard headers.
 #include <cstddef>
+#include <cstdint>
 #include <map>
+#include <string>
 #include <vector>
 
 // Forward declarations.
@@ -88,6 +90,23 @@ class AssemblyTree
     // Return the size (in bytes) of this object in memory.
     size_t get_memory_size() const;
 
+    // Get/set the number of children per interior node of triangle trees (2, 4 or 8).
+    size_t get_triangle_tree_node_width() const;
+    void set_triangle_tree_node_width(const size_t value);
+
+    // Get/set whether triangles are intersected in single precision.
+    bool get_triangle_tree_single_precision() const;
+    void set_triangle_tree_single_precision(const bool value);
+
+    // Get/set whether wide triangle trees and curve trees use quantized nodes.
+    bool get_quantized_bvh_nodes() const;
+    void set_quantized_bvh_nodes(const bool value);
+
+    // Get/set the directory where triangle trees are cached between renders.
+    // An empty path disables the cache.
+    const std::string& get_bvh_cache_directory() const;
+    void set_bvh_cache_directory(const std::string& path);
+
 #ifdef APPLESEED_WITH_EMBREE
 
     bool use_embree() const;
@@ -125,13 +144,23 @@ class AssemblyTree
     typedef std::vector<foundation::AABB3d> AABBVector;
     typedef std::vector<const Assembly*> AssemblyVector;
     typedef std::map<foundation::UniqueID, foundation::VersionID> AssemblyVersionMap;
+    typedef std::map<foundation::UniqueID, std::uint64_t> MeshSignatureMap;
+    typedef std::map<const foundation::Lazy<TriangleTree>*, foundation::UniqueID> TriangleTreeOwnerMap;
 
     const Scene&                    m_scene;
     ItemVector                      m_items;
     AssemblyVersionMap              m_assembly_versions;
 
+    size_t                          m_triangle_tree_node_width;
+    bool                            m_triangle_tree_single_precision;
+    bool                            m_quantized_bvh_nodes;
+    bool                            m_dirty;    // forces child trees to be rebuilt
+    std::string                     m_bvh_cache_directory;
+
     TreeRepository<TriangleTree>    m_triangle_tree_repository;
     TriangleTreeContainer           m_triangle_trees;
+    TriangleTreeOwnerMap            m_triangle_tree_owners;     // assembly each triangle tree was built from
+    mutable MeshSignatureMap        m_mesh_signatures;          // content hashes of mesh objects, valid during an update
 
     TreeRepository<CurveTree>       m_curve_tree_repository;
     CurveTreeContainer              m_curve_trees;
@@ -141,7 +170,6 @@ class AssemblyTree
     TreeRepository<EmbreeScene>     m_embree_scene_repository;
     EmbreeSceneContainer            m_embree_scenes;
     bool                            m_use_embree;
-    bool                            m_dirty; // is used to determine triangle tree / embree switch
 
 #endif
 
@@ -156,8 +184,10 @@ class AssemblyTree
     void update_tree_hierarchy();
     void collect_unique_assemblies(AssemblyVector& assemblies) const;
     void delete_unused_child_trees(const AssemblyVector& assemblies);
+    void rebuild_orphaned_child_trees(const AssemblyVector& assemblies);
 
     void create_child_trees(const Assembly& assembly);
+    std::uint64_t compute_triangle_tree_key(const Assembly& assembly) const;
     void create_triangle_tree(const Assembly& assembly);
     void create_curve_tree(const Assembly& assembly);
 
@@ -168,6 +198,9 @@ class AssemblyTree
 
 #endif
 
+    bool refit_child_trees(const Assembly& assembly);
+    bool refit_triangle_tree(const Assembly& assembly);
+
     void delete_child_trees(const foundation::UniqueID assembly_id);
     void delete_triangle_tree(const foundation::UniqueID assembly_id);
     void delete_curve_tree(const foundation::UniqueID assembly_id);
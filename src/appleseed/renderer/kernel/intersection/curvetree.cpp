@@ -48,6 +48,8 @@
 #include "foundation/platform/system.h"
 #include "foundation/utility/alignedallocator.h"
 #include "foundation/utility/api/apistring.h"
+#include "foundation/utility/job/jobmanager.h"
+#include "foundation/utility/job/jobqueue.h"
 #include "foundation/utility/makevector.h"
 #include "foundation/utility/memory.h"
 #include "foundation/utility/statistics.h"
@@ -72,17 +74,23 @@ CurveTree::Arguments::Arguments(
     const Scene&            scene,
     const UniqueID          curve_tree_uid,
     const GAABB3&           bbox,
-    const Assembly&         assembly)
+    const Assembly&         assembly,
+    const bool              quantized_nodes)
   : m_scene(scene)
   , m_curve_tree_uid(curve_tree_uid)
   , m_bbox(bbox)
   , m_assembly(assembly)
+  , m_quantized_nodes(quantized_nodes)
 {
 }
 
 CurveTree::CurveTree(const Arguments& arguments)
   : TreeType(AlignedAllocator<void>(System::get_l1_data_cache_line_size()))
   , m_arguments(arguments)
+  , m_quantized_nodes(false)
+  , m_quantized_wide_tree_4(
+        AlignedAllocator<void>(System::get_l1_data_cache_line_size()),
+        AlignedAllocator<void>(System::get_l1_data_cache_line_size()))
 {
     // Retrieve construction parameters.
     const MessageContext message_context(
@@ -103,6 +111,9 @@ CurveTree::CurveTree(const Arguments& arguments)
     statistics.insert_time("total build time", stopwatch.measure().get_seconds());
     statistics.insert_size("nodes alignment", alignment(&m_nodes[0]));
 
+    // Collapse the binary tree into a quantized wide tree if requested.
+    collapse(statistics);
+
     // Print curve tree statistics.
     RENDERER_LOG_DEBUG("%s",
         StatisticsVector::make(
@@ -110,6 +121,18 @@ CurveTree::CurveTree(const Arguments& arguments)
             statistics).to_string().c_str());
 }
 
+size_t CurveTree::get_memory_size() const
+{
+    return
+          TreeType::get_memory_size()
+        - sizeof(*static_cast<const TreeType*>(this))
+        + sizeof(*this)
+        + m_quantized_wide_tree_4.get_memory_size() - sizeof(m_quantized_wide_tree_4)
+        + m_curves1.capacity() * sizeof(Curve1Type)
+        + m_curves3.capacity() * sizeof(Curve3Type)
+        + m_curve_keys.capacity() * sizeof(CurveKey);
+}
+
 void CurveTree::collect_curves(std::vector<GAABB3>& curve_bboxes)
 {
     const ObjectInstanceContainer& object_instances = m_arguments.m_assembly.object_instances();
@@ -203,16 +226,45 @@ void CurveTree::build_bvh(
         CurveTreeDefaultInteriorNodeTraversalCost,
         CurveTreeDefaultCurveIntersectionCost);
 
-    // Build the tree.
+    // Build the tree, distributing independent subtrees over a pool of worker threads
+    // if the tree is large enough to be worth it.
+    const size_t curve_count = m_curves1.size() + m_curves3.size();
+    const size_t build_thread_count =
+        curve_count >= CurveTreeMinParallelBuildSize
+            ? System::get_logical_cpu_core_count()
+            : 1;
     typedef bvh::Builder<CurveTree, Partitioner> Builder;
     Builder builder;
-    builder.build<DefaultWallclockTimer>(
-        *this,
-        partitioner,
-        m_curves1.size() + m_curves3.size(),
-        CurveTreeDefaultMaxLeafSize);
+    if (build_thread_count > 1)
+    {
+        JobQueue job_queue;
+        JobManager job_manager(
+            global_logger(),
+            job_queue,
+            build_thread_count,
+            JobManager::KeepRunningOnEmptyQueue);
+        job_manager.start();
+        builder.build<DefaultWallclockTimer>(
+            *this,
+            partitioner,
+            curve_count,
+            CurveTreeDefaultMaxLeafSize,
+            job_queue,
+            build_thread_count);
+        job_manager.stop();
+    }
+    else
+    {
+        builder.build<DefaultWallclockTimer>(
+            *this,
+            partitioner,
+            curve_count,
+            CurveTreeDefaultMaxLeafSize);
+    }
     statistics.merge(
         bvh::TreeStatistics<CurveTree>(*this, m_arguments.m_bbox));
+    statistics.insert("build threads", build_thread_count);
+    statistics.insert("parallel subtrees", builder.get_subtree_count());
 
     // Reorder the curve keys based on the nodes ordering.
     if (!m_curves1.empty() || !m_curves3.empty())
@@ -301,6 +353,22 @@ void CurveTree::reorder_curve_keys_in_leaf_nodes()
     }
 }
 
+void CurveTree::collapse(Statistics& statistics)
+{
+    if (!m_arguments.m_quantized_nodes)
+        return;
+
+    bvh::Collapser<TreeType, QuantizedWideTree4Type> collapser;
+    collapser.collapse<DefaultWallclockTimer>(*this, AABB3d(m_arguments.m_bbox), m_quantized_wide_tree_4);
+    statistics.merge(bvh::WideTreeStatistics<QuantizedWideTree4Type>(m_quantized_wide_tree_4));
+    statistics.insert_time("collapse time", collapser.get_collapse_time());
+
+    // The binary tree is no longer needed: leaves were copied into the wide tree.
+    clear_release_memory(m_nodes);
+
+    m_quantized_nodes = true;
+}
+
 
 //
 // CurveTreeFactory class implementation.
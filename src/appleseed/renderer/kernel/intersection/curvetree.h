@@ -72,6 +72,12 @@ class CurveTree
            >
 {
   public:
+    // Wide tree with quantized child bounding boxes, obtained by collapsing the binary tree.
+    typedef foundation::bvh::WideTree<
+        foundation::AlignedVector<foundation::bvh::QuantizedWideNode<4>>,
+        NodeVectorType
+    > QuantizedWideTree4Type;
+
     // Construction arguments.
     struct Arguments
     {
@@ -79,18 +85,29 @@ class CurveTree
         const foundation::UniqueID              m_curve_tree_uid;
         const GAABB3                            m_bbox;
         const Assembly&                         m_assembly;
+        const bool                              m_quantized_nodes;
 
         // Constructor.
         Arguments(
             const Scene&                        scene,
             const foundation::UniqueID          curve_tree_uid,
             const GAABB3&                       bbox,
-            const Assembly&                     assembly);
+            const Assembly&                     assembly,
+            const bool                          quantized_nodes = CurveTreeDefaultQuantizedNodes);
     };
 
     // Constructor, builds the tree for a given assembly.
     explicit CurveTree(const Arguments& arguments);
 
+    // Return true if the binary tree was collapsed into a quantized wide tree.
+    bool has_quantized_nodes() const;
+
+    // Access the quantized wide tree. Only valid if has_quantized_nodes() returns true.
+    const QuantizedWideTree4Type& get_quantized_wide_tree_4() const;
+
+    // Return the size (in bytes) of this object in memory.
+    size_t get_memory_size() const;
+
   private:
     friend class CurveLeafVisitor;
     friend class CurveLeafProbeVisitor;
@@ -107,6 +124,8 @@ class CurveTree
     std::vector<Curve1Type> m_curves1;
     std::vector<Curve3Type> m_curves3;
     std::vector<CurveKey>   m_curve_keys;
+    bool                    m_quantized_nodes;
+    QuantizedWideTree4Type  m_quantized_wide_tree_4;
 
     void collect_curves(std::vector<GAABB3>& curve_bboxes);
 
@@ -123,6 +142,8 @@ class CurveTree
 
     // Reorder curve keys in leaf nodes so that all degree-1 curve keys come before degree-3 ones.
     void reorder_curve_keys_in_leaf_nodes();
+
+    void collapse(foundation::Statistics& statistics);
 };
 
 
@@ -248,6 +269,35 @@ typedef foundation::bvh::Intersector<
     CurveTreeStackSize
 > CurveTreeProbeIntersector;
 
+typedef foundation::bvh::WideIntersector<
+    CurveTree::QuantizedWideTree4Type,
+    CurveLeafVisitor,
+    GRay3,
+    CurveTreeWideStackSize
+> CurveTreeQuantized4Intersector;
+
+typedef foundation::bvh::WideIntersector<
+    CurveTree::QuantizedWideTree4Type,
+    CurveLeafProbeVisitor,
+    GRay3,
+    CurveTreeWideStackSize
+> CurveTreeQuantized4ProbeIntersector;
+
+
+//
+// CurveTree class implementation.
+//
+
+inline bool CurveTree::has_quantized_nodes() const
+{
+    return m_quantized_nodes;
+}
+
+inline const CurveTree::QuantizedWideTree4Type& CurveTree::get_quantized_wide_tree_4() const
+{
+    return m_quantized_wide_tree_4;
+}
+
 
 //
 // CurveLeafVisitor class implementation.
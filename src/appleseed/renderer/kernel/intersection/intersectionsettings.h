@@ -35,6 +35,7 @@
 // appleseed.foundation headers.
 #include "foundation/math/beziercurve.h"
 #include "foundation/math/intersection/raytrianglemt.h"
+#include "foundation/math/intersection/raytrianglewt.h"
 #include "foundation/math/matrix.h"
 
 // Standard headers.
@@ -68,6 +69,9 @@ typedef foundation::TriangleMT<GScalar> GTriangleType;
 typedef foundation::TriangleMT<double> TriangleType;
 typedef foundation::TriangleMTSupportPlane<double> TriangleSupportPlaneType;
 
+// Triangle format used for storage and intersection in single precision mode.
+typedef foundation::TriangleWT<GScalar> GWatertightTriangleType;
+
 // Maximum number of triangles per leaf.
 const size_t TriangleTreeDefaultMaxLeafSize = 2;
 
@@ -80,6 +84,18 @@ const GScalar TriangleTreeDefaultTriangleIntersectionCost(1.0);
 // Number of bins used during SBVH construction.
 const size_t TriangleTreeDefaultBinCount = 256;
 
+// Minimum number of triangles for a triangle tree to be built using worker threads.
+// Smaller trees are built serially, without the cost of spawning a pool of threads.
+const size_t TriangleTreeMinParallelBuildSize = 64 * 1024;
+
+// Maximum ratio between the SAH cost of a refit triangle tree and its cost when it
+// was built. Trees whose quality degrades beyond this ratio are rebuilt.
+const double TriangleTreeDefaultMaxRefitCostRatio = 1.5;
+
+// Minimum number of triangles for the leaves of a triangle tree to be refit using
+// worker threads. Smaller trees are refit serially.
+const size_t TriangleTreeMinParallelRefitSize = 64 * 1024;
+
 // Define this symbol to enable reordering the nodes of triangle trees for better
 // locality of reference. Requires a lot of temporary memory for minimal results.
 #undef RENDERER_TRIANGLE_TREE_REORDER_NODES
@@ -94,6 +110,22 @@ const size_t TriangleTreeAccessCacheWays = 2;
 // Size of the stack (in number of nodes) used during traversal.
 const size_t TriangleTreeStackSize = 64;
 
+// Default number of children per interior node (2, 4 or 8). With 4 or 8, the binary
+// tree is collapsed into a wide tree traversed with SIMD instructions.
+const size_t TriangleTreeDefaultNodeWidth = 2;
+
+// Size of the stack (in number of nodes) used during traversal of wide trees.
+const size_t TriangleTreeWideStackSize = 256;
+
+// Intersect triangles in double precision with the Moeller-Trumbore test by default, even
+// though they are stored in single precision. In single precision mode, triangles are
+// intersected with a watertight test against a single precision copy of the ray.
+const bool TriangleTreeDefaultSinglePrecision = false;
+
+// Store the child bounding boxes of wide tree nodes as 8-bit quantized coordinates.
+// This halves the memory used by wide nodes at the cost of slightly looser boxes.
+const bool TriangleTreeDefaultQuantizedNodes = false;
+
 
 //
 // Curve tree settings.
@@ -119,6 +151,9 @@ const GScalar CurveTreeDefaultInteriorNodeTraversalCost(1.0);
 // Relative cost of intersecting a curve.
 const GScalar CurveTreeDefaultCurveIntersectionCost(1.0);
 
+// Minimum number of curves for a curve tree to be built using worker threads.
+const size_t CurveTreeMinParallelBuildSize = 64 * 1024;
+
 // Size of the curve tree access cache.
 const size_t CurveTreeAccessCacheLines = 128;
 const size_t CurveTreeAccessCacheWays = 2;
@@ -126,6 +161,12 @@ const size_t CurveTreeAccessCacheWays = 2;
 // Size of the stack (in number of nodes) used during traversal.
 const size_t CurveTreeStackSize = 64;
 
+// Collapse the binary tree into a 4-wide tree with quantized nodes by default.
+const bool CurveTreeDefaultQuantizedNodes = false;
+
+// Size of the stack (in number of nodes) used during traversal of the quantized wide tree.
+const size_t CurveTreeWideStackSize = 256;
+
 
 //
 // Embree settings.
@@ -86,6 +86,26 @@ void TraceContext::update()
     m_assembly_tree->update();
 }
 
+void TraceContext::set_triangle_tree_node_width(const size_t value)
+{
+    m_assembly_tree->set_triangle_tree_node_width(value);
+}
+
+void TraceContext::set_triangle_tree_single_precision(const bool value)
+{
+    m_assembly_tree->set_triangle_tree_single_precision(value);
+}
+
+void TraceContext::set_quantized_bvh_nodes(const bool value)
+{
+    m_assembly_tree->set_quantized_bvh_nodes(value);
+}
+
+void TraceContext::set_bvh_cache_directory(const std::string& path)
+{
+    m_assembly_tree->set_bvh_cache_directory(path);
+}
+
 #ifdef APPLESEED_WITH_EMBREE
 
 void TraceContext::set_use_embree(const bool value)
@@ -35,6 +35,10 @@
 // appleseed.main headers.
 #include "main/dllsymbol.h"
 
+// Standard headers.
+#include <cstddef>
+#include <string>
+
 // Forward declarations.
 namespace renderer  { class AssemblyTree; }
 namespace renderer  { class Scene; }
@@ -68,6 +72,18 @@ class APPLESEED_DLLSYMBOL TraceContext
     // Synchronize the trace context with the scene.
     void update();
 
+    // Set the number of children per interior node of triangle trees (2, 4 or 8).
+    void set_triangle_tree_node_width(const size_t value);
+
+    // Set whether triangles are intersected in single precision.
+    void set_triangle_tree_single_precision(const bool value);
+
+    // Set whether wide triangle trees and curve trees use quantized nodes.
+    void set_quantized_bvh_nodes(const bool value);
+
+    // Set the directory where triangle trees are cached between renders (empty to disable).
+    void set_bvh_cache_directory(const std::string& path);
+
 #ifdef APPLESEED_WITH_EMBREE
     void set_use_embree(const bool value);
 #endif
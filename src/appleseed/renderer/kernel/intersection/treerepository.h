@@ -61,6 +61,13 @@ class TreeRepository
     LazyTreeType* acquire(const std::uint64_t key);
     void release(LazyTreeType* tree);
 
+    // Return the key of a tree and the number of references to it.
+    std::uint64_t get_key(LazyTreeType* tree) const;
+    size_t get_ref_count(LazyTreeType* tree) const;
+
+    // Change the key of a tree. Return false if another tree already uses this key.
+    bool rekey(LazyTreeType* tree, const std::uint64_t key);
+
     template <typename Func>
     void for_each(Func& func);
 
@@ -135,6 +142,47 @@ void TreeRepository<TreeType>::release(LazyTreeType* tree)
     }
 }
 
+template <typename TreeType>
+std::uint64_t TreeRepository<TreeType>::get_key(LazyTreeType* tree) const
+{
+    const typename TreeIndex::const_iterator i = m_index.find(tree);
+    assert(i != m_index.end());
+
+    return i->second;
+}
+
+template <typename TreeType>
+size_t TreeRepository<TreeType>::get_ref_count(LazyTreeType* tree) const
+{
+    const typename TreeContainer::const_iterator t = m_trees.find(get_key(tree));
+    assert(t != m_trees.end());
+
+    return t->second.m_ref;
+}
+
+template <typename TreeType>
+bool TreeRepository<TreeType>::rekey(LazyTreeType* tree, const std::uint64_t key)
+{
+    const typename TreeIndex::iterator i = m_index.find(tree);
+    assert(i != m_index.end());
+
+    if (i->second == key)
+        return true;
+
+    if (m_trees.find(key) != m_trees.end())
+        return false;
+
+    const typename TreeContainer::iterator t = m_trees.find(i->second);
+    assert(t != m_trees.end());
+
+    const TreeInfo info = t->second;
+    m_trees.erase(t);
+    m_trees.insert(std::make_pair(key, info));
+    i->second = key;
+
+    return true;
+}
+
 template <typename TreeType>
 template <typename Func>
 void TreeRepository<TreeType>::for_each(Func& func)
@@ -39,12 +39,17 @@
 
 // Standard headers.
 #include <cstdint>
+#include <cstring>
 
 using namespace foundation;
 
 namespace renderer
 {
 
+static_assert(
+    sizeof(GTriangleType) == sizeof(GWatertightTriangleType),
+    "Triangle storage formats must have the same size");
+
 size_t TriangleEncoder::compute_size(
     const std::vector<TriangleVertexInfo>&  triangle_vertex_infos,
     const std::vector<size_t>&              triangle_indices,
@@ -75,6 +80,7 @@ void TriangleEncoder::encode(
     const std::vector<size_t>&              triangle_indices,
     const size_t                            item_begin,
     const size_t                            item_count,
+    const bool                              single_precision,
     MemoryWriter&                           writer)
 {
     for (size_t i = 0; i < item_count; ++i)
@@ -87,11 +93,22 @@ void TriangleEncoder::encode(
 
         if (vertex_info.m_motion_segment_count == 0)
         {
-            writer.write(
-                GTriangleType(
-                    triangle_vertices[vertex_info.m_vertex_index + 0],
-                    triangle_vertices[vertex_info.m_vertex_index + 1],
-                    triangle_vertices[vertex_info.m_vertex_index + 2]));
+            if (single_precision)
+            {
+                writer.write(
+                    GWatertightTriangleType(
+                        triangle_vertices[vertex_info.m_vertex_index + 0],
+                        triangle_vertices[vertex_info.m_vertex_index + 1],
+                        triangle_vertices[vertex_info.m_vertex_index + 2]));
+            }
+            else
+            {
+                writer.write(
+                    GTriangleType(
+                        triangle_vertices[vertex_info.m_vertex_index + 0],
+                        triangle_vertices[vertex_info.m_vertex_index + 1],
+                        triangle_vertices[vertex_info.m_vertex_index + 2]));
+            }
         }
         else
         {
@@ -102,4 +119,35 @@ void TriangleEncoder::encode(
     }
 }
 
+bool TriangleEncoder::check_size(
+    const std::uint8_t*                     data,
+    const size_t                            data_size,
+    const size_t                            item_count)
+{
+    size_t offset = 0;
+
+    for (size_t i = 0; i < item_count; ++i)
+    {
+        // Visibility flags and motion segment count.
+        if (data_size - offset < 2 * sizeof(std::uint32_t))
+            return false;
+
+        std::uint32_t motion_segment_count;
+        std::memcpy(&motion_segment_count, data + offset + sizeof(std::uint32_t), sizeof(motion_segment_count));
+        offset += 2 * sizeof(std::uint32_t);
+
+        // Vertices; computed in 64-bit to rule out overflows.
+        const std::uint64_t vertex_size =
+            motion_segment_count == 0
+                ? sizeof(GTriangleType)
+                : (std::uint64_t(motion_segment_count) + 1) * 3 * sizeof(GVector3);
+        if (vertex_size > data_size - offset)
+            return false;
+
+        offset += static_cast<size_t>(vertex_size);
+    }
+
+    return true;
+}
+
 }   // namespace renderer
@@ -34,6 +34,7 @@
 
 // Standard headers.
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 
 // Forward declarations.
@@ -52,13 +53,23 @@ class TriangleEncoder
         const size_t                            item_begin,
         const size_t                            item_count);
 
+    // Static triangles are encoded as GWatertightTriangleType if single_precision
+    // is true, and as GTriangleType otherwise. Both formats have the same size.
     static void encode(
         const std::vector<TriangleVertexInfo>&  triangle_vertex_infos,
         const std::vector<GVector3>&            triangle_vertices,
         const std::vector<size_t>&              triangle_indices,
         const size_t                            item_begin,
         const size_t                            item_count,
+        const bool                              single_precision,
         foundation::MemoryWriter&               writer);
+
+    // Return true if the first data_size bytes of data hold item_count encoded triangles.
+    // Used to validate triangles read from untrusted sources such as bvh cache files.
+    static bool check_size(
+        const std::uint8_t*                     data,
+        const size_t                            data_size,
+        const size_t                            item_count);
 };
 
 }   // namespace renderer
@@ -65,20 +65,31 @@
 #include "foundation/platform/types.h"
 #include "foundation/utility/alignedallocator.h"
 #include "foundation/utility/api/apistring.h"
+#include "foundation/utility/bufferedfile.h"
 #include "foundation/utility/foreach.h"
+#include "foundation/utility/job/jobmanager.h"
+#include "foundation/utility/job/jobqueue.h"
 #include "foundation/utility/makevector.h"
 #include "foundation/utility/memory.h"
 #include "foundation/utility/statistics.h"
 #include "foundation/utility/stopwatch.h"
 #include "foundation/utility/string.h"
 
+// Boost headers.
+#include "boost/filesystem.hpp"
+#include "boost/system/error_code.hpp"
+
 // Standard headers.
 #include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <exception>
 #include <set>
 #include <string>
 
 using namespace foundation;
+namespace bf = boost::filesystem;
 
 namespace renderer
 {
@@ -380,24 +391,75 @@ namespace
             }
         }
     }
+
+    std::vector<size_t> collect_motion_segment_counts(const Assembly& assembly)
+    {
+        std::vector<size_t> motion_segment_counts(assembly.object_instances().size(), 0);
+
+        for (size_t i = 0, e = motion_segment_counts.size(); i < e; ++i)
+        {
+            const Object& object = assembly.object_instances().get_by_index(i)->get_object();
+
+            if (strcmp(object.get_model(), MeshObjectFactory().get_model()) == 0)
+            {
+                const MeshObject& mesh = static_cast<const MeshObject&>(object);
+                motion_segment_counts[i] = mesh.get_static_triangle_tess().get_motion_segment_count();
+            }
+        }
+
+        return motion_segment_counts;
+    }
 }
 
 TriangleTree::Arguments::Arguments(
     const Scene&            scene,
     const UniqueID          triangle_tree_uid,
     const GAABB3&           bbox,
-    const Assembly&         assembly)
+    const Assembly&         assembly,
+    const size_t            node_width,
+    const bool              single_precision,
+    const bool              quantized_nodes,
+    const std::string&      cache_filepath,
+    const std::uint64_t     mesh_signature,
+    const std::uint64_t     params_signature)
   : m_scene(scene)
   , m_triangle_tree_uid(triangle_tree_uid)
   , m_bbox(bbox)
   , m_assembly(assembly)
+  , m_node_width(node_width)
+  , m_single_precision(single_precision)
+  , m_quantized_nodes(quantized_nodes)
+  , m_cache_filepath(cache_filepath)
+  , m_mesh_signature(mesh_signature)
+  , m_params_signature(params_signature)
 {
 }
 
 TriangleTree::TriangleTree(const Arguments& arguments)
   : TreeType(AlignedAllocator<void>(System::get_l1_data_cache_line_size()))
   , m_arguments(arguments)
+  , m_single_precision(arguments.m_single_precision)
+  , m_motion_segment_counts(collect_motion_segment_counts(arguments.m_assembly))
+  , m_reference_sah_cost(0.0)
+  , m_node_width(2)
+  , m_wide_tree_4(
+        AlignedAllocator<void>(System::get_l1_data_cache_line_size()),
+        AlignedAllocator<void>(System::get_l1_data_cache_line_size()))
+  , m_wide_tree_8(
+        AlignedAllocator<void>(System::get_l1_data_cache_line_size()),
+        AlignedAllocator<void>(System::get_l1_data_cache_line_size()))
+  , m_quantized_nodes(false)
+  , m_quantized_wide_tree_4(
+        AlignedAllocator<void>(System::get_l1_data_cache_line_size()),
+        AlignedAllocator<void>(System::get_l1_data_cache_line_size()))
+  , m_quantized_wide_tree_8(
+        AlignedAllocator<void>(System::get_l1_data_cache_line_size()),
+        AlignedAllocator<void>(System::get_l1_data_cache_line_size()))
 {
+    // Reuse the tree stored in the BVH cache if there is one.
+    if (!m_arguments.m_cache_filepath.empty() && load(m_arguments.m_cache_filepath))
+        return;
+
     // Retrieve construction parameters.
     const MessageContext message_context(
         format("while building triangle tree for assembly \"{0}\"", m_arguments.m_assembly.get_path()));
@@ -416,6 +478,7 @@ TriangleTree::TriangleTree(const Arguments& arguments)
         build_bvh(params, time, save_memory, statistics);
     else build_sbvh(params, time, save_memory, statistics);
     statistics.insert_time("total build time", stopwatch.measure().get_seconds());
+    statistics.insert<std::string>("triangle precision", m_single_precision ? "single" : "double");
     statistics.insert_size("nodes alignment", alignment(&m_nodes[0]));
 
 #ifdef RENDERER_TRIANGLE_TREE_REORDER_NODES
@@ -425,11 +488,18 @@ TriangleTree::TriangleTree(const Arguments& arguments)
     assert(m_nodes.size() == m_nodes.capacity());
 #endif
 
+    // Collapse the binary tree into a wide tree if requested.
+    collapse(statistics);
+
     // Print triangle tree statistics.
     RENDERER_LOG_DEBUG("%s",
         StatisticsVector::make(
             "triangle tree #" + to_string(m_arguments.m_triangle_tree_uid) + " statistics",
             statistics).to_string().c_str());
+
+    // Store the tree in the BVH cache for subsequent renders.
+    if (!m_arguments.m_cache_filepath.empty())
+        save(m_arguments.m_cache_filepath);
 }
 
 TriangleTree::~TriangleTree()
@@ -455,6 +525,10 @@ size_t TriangleTree::get_memory_size() const
           TreeType::get_memory_size()
         - sizeof(*static_cast<const TreeType*>(this))
         + sizeof(*this)
+        + m_wide_tree_4.get_memory_size() - sizeof(m_wide_tree_4)
+        + m_wide_tree_8.get_memory_size() - sizeof(m_wide_tree_8)
+        + m_quantized_wide_tree_4.get_memory_size() - sizeof(m_quantized_wide_tree_4)
+        + m_quantized_wide_tree_8.get_memory_size() - sizeof(m_quantized_wide_tree_8)
         + m_triangle_keys.capacity() * sizeof(TriangleKey)
         + m_leaf_data.capacity() * sizeof(std::uint8_t);
 }
@@ -538,6 +612,10 @@ void TriangleTree::build_bvh(
     const size_t max_leaf_size = params.get_optional<size_t>("max_leaf_size", TriangleTreeDefaultMaxLeafSize);
     const GScalar interior_node_traversal_cost = params.get_optional<GScalar>("interior_node_traversal_cost", TriangleTreeDefaultInteriorNodeTraversalCost);
     const GScalar triangle_intersection_cost = params.get_optional<GScalar>("triangle_intersection_cost", TriangleTreeDefaultTriangleIntersectionCost);
+    const size_t build_thread_count =
+        triangle_keys.size() >= TriangleTreeMinParallelBuildSize
+            ? params.get_optional<size_t>("build_threads", System::get_logical_cpu_core_count())
+            : 1;
 
     // Create the partitioner.
     typedef bvh::SAHPartitioner<std::vector<GAABB3>> Partitioner;
@@ -547,14 +625,36 @@ void TriangleTree::build_bvh(
         interior_node_traversal_cost,
         triangle_intersection_cost);
 
-    // Build the tree.
+    // Build the tree, distributing independent subtrees over a pool of worker threads
+    // if the tree is large enough to be worth it.
     typedef bvh::Builder<TriangleTree, Partitioner> Builder;
     Builder builder;
-    builder.build<DefaultWallclockTimer>(
-        *this,
-        partitioner,
-        triangle_keys.size(),
-        max_leaf_size);
+    if (build_thread_count > 1)
+    {
+        JobQueue job_queue;
+        JobManager job_manager(
+            global_logger(),
+            job_queue,
+            build_thread_count,
+            JobManager::KeepRunningOnEmptyQueue);
+        job_manager.start();
+        builder.build<DefaultWallclockTimer>(
+            *this,
+            partitioner,
+            triangle_keys.size(),
+            max_leaf_size,
+            job_queue,
+            build_thread_count);
+        job_manager.stop();
+    }
+    else
+    {
+        builder.build<DefaultWallclockTimer>(
+            *this,
+            partitioner,
+            triangle_keys.size(),
+            max_leaf_size);
+    }
     statistics.merge(
         bvh::TreeStatistics<TriangleTree>(*this, AABB3d(m_arguments.m_bbox)));
 
@@ -591,6 +691,8 @@ void TriangleTree::build_bvh(
 
     const double store_time = stopwatch.measure().get_seconds();
 
+    statistics.insert("build threads", build_thread_count);
+    statistics.insert("parallel subtrees", builder.get_subtree_count());
     statistics.insert_time("collection time", collection_time);
     statistics.insert_time("partition time", builder.get_build_time());
     statistics.insert_time("store time", store_time);
@@ -957,6 +1059,7 @@ void TriangleTree::store_triangles(
                     triangle_indices,
                     item_begin,
                     item_count,
+                    m_single_precision,
                     user_data_writer);
             }
             else
@@ -969,6 +1072,7 @@ void TriangleTree::store_triangles(
                     triangle_indices,
                     item_begin,
                     item_count,
+                    m_single_precision,
                     leaf_data_writer);
             }
         }
@@ -1246,6 +1350,662 @@ namespace
     }
 }
 
+void TriangleTree::collapse(Statistics& statistics)
+{
+    if (m_arguments.m_node_width != 4 && m_arguments.m_node_width != 8)
+        return;
+
+    // Wide nodes don't store motion bounding boxes.
+    if (m_moving_triangle_count > 0)
+    {
+        RENDERER_LOG_WARNING(
+            "triangle tree #" FMT_UNIQUE_ID " contains moving triangles, using binary tree.",
+            m_arguments.m_triangle_tree_uid);
+        return;
+    }
+
+    if (m_arguments.m_quantized_nodes)
+    {
+        if (m_arguments.m_node_width == 4)
+            collapse(m_quantized_wide_tree_4, statistics);
+        else collapse(m_quantized_wide_tree_8, statistics);
+    }
+    else
+    {
+        if (m_arguments.m_node_width == 4)
+            collapse(m_wide_tree_4, statistics);
+        else collapse(m_wide_tree_8, statistics);
+    }
+
+    statistics.insert<std::string>("node compression", m_arguments.m_quantized_nodes ? "quantized" : "none");
+
+    // The binary tree is no longer needed: leaves were copied into the wide tree.
+    clear_release_memory(m_nodes);
+
+    m_node_width = m_arguments.m_node_width;
+    m_quantized_nodes = m_arguments.m_quantized_nodes;
+}
+
+template <typename WideTree>
+void TriangleTree::collapse(
+    WideTree&               wide_tree,
+    Statistics&             statistics)
+{
+    bvh::Collapser<TreeType, WideTree> collapser;
+    collapser.template collapse<DefaultWallclockTimer>(*this, AABB3d(m_arguments.m_bbox), wide_tree);
+    statistics.merge(bvh::WideTreeStatistics<WideTree>(wide_tree));
+    statistics.insert_time("collapse time", collapser.get_collapse_time());
+}
+
+namespace
+{
+    //
+    // BVH cache files start with a header identifying the layout of the data that
+    // follows and the geometry it was built from. Files are named after a hash of
+    // the same inputs; the header guards against hash collisions and stale files.
+    //
+
+    const std::uint32_t TriangleTreeCacheMagic = 0x54544241;    // "ABTT"
+    const std::uint32_t TriangleTreeCacheVersion = 3;
+
+    // Return the number of triangles of the mesh objects instantiated in an assembly.
+    std::uint64_t count_mesh_triangles(const Assembly& assembly)
+    {
+        std::uint64_t triangle_count = 0;
+
+        for (const_each<ObjectInstanceContainer> i = assembly.object_instances(); i; ++i)
+        {
+            const Object& object = i->get_object();
+
+            if (strcmp(object.get_model(), MeshObjectFactory().get_model()) == 0)
+                triangle_count += static_cast<const MeshObject&>(object).get_triangle_count();
+        }
+
+        return triangle_count;
+    }
+
+    struct TriangleTreeCacheHeader
+    {
+        std::uint32_t   m_magic;
+        std::uint32_t   m_version;
+        std::uint32_t   m_node_size;
+        std::uint32_t   m_triangle_key_size;
+        std::uint32_t   m_scalar_size;
+        std::uint32_t   m_node_width;
+        std::uint32_t   m_single_precision;
+        std::uint32_t   m_quantized_nodes;
+        std::uint64_t   m_mesh_signature;
+        std::uint64_t   m_params_signature;
+        std::uint64_t   m_triangle_count;
+
+        explicit TriangleTreeCacheHeader(const TriangleTree::Arguments& arguments)
+          : m_magic(TriangleTreeCacheMagic)
+          , m_version(TriangleTreeCacheVersion)
+          , m_node_size(static_cast<std::uint32_t>(sizeof(TriangleTree::NodeType)))
+          , m_triangle_key_size(static_cast<std::uint32_t>(sizeof(TriangleKey)))
+          , m_scalar_size(static_cast<std::uint32_t>(sizeof(GScalar)))
+          , m_node_width(static_cast<std::uint32_t>(arguments.m_node_width))
+          , m_single_precision(arguments.m_single_precision ? 1 : 0)
+          , m_quantized_nodes(arguments.m_quantized_nodes ? 1 : 0)
+          , m_mesh_signature(arguments.m_mesh_signature)
+          , m_params_signature(arguments.m_params_signature)
+          , m_triangle_count(count_mesh_triangles(arguments.m_assembly))
+        {
+        }
+
+        bool has_same_format(const TriangleTreeCacheHeader& rhs) const
+        {
+            return std::memcmp(this, &rhs, offsetof(TriangleTreeCacheHeader, m_mesh_signature)) == 0;
+        }
+
+        bool has_same_geometry(const TriangleTreeCacheHeader& rhs) const
+        {
+            return
+                m_mesh_signature == rhs.m_mesh_signature &&
+                m_params_signature == rhs.m_params_signature &&
+                m_triangle_count == rhs.m_triangle_count;
+        }
+    };
+
+    const size_t TriangleTreeCacheBufferSize = 1024 * 1024;
+
+    //
+    // Reject leaves of a loaded tree that reference triangles or encoded triangle
+    // data outside of the triangle keys and leaf data read from the cache file.
+    //
+
+    class TriangleLeafChecker
+    {
+      public:
+        TriangleLeafChecker(
+            const std::vector<TriangleKey>&     triangle_keys,
+            const std::vector<std::uint8_t>&    leaf_data)
+          : m_triangle_keys(triangle_keys)
+          , m_leaf_data(leaf_data)
+        {
+        }
+
+        bool operator()(const TriangleTree::NodeType& leaf) const
+        {
+            const size_t item_index = leaf.get_item_index();
+            const size_t item_count = leaf.get_item_count();
+
+            if (item_index > m_triangle_keys.size() ||
+                item_count > m_triangle_keys.size() - item_index)
+                return false;
+
+            const std::uint8_t* user_data = &leaf.get_user_data<std::uint8_t>();
+            std::uint32_t leaf_data_index;
+            std::memcpy(&leaf_data_index, user_data, sizeof(leaf_data_index));
+
+            // Triangles are stored in the leaf node.
+            if (leaf_data_index == ~std::uint32_t(0))
+            {
+                return
+                    TriangleEncoder::check_size(
+                        user_data + sizeof(std::uint32_t),
+                        TriangleTree::NodeType::MaxUserDataSize - sizeof(std::uint32_t),
+                        item_count);
+            }
+
+            // Triangles are stored in the tree.
+            return
+                leaf_data_index < m_leaf_data.size() &&
+                TriangleEncoder::check_size(
+                    &m_leaf_data[leaf_data_index],
+                    m_leaf_data.size() - leaf_data_index,
+                    item_count);
+        }
+
+      private:
+        const std::vector<TriangleKey>&     m_triangle_keys;
+        const std::vector<std::uint8_t>&    m_leaf_data;
+    };
+
+    // Return true if a range of motion bounding boxes lies within the tree's bounding boxes.
+    bool is_valid_motion_bbox_range(
+        const size_t                            bbox_index,
+        const size_t                            bbox_count,
+        const size_t                            node_bbox_count)
+    {
+        return
+            bbox_count > 0 &&
+            (bbox_count == 1 || (bbox_index <= node_bbox_count && bbox_count <= node_bbox_count - bbox_index));
+    }
+
+    // Return true if the motion bounding boxes of all interior nodes lie within the tree's bounding boxes.
+    bool is_valid_motion_bbox_data(
+        const TriangleTree::NodeVectorType&     nodes,
+        const std::vector<AABB3d>&              node_bboxes)
+    {
+        for (const_each<TriangleTree::NodeVectorType> i = nodes; i; ++i)
+        {
+            if (i->is_interior() &&
+                (!is_valid_motion_bbox_range(i->get_left_bbox_index(), i->get_left_bbox_count(), node_bboxes.size()) ||
+                 !is_valid_motion_bbox_range(i->get_right_bbox_index(), i->get_right_bbox_count(), node_bboxes.size())))
+                return false;
+        }
+
+        return true;
+    }
+}
+
+bool TriangleTree::load(const std::string& filepath)
+{
+    Stopwatch<DefaultWallclockTimer> stopwatch;
+    stopwatch.start();
+
+    BufferedFile file;
+    if (!file.open(filepath.c_str(), BufferedFile::BinaryType, BufferedFile::ReadMode, TriangleTreeCacheBufferSize))
+        return false;
+
+    PassthroughReaderAdapter reader(file);
+
+    const TriangleTreeCacheHeader expected_header(m_arguments);
+    TriangleTreeCacheHeader header(expected_header);
+    if (reader.read(header) != sizeof(header) || !header.has_same_format(expected_header))
+    {
+        RENDERER_LOG_WARNING(
+            "ignoring bvh cache file %s for triangle tree #" FMT_UNIQUE_ID ": incompatible format.",
+            filepath.c_str(),
+            m_arguments.m_triangle_tree_uid);
+        return false;
+    }
+
+    if (!header.has_same_geometry(expected_header))
+    {
+        RENDERER_LOG_WARNING(
+            "ignoring bvh cache file %s for triangle tree #" FMT_UNIQUE_ID ": built from different geometry.",
+            filepath.c_str(),
+            m_arguments.m_triangle_tree_uid);
+        return false;
+    }
+
+    bool success = false;
+
+    try
+    {
+        std::uint64_t static_triangle_count, moving_triangle_count, node_width, quantized_nodes;
+
+        success =
+            reader.read(static_triangle_count) == sizeof(static_triangle_count) &&
+            reader.read(moving_triangle_count) == sizeof(moving_triangle_count) &&
+            reader.read(m_reference_sah_cost) == sizeof(m_reference_sah_cost) &&
+            reader.read(node_width) == sizeof(node_width) &&
+            (node_width == 2 || node_width == 4 || node_width == 8) &&
+            reader.read(quantized_nodes) == sizeof(quantized_nodes) &&
+            bvh::read_plain_vector(reader, m_triangle_keys) &&
+            m_triangle_keys.size() == static_triangle_count + moving_triangle_count &&
+            bvh::read_plain_vector(reader, m_leaf_data);
+
+        // Leaves are checked against the triangle keys and leaf data read above.
+        const TriangleLeafChecker leaf_checker(m_triangle_keys, m_leaf_data);
+
+        success =
+            success &&
+            bvh::TreeSerializer<TreeType>::read(reader, *this, leaf_checker) &&
+            is_valid_motion_bbox_data(m_nodes, m_node_bboxes) &&
+            bvh::WideTreeSerializer<WideTree4Type>::read(reader, m_wide_tree_4, leaf_checker) &&
+            bvh::WideTreeSerializer<WideTree8Type>::read(reader, m_wide_tree_8, leaf_checker) &&
+            bvh::WideTreeSerializer<QuantizedWideTree4Type>::read(reader, m_quantized_wide_tree_4, leaf_checker) &&
+            bvh::WideTreeSerializer<QuantizedWideTree8Type>::read(reader, m_quantized_wide_tree_8, leaf_checker);
+
+        if (success)
+        {
+            m_static_triangle_count = static_cast<size_t>(static_triangle_count);
+            m_moving_triangle_count = static_cast<size_t>(moving_triangle_count);
+            m_node_width = static_cast<size_t>(node_width);
+            m_quantized_nodes = quantized_nodes != 0;
+        }
+    }
+    catch (const std::exception&)
+    {
+        // Corrupted vector sizes may cause allocations to fail.
+        success = false;
+    }
+
+    if (!success)
+    {
+        RENDERER_LOG_WARNING(
+            "ignoring bvh cache file %s for triangle tree #" FMT_UNIQUE_ID ": file is truncated or corrupted.",
+            filepath.c_str(),
+            m_arguments.m_triangle_tree_uid);
+
+        // Restore the state of a freshly constructed tree.
+        clear_release_memory(m_nodes);
+        clear_release_memory(m_node_bboxes);
+        m_wide_tree_4.clear();
+        m_wide_tree_8.clear();
+        m_quantized_wide_tree_4.clear();
+        m_quantized_wide_tree_8.clear();
+        clear_release_memory(m_triangle_keys);
+        clear_release_memory(m_leaf_data);
+        m_reference_sah_cost = 0.0;
+        m_node_width = 2;
+        m_quantized_nodes = false;
+
+        return false;
+    }
+
+    RENDERER_LOG_INFO(
+        "loaded triangle tree #" FMT_UNIQUE_ID " (%s %s) from bvh cache file %s in %s.",
+        m_arguments.m_triangle_tree_uid,
+        pretty_uint(m_static_triangle_count + m_moving_triangle_count).c_str(),
+        plural(m_static_triangle_count + m_moving_triangle_count, "triangle").c_str(),
+        filepath.c_str(),
+        pretty_time(stopwatch.measure().get_seconds()).c_str());
+
+    return true;
+}
+
+bool TriangleTree::save(const std::string& filepath) const
+{
+    // Write to a temporary file first so that concurrent renders never see a partial file.
+    const bf::path path(filepath);
+    if (path.has_parent_path())
+    {
+        // Failures are reported when opening the file.
+        boost::system::error_code ignored;
+        bf::create_directories(path.parent_path(), ignored);
+    }
+
+    boost::system::error_code error;
+    const bf::path temp_path = bf::unique_path(path.string() + ".%%%%%%%%.tmp", error);
+
+    bool success = false;
+
+    if (!error)
+    {
+        BufferedFile file;
+        if (file.open(temp_path.string().c_str(), BufferedFile::BinaryType, BufferedFile::WriteMode, TriangleTreeCacheBufferSize))
+        {
+            PassthroughWriterAdapter writer(file);
+
+            const TriangleTreeCacheHeader header(m_arguments);
+            const std::uint64_t static_triangle_count = m_static_triangle_count;
+            const std::uint64_t moving_triangle_count = m_moving_triangle_count;
+            const std::uint64_t node_width = m_node_width;
+            const std::uint64_t quantized_nodes = m_quantized_nodes ? 1 : 0;
+
+            success =
+                writer.write(header) == sizeof(header) &&
+                writer.write(static_triangle_count) == sizeof(static_triangle_count) &&
+                writer.write(moving_triangle_count) == sizeof(moving_triangle_count) &&
+                writer.write(m_reference_sah_cost) == sizeof(m_reference_sah_cost) &&
+                writer.write(node_width) == sizeof(node_width) &&
+                writer.write(quantized_nodes) == sizeof(quantized_nodes) &&
+                bvh::write_plain_vector(writer, m_triangle_keys) &&
+                bvh::write_plain_vector(writer, m_leaf_data) &&
+                bvh::TreeSerializer<TreeType>::write(writer, *this) &&
+                bvh::WideTreeSerializer<WideTree4Type>::write(writer, m_wide_tree_4) &&
+                bvh::WideTreeSerializer<WideTree8Type>::write(writer, m_wide_tree_8) &&
+                bvh::WideTreeSerializer<QuantizedWideTree4Type>::write(writer, m_quantized_wide_tree_4) &&
+                bvh::WideTreeSerializer<QuantizedWideTree8Type>::write(writer, m_quantized_wide_tree_8);
+
+            success = file.close() && success;
+        }
+
+        if (success)
+        {
+            bf::rename(temp_path, path, error);
+            success = !error;
+        }
+
+        if (!success)
+            bf::remove(temp_path, error);
+    }
+
+    if (!success)
+    {
+        RENDERER_LOG_WARNING(
+            "failed to write bvh cache file %s for triangle tree #" FMT_UNIQUE_ID ".",
+            filepath.c_str(),
+            m_arguments.m_triangle_tree_uid);
+    }
+
+    return success;
+}
+
+namespace
+{
+    bool triangle_key_less(const TriangleKey& lhs, const TriangleKey& rhs)
+    {
+        return
+            lhs.get_object_instance_index() != rhs.get_object_instance_index()
+                ? lhs.get_object_instance_index() < rhs.get_object_instance_index()
+                : lhs.get_triangle_index() < rhs.get_triangle_index();
+    }
+
+    // Find the collected triangle corresponding to each triangle of the tree.
+    // Collected triangles are sorted by object instance and triangle index.
+    // Return false if a triangle of the tree was not collected, or if a collected
+    // triangle is not referenced by the tree.
+    bool map_triangle_keys(
+        const std::vector<TriangleKey>&     tree_triangle_keys,
+        const std::vector<TriangleKey>&     triangle_keys,
+        std::vector<size_t>&                triangle_indices)
+    {
+        std::vector<bool> referenced(triangle_keys.size(), false);
+        size_t referenced_count = 0;
+
+        triangle_indices.resize(tree_triangle_keys.size());
+
+        for (size_t i = 0, e = tree_triangle_keys.size(); i < e; ++i)
+        {
+            const std::vector<TriangleKey>::const_iterator it =
+                std::lower_bound(
+                    triangle_keys.begin(),
+                    triangle_keys.end(),
+                    tree_triangle_keys[i],
+                    triangle_key_less);
+
+            if (it == triangle_keys.end() || triangle_key_less(tree_triangle_keys[i], *it))
+                return false;
+
+            const size_t triangle_index = it - triangle_keys.begin();
+            triangle_indices[i] = triangle_index;
+
+            if (!referenced[triangle_index])
+            {
+                referenced[triangle_index] = true;
+                ++referenced_count;
+            }
+        }
+
+        return referenced_count == triangle_keys.size();
+    }
+
+    //
+    // Recompute the bounding box of a leaf and re-encode its triangles in place.
+    // Since the set of triangles and their number of motion segments did not
+    // change, the encoded triangles have the same size as before.
+    //
+
+    class TriangleLeafRefitter
+    {
+      public:
+        TriangleLeafRefitter(
+            const std::vector<TriangleVertexInfo>&  triangle_vertex_infos,
+            const std::vector<GVector3>&            triangle_vertices,
+            const std::vector<GAABB3>&              triangle_bboxes,
+            const std::vector<size_t>&              triangle_indices,
+            std::vector<std::uint8_t>&              leaf_data,
+            const bool                              single_precision)
+          : m_triangle_vertex_infos(triangle_vertex_infos)
+          , m_triangle_vertices(triangle_vertices)
+          , m_triangle_bboxes(triangle_bboxes)
+          , m_triangle_indices(triangle_indices)
+          , m_leaf_data(leaf_data)
+          , m_single_precision(single_precision)
+        {
+        }
+
+        AABB3d operator()(TriangleTree::NodeType& leaf) const
+        {
+            const size_t item_begin = leaf.get_item_index();
+            const size_t item_count = leaf.get_item_count();
+
+            GAABB3 bbox;
+            bbox.invalidate();
+
+            for (size_t i = 0; i < item_count; ++i)
+                bbox.insert(m_triangle_bboxes[m_triangle_indices[item_begin + i]]);
+
+            std::uint8_t* user_data = &leaf.get_user_data<std::uint8_t>();
+            const std::uint32_t leaf_data_index = *reinterpret_cast<const std::uint32_t*>(user_data);
+
+            MemoryWriter writer(
+                leaf_data_index == ~std::uint32_t(0)
+                    ? user_data + sizeof(std::uint32_t)
+                    : &m_leaf_data[leaf_data_index]);
+
+            TriangleEncoder::encode(
+                m_triangle_vertex_infos,
+                m_triangle_vertices,
+                m_triangle_indices,
+                item_begin,
+                item_count,
+                m_single_precision,
+                writer);
+
+            return AABB3d(bbox);
+        }
+
+      private:
+        const std::vector<TriangleVertexInfo>&      m_triangle_vertex_infos;
+        const std::vector<GVector3>&                m_triangle_vertices;
+        const std::vector<GAABB3>&                  m_triangle_bboxes;
+        const std::vector<size_t>&                  m_triangle_indices;
+        std::vector<std::uint8_t>&                  m_leaf_data;
+        const bool                                  m_single_precision;
+    };
+}
+
+bool TriangleTree::refit(const GAABB3& bbox)
+{
+    const ParamArray& params = m_arguments.m_assembly.get_parameters().child("acceleration_structure");
+    const double time = params.get_optional<double>("time", 0.5);
+
+    if (!params.get_optional<bool>("enable_refit", true))
+        return false;
+
+    // Triangles with a different number of motion segments would be encoded differently.
+    if (collect_motion_segment_counts(m_arguments.m_assembly) != m_motion_segment_counts)
+        return false;
+
+    Stopwatch<DefaultWallclockTimer> stopwatch;
+    stopwatch.start();
+
+    // Collect triangles intersecting the new bounding box of the assembly.
+    const Arguments arguments(
+        m_arguments.m_scene,
+        m_arguments.m_triangle_tree_uid,
+        bbox,
+        m_arguments.m_assembly,
+        m_arguments.m_node_width,
+        m_arguments.m_single_precision,
+        m_arguments.m_quantized_nodes);
+    std::vector<TriangleKey> triangle_keys;
+    std::vector<TriangleVertexInfo> triangle_vertex_infos;
+    std::vector<GVector3> triangle_vertices;
+    std::vector<GAABB3> triangle_bboxes;
+    collect_triangles(
+        arguments,
+        time,
+        false,
+        &triangle_keys,
+        &triangle_vertex_infos,
+        &triangle_vertices,
+        &triangle_bboxes);
+    const double collection_time = stopwatch.measure().get_seconds();
+
+    // The tree can only be refit if it references the same triangles.
+    std::vector<size_t> triangle_indices;
+    if (!map_triangle_keys(m_triangle_keys, triangle_keys, triangle_indices))
+    {
+        RENDERER_LOG_INFO(
+            "triangles of triangle tree #" FMT_UNIQUE_ID " have changed, rebuilding it.",
+            m_arguments.m_triangle_tree_uid);
+        return false;
+    }
+
+    RENDERER_LOG_INFO(
+        "refitting triangle tree #" FMT_UNIQUE_ID "...",
+        m_arguments.m_triangle_tree_uid);
+
+    // Primitive attributes may have changed.
+    for (size_t i = 0, e = m_triangle_keys.size(); i < e; ++i)
+        m_triangle_keys[i] = triangle_keys[triangle_indices[i]];
+
+    // Refit the tree used for intersection.
+    const TriangleLeafRefitter leaf_refitter(
+        triangle_vertex_infos,
+        triangle_vertices,
+        triangle_bboxes,
+        triangle_indices,
+        m_leaf_data,
+        m_single_precision);
+    Statistics statistics;
+    bool success;
+    if (m_node_width == 2)
+        success = refit<bvh::Refitter<TreeType, TriangleLeafRefitter>>(*this, leaf_refitter, params, statistics);
+    else if (m_quantized_nodes)
+    {
+        success =
+            m_node_width == 4
+                ? refit<bvh::WideRefitter<QuantizedWideTree4Type, TriangleLeafRefitter>>(m_quantized_wide_tree_4, leaf_refitter, params, statistics)
+                : refit<bvh::WideRefitter<QuantizedWideTree8Type, TriangleLeafRefitter>>(m_quantized_wide_tree_8, leaf_refitter, params, statistics);
+    }
+    else
+    {
+        success =
+            m_node_width == 4
+                ? refit<bvh::WideRefitter<WideTree4Type, TriangleLeafRefitter>>(m_wide_tree_4, leaf_refitter, params, statistics)
+                : refit<bvh::WideRefitter<WideTree8Type, TriangleLeafRefitter>>(m_wide_tree_8, leaf_refitter, params, statistics);
+    }
+
+    if (!success)
+        return false;
+
+    // Recompute motion bounding boxes. Only binary trees can have moving triangles.
+    if (m_moving_triangle_count > 0)
+    {
+        assert(m_node_width == 2);
+        m_node_bboxes.clear();
+        compute_motion_bboxes(
+            triangle_indices,
+            triangle_vertex_infos,
+            triangle_vertices,
+            0);
+    }
+
+    statistics.insert_time("collection time", collection_time);
+    statistics.insert_time("total refit time", stopwatch.measure().get_seconds());
+
+    // Print triangle tree statistics.
+    RENDERER_LOG_DEBUG("%s",
+        StatisticsVector::make(
+            "triangle tree #" + to_string(m_arguments.m_triangle_tree_uid) + " refit statistics",
+            statistics).to_string().c_str());
+
+    return true;
+}
+
+template <typename Refitter, typename RefitTree, typename LeafRefitter>
+bool TriangleTree::refit(
+    RefitTree&              tree,
+    const LeafRefitter&     leaf_refitter,
+    const ParamArray&       params,
+    Statistics&             statistics)
+{
+    const GScalar interior_node_traversal_cost = params.get_optional<GScalar>("interior_node_traversal_cost", TriangleTreeDefaultInteriorNodeTraversalCost);
+    const GScalar triangle_intersection_cost = params.get_optional<GScalar>("triangle_intersection_cost", TriangleTreeDefaultTriangleIntersectionCost);
+    const double max_refit_cost_ratio = params.get_optional<double>("max_refit_cost_ratio", TriangleTreeDefaultMaxRefitCostRatio);
+    const size_t refit_thread_count =
+        m_triangle_keys.size() >= TriangleTreeMinParallelRefitSize
+            ? params.get_optional<size_t>("build_threads", System::get_logical_cpu_core_count())
+            : 1;
+
+    // Refit leaves over a pool of worker threads if the tree is large enough to be worth it.
+    Refitter refitter(interior_node_traversal_cost, triangle_intersection_cost);
+    if (refit_thread_count > 1)
+    {
+        JobQueue job_queue;
+        JobManager job_manager(
+            global_logger(),
+            job_queue,
+            refit_thread_count,
+            JobManager::KeepRunningOnEmptyQueue);
+        job_manager.start();
+        refitter.template refit<DefaultWallclockTimer>(tree, leaf_refitter, job_queue, refit_thread_count);
+        job_manager.stop();
+    }
+    else refitter.template refit<DefaultWallclockTimer>(tree, leaf_refitter);
+
+    // The cost of the tree before its first refit is the cost of the tree as built.
+    if (m_reference_sah_cost == 0.0)
+        m_reference_sah_cost = refitter.get_initial_cost();
+
+    const double cost_ratio =
+        m_reference_sah_cost > 0.0 ? refitter.get_cost() / m_reference_sah_cost : 1.0;
+
+    statistics.insert("refit threads", refit_thread_count);
+    statistics.insert_time("refit time", refitter.get_refit_time());
+    statistics.insert("sah cost ratio", cost_ratio);
+
+    if (cost_ratio > max_refit_cost_ratio)
+    {
+        RENDERER_LOG_INFO(
+            "quality of triangle tree #" FMT_UNIQUE_ID " degraded too much after refit "
+            "(sah cost ratio %.2f), rebuilding it.",
+            m_arguments.m_triangle_tree_uid,
+            cost_ratio);
+        return false;
+    }
+
+    return true;
+}
+
 void TriangleTree::update_intersection_filters()
 {
     // Collect object instances.
@@ -1368,6 +2128,16 @@ bool TriangleLeafVisitor::visit(
             : &m_tree.m_leaf_data[leaf_data_index];     // triangles are stored in the tree
     MemoryReader reader(leaf_data);
 
+    // In single precision mode, triangles are intersected with a single precision copy of the ray.
+    // The rounding error of its origin is taken into account to prevent self-intersections.
+    GRay3 single_ray;
+    GVector3 single_org_error;
+    if (m_single_precision)
+    {
+        single_ray = GRay3(ray);
+        single_org_error = GWatertightTriangleType::compute_rounding_error(ray.m_org);
+    }
+
     // Sequentially intersect all triangles of the leaf.
     for (size_t triangle_index = node.get_item_index(),
                 triangle_count = node.get_item_count();
@@ -1392,6 +2162,36 @@ bool TriangleLeafVisitor::visit(
                 continue;
             }
 
+            if (m_single_precision)
+            {
+                const GWatertightTriangleType& triangle = reader.read<GWatertightTriangleType>();
+
+                // Intersect the triangle.
+                GScalar t, u, v;
+                if (triangle.intersect(single_ray, single_org_error, t, u, v) && t < ray.m_tmax)
+                {
+                    // Optionally filter intersections.
+                    if (m_has_intersection_filters)
+                    {
+                        const TriangleKey& triangle_key = m_tree.m_triangle_keys[triangle_index];
+                        const IntersectionFilter* filter =
+                            m_tree.m_intersection_filters[triangle_key.get_object_instance_index()];
+                        if (filter && !filter->accept(triangle_key, u, v))
+                            continue;
+                    }
+
+                    m_interpolated_triangle = GTriangleType(triangle.m_v0, triangle.m_v1, triangle.m_v2);
+                    m_hit_triangle = &m_interpolated_triangle;
+                    m_hit_triangle_index = triangle_index;
+                    m_shading_point.m_ray.m_tmax = t;
+                    m_shading_point.m_bary[0] = u;
+                    m_shading_point.m_bary[1] = v;
+                    single_ray.m_tmax = t;
+                }
+
+                continue;
+            }
+
             // Read the triangle, converting it to the right format if necessary.
             const GTriangleType& triangle = reader.read<GTriangleType>();
             const TriangleReader triangle_reader(triangle);
@@ -1447,6 +2247,35 @@ bool TriangleLeafVisitor::visit(
             // Skip the remaining motion steps of this triangle.
             reader += (motion_segment_count - base_index - 1) * TriangleSize;
 
+            if (m_single_precision)
+            {
+                // Intersect the triangle.
+                const GWatertightTriangleType triangle(v0, v1, v2);
+                GScalar t, u, v;
+                if (triangle.intersect(single_ray, single_org_error, t, u, v) && t < ray.m_tmax)
+                {
+                    // Optionally filter intersections.
+                    if (m_has_intersection_filters)
+                    {
+                        const TriangleKey& triangle_key = m_tree.m_triangle_keys[triangle_index];
+                        const IntersectionFilter* filter =
+                            m_tree.m_intersection_filters[triangle_key.get_object_instance_index()];
+                        if (filter && !filter->accept(triangle_key, u, v))
+                            continue;
+                    }
+
+                    m_interpolated_triangle = GTriangleType(v0, v1, v2);
+                    m_hit_triangle = &m_interpolated_triangle;
+                    m_hit_triangle_index = triangle_index;
+                    m_shading_point.m_ray.m_tmax = t;
+                    m_shading_point.m_bary[0] = u;
+                    m_shading_point.m_bary[1] = v;
+                    single_ray.m_tmax = t;
+                }
+
+                continue;
+            }
+
             // Build the triangle and convert it to the right format if necessary.
             const GTriangleType triangle(v0, v1, v2);
             const TriangleReader reader(triangle);
@@ -1522,6 +2351,16 @@ bool TriangleLeafProbeVisitor::visit(
             : &m_tree.m_leaf_data[leaf_data_index];     // triangles are stored in the tree
     MemoryReader reader(leaf_data);
 
+    // In single precision mode, triangles are intersected with a single precision copy of the ray.
+    // The rounding error of its origin is taken into account to prevent self-intersections.
+    GRay3 single_ray;
+    GVector3 single_org_error;
+    if (m_single_precision)
+    {
+        single_ray = GRay3(ray);
+        single_org_error = GWatertightTriangleType::compute_rounding_error(ray.m_org);
+    }
+
     // Sequentially intersect triangles until a hit is found.
     for (size_t triangle_count = node.get_item_count(); triangle_count--; )
     {
@@ -1543,6 +2382,19 @@ bool TriangleLeafProbeVisitor::visit(
                 continue;
             }
 
+            if (m_single_precision)
+            {
+                // Intersect the triangle.
+                const GWatertightTriangleType& triangle = reader.read<GWatertightTriangleType>();
+                if (triangle.intersect(single_ray, single_org_error))
+                {
+                    m_hit = true;
+                    return false;
+                }
+
+                continue;
+            }
+
             // Read the triangle, converting it to the right format if necessary.
             const GTriangleType& triangle = reader.read<GTriangleType>();
             const TriangleReader triangle_reader(triangle);
@@ -1581,15 +2433,28 @@ bool TriangleLeafProbeVisitor::visit(
             v1 += reader.read<GVector3>() * frac;
             v2 += reader.read<GVector3>() * frac;
 
-            // Build the triangle and convert it to the right format if necessary.
-            const GTriangleType triangle(v0, v1, v2);
-            const TriangleReader triangle_reader(triangle);
-
-            // Intersect the triangle.
-            if (triangle_reader.m_triangle.intersect(ray))
+            if (m_single_precision)
             {
-                m_hit = true;
-                return false;
+                // Intersect the triangle.
+                const GWatertightTriangleType triangle(v0, v1, v2);
+                if (triangle.intersect(single_ray, single_org_error))
+                {
+                    m_hit = true;
+                    return false;
+                }
+            }
+            else
+            {
+                // Build the triangle and convert it to the right format if necessary.
+                const GTriangleType triangle(v0, v1, v2);
+                const TriangleReader triangle_reader(triangle);
+
+                // Intersect the triangle.
+                if (triangle_reader.m_triangle.intersect(ray))
+                {
+                    m_hit = true;
+                    return false;
+                }
             }
 
             // Skip the remaining motion steps of this triangle.
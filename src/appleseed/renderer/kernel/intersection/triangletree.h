@@ -52,6 +52,7 @@
 #include <cstdint>
 #include <map>
 #include <memory>
+#include <string>
 #include <vector>
 
 // Forward declarations.
@@ -80,6 +81,26 @@ class TriangleTree
            >
 {
   public:
+    // Wide trees, obtained by collapsing the binary tree.
+    typedef foundation::bvh::WideTree<
+        foundation::AlignedVector<foundation::bvh::WideNode<4>>,
+        NodeVectorType
+    > WideTree4Type;
+    typedef foundation::bvh::WideTree<
+        foundation::AlignedVector<foundation::bvh::WideNode<8>>,
+        NodeVectorType
+    > WideTree8Type;
+
+    // Wide trees with quantized child bounding boxes.
+    typedef foundation::bvh::WideTree<
+        foundation::AlignedVector<foundation::bvh::QuantizedWideNode<4>>,
+        NodeVectorType
+    > QuantizedWideTree4Type;
+    typedef foundation::bvh::WideTree<
+        foundation::AlignedVector<foundation::bvh::QuantizedWideNode<8>>,
+        NodeVectorType
+    > QuantizedWideTree8Type;
+
     // Construction arguments.
     struct Arguments
     {
@@ -87,16 +108,29 @@ class TriangleTree
         const foundation::UniqueID              m_triangle_tree_uid;
         const GAABB3                            m_bbox;
         const Assembly&                         m_assembly;
+        const size_t                            m_node_width;
+        const bool                              m_single_precision;
+        const bool                              m_quantized_nodes;
+        const std::string                       m_cache_filepath;   // BVH cache file, empty if caching is disabled
+        const std::uint64_t                     m_mesh_signature;   // content hash of the mesh geometry, checked against the BVH cache file
+        const std::uint64_t                     m_params_signature; // hash of the acceleration structure parameters, idem
 
         // Constructor.
         Arguments(
             const Scene&                        scene,
             const foundation::UniqueID          triangle_tree_uid,
             const GAABB3&                       bbox,
-            const Assembly&                     assembly);
+            const Assembly&                     assembly,
+            const size_t                        node_width = TriangleTreeDefaultNodeWidth,
+            const bool                          single_precision = TriangleTreeDefaultSinglePrecision,
+            const bool                          quantized_nodes = TriangleTreeDefaultQuantizedNodes,
+            const std::string&                  cache_filepath = std::string(),
+            const std::uint64_t                 mesh_signature = 0,
+            const std::uint64_t                 params_signature = 0);
     };
 
-    // Constructor, builds the tree for a given assembly.
+    // Constructor, builds the tree for a given assembly, or loads it from the
+    // BVH cache file if one is specified and is valid.
     explicit TriangleTree(const Arguments& arguments);
 
     // Destructor.
@@ -105,10 +139,30 @@ class TriangleTree
     // Update the non-geometry aspects of the tree.
     void update_non_geometry(const bool enable_intersection_filters);
 
+    // Update the bounding boxes of the tree after vertices have moved, without changing
+    // its topology. 'bbox' is the new bounding box of the assembly. Return false if the
+    // triangles of the assembly changed or if the quality of the tree degraded too much;
+    // the tree is then left in an unspecified state and must be rebuilt.
+    bool refit(const GAABB3& bbox);
+
     // Return the number of static and moving triangles.
     size_t get_static_triangle_count() const;
     size_t get_moving_triangle_count() const;
 
+    // Return the number of children per interior node of the tree used for
+    // intersection: 2 for the binary tree, 4 or 8 for the wide trees.
+    size_t get_node_width() const;
+
+    // Return true if the wide tree used for intersection has quantized nodes.
+    bool has_quantized_nodes() const;
+
+    // Access the wide trees. Only valid if get_node_width() returns 4 or 8,
+    // and if has_quantized_nodes() returns false or true respectively.
+    const WideTree4Type& get_wide_tree_4() const;
+    const WideTree8Type& get_wide_tree_8() const;
+    const QuantizedWideTree4Type& get_quantized_wide_tree_4() const;
+    const QuantizedWideTree8Type& get_quantized_wide_tree_8() const;
+
     // Return the size (in bytes) of this object in memory.
     size_t get_memory_size() const;
 
@@ -121,6 +175,18 @@ class TriangleTree
     size_t                                      m_static_triangle_count;
     size_t                                      m_moving_triangle_count;
 
+    bool                                        m_single_precision;
+
+    std::vector<size_t>                         m_motion_segment_counts;    // per object instance
+    double                                      m_reference_sah_cost;       // SAH cost of the tree as built, 0 if unknown
+
+    size_t                                      m_node_width;
+    WideTree4Type                               m_wide_tree_4;
+    WideTree8Type                               m_wide_tree_8;
+    bool                                        m_quantized_nodes;
+    QuantizedWideTree4Type                      m_quantized_wide_tree_4;
+    QuantizedWideTree8Type                      m_quantized_wide_tree_8;
+
     std::vector<TriangleKey>                    m_triangle_keys;
     std::vector<std::uint8_t>                   m_leaf_data;
 
@@ -152,6 +218,24 @@ class TriangleTree
         const std::vector<TriangleKey>&         triangle_keys,
         foundation::Statistics&                 statistics);
 
+    void collapse(foundation::Statistics& statistics);
+
+    // Load the tree from a BVH cache file, or save it to one. Return true on success.
+    bool load(const std::string& filepath);
+    bool save(const std::string& filepath) const;
+
+    template <typename Refitter, typename RefitTree, typename LeafRefitter>
+    bool refit(
+        RefitTree&                              tree,
+        const LeafRefitter&                     leaf_refitter,
+        const ParamArray&                       params,
+        foundation::Statistics&                 statistics);
+
+    template <typename WideTree>
+    void collapse(
+        WideTree&                               wide_tree,
+        foundation::Statistics&                 statistics);
+
     void update_intersection_filters();
     void delete_intersection_filters();
 };
@@ -227,6 +311,7 @@ class TriangleLeafVisitor
 
   private:
     const TriangleTree&     m_tree;
+    const bool              m_single_precision;
     const bool              m_has_intersection_filters;
     ShadingPoint&           m_shading_point;
     GTriangleType           m_interpolated_triangle;
@@ -265,6 +350,7 @@ class TriangleLeafProbeVisitor
     const TriangleTree&         m_tree;
     const double                m_ray_time;
     const VisibilityFlags::Type m_ray_flags;
+    const bool                  m_single_precision;
     const bool                  m_has_intersection_filters;
 };
 
@@ -287,6 +373,62 @@ typedef foundation::bvh::Intersector<
     TriangleTreeStackSize
 > TriangleTreeProbeIntersector;
 
+typedef foundation::bvh::WideIntersector<
+    TriangleTree::WideTree4Type,
+    TriangleLeafVisitor,
+    foundation::Ray3d,
+    TriangleTreeWideStackSize
+> TriangleTree4Intersector;
+
+typedef foundation::bvh::WideIntersector<
+    TriangleTree::WideTree4Type,
+    TriangleLeafProbeVisitor,
+    foundation::Ray3d,
+    TriangleTreeWideStackSize
+> TriangleTree4ProbeIntersector;
+
+typedef foundation::bvh::WideIntersector<
+    TriangleTree::WideTree8Type,
+    TriangleLeafVisitor,
+    foundation::Ray3d,
+    TriangleTreeWideStackSize
+> TriangleTree8Intersector;
+
+typedef foundation::bvh::WideIntersector<
+    TriangleTree::WideTree8Type,
+    TriangleLeafProbeVisitor,
+    foundation::Ray3d,
+    TriangleTreeWideStackSize
+> TriangleTree8ProbeIntersector;
+
+typedef foundation::bvh::WideIntersector<
+    TriangleTree::QuantizedWideTree4Type,
+    TriangleLeafVisitor,
+    foundation::Ray3d,
+    TriangleTreeWideStackSize
+> TriangleTreeQuantized4Intersector;
+
+typedef foundation::bvh::WideIntersector<
+    TriangleTree::QuantizedWideTree4Type,
+    TriangleLeafProbeVisitor,
+    foundation::Ray3d,
+    TriangleTreeWideStackSize
+> TriangleTreeQuantized4ProbeIntersector;
+
+typedef foundation::bvh::WideIntersector<
+    TriangleTree::QuantizedWideTree8Type,
+    TriangleLeafVisitor,
+    foundation::Ray3d,
+    TriangleTreeWideStackSize
+> TriangleTreeQuantized8Intersector;
+
+typedef foundation::bvh::WideIntersector<
+    TriangleTree::QuantizedWideTree8Type,
+    TriangleLeafProbeVisitor,
+    foundation::Ray3d,
+    TriangleTreeWideStackSize
+> TriangleTreeQuantized8ProbeIntersector;
+
 
 //
 // TriangleTree class implementation.
@@ -302,6 +444,36 @@ inline size_t TriangleTree::get_moving_triangle_count() const
     return m_moving_triangle_count;
 }
 
+inline size_t TriangleTree::get_node_width() const
+{
+    return m_node_width;
+}
+
+inline bool TriangleTree::has_quantized_nodes() const
+{
+    return m_quantized_nodes;
+}
+
+inline const TriangleTree::WideTree4Type& TriangleTree::get_wide_tree_4() const
+{
+    return m_wide_tree_4;
+}
+
+inline const TriangleTree::WideTree8Type& TriangleTree::get_wide_tree_8() const
+{
+    return m_wide_tree_8;
+}
+
+inline const TriangleTree::QuantizedWideTree4Type& TriangleTree::get_quantized_wide_tree_4() const
+{
+    return m_quantized_wide_tree_4;
+}
+
+inline const TriangleTree::QuantizedWideTree8Type& TriangleTree::get_quantized_wide_tree_8() const
+{
+    return m_quantized_wide_tree_8;
+}
+
 
 //
 // TriangleLeafVisitor class implementation.
@@ -311,6 +483,7 @@ inline TriangleLeafVisitor::TriangleLeafVisitor(
     const TriangleTree&         tree,
     ShadingPoint&               shading_point)
   : m_tree(tree)
+  , m_single_precision(tree.m_single_precision)
   , m_has_intersection_filters(!tree.m_intersection_filters.empty())
   , m_shading_point(shading_point)
   , m_hit_triangle(nullptr)
@@ -329,6 +502,7 @@ inline TriangleLeafProbeVisitor::TriangleLeafProbeVisitor(
   : m_tree(tree)
   , m_ray_time(ray_time)
   , m_ray_flags(ray_flags)
+  , m_single_precision(tree.m_single_precision)
   , m_has_intersection_filters(!tree.m_intersection_filters.empty())
 {
 }
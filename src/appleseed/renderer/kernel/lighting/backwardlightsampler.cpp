@@ -39,6 +39,10 @@
 #include "renderer/modeling/material/material.h"
 #include "renderer/modeling/scene/scene.h"
 
+// appleseed.foundation headers.
+#include "foundation/math/scalar.h"
+#include "foundation/platform/system.h"
+
 // Standard headers.
 #include <cassert>
 #include <string>
@@ -78,6 +82,24 @@ Dictionary BackwardLightSampler::get_params_metadata()
                             .insert("label", "Light Tree")
                             .insert("help", "Lights organized in a BVH"))));
 
+    metadata.insert(
+        "max_light_cut_size",
+        Dictionary()
+            .insert("type", "int")
+            .insert("default", "1")
+            .insert("min", "1")
+            .insert("max", "64")
+            .insert("label", "Max Light Cut Size")
+            .insert("help", "Maximum number of light tree nodes selected once per shading point and shared by all its light samples; 1 walks the light tree from the root for every sample"));
+
+    metadata.insert(
+        "enable_orientation_culling",
+        Dictionary()
+            .insert("type", "bool")
+            .insert("default", "false")
+            .insert("label", "Enable Orientation Culling")
+            .insert("help", "Skip light tree nodes whose lights all face away from the shading point"));
+
     metadata.merge(LightSamplerBase::get_params_metadata());
 
     return metadata;
@@ -90,6 +112,11 @@ BackwardLightSampler::BackwardLightSampler(
 {
     // Read which sampling algorithm should be used.
     m_use_light_tree = params.get_optional<std::string>("algorithm", "cdf") == "lighttree";
+    m_max_light_cut_size =
+        clamp<size_t>(
+            params.get_optional<size_t>("max_light_cut_size", 1),
+            1,
+            LightTreeCut::MaxSize);
 
     RENDERER_LOG_INFO("collecting light emitters...");
 
@@ -166,10 +193,15 @@ BackwardLightSampler::BackwardLightSampler(
     if (m_use_light_tree)
     {
         // Initialize the LightTree only after the lights are collected.
-        m_light_tree.reset(new LightTree(m_light_tree_lights, m_emitting_shapes));
+        m_light_tree.reset(
+            new LightTree(
+                m_light_tree_lights,
+                m_emitting_shapes,
+                params.get_optional<bool>("enable_orientation_culling", false)));
 
         // Build the light tree.
-        const std::vector<size_t> tri_index_to_node_index = m_light_tree->build();
+        const std::vector<size_t> tri_index_to_node_index =
+            m_light_tree->build(System::get_logical_cpu_core_count());
         assert(tri_index_to_node_index.size() == m_emitting_shapes.size());
 
         // Associate light tree nodes to emitting shapes.
@@ -206,7 +238,58 @@ void BackwardLightSampler::sample_lightset(
     if (m_use_light_tree)
     {
         // Light tree sampling.
-        sample_light_tree(
+        if (use_light_cuts())
+        {
+            LightTreeCut cut;
+            m_light_tree->select_cut(shading_point, m_max_light_cut_size, cut);
+
+            sample_light_tree(
+                time,
+                s,
+                shading_point,
+                &cut,
+                light_sample);
+        }
+        else
+        {
+            sample_light_tree(
+                time,
+                s,
+                shading_point,
+                nullptr,
+                light_sample);
+        }
+    }
+    else
+    {
+        // CDF-based sampling.
+        sample_emitting_shapes(
+            time,
+            s,
+            light_sample);
+    }
+}
+
+void BackwardLightSampler::select_light_cut(
+    const ShadingPoint&                 shading_point,
+    LightTreeCut&                       cut) const
+{
+    cut.clear();
+
+    if (use_light_cuts() && m_light_tree->is_built())
+        m_light_tree->select_cut(shading_point, m_max_light_cut_size, cut);
+}
+
+void BackwardLightSampler::sample_lightset(
+    const ShadingRay::Time&             time,
+    const Vector3f&                     s,
+    const ShadingPoint&                 shading_point,
+    const LightTreeCut&                 cut,
+    LightSample&                        light_sample) const
+{
+    if (cut.empty())
+    {
+        sample_lightset(
             time,
             s,
             shading_point,
@@ -214,10 +297,12 @@ void BackwardLightSampler::sample_lightset(
     }
     else
     {
-        // CDF-based sampling.
-        sample_emitting_shapes(
+        assert(use_light_cuts());
+        sample_light_tree(
             time,
             s,
+            shading_point,
+            &cut,
             light_sample);
     }
 }
@@ -225,6 +310,17 @@ void BackwardLightSampler::sample_lightset(
 float BackwardLightSampler::evaluate_pdf(
     const ShadingPoint&                 light_shading_point,
     const ShadingPoint&                 surface_shading_point) const
+{
+    LightTreeCut cut;
+    select_light_cut(surface_shading_point, cut);
+
+    return evaluate_pdf(light_shading_point, surface_shading_point, cut);
+}
+
+float BackwardLightSampler::evaluate_pdf(
+    const ShadingPoint&                 light_shading_point,
+    const ShadingPoint&                 surface_shading_point,
+    const LightTreeCut&                 cut) const
 {
     const EmittingShapeKey shape_key(
         light_shading_point.get_assembly_instance().get_uid(),
@@ -238,12 +334,26 @@ float BackwardLightSampler::evaluate_pdf(
 
     const EmittingShape* shape = *shape_ptr;
 
-    const float shape_probability =
-        m_use_light_tree
-            ? m_light_tree->evaluate_node_pdf(
+    float shape_probability;
+
+    if (!cut.empty())
+    {
+        assert(use_light_cuts());
+        shape_probability =
+            m_light_tree->evaluate_node_pdf(
                 surface_shading_point,
-                shape->m_light_tree_node_index)
-            : shape->evaluate_pdf_uniform();
+                cut,
+                shape->m_light_tree_node_index);
+    }
+    else
+    {
+        shape_probability =
+            m_use_light_tree
+                ? m_light_tree->evaluate_node_pdf(
+                    surface_shading_point,
+                    shape->m_light_tree_node_index)
+                : shape->evaluate_pdf_uniform();
+    }
 
     assert(shape_probability >= 0.0f);
 
@@ -254,6 +364,7 @@ void BackwardLightSampler::sample_light_tree(
     const ShadingRay::Time&             time,
     const Vector3f&                     s,
     const ShadingPoint&                 shading_point,
+    const LightTreeCut*                 cut,
     LightSample&                        light_sample) const
 {
     assert(has_lightset());
@@ -261,12 +372,26 @@ void BackwardLightSampler::sample_light_tree(
     LightType light_type;
     size_t light_index;
     float light_prob;
-    m_light_tree->sample(
-        shading_point,
-        s[0],
-        light_type,
-        light_index,
-        light_prob);
+
+    if (cut != nullptr)
+    {
+        m_light_tree->sample(
+            shading_point,
+            *cut,
+            s[0],
+            light_type,
+            light_index,
+            light_prob);
+    }
+    else
+    {
+        m_light_tree->sample(
+            shading_point,
+            s[0],
+            light_type,
+            light_index,
+            light_prob);
+    }
 
     if (light_type == NonPhysicalLightType)
     {
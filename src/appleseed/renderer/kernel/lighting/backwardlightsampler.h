@@ -85,6 +85,20 @@ class BackwardLightSampler
         const ShadingPoint&                 shading_point,
         LightSample&                        light_sample) const;
 
+    // Select the light tree cut from which all the light samples of a given shading
+    // point will be drawn. The cut is left empty if light cuts are not in use.
+    void select_light_cut(
+        const ShadingPoint&                 shading_point,
+        LightTreeCut&                       cut) const;
+
+    // Sample the light set using a cut previously selected for this shading point.
+    void sample_lightset(
+        const ShadingRay::Time&             time,
+        const foundation::Vector3f&         s,
+        const ShadingPoint&                 shading_point,
+        const LightTreeCut&                 cut,
+        LightSample&                        light_sample) const;
+
     // Compute the probability density in area measure of a given light sample.
     // Shading points are located on the light (emitting shape) hit by the
     // path tracer, and the surface actually being illuminated, respectively.
@@ -92,15 +106,26 @@ class BackwardLightSampler
         const ShadingPoint&                 light_shading_point,
         const ShadingPoint&                 surface_shading_point) const;
 
+    // Same as above, using the cut previously selected for the surface shading point
+    // with select_light_cut() instead of selecting it again.
+    float evaluate_pdf(
+        const ShadingPoint&                 light_shading_point,
+        const ShadingPoint&                 surface_shading_point,
+        const LightTreeCut&                 cut) const;
+
   private:
     bool                                    m_use_light_tree;
+    size_t                                  m_max_light_cut_size;
     NonPhysicalLightVector                  m_light_tree_lights;
     std::unique_ptr<LightTree>              m_light_tree;
 
+    bool use_light_cuts() const;
+
     void sample_light_tree(
         const ShadingRay::Time&             time,
         const foundation::Vector3f&         s,
         const ShadingPoint&                 shading_point,
+        const LightTreeCut*                 cut,
         LightSample&                        light_sample) const;
 };
 
@@ -127,4 +152,9 @@ inline bool BackwardLightSampler::has_lightset() const
     return !m_emitting_shapes.empty() || !m_light_tree_lights.empty();
 }
 
+inline bool BackwardLightSampler::use_light_cuts() const
+{
+    return m_use_light_tree && m_max_light_cut_size > 1;
+}
+
 }   // namespace renderer
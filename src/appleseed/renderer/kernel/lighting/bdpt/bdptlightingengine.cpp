@@ -30,6 +30,7 @@
 #include "bdptlightingengine.h"
 
 // appleseed.renderer headers.
+#include "renderer/global/globallogger.h"
 #include "renderer/kernel/lighting/forwardlightsampler.h"
 #include "renderer/kernel/lighting/pathtracer.h"
 #include "renderer/kernel/lighting/tracer.h"
@@ -42,12 +43,19 @@
 
 // appleseed.foundation headers.
 #include "foundation/math/fp.h"
+#include "foundation/math/hash.h"
 #include "foundation/math/population.h"
+#include "foundation/math/scalar.h"
 #include "foundation/utility/arena.h"
+#include "foundation/utility/containers/dictionary.h"
 #include "foundation/utility/statistics.h"
+#include "foundation/utility/string.h"
 
 // Standard headers.
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <vector>
 
 using namespace foundation;
 
@@ -116,8 +124,17 @@ namespace
         {
             const size_t    m_max_bounces;                  // maximum number of bounces, ~0 for unlimited
 
+            const bool      m_enable_lvc;                   // share light subpaths between camera samples?
+            const size_t    m_lvc_light_paths;              // number of light subpaths in the light vertex cache
+            const size_t    m_lvc_connections;              // number of cached light vertices connected to per camera sample
+            const size_t    m_lvc_path_reuse;               // number of camera samples served per cached light subpath
+
             explicit Parameters(const ParamArray& params)
-                : m_max_bounces(fixup_bounces(params.get_optional<int>("max_bounces", 8)))
+              : m_max_bounces(fixup_bounces(params.get_optional<int>("max_bounces", 8)))
+              , m_enable_lvc(params.get_optional<bool>("enable_light_vertex_cache", false))
+              , m_lvc_light_paths(std::max<size_t>(params.get_optional<size_t>("lvc_light_paths", 1024), 1))
+              , m_lvc_connections(std::max<size_t>(params.get_optional<size_t>("lvc_connections", 3), 1))
+              , m_lvc_path_reuse(std::max<size_t>(params.get_optional<size_t>("lvc_path_reuse", 2), 1))
             {
             }
 
@@ -130,15 +147,26 @@ namespace
         BDPTLightingEngine(
             const Project&              project,
             const ForwardLightSampler&  light_sampler,
-            const ParamArray&           params)
+            const ParamArray&           params,
+            const size_t                engine_index)
           : m_light_sampler(light_sampler)
           , m_params(params)
+          , m_shadow_ray_count(0)
+          , m_lvc_rng(hash_uint32(static_cast<std::uint32_t>(engine_index)), engine_index + 1)
+          , m_lvc_path_count(0)
+          , m_lvc_remaining_samples(0)
+          , m_lvc_build_count(0)
         {
             const Camera* camera = project.get_uncached_active_camera();
             m_shutter_open_begin_time = camera->get_shutter_open_begin_time();
             m_shutter_close_end_time = camera->get_shutter_close_end_time();
 
             m_num_max_vertices = m_params.m_max_bounces + 3;
+
+            m_camera_vertices.resize(m_num_max_vertices - 1);
+            m_light_vertices.resize(m_num_max_vertices);
+            m_light_pdfs.resize(m_num_max_vertices + 1);
+            m_camera_pdfs.resize(m_num_max_vertices + 1);
         }
 
         void release() override
@@ -148,6 +176,18 @@ namespace
 
         void print_settings() const override
         {
+            RENDERER_LOG_INFO(
+                "bidirectional path tracer settings:\n"
+                "  max bounces                   %s\n"
+                "  light vertex cache            %s\n"
+                "  lvc light paths               %s\n"
+                "  lvc connections               %s\n"
+                "  lvc path reuse                %s",
+                m_params.m_max_bounces == ~size_t(0) ? "unlimited" : pretty_uint(m_params.m_max_bounces).c_str(),
+                m_params.m_enable_lvc ? "on" : "off",
+                pretty_uint(m_params.m_lvc_light_paths).c_str(),
+                pretty_uint(m_params.m_lvc_connections).c_str(),
+                pretty_uint(m_params.m_lvc_path_reuse).c_str());
         }
 
         void compute_lighting(
@@ -158,277 +198,460 @@ namespace
             ShadingComponents&          radiance,               // output radiance, in W.sr^-1.m^-2
             AOVComponents&              aov_components) override
         {
-            /// todo: use arena to alloc BDPTVertices instead
-            BDPTVertex* camera_vertices = new BDPTVertex[m_num_max_vertices - 1];
-            BDPTVertex* light_vertices = new BDPTVertex[m_num_max_vertices];
+            BDPTVertex* camera_vertices = &m_camera_vertices[0];
+            BDPTVertex* light_vertices = &m_light_vertices[0];
 
-            size_t num_light_vertices = trace_light(sampling_context, shading_context, light_vertices);
-            size_t num_camera_vertices = trace_camera(sampling_context, shading_context, shading_point, camera_vertices);
+            if (m_params.m_enable_lvc)
+            {
+                compute_lighting_with_light_vertex_cache(
+                    sampling_context,
+                    shading_context,
+                    shading_point,
+                    radiance);
+                return;
+            }
+
+            const size_t num_light_vertices = trace_light(sampling_context, shading_context, light_vertices);
+            const size_t num_camera_vertices = trace_camera(sampling_context, shading_context, shading_point, camera_vertices);
 
             assert(num_camera_vertices <= m_num_max_vertices - 1);
             assert(num_light_vertices <= m_num_max_vertices);
 
-            for (size_t s = 0; s < num_light_vertices + 1; s++)
+            // Compute once per subpath the vertex densities that don't depend on the connection.
+            compute_light_subpath_densities(light_vertices, num_light_vertices);
+            compute_camera_subpath_densities(camera_vertices, num_camera_vertices);
+
+            // Evaluate all connections as if their endpoints were mutually visible.
+            // Connections sharing a camera vertex are kept together so that their
+            // visibility rays leave from the same point.
+            m_connections.clear();
+            for (size_t t = 2; t < num_camera_vertices + 2; t++)
             {
-                for (size_t t = 2; t < num_camera_vertices + 2; t++)
+                for (size_t s = 0; s < num_light_vertices + 1; s++)
                 {
                     if (s + t <= m_num_max_vertices)
-                        connect(shading_context, shading_point, light_vertices, camera_vertices, s, t, radiance);
+                        connect(light_vertices, camera_vertices, s, t, 1.0f, radiance);
                 }
             }
 
-            delete[] camera_vertices;
-            delete[] light_vertices;
+            // Trace the visibility rays of the connections that survived.
+            trace_connections(shading_context, shading_point, radiance);
         }
 
-        // todo: use an output parameter instead of returning a spectrum.
-        Spectrum compute_geometry_term(
+        // Same as compute_lighting() but the camera subpath is connected to a few vertices picked at
+        // random in a cache of light subpaths shared by consecutive samples, instead of to every vertex
+        // of a light subpath traced for this sample alone. Connecting to M vertices picked uniformly
+        // among the V vertices of P cached subpaths and scaling by V / (M P) estimates the average over
+        // the cached subpaths of the usual BDPT estimator, hence remains unbiased.
+        void compute_lighting_with_light_vertex_cache(
+            SamplingContext&            sampling_context,
             const ShadingContext&       shading_context,
             const ShadingPoint&         shading_point,
-            const BDPTVertex&           a,
-            const BDPTVertex&           b)
+            ShadingComponents&          radiance)
         {
-            const Vector3d v = b.m_position - a.m_position;
-            const Vector3d normalized_v = normalize(v);
-            const double dist2 = square_norm(v);
+            if (m_lvc_remaining_samples == 0)
+                build_light_vertex_cache(shading_context);
+            --m_lvc_remaining_samples;
 
-            /// todo: the special care have to be taken for these dot products when it comes to volume
-            const double cos1 = std::max(-dot(normalized_v, b.m_geometric_normal), 0.0);
-            const double cos2 = std::max(dot(normalized_v, a.m_geometric_normal), 0.0);
+            BDPTVertex* camera_vertices = &m_camera_vertices[0];
+            const size_t num_camera_vertices = trace_camera(sampling_context, shading_context, shading_point, camera_vertices);
+            assert(num_camera_vertices <= m_num_max_vertices - 1);
 
-            Spectrum result(0.0f);
+            compute_camera_subpath_densities(camera_vertices, num_camera_vertices);
 
-            // do the visibility test
-            if (cos1 > 0.0 && cos2 > 0.0)
+            m_connections.clear();
+
+            // Camera subpaths that hit a light source.
+            for (size_t t = 2; t < num_camera_vertices + 2; t++)
             {
-                shading_context.get_tracer().trace_between_simple(
-                    shading_context,
-                    a.m_position + (v * 1.0e-6),
-                    b.m_position,
-                    shading_point.get_ray().m_time,
-                    VisibilityFlags::ShadowRay,
-                    shading_point.get_ray().m_depth,
-                    result);
-                double geometry_term = cos1 * cos2 / dist2;
-                result *= (float)geometry_term;
+                if (t <= m_num_max_vertices)
+                    connect(&m_light_vertices[0], camera_vertices, 0, t, 1.0f, radiance);
+            }
+
+            const size_t cached_vertex_count = m_lvc_vertices.size();
+            if (cached_vertex_count > 0 && num_camera_vertices > 0)
+            {
+                const size_t connection_count = m_params.m_lvc_connections;
+                const float weight =
+                    static_cast<float>(cached_vertex_count) /
+                    static_cast<float>(connection_count * m_lvc_path_count);
+
+                sampling_context.split_in_place(1, connection_count);
+
+                // The BSDF inputs of a cached vertex are only needed while it is being connected.
+                Arena& arena = shading_context.get_arena();
+                const size_t arena_size = arena.get_allocated_size();
+
+                for (size_t i = 0; i < connection_count; ++i)
+                {
+                    const size_t index =
+                        std::min(
+                            truncate<size_t>(sampling_context.next2<float>() * cached_vertex_count),
+                            cached_vertex_count - 1);
+
+                    // Cached vertices outlive the arena that held their BSDF inputs.
+                    BDPTVertex& light_vertex = m_lvc_vertices[index];
+                    prepare_cached_vertex(shading_context, light_vertex);
+
+                    const size_t path_begin = m_lvc_path_begin[index];
+                    const size_t s = index - path_begin + 1;
+
+                    for (size_t t = 2; t < num_camera_vertices + 2; t++)
+                    {
+                        if (s + t <= m_num_max_vertices)
+                            connect(&m_lvc_vertices[path_begin], camera_vertices, s, t, weight, radiance);
+                    }
+
+                    light_vertex.m_bsdf_data = nullptr;
+                    arena.rewind(arena_size);
+                }
             }
 
-            return result;
+            trace_connections(shading_context, shading_point, radiance);
         }
 
-        /// todo: precompute path density using fwd_pdf and rev_pdf.
-        /// in the final code, this function should be removed and the mis weight computation should be very simple.
-        /// example: https://github.com/mmp/pbrt-v3/blob/master/src/integrators/bdpt.cpp#L228
-        float compute_path_density(
-            BDPTVertex*                 light_vertices,
-            BDPTVertex*                 camera_vertices,
-            const size_t                s,
-            const size_t                t,
-            const size_t                p,
-            const size_t                q)
+        // Trace a new set of light subpaths and store their vertices one subpath after the other.
+        // Densities are computed now since they need the BSDF inputs of the whole subpath.
+        void build_light_vertex_cache(const ShadingContext& shading_context)
         {
-            assert(p + q == s + t);
+            m_lvc_vertices.clear();
+            m_lvc_path_begin.clear();
+
+            SamplingContext sampling_context(
+                m_lvc_rng,
+                SamplingContext::RNGMode,
+                4,                          // number of dimensions
+                0,                          // number of samples -- unknown
+                m_lvc_build_count);         // initial instance number
+
+            BDPTVertex* light_vertices = &m_light_vertices[0];
 
-            // get i Vertex in the constructed path
-            // i = 1 correspond first vertex of the full path
+            // Each subpath allocates BSDF inputs and closures in the shading context's arena. They are
+            // released once the densities of the subpath are known, leaving the caller's data untouched.
+            Arena& arena = shading_context.get_arena();
+            const size_t arena_size = arena.get_allocated_size();
 
-            auto get_vertex_start_from_light = [&](const size_t i)
+            for (size_t i = 0; i < m_params.m_lvc_light_paths; ++i)
             {
-                if (i <= s)
-                {
-                    return &light_vertices[i - 1];
-                }
-                else
+                SamplingContext child_sampling_context(sampling_context);
+                const size_t num_light_vertices = trace_light(child_sampling_context, shading_context, light_vertices);
+                compute_light_subpath_densities(light_vertices, num_light_vertices);
+
+                const size_t path_begin = m_lvc_vertices.size();
+                for (size_t j = 0; j < num_light_vertices; ++j)
                 {
-                    return &camera_vertices[s + t - i - 1];
+                    m_lvc_vertices.push_back(light_vertices[j]);
+                    m_lvc_vertices.back().m_bsdf_data = nullptr;    // evaluated again by prepare_cached_vertex()
+                    m_lvc_path_begin.push_back(static_cast<std::uint32_t>(path_begin));
                 }
-            };
 
-            auto get_vertex_start_from_camera = [&](const size_t i)
+                arena.rewind(arena_size);
+            }
+
+            m_lvc_path_count = m_params.m_lvc_light_paths;
+            m_lvc_remaining_samples = m_params.m_lvc_light_paths * m_params.m_lvc_path_reuse;
+            ++m_lvc_build_count;
+        }
+
+        // Evaluate again the BSDF inputs of a cached light vertex.
+        static void prepare_cached_vertex(
+            const ShadingContext&       shading_context,
+            BDPTVertex&                 vertex)
+        {
+            if (vertex.m_bsdf == nullptr)
+                return;
+
+            const Material* material = vertex.m_shading_point.get_material();
+            if (material == nullptr)
+                return;
+
+            const Material::RenderData& material_data = material->get_render_data();
+            if (material_data.m_shader_group)
             {
-                if (i <= t)
-                {
-                    return &camera_vertices[i - 2];
-                }
-                else
-                {
-                    return &light_vertices[s + t - i];
-                }
-            };
+                shading_context.execute_osl_shading(
+                    *material_data.m_shader_group,
+                    vertex.m_shading_point);
+            }
+
+            vertex.m_bsdf_data = vertex.m_bsdf->evaluate_inputs(shading_context, vertex.m_shading_point);
+        }
+
+        // Return the density, with respect to surface area at `next`, of sampling `next`
+        // by scattering at `vertex` a path arriving from direction `incoming`.
+        static float evaluate_bsdf_pdf(
+            const BDPTVertex&           vertex,
+            const bool                  adjoint,
+            const Vector3d&             incoming,
+            const BDPTVertex&           next)
+        {
+            if (vertex.m_bsdf == nullptr || vertex.m_bsdf_data == nullptr)
+                return 0.0f;
+
+            BSDF::LocalGeometry local_geometry;
+            local_geometry.m_shading_point = &vertex.m_shading_point;
+            local_geometry.m_geometric_normal = Vector3f(vertex.m_geometric_normal);
+            local_geometry.m_shading_basis = vertex.m_shading_basis;
+
+            const float pdf_w =
+                vertex.m_bsdf->evaluate_pdf(
+                    vertex.m_bsdf_data,
+                    adjoint,
+                    local_geometry,
+                    static_cast<Vector3f>(normalize(next.m_position - vertex.m_position)),
+                    static_cast<Vector3f>(incoming),
+                    ScatteringMode::All);
 
-            /// todo: swap all pdf computation to rev_pdf and fwd_pdf
-            float result = 1.0f;
-            // start from light
-            for (size_t i = 1; i <= p; i++)
+            return static_cast<float>(vertex.convert_density(pdf_w, next));
+        }
+
+        // Return the density, with respect to surface area at `next`, of emitting toward `next` from `light`.
+        static float evaluate_emission_pdf(
+            const BDPTVertex&           light,
+            const BDPTVertex&           next)
+        {
+            /// todo: fix this. This assumes diffuse light source.
+            const float pdf_w = static_cast<float>(dot(normalize(next.m_position - light.m_position), light.m_geometric_normal) * RcpPi<float>());
+            return static_cast<float>(light.convert_density(pdf_w, next));
+        }
+
+        // Return the density, with respect to surface area, of sampling `vertex` on a light source.
+        float evaluate_light_pdf(const BDPTVertex& vertex) const
+        {
+            return vertex.m_is_light_vertex ? m_light_sampler.evaluate_pdf(vertex.m_shading_point) : 0.0f;
+        }
+
+        // m_fwd_pdf is the density of sampling a light subpath vertex from the light.
+        // m_rev_pdf is the density of sampling it from the camera side; it is only known
+        // here when the two vertices following it on the light subpath are fixed.
+        void compute_light_subpath_densities(
+            BDPTVertex*                 vertices,
+            const size_t                num_vertices) const
+        {
+            for (size_t i = 0; i < num_vertices; ++i)
             {
-                if (i == 1) // the vertex on light source
-                {
-                    const BDPTVertex& vertex = *get_vertex_start_from_light(i);
-                    float pdf_a = vertex.m_is_light_vertex ? m_light_sampler.evaluate_pdf(vertex.m_shading_point) : 0.0f;
-                    assert(pdf_a >= 0.0f);
-                    result *= pdf_a;
-                }
-                else if (i == 2) // the vertex after light source
-                {
-                    const BDPTVertex& prev_vertex = *get_vertex_start_from_light(i - 1);
-                    const BDPTVertex& vertex = *get_vertex_start_from_light(i);
-                    /// todo: fix this. This assumes diffuse light source.
-                    float pdf_w = static_cast<float>(dot(normalize(vertex.m_position - prev_vertex.m_position), prev_vertex.m_geometric_normal) * RcpPi<float>());
-                    float pdf_a = static_cast<float>(prev_vertex.convert_density(pdf_w, vertex));
-                    assert(pdf_a >= 0.0f);
-                    result *= pdf_a;
-                }
-                else
-                {
-                    const BDPTVertex& prev2_vertex = *get_vertex_start_from_light(i - 2);
-                    const BDPTVertex& prev_vertex = *get_vertex_start_from_light(i - 1);
-                    const BDPTVertex& vertex = *get_vertex_start_from_light(i);
-                    BSDF::LocalGeometry local_geometry;
-                    local_geometry.m_shading_point = &prev_vertex.m_shading_point;
-                    local_geometry.m_geometric_normal = Vector3f(prev_vertex.m_geometric_normal);
-                    local_geometry.m_shading_basis = prev_vertex.m_shading_basis;
-                    const float pdf_w =
-                        prev_vertex.m_bsdf->evaluate_pdf(
-                            prev_vertex.m_bsdf_data,
+                BDPTVertex& vertex = vertices[i];
+
+                vertex.m_fwd_pdf =
+                    i == 0 ? evaluate_light_pdf(vertex) :
+                    i == 1 ? evaluate_emission_pdf(vertices[0], vertex) :
+                    evaluate_bsdf_pdf(vertices[i - 1], true, vertices[i - 1].m_dir_to_prev_vertex, vertex);
+
+                vertex.m_rev_pdf =
+                    i + 2 < num_vertices
+                        ? evaluate_bsdf_pdf(
+                            vertices[i + 1],
+                            false,
+                            normalize(vertices[i + 2].m_position - vertices[i + 1].m_position),
+                            vertex)
+                        : 0.0f;
+            }
+        }
+
+        // m_fwd_pdf is the density of sampling a camera subpath vertex from the camera; the density
+        // of the primary hit is shared by all strategies and is left out. m_rev_pdf is the density
+        // of sampling it from the light side, known when the two vertices following it are fixed.
+        void compute_camera_subpath_densities(
+            BDPTVertex*                 vertices,
+            const size_t                num_vertices) const
+        {
+            for (size_t i = 0; i < num_vertices; ++i)
+            {
+                BDPTVertex& vertex = vertices[i];
+
+                vertex.m_fwd_pdf =
+                    i == 0 ? 1.0f :
+                    evaluate_bsdf_pdf(vertices[i - 1], false, vertices[i - 1].m_dir_to_prev_vertex, vertex);
+
+                vertex.m_rev_pdf =
+                    i + 2 < num_vertices
+                        ? evaluate_bsdf_pdf(
+                            vertices[i + 1],
                             true,
-                            local_geometry,
-                            static_cast<Vector3f>(normalize(vertex.m_position - prev_vertex.m_position)),
-                            static_cast<Vector3f>(normalize(prev2_vertex.m_position - prev_vertex.m_position)),
-                            ScatteringMode::All);
-                    float pdf_a = static_cast<float>(prev_vertex.convert_density(pdf_w, vertex));
-                    assert(pdf_a >= 0.0f);
-                    result *= pdf_a;
-                }
+                            normalize(vertices[i + 2].m_position - vertices[i + 1].m_position),
+                            vertex)
+                        : 0.0f;
             }
+        }
+
+        // Compute the balance heuristic weight of the strategy (s, t). Only the densities of the
+        // two vertices on either side of the connection need to be evaluated here; the weight
+        // is then obtained with prefix and suffix products in O(s + t).
+        float compute_mis_weight(
+            const BDPTVertex*           light_vertices,
+            const BDPTVertex*           camera_vertices,
+            const size_t                s,
+            const size_t                t)
+        {
+            assert(t >= 2);
 
-            // start from camera
-            for (size_t i = 3; i <= q; i++)
+            // Vertices are numbered from 1 (on the light) to s + t (the camera). The density of the
+            // path sampled with p light vertices is the product of light_pdfs[1..p] and camera_pdfs[p+1..s+t-2].
+            const size_t last = s + t - 2;
+            float* light_pdfs = &m_light_pdfs[0];
+            float* camera_pdfs = &m_camera_pdfs[0];
+
+            for (size_t j = 1; j <= last; ++j)
             {
-                if (i == 3) // first point after shading point
+                if (j <= s)
                 {
-                    const BDPTVertex& prev_vertex = *get_vertex_start_from_camera(i - 1);
-                    const BDPTVertex& vertex = *get_vertex_start_from_camera(i);
-                    BSDF::LocalGeometry local_geometry;
-                    local_geometry.m_shading_point = &prev_vertex.m_shading_point;
-                    local_geometry.m_geometric_normal = Vector3f(prev_vertex.m_geometric_normal);
-                    local_geometry.m_shading_basis = prev_vertex.m_shading_basis;
-                    const float pdf_w =
-                        prev_vertex.m_bsdf->evaluate_pdf(
-                            prev_vertex.m_bsdf_data,
-                            false,
-                            local_geometry,
-                            static_cast<Vector3f>(normalize(vertex.m_position - prev_vertex.m_position)),
-                            static_cast<Vector3f>(prev_vertex.m_dir_to_prev_vertex),
-                            ScatteringMode::All);
-                    float pdf_a = static_cast<float>(prev_vertex.convert_density(pdf_w, vertex));
-                    assert(pdf_a >= 0.0f);
-                    result *= pdf_a;
+                    light_pdfs[j] = light_vertices[j - 1].m_fwd_pdf;
+                    camera_pdfs[j] = light_vertices[j - 1].m_rev_pdf;
                 }
                 else
                 {
-                    const BDPTVertex& prev2_vertex = *get_vertex_start_from_camera(i - 2);
-                    const BDPTVertex& prev_vertex = *get_vertex_start_from_camera(i - 1);
-                    const BDPTVertex& vertex = *get_vertex_start_from_camera(i);
-                    BSDF::LocalGeometry local_geometry;
-                    local_geometry.m_shading_point = &prev_vertex.m_shading_point;
-                    local_geometry.m_geometric_normal = Vector3f(prev_vertex.m_geometric_normal);
-                    local_geometry.m_shading_basis = prev_vertex.m_shading_basis;
-                    const float pdf_w =
-                        prev_vertex.m_bsdf->evaluate_pdf(
-                            prev_vertex.m_bsdf_data,
-                            false,
-                            local_geometry,
-                            static_cast<Vector3f>(normalize(vertex.m_position - prev_vertex.m_position)),
-                            static_cast<Vector3f>(normalize(prev2_vertex.m_position - prev_vertex.m_position)),
-                            ScatteringMode::All);
-                    float pdf_a = static_cast<float>(prev_vertex.convert_density(pdf_w, vertex));
-                    assert(pdf_a >= 0.0f);
-                    result *= pdf_a;
+                    light_pdfs[j] = camera_vertices[s + t - j - 1].m_rev_pdf;
+                    camera_pdfs[j] = camera_vertices[s + t - j - 1].m_fwd_pdf;
                 }
             }
 
-            return result;
+            const BDPTVertex& camera_vertex = camera_vertices[t - 2];
+
+            if (s + 1 <= last)
+            {
+                light_pdfs[s + 1] =
+                    s == 0 ? evaluate_light_pdf(camera_vertex) :
+                    s == 1 ? evaluate_emission_pdf(light_vertices[0], camera_vertex) :
+                    evaluate_bsdf_pdf(light_vertices[s - 1], true, light_vertices[s - 1].m_dir_to_prev_vertex, camera_vertex);
+            }
+
+            if (s + 2 <= last)
+            {
+                light_pdfs[s + 2] =
+                    s == 0
+                        ? evaluate_emission_pdf(camera_vertex, camera_vertices[t - 3])
+                        : evaluate_bsdf_pdf(
+                            camera_vertex,
+                            true,
+                            normalize(light_vertices[s - 1].m_position - camera_vertex.m_position),
+                            camera_vertices[t - 3]);
+            }
+
+            if (s >= 1)
+                camera_pdfs[s] = evaluate_bsdf_pdf(camera_vertex, false, camera_vertex.m_dir_to_prev_vertex, light_vertices[s - 1]);
+
+            if (s >= 2)
+            {
+                camera_pdfs[s - 1] =
+                    evaluate_bsdf_pdf(
+                        light_vertices[s - 1],
+                        false,
+                        normalize(camera_vertex.m_position - light_vertices[s - 1].m_position),
+                        light_vertices[s - 2]);
+            }
+
+            // Turn light_pdfs into prefix products.
+            light_pdfs[0] = 1.0f;
+            for (size_t j = 1; j <= last; ++j)
+                light_pdfs[j] *= light_pdfs[j - 1];
+
+            // [p = 0, q = s + t], [p = 1, q = s + t - 1] ... [p = s + t - 2, q = 2]
+            float numerator = 0.0f;
+            float denominator = 0.0f;
+            float suffix = 1.0f;
+            for (size_t p = last + 1; p-- > 0; )
+            {
+                const float density = light_pdfs[p] * suffix;
+                denominator += density;
+
+                if (p == s)
+                    numerator = density;
+
+                if (p > 0)
+                    suffix *= camera_pdfs[p];
+            }
+
+            if (numerator == 0.0f)
+                return 0.0f;
+
+            /// todo: unhandled case where (numerator <= 0) (specular surface / impossible path).
+            assert(FP<float>::is_finite(numerator));
+            assert(numerator > 0.0f);
+
+            /// todo: unhandled case where (denominator <= 0) (specular surface / impossible path).
+            assert(FP<float>::is_finite(denominator));
+            assert(denominator > 0.0f);
+
+            const float mis_weight = numerator / denominator;
+            assert(mis_weight <= 1.0f);
+
+            return mis_weight;
         }
 
+        // Evaluate the MIS-weighted contribution of the strategy (s, t). Complete camera subpaths are
+        // accumulated right away; other connections are queued until their visibility is known.
         void connect(
-            const ShadingContext&       shading_context,
-            const ShadingPoint&         shading_point,
-            BDPTVertex*                 light_vertices,
-            BDPTVertex*                 camera_vertices,
+            const BDPTVertex*           light_vertices,
+            const BDPTVertex*           camera_vertices,
             const size_t                s,
             const size_t                t,
+            const float                 weight,
             ShadingComponents&          radiance)
         {
             assert(t >= 2);
-            Spectrum result(0);
+
+            const BDPTVertex& camera_vertex = camera_vertices[t - 2];
 
             if (s == 0)
             {
                 // camera subpath is a complete path
-                const BDPTVertex& camera_vertex = camera_vertices[t - 2];
                 if (!camera_vertex.m_is_light_vertex)
-                {
                     return;
-                }
-                result = camera_vertex.m_beta * camera_vertex.m_Le;
-            }
-            else if (s == 1)
-            {
-                // only one light vertex
-                const BDPTVertex& light_vertex = light_vertices[s - 1];
-                const BDPTVertex& camera_vertex = camera_vertices[t - 2];
 
-                /// todo: need to take care of light material as well
-                if (camera_vertex.m_bsdf == nullptr || camera_vertex.m_bsdf_data == nullptr)
-                {
+                const Spectrum result = camera_vertex.m_beta * camera_vertex.m_Le;
+
+                // check if throughput is near black or not
+                if (fz(result, 1.0e-4f))
                     return;
-                }
 
-                const Spectrum geometry = compute_geometry_term(shading_context, shading_point, camera_vertex, light_vertex);
+                radiance.m_beauty += compute_mis_weight(light_vertices, camera_vertices, s, t) * result;
+                return;
+            }
 
-                BSDF::LocalGeometry local_geometry;
-                local_geometry.m_shading_point = &camera_vertex.m_shading_point;
-                local_geometry.m_geometric_normal = Vector3f(camera_vertex.m_geometric_normal);
-                local_geometry.m_shading_basis = camera_vertex.m_shading_basis;
+            const BDPTVertex& light_vertex = light_vertices[s - 1];
 
-                DirectShadingComponents camera_eval_bsdf;
-                camera_vertex.m_bsdf->evaluate(
-                    camera_vertex.m_bsdf_data,
-                    false,   // Adjoint
-                    false,
-                    local_geometry,
-                    static_cast<Vector3f>(normalize(light_vertex.m_position - camera_vertex.m_position)),
-                    static_cast<Vector3f>(camera_vertex.m_dir_to_prev_vertex),
-                    ScatteringMode::All,
-                    camera_eval_bsdf);
+            /// todo: need to take care of light material as well
+            if (camera_vertex.m_bsdf == nullptr || camera_vertex.m_bsdf_data == nullptr)
+                return;
 
-                result = geometry * camera_eval_bsdf.m_beauty * camera_vertex.m_beta * light_vertex.m_beta;
-            }
-            else
-            {
-                const BDPTVertex& light_vertex = light_vertices[s - 1];
-                const BDPTVertex& camera_vertex = camera_vertices[t - 2];
+            if (s > 1 && (light_vertex.m_bsdf == nullptr || light_vertex.m_bsdf_data == nullptr))
+                return;
 
-                if (light_vertex.m_bsdf == nullptr || camera_vertex.m_bsdf == nullptr ||
-                    light_vertex.m_bsdf_data == nullptr || camera_vertex.m_bsdf == nullptr)
-                    return;
+            const Vector3d v = light_vertex.m_position - camera_vertex.m_position;
+            const double dist2 = square_norm(v);
+            if (dist2 == 0.0)
+                return;
 
-                BSDF::LocalGeometry camera_local_geometry;
-                camera_local_geometry.m_shading_point = &camera_vertex.m_shading_point;
-                camera_local_geometry.m_geometric_normal = Vector3f(camera_vertex.m_geometric_normal);
-                camera_local_geometry.m_shading_basis = camera_vertex.m_shading_basis;
+            const Vector3d normalized_v = v / std::sqrt(dist2);
 
-                DirectShadingComponents camera_eval_bsdf;
-                camera_vertex.m_bsdf->evaluate(
-                    camera_vertex.m_bsdf_data,
-                    false,   // Adjoint
-                    false,
-                    camera_local_geometry,
-                    static_cast<Vector3f>(normalize(light_vertex.m_position - camera_vertex.m_position)),
-                    static_cast<Vector3f>(camera_vertex.m_dir_to_prev_vertex),
-                    ScatteringMode::All,
-                    camera_eval_bsdf);
+            /// todo: the special care have to be taken for these dot products when it comes to volume
+            const double cos1 = std::max(-dot(normalized_v, light_vertex.m_geometric_normal), 0.0);
+            const double cos2 = std::max(dot(normalized_v, camera_vertex.m_geometric_normal), 0.0);
+            if (cos1 == 0.0 || cos2 == 0.0)
+                return;
 
+            Spectrum result = camera_vertex.m_beta * light_vertex.m_beta;
+            result *= static_cast<float>(cos1 * cos2 / dist2);
+
+            BSDF::LocalGeometry camera_local_geometry;
+            camera_local_geometry.m_shading_point = &camera_vertex.m_shading_point;
+            camera_local_geometry.m_geometric_normal = Vector3f(camera_vertex.m_geometric_normal);
+            camera_local_geometry.m_shading_basis = camera_vertex.m_shading_basis;
+
+            DirectShadingComponents camera_eval_bsdf;
+            camera_vertex.m_bsdf->evaluate(
+                camera_vertex.m_bsdf_data,
+                false,   // Adjoint
+                false,
+                camera_local_geometry,
+                static_cast<Vector3f>(normalized_v),
+                static_cast<Vector3f>(camera_vertex.m_dir_to_prev_vertex),
+                ScatteringMode::All,
+                camera_eval_bsdf);
+
+            result *= camera_eval_bsdf.m_beauty;
+
+            if (s > 1)
+            {
                 BSDF::LocalGeometry light_local_geometry;
                 light_local_geometry.m_shading_point = &light_vertex.m_shading_point;
                 light_local_geometry.m_geometric_normal = Vector3f(light_vertex.m_geometric_normal);
@@ -440,40 +663,62 @@ namespace
                     true,   // Adjoint
                     false,
                     light_local_geometry,
-                    static_cast<Vector3f>(normalize(camera_vertex.m_position - light_vertex.m_position)),
+                    static_cast<Vector3f>(-normalized_v),
                     static_cast<Vector3f>(light_vertex.m_dir_to_prev_vertex),
                     ScatteringMode::All,
                     light_eval_bsdf);
 
-                Spectrum geometry = compute_geometry_term(shading_context, shading_point, camera_vertex, light_vertex);
-                result = geometry * camera_eval_bsdf.m_beauty * light_eval_bsdf.m_beauty * camera_vertex.m_beta * light_vertex.m_beta;
+                result *= light_eval_bsdf.m_beauty;
             }
 
             // check if throughput is near black or not
             if (fz(result, 1.0e-4f))
                 return;
 
-            const float numerator = compute_path_density(light_vertices, camera_vertices, s, t, s, t);
-            if (numerator == 0.0f)
+            const float mis_weight = compute_mis_weight(light_vertices, camera_vertices, s, t);
+            if (mis_weight == 0.0f)
                 return;
 
-            /// todo: unhandled case where (numerator <= 0) (specular surface / impossible path).
-            assert(FP<float>::is_finite(numerator));
-            assert(numerator > 0.0f);
+            result *= mis_weight * weight;
 
-            float denominator = 0.0f;
-            // [p = 0, q = s + t], [p = 1, q = s + t - 1] ... [p = s + t - 2, q = 2]
-            for (size_t i = 0; i <= s + t - 2; i++)
-                denominator += compute_path_density(light_vertices, camera_vertices, s, t, i, s + t - i);
+            // Defer the visibility test.
+            Connection connection;
+            connection.m_origin = camera_vertex.m_position + v * 1.0e-6;
+            connection.m_target = light_vertex.m_position;
+            connection.m_contribution = result;
+            m_connections.push_back(connection);
+        }
 
-            /// todo: unhandled case where (denominator <= 0) (specular surface / impossible path).
-            assert(FP<float>::is_finite(denominator));
-            assert(denominator > 0.0f);
+        // Test the visibility of the queued connections and accumulate the contributions of the
+        // unoccluded ones. Rays are traced one at a time through the tracer, which accounts for alpha
+        // mapping and participating media along each segment. Connections are queued per camera vertex,
+        // so consecutive rays leave from the same point and tend to visit the same tree nodes. This
+        // stage runs on the thread that owns the engine: threads already render separate tiles.
+        void trace_connections(
+            const ShadingContext&       shading_context,
+            const ShadingPoint&         shading_point,
+            ShadingComponents&          radiance)
+        {
+            const ShadingRay& ray = shading_point.get_ray();
+            Tracer& tracer = shading_context.get_tracer();
 
-            const float mis_weight = numerator / denominator;
+            for (const Connection& connection : m_connections)
+            {
+                Spectrum transmission;
+                tracer.trace_between_simple(
+                    shading_context,
+                    connection.m_origin,
+                    connection.m_target,
+                    ray.m_time,
+                    VisibilityFlags::ShadowRay,
+                    ray.m_depth,
+                    transmission);
 
-            assert(mis_weight <= 1.0f);
-            radiance.m_beauty += mis_weight * result;
+                transmission *= connection.m_contribution;
+                radiance.m_beauty += transmission;
+            }
+
+            m_shadow_ray_count += m_connections.size();
         }
 
         size_t trace_light(
@@ -576,12 +821,13 @@ namespace
 
             BDPTVertex& bdpt_vertex = vertices[0];
             bdpt_vertex.m_beta = initial_flux;
-            bdpt_vertex.m_fwd_pdf = light_sample.m_probability;
+            bdpt_vertex.m_bsdf = nullptr;
+            bdpt_vertex.m_bsdf_data = nullptr;
+            bdpt_vertex.m_Le.set(0.0f);
             /// CONFUSE:: why geometric normal is flipped?
             bdpt_vertex.m_geometric_normal = -light_shading_point.get_geometric_normal();
             bdpt_vertex.m_is_light_vertex = true;
             bdpt_vertex.m_position = light_shading_point.get_point();
-            bdpt_vertex.m_rev_pdf = 1.0;
             bdpt_vertex.m_shading_point = light_shading_point;
 
             // Build the path tracer.
@@ -661,6 +907,12 @@ namespace
         StatisticsVector get_statistics() const override
         {
             Statistics stats;
+            stats.insert("light path length", m_light_path_length);
+            stats.insert("camera path length", m_camera_path_length);
+            stats.insert("shadow rays", m_shadow_ray_count);
+
+            if (m_params.m_enable_lvc)
+                stats.insert("light vertex cache builds", m_lvc_build_count);
 
             return StatisticsVector::make("bdpt statistics", stats);
         }
@@ -678,6 +930,29 @@ namespace
 
         size_t                      m_num_max_vertices;
 
+        // A connection between a light and a camera subpath vertex waiting for its visibility test.
+        struct Connection
+        {
+            Vector3d                m_origin;
+            Vector3d                m_target;
+            Spectrum                m_contribution;     // MIS-weighted contribution if unoccluded
+        };
+
+        std::vector<BDPTVertex>     m_camera_vertices;
+        std::vector<BDPTVertex>     m_light_vertices;
+        std::vector<Connection>     m_connections;
+        std::vector<float>          m_light_pdfs;
+        std::vector<float>          m_camera_pdfs;
+        std::uint64_t               m_shadow_ray_count;
+
+        // Light vertex cache.
+        SamplingContext::RNGType    m_lvc_rng;
+        std::vector<BDPTVertex>     m_lvc_vertices;             // vertices of the cached light subpaths
+        std::vector<std::uint32_t>  m_lvc_path_begin;           // index of the first vertex of the subpath of each cached vertex
+        size_t                      m_lvc_path_count;
+        size_t                      m_lvc_remaining_samples;    // number of camera samples before the cache is rebuilt
+        std::uint64_t               m_lvc_build_count;
+
         struct PathVisitor
         {
             const ShadingContext&           m_shading_context;
@@ -722,18 +997,17 @@ namespace
                 bdpt_vertex.m_bsdf = vertex.m_bsdf;
                 bdpt_vertex.m_bsdf_data = vertex.m_bsdf_data;
                 bdpt_vertex.m_dir_to_prev_vertex = normalize(vertex.m_outgoing.get_value());
-                bdpt_vertex.m_fwd_pdf = vertex.m_prev_prob;
                 bdpt_vertex.m_geometric_normal = vertex.get_geometric_normal();
                 bdpt_vertex.m_position = vertex.get_point();
                 bdpt_vertex.m_shading_basis = Basis3f(vertex.get_shading_basis());
                 bdpt_vertex.m_shading_point = *vertex.m_shading_point;
-                /// todo: compute rev_pdf here
 
-                if (vertex.m_edf)
-                {
+                // Vertices are reused from one sample to the next.
+                bdpt_vertex.m_is_light_vertex = vertex.m_edf != nullptr;
+                if (bdpt_vertex.m_is_light_vertex)
                     vertex.compute_emitted_radiance(m_shading_context, bdpt_vertex.m_Le);
-                    bdpt_vertex.m_is_light_vertex = true;
-                }
+                else
+                    bdpt_vertex.m_Le.set(0.0f);
 
                 bdpt_vertex.m_prev_vertex = (*m_num_vertices == 0) ? nullptr : m_vertices - 1;
                 (*m_num_vertices)++;
@@ -794,6 +1068,41 @@ Dictionary BDPTLightingEngineFactory::get_params_metadata()
             .insert("label", "Max Bounces")
             .insert("help", "Maximum number of bounces"));
 
+    metadata.dictionaries().insert(
+        "enable_light_vertex_cache",
+        Dictionary()
+            .insert("type", "bool")
+            .insert("default", "off")
+            .insert("label", "Enable Light Vertex Cache")
+            .insert("help", "Connect camera subpaths to light subpaths shared by consecutive samples"));
+
+    metadata.dictionaries().insert(
+        "lvc_light_paths",
+        Dictionary()
+            .insert("type", "int")
+            .insert("default", "1024")
+            .insert("min", "1")
+            .insert("label", "Cached Light Paths")
+            .insert("help", "Number of light subpaths stored in the light vertex cache of each rendering thread"));
+
+    metadata.dictionaries().insert(
+        "lvc_connections",
+        Dictionary()
+            .insert("type", "int")
+            .insert("default", "3")
+            .insert("min", "1")
+            .insert("label", "Cached Light Vertex Connections")
+            .insert("help", "Number of cached light vertices each camera subpath is connected to"));
+
+    metadata.dictionaries().insert(
+        "lvc_path_reuse",
+        Dictionary()
+            .insert("type", "int")
+            .insert("default", "2")
+            .insert("min", "1")
+            .insert("label", "Cached Light Path Reuse")
+            .insert("help", "Number of camera samples served per cached light subpath before the cache is rebuilt"));
+
     metadata.dictionaries().insert(
         "dl_light_samples",
         Dictionary()
@@ -828,6 +1137,7 @@ BDPTLightingEngineFactory::BDPTLightingEngineFactory(
   : m_project(project)
   , m_light_sampler(light_sampler)
   , m_params(params)
+  , m_engine_count(0)
 {
 }
 
@@ -842,7 +1152,8 @@ ILightingEngine* BDPTLightingEngineFactory::create()
         new BDPTLightingEngine(
             m_project,
             m_light_sampler,
-            m_params);
+            m_params,
+            m_engine_count++);
 }
 
 }   // namespace renderer
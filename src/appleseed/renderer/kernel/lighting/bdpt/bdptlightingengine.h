@@ -32,6 +32,9 @@
 #include "renderer/kernel/lighting/ilightingengine.h"
 #include "renderer/utility/paramarray.h"
 
+// Standard headers.
+#include <cstddef>
+
 // Forward declarations.
 namespace foundation    { class Dictionary; }
 namespace renderer      { class ForwardLightSampler; }
@@ -67,6 +70,7 @@ class BDPTLightingEngineFactory
     const Project&                  m_project;
     const ForwardLightSampler&      m_light_sampler;
     ParamArray                      m_params;
+    size_t                          m_engine_count;
 };
 
 }   // namespace renderer
@@ -48,6 +48,7 @@
 #include "foundation/math/scalar.h"
 
 // Standard headers.
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 
@@ -67,6 +68,9 @@ namespace renderer
 //   compute_outgoing_radiance_light_sampling_low_variance
 //       add_emitting_shape_sample_contribution
 //       add_non_physical_light_sample_contribution
+//       add_resampled_lightset_contribution
+//           evaluate_emitting_shape_candidate
+//           evaluate_non_physical_light_candidate
 //
 //   compute_outgoing_radiance_combined_sampling_low_variance
 //       compute_outgoing_radiance_material_sampling
@@ -82,7 +86,9 @@ DirectLightingIntegrator::DirectLightingIntegrator(
     const size_t                    material_sample_count,
     const size_t                    light_sample_count,
     const float                     low_light_threshold,
-    const bool                      indirect)
+    const bool                      indirect,
+    const size_t                    resampling_candidate_count,
+    LightReservoir*                 light_reservoir)
   : m_shading_context(shading_context)
   , m_light_sampler(light_sampler)
   , m_material_sampler(material_sampler)
@@ -92,7 +98,13 @@ DirectLightingIntegrator::DirectLightingIntegrator(
   , m_light_sample_count(light_sample_count)
   , m_low_light_threshold(low_light_threshold)
   , m_indirect(indirect)
+  , m_resampling_candidate_count(resampling_candidate_count)
+  , m_light_reservoir(light_reservoir)
 {
+    // Select the light tree cut once for all light samples and candidates, and for
+    // the probability densities of the lights hit by material samples.
+    if (m_light_sampler.has_lightset())
+        m_light_sampler.select_light_cut(m_material_sampler.get_shading_point(), m_light_cut);
 }
 
 void DirectLightingIntegrator::compute_outgoing_radiance_material_sampling(
@@ -161,37 +173,51 @@ void DirectLightingIntegrator::compute_outgoing_radiance_light_sampling_low_vari
     {
         DirectShadingComponents lightset_radiance;
 
-        sampling_context.split_in_place(3, m_light_sample_count);
-
-        for (size_t i = 0, e = m_light_sample_count; i < e; ++i)
+        if (m_resampling_candidate_count > 1)
         {
-            // Sample the light set.
-            LightSample sample;
-            m_light_sampler.sample_lightset(
-                m_time,
-                sampling_context.next2<Vector3f>(),
-                m_material_sampler.get_shading_point(),
-                sample);
+            add_resampled_lightset_contribution(
+                sampling_context,
+                m_light_cut,
+                mis_heuristic,
+                outgoing,
+                lightset_radiance,
+                light_path_stream);
+        }
+        else
+        {
+            sampling_context.split_in_place(3, m_light_sample_count);
 
-            // Add the contribution of the chosen light.
-            if (sample.m_shape)
-            {
-                add_emitting_shape_sample_contribution(
-                    sampling_context,
-                    sample,
-                    mis_heuristic,
-                    outgoing,
-                    lightset_radiance,
-                    light_path_stream);
-            }
-            else
+            for (size_t i = 0, e = m_light_sample_count; i < e; ++i)
             {
-                add_non_physical_light_sample_contribution(
-                    sampling_context,
-                    sample,
-                    outgoing,
-                    lightset_radiance,
-                    light_path_stream);
+                // Sample the light set.
+                LightSample sample;
+                m_light_sampler.sample_lightset(
+                    m_time,
+                    sampling_context.next2<Vector3f>(),
+                    m_material_sampler.get_shading_point(),
+                    m_light_cut,
+                    sample);
+
+                // Add the contribution of the chosen light.
+                if (sample.m_shape)
+                {
+                    add_emitting_shape_sample_contribution(
+                        sampling_context,
+                        sample,
+                        mis_heuristic,
+                        outgoing,
+                        lightset_radiance,
+                        light_path_stream);
+                }
+                else
+                {
+                    add_non_physical_light_sample_contribution(
+                        sampling_context,
+                        sample,
+                        outgoing,
+                        lightset_radiance,
+                        light_path_stream);
+                }
             }
         }
 
@@ -315,7 +341,8 @@ void DirectLightingIntegrator::take_single_material_sample(
             const float light_prob_area =
                 m_light_sampler.evaluate_pdf(
                     light_shading_point,
-                    m_material_sampler.get_shading_point());
+                    m_material_sampler.get_shading_point(),
+                    m_light_cut);
 
             // Apply the weighting function.
             weight *=
@@ -551,4 +578,335 @@ void DirectLightingIntegrator::add_non_physical_light_sample_contribution(
     }
 }
 
+struct DirectLightingIntegrator::LightCandidate
+{
+    LightSample                 m_sample;
+    Vector3d                    m_position;             // world space position the shadow ray is traced to
+    DirectShadingComponents     m_material_value;
+    Spectrum                    m_light_value;          // unshadowed light contribution, before division by the sample probability
+    float                       m_target;               // unshadowed contribution reduced to a scalar
+    bool                        m_cast_shadows;
+};
+
+void DirectLightingIntegrator::add_resampled_lightset_contribution(
+    SamplingContext&                sampling_context,
+    const LightTreeCut&             light_cut,
+    const MISHeuristic              mis_heuristic,
+    const Dual3d&                   outgoing,
+    DirectShadingComponents&        radiance,
+    LightPathStream*                light_path_stream) const
+{
+    const size_t candidate_count = m_resampling_candidate_count;
+
+    const bool reuse = m_light_reservoir != nullptr && can_reuse_light_reservoir();
+    const size_t selection_count = candidate_count + (reuse ? 1 : 0);
+
+    sampling_context.split_in_place(3, m_light_sample_count * candidate_count);
+    SamplingContext child_sampling_context = sampling_context.split(1, m_light_sample_count * selection_count);
+
+    for (size_t i = 0, e = m_light_sample_count; i < e; ++i)
+    {
+        // Stream the candidates through a weighted reservoir of size one.
+        LightCandidate selected;
+        float weight_sum = 0.0f;
+        float total_candidate_count = static_cast<float>(candidate_count);
+
+        for (size_t j = 0; j < candidate_count; ++j)
+        {
+            // Sample the light set.
+            LightCandidate candidate;
+            m_light_sampler.sample_lightset(
+                m_time,
+                sampling_context.next2<Vector3f>(),
+                m_material_sampler.get_shading_point(),
+                light_cut,
+                candidate.m_sample);
+
+            const float s = child_sampling_context.next2<float>();
+
+            const bool valid =
+                candidate.m_sample.m_shape
+                    ? evaluate_emitting_shape_candidate(candidate.m_sample, mis_heuristic, outgoing, candidate)
+                    : evaluate_non_physical_light_candidate(sampling_context, candidate.m_sample, outgoing, candidate);
+
+            if (!valid)
+                continue;
+
+            // Resampling weight: target density over source density.
+            const float weight = candidate.m_target / candidate.m_sample.m_probability;
+            weight_sum += weight;
+
+            if (s * weight_sum < weight)
+                selected = candidate;
+        }
+
+        // Offer the sample chosen at the previous shading point as one more candidate,
+        // standing for at most as many candidates as were drawn here.
+        if (reuse && i == 0)
+        {
+            const float s = child_sampling_context.next2<float>();
+
+            // The light sampling density of the reused sample depends on the shading point:
+            // evaluate it again here so that MIS weights it as if it had been drawn here.
+            LightSample reused_sample = m_light_reservoir->m_sample;
+            ShadingPoint light_shading_point;
+            reused_sample.make_shading_point(
+                light_shading_point,
+                reused_sample.m_shading_normal,
+                m_shading_context.get_intersector());
+            reused_sample.m_probability =
+                m_light_sampler.evaluate_pdf(
+                    light_shading_point,
+                    m_material_sampler.get_shading_point(),
+                    light_cut);
+
+            LightCandidate candidate;
+            if (evaluate_emitting_shape_candidate(reused_sample, mis_heuristic, outgoing, candidate))
+            {
+                const float reused_candidate_count =
+                    std::min(m_light_reservoir->m_candidate_count, static_cast<float>(candidate_count));
+                const float weight =
+                    candidate.m_target * m_light_reservoir->m_contribution_weight * reused_candidate_count;
+                weight_sum += weight;
+                total_candidate_count += reused_candidate_count;
+
+                if (s * weight_sum < weight)
+                    selected = candidate;
+            }
+        }
+        else if (reuse)
+            child_sampling_context.next2<float>();
+
+        if (weight_sum == 0.0f)
+        {
+            if (m_light_reservoir && i == 0)
+                m_light_reservoir->clear();
+            continue;
+        }
+
+        // Compute the transmission factor between the chosen light sample and the shading point.
+        Spectrum transmission;
+        if (selected.m_cast_shadows)
+        {
+            m_material_sampler.trace_between(
+                m_shading_context,
+                selected.m_position,
+                transmission);
+        }
+        else transmission.set(1.0f);
+
+        // Unbiased contribution weight of the chosen sample.
+        const float contribution_weight = weight_sum / (total_candidate_count * selected.m_target);
+
+        // Keep the chosen sample for the next shading point if it reached this one.
+        if (m_light_reservoir && i == 0)
+        {
+            if (selected.m_sample.m_shape && !is_zero(transmission))
+            {
+                m_light_reservoir->m_sample = selected.m_sample;
+                m_light_reservoir->m_point = m_material_sampler.get_point();
+                m_light_reservoir->m_normal = m_material_sampler.get_shading_point().get_shading_normal();
+                m_light_reservoir->m_contribution_weight = contribution_weight;
+                m_light_reservoir->m_candidate_count = total_candidate_count;
+            }
+            else m_light_reservoir->clear();
+        }
+
+        // Discard occluded samples.
+        if (is_zero(transmission))
+            continue;
+
+        // Add the contribution of the chosen sample to the illumination.
+        Spectrum light_value = selected.m_light_value;
+        light_value *= transmission;
+        light_value *= contribution_weight;
+        madd(radiance, selected.m_material_value, light_value);
+
+        // Record light path event.
+        if (light_path_stream)
+        {
+            if (selected.m_sample.m_shape)
+            {
+                light_path_stream->sampled_emitting_shape(
+                    *selected.m_sample.m_shape,
+                    selected.m_position,
+                    selected.m_material_value.m_beauty,
+                    light_value);
+            }
+            else
+            {
+                light_path_stream->sampled_non_physical_light(
+                    *selected.m_sample.m_light,
+                    selected.m_position,
+                    selected.m_material_value.m_beauty,
+                    light_value);
+            }
+        }
+    }
+}
+
+bool DirectLightingIntegrator::can_reuse_light_reservoir() const
+{
+    assert(m_light_reservoir);
+
+    if (m_light_reservoir->is_empty())
+        return false;
+
+    // Only reuse samples chosen at shading points with a similar orientation.
+    const Vector3d& normal = m_material_sampler.get_shading_point().get_shading_normal();
+    if (dot(normal, m_light_reservoir->m_normal) < 0.9)
+        return false;
+
+    // Only reuse samples chosen at shading points close to this one, relative to the distance to the light.
+    const Vector3d& point = m_material_sampler.get_point();
+    return
+        square_norm(point - m_light_reservoir->m_point) <
+        0.01 * square_norm(m_light_reservoir->m_sample.m_point - point);
+}
+
+bool DirectLightingIntegrator::evaluate_emitting_shape_candidate(
+    const LightSample&              sample,
+    const MISHeuristic              mis_heuristic,
+    const Dual3d&                   outgoing,
+    LightCandidate&                 candidate) const
+{
+    const Material* material = sample.m_shape->get_material();
+    const Material::RenderData& material_data = material->get_render_data();
+    const EDF* edf = material_data.m_edf;
+
+    // No contribution if we are computing indirect lighting but this light does not cast indirect light.
+    if (m_indirect && !(edf->get_flags() & EDF::CastIndirectLight))
+        return false;
+
+    // Compute the incoming direction in world space.
+    Vector3d incoming = sample.m_point - m_material_sampler.get_point();
+
+    // No contribution if the shading point is behind the light.
+    double cos_on = dot(-incoming, sample.m_shading_normal);
+    if (cos_on <= 0.0)
+        return false;
+
+    // Compute the square distance between the light sample and the shading point.
+    const double square_distance = square_norm(incoming);
+
+    // Don't use this sample if we're closer than the light near start value.
+    if (square_distance < square(edf->get_light_near_start()))
+        return false;
+
+    const double rcp_sample_square_distance = 1.0 / square_distance;
+    const double rcp_sample_distance = std::sqrt(rcp_sample_square_distance);
+
+    // Normalize the incoming direction.
+    cos_on *= rcp_sample_distance;
+    incoming *= rcp_sample_distance;
+
+    // Evaluate the BSDF (or volume).
+    const float material_probability =
+        m_material_sampler.evaluate(
+            Vector3f(outgoing.get_value()),
+            Vector3f(incoming),
+            m_light_sampling_modes,
+            candidate.m_material_value);
+    assert(material_probability >= 0.0f);
+    if (material_probability == 0.0f)
+        return false;
+
+    // Build a shading point on the light source.
+    ShadingPoint light_shading_point;
+    sample.make_shading_point(
+        light_shading_point,
+        sample.m_shading_normal,
+        m_shading_context.get_intersector());
+
+    if (material_data.m_shader_group)
+    {
+        m_shading_context.execute_osl_emission(
+            *material_data.m_shader_group,
+            light_shading_point);
+    }
+
+    // Evaluate the EDF.
+    candidate.m_light_value = Spectrum(Spectrum::Illuminance);
+    edf->evaluate(
+        edf->evaluate_inputs(m_shading_context, light_shading_point),
+        Vector3f(sample.m_geometric_normal),
+        Basis3f(Vector3f(sample.m_shading_normal)),
+        -Vector3f(incoming),
+        candidate.m_light_value);
+
+    const float g = static_cast<float>(cos_on * rcp_sample_square_distance);
+
+    // Apply MIS weighting.
+    const float mis_weight =
+        mis(
+            mis_heuristic,
+            m_light_sample_count * sample.m_probability,
+            m_material_sample_count * material_probability * g);
+
+    candidate.m_light_value *= mis_weight * g;
+    candidate.m_target = average_value(candidate.m_material_value.m_beauty * candidate.m_light_value);
+    if (!(candidate.m_target > 0.0f))
+        return false;
+
+    candidate.m_sample = sample;
+    candidate.m_position = sample.m_point;
+    candidate.m_cast_shadows = true;
+
+    return true;
+}
+
+bool DirectLightingIntegrator::evaluate_non_physical_light_candidate(
+    SamplingContext&                sampling_context,
+    const LightSample&              sample,
+    const Dual3d&                   outgoing,
+    LightCandidate&                 candidate) const
+{
+    const Light* light = sample.m_light;
+
+    // No contribution if we are computing indirect lighting but this light does not cast indirect light.
+    if (m_indirect && !(light->get_flags() & Light::CastIndirectLight))
+        return false;
+
+    // Generate a uniform sample in [0,1)^2.
+    SamplingContext child_sampling_context = sampling_context.split(2, 1);
+    const Vector2d s = child_sampling_context.next2<Vector2d>();
+
+    // Evaluate the light.
+    Vector3d emission_direction;
+    float probability;
+    candidate.m_light_value = Spectrum(Spectrum::Illuminance);
+    light->sample(
+        m_shading_context,
+        sample.m_light_transform,
+        m_material_sampler.get_point(),
+        s,
+        candidate.m_position,
+        emission_direction,
+        candidate.m_light_value,
+        probability);
+
+    // Evaluate the BSDF (or volume).
+    const float material_probability =
+        m_material_sampler.evaluate(
+            Vector3f(outgoing.get_value()),
+            Vector3f(-emission_direction),
+            m_light_sampling_modes,
+            candidate.m_material_value);
+    assert(material_probability >= 0.0f);
+    if (material_probability == 0.0f)
+        return false;
+
+    const float attenuation = light->compute_distance_attenuation(
+        m_material_sampler.get_point(), candidate.m_position);
+    candidate.m_light_value *= attenuation / probability;
+    candidate.m_target = average_value(candidate.m_material_value.m_beauty * candidate.m_light_value);
+    if (!(candidate.m_target > 0.0f))
+        return false;
+
+    candidate.m_sample = sample;
+    candidate.m_cast_shadows = (light->get_flags() & Light::CastShadows) != 0;
+
+    return true;
+}
+
 }   // namespace renderer
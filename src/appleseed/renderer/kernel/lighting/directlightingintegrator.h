@@ -31,6 +31,8 @@
 
 // appleseed.renderer headers.
 #include "renderer/global/globaltypes.h"
+#include "renderer/kernel/lighting/lightsample.h"
+#include "renderer/kernel/lighting/lighttree.h"
 #include "renderer/kernel/lighting/materialsamplers.h"
 #include "renderer/kernel/shading/shadingray.h"
 
@@ -47,12 +49,36 @@
 namespace renderer  { class BackwardLightSampler; }
 namespace renderer  { class DirectShadingComponents; }
 namespace renderer  { class LightPathStream; }
-namespace renderer  { class LightSample; }
 namespace renderer  { class ShadingContext; }
 
 namespace renderer
 {
 
+//
+// A light sample chosen by resampled light sampling at a shading point, kept so that
+// it can be offered as an additional candidate at the next, nearby, shading points.
+//
+
+class LightReservoir
+{
+  public:
+    LightSample                 m_sample;               // chosen light sample, on a light-emitting shape
+    foundation::Vector3d        m_point;                // shading point where the sample was chosen
+    foundation::Vector3d        m_normal;               // shading normal at that point
+    float                       m_contribution_weight;  // unbiased contribution weight of the sample, 0 if empty
+    float                       m_candidate_count;      // number of candidates the sample was chosen from
+
+    // Constructor. The reservoir is initially empty.
+    LightReservoir();
+
+    // Return true if the reservoir holds a light sample.
+    bool is_empty() const;
+
+    // Empty the reservoir.
+    void clear();
+};
+
+
 //
 // The direct lighting integrator allows to estimate direct lighting at a given point in the scene.
 //
@@ -67,6 +93,23 @@ namespace renderer
 //   The number of shadow rays cast by these functions may be as high as the number of light
 //   samples passed to the constructor plus the number of non-physical lights in the scene.
 //
+// Note about resampled light sampling:
+//
+//   When a resampling candidate count is passed to the constructor, every light sample of
+//   the light set is chosen among that many candidate samples using weighted reservoir
+//   sampling. The candidates are weighted by their unshadowed contribution, and only the
+//   chosen one is shadow-tested. The low light threshold is not used in this mode.
+//
+//   When a light reservoir is also provided, the sample chosen at the previous shading point
+//   is offered as an additional candidate if that point is close enough, then replaced with
+//   the new choice. This reuse across neighboring pixels reduces noise further but is biased.
+//
+//   Reference:
+//
+//     Spatiotemporal reservoir resampling for real-time ray tracing with dynamic direct lighting
+//     Benedikt Bitterli, Chris Wyman, Matt Pharr, Peter Shirley, Aaron Lefohn, Wojciech Jarosz
+//     https://research.nvidia.com/publication/2020-07_spatiotemporal-reservoir-resampling-real-time-ray-tracing-dynamic-direct
+//
 
 class DirectLightingIntegrator
 {
@@ -81,7 +124,9 @@ class DirectLightingIntegrator
         const size_t                    material_sample_count,        // number of samples in material sampling
         const size_t                    light_sample_count,           // number of samples in light sampling
         const float                     low_light_threshold,          // light contribution threshold to disable shadow rays
-        const bool                      indirect);                    // are we computing indirect lighting?
+        const bool                      indirect,                     // are we computing indirect lighting?
+        const size_t                    resampling_candidate_count,   // number of candidates per light sample, 0 or 1 to disable resampling
+        LightReservoir*                 light_reservoir);             // sample reused between shading points, or nullptr
 
     // Compute outgoing radiance due to direct lighting via combined BSDF and light sampling.
     void compute_outgoing_radiance_combined_sampling_low_variance(
@@ -105,6 +150,10 @@ class DirectLightingIntegrator
         DirectShadingComponents&        radiance,
         LightPathStream*                light_path_stream) const;
 
+    // Return the light tree cut selected for the shading point. The cut is empty if
+    // light cuts are not in use.
+    const LightTreeCut& get_light_cut() const;
+
   private:
     friend class VolumeLightingIntegrator;
 
@@ -117,6 +166,11 @@ class DirectLightingIntegrator
     const size_t                        m_material_sample_count;
     const size_t                        m_light_sample_count;
     const bool                          m_indirect;
+    const size_t                        m_resampling_candidate_count;
+    LightReservoir*                     m_light_reservoir;
+    LightTreeCut                        m_light_cut;
+
+    struct LightCandidate;
 
     void take_single_material_sample(
         SamplingContext&                sampling_context,
@@ -138,6 +192,61 @@ class DirectLightingIntegrator
         const foundation::Dual3d&       outgoing,
         DirectShadingComponents&        radiance,
         LightPathStream*                light_path_stream) const;
+
+    void add_resampled_lightset_contribution(
+        SamplingContext&                sampling_context,
+        const LightTreeCut&             light_cut,
+        const foundation::MISHeuristic  mis_heuristic,
+        const foundation::Dual3d&       outgoing,
+        DirectShadingComponents&        radiance,
+        LightPathStream*                light_path_stream) const;
+
+    bool can_reuse_light_reservoir() const;
+
+    // Evaluate the unshadowed contribution of a light sample. Return false if it is zero.
+    bool evaluate_emitting_shape_candidate(
+        const LightSample&              sample,
+        const foundation::MISHeuristic  mis_heuristic,
+        const foundation::Dual3d&       outgoing,
+        LightCandidate&                 candidate) const;
+
+    bool evaluate_non_physical_light_candidate(
+        SamplingContext&                sampling_context,
+        const LightSample&              sample,
+        const foundation::Dual3d&       outgoing,
+        LightCandidate&                 candidate) const;
 };
 
+
+//
+// LightReservoir class implementation.
+//
+
+inline LightReservoir::LightReservoir()
+  : m_contribution_weight(0.0f)
+  , m_candidate_count(0.0f)
+{
+}
+
+inline bool LightReservoir::is_empty() const
+{
+    return m_contribution_weight == 0.0f;
+}
+
+inline void LightReservoir::clear()
+{
+    m_contribution_weight = 0.0f;
+    m_candidate_count = 0.0f;
+}
+
+
+//
+// DirectLightingIntegrator class implementation.
+//
+
+inline const LightTreeCut& DirectLightingIntegrator::get_light_cut() const
+{
+    return m_light_cut;
+}
+
 }   // namespace renderer
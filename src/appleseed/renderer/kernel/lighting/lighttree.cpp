@@ -45,9 +45,12 @@
 #include "foundation/math/scalar.h"
 #include "foundation/math/vector.h"
 #include "foundation/platform/timers.h"
+#include "foundation/utility/job/jobmanager.h"
+#include "foundation/utility/job/jobqueue.h"
 #include "foundation/utility/vpythonfile.h"
 
 // Standard headers.
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <limits>
@@ -60,20 +63,92 @@ namespace renderer
 //
 // LightTree class implementation.
 //
+// References:
+//
+//   [1] Area Light Sources for Real-Time Graphics
+//       https://www.microsoft.com/en-us/research/wp-content/uploads/1996/03/arealights.pdf
+//
+//   [2] Importance Sampling of Many Lights with Adaptive Tree Splitting
+//       http://www.aconty.com/pdf/many-lights-hpg2018.pdf
+//
+//   [3] Stochastic Lightcuts
+//       http://www.cemyuksel.com/research/stochasticlightcuts/stochasticlightcuts.pdf
+//
+
+namespace
+{
+    // Retrieve the importance of a non-physical light.
+    float compute_light_importance(const Light& light)
+    {
+        Spectrum spectrum;
+        light.get_inputs().find("intensity").source()->evaluate_uniform(spectrum);
+        return average_value(spectrum);
+    }
+
+    // Retrieve the importance of an emitting shape.
+    float compute_shape_importance(const EmittingShape& shape)
+    {
+        const EDF* edf = shape.get_material()->get_uncached_edf();
+        assert(edf != nullptr);
+
+        const float max_contribution = edf->get_uncached_max_contribution();
+
+        // max_contribution is reported as std::numeric_limits<float>::max() when
+        // we can't compute the max_contribution easily (ex: textured lights)
+        // In such cases, we can use a default importance value of 1.0 to avoid
+        // infinite importance values in the light tree nodes.
+        if (max_contribution == std::numeric_limits<float>::max())
+            return 1.0f;
+
+        return max_contribution * edf->get_uncached_importance_multiplier();
+    }
+
+    // Return true if none of the lights bounded by a box and a normal cone emit light toward a given point.
+    bool is_facing_away(
+        const AABB3d&       bbox,
+        const Vector3f&     cone_axis,
+        const float         cone_cos_angle,
+        const Vector3d&     point)
+    {
+        if (cone_cos_angle <= -1.0f)
+            return false;
+
+        const Vector3d center = bbox.center();
+        const double square_dist = square_distance(point, center);
+        const double square_radius = bbox.square_radius();
+
+        // The point is inside the bounding sphere of the lights.
+        if (square_dist <= square_radius)
+            return false;
+
+        // [2] section 4.3: angle between the cone and the point, reduced by the cone
+        // angle and by the angle subtended by the bounding sphere of the lights.
+        const Vector3f to_point(normalize(point - center));
+        const float theta = std::acos(clamp(dot(cone_axis, to_point), -1.0f, 1.0f));
+        const float theta_o = std::acos(clamp(cone_cos_angle, -1.0f, 1.0f));
+        const float theta_u = std::asin(static_cast<float>(std::sqrt(square_radius / square_dist)));
+
+        // Leave some slack to account for the limited precision of the cones.
+        return theta - theta_o - theta_u > HalfPi<float>() + 1.0e-3f;
+    }
+}
 
 LightTree::LightTree(
     const std::vector<NonPhysicalLightInfo>&      non_physical_lights,
-    const std::vector<EmittingShape>&             emitting_shapes)
+    const std::vector<EmittingShape>&             emitting_shapes,
+    const bool                                    use_orientation_bounds)
   : m_non_physical_lights(non_physical_lights)
   , m_emitting_shapes(emitting_shapes)
+  , m_use_orientation_bounds(use_orientation_bounds)
   , m_tree_depth(0)
   , m_is_built(false)
 {
 }
 
-std::vector<size_t> LightTree::build()
+std::vector<size_t> LightTree::build(const size_t thread_count)
 {
-    AABBVector light_bboxes;
+    std::vector<AABB3d> light_bboxes;
+    LightTreePartitioner::EmitterVector emitters;
 
     // Collect non-physical light sources.
     for (size_t i = 0, e = m_non_physical_lights.size(); i < e; ++i)
@@ -96,7 +171,14 @@ std::vector<size_t> LightTree::build()
                                             position[2] + BboxSize));
         light_bboxes.push_back(bbox);
 
-        m_items.emplace_back(bbox, i, NonPhysicalLightType);
+        // Non-physical lights are assumed to emit light in all directions.
+        LightTreePartitioner::Emitter emitter;
+        emitter.m_energy = compute_light_importance(*light);
+        emitter.m_cone_axis = Vector3f(0.0f, 0.0f, 1.0f);
+        emitter.m_cone_cos_angle = -1.0f;
+        emitters.push_back(emitter);
+
+        m_items.emplace_back(bbox, i, NonPhysicalLightType, emitter);
     }
 
     // Collect emitting shapes.
@@ -105,56 +187,83 @@ std::vector<size_t> LightTree::build()
         const EmittingShape& shape = m_emitting_shapes[i];
 
         const AABB3d& bbox = shape.get_bbox();
-
         light_bboxes.push_back(bbox);
-        m_items.emplace_back(bbox, i, EmittingShapeType);
+
+        // Bound the shading normals of the emitting shape.
+        Vector3d cone_axis;
+        double cone_cos_angle;
+        shape.compute_normal_cone(cone_axis, cone_cos_angle);
+
+        LightTreePartitioner::Emitter emitter;
+        emitter.m_energy = compute_shape_importance(shape);
+        emitter.m_cone_axis = Vector3f(cone_axis);
+        emitter.m_cone_cos_angle = static_cast<float>(cone_cos_angle);
+        emitters.push_back(emitter);
+
+        m_items.emplace_back(bbox, i, EmittingShapeType, emitter);
+    }
+
+    if (m_items.empty())
+    {
+        RENDERER_LOG_INFO("no light tree compatible lights in the scene; light tree not built.");
+        return IndexLUT();
     }
 
     // Create the partitioner.
-    typedef bvh::MiddlePartitioner<AABBVector> Partitioner;
-    Partitioner partitioner(light_bboxes);
+    LightTreePartitioner partitioner(light_bboxes, emitters);
 
-    // Build the light tree.
-    typedef bvh::Builder<LightTree, Partitioner> Builder;
+    // Build the light tree, distributing independent subtrees over a pool of worker threads.
+    typedef bvh::Builder<LightTree, LightTreePartitioner> Builder;
     Builder builder;
-    builder.build<DefaultWallclockTimer>(*this, partitioner, m_items.size(), 1);
+    JobQueue job_queue;
+    JobManager job_manager(
+        global_logger(),
+        job_queue,
+        thread_count,
+        JobManager::KeepRunningOnEmptyQueue);
+    job_manager.start();
+    builder.build<DefaultWallclockTimer>(
+        *this,
+        partitioner,
+        m_items.size(),
+        1,
+        job_queue,
+        thread_count);
+    job_manager.stop();
+
+    m_is_built = true;
 
     // Reorder m_items vector to match the ordering in the LightTree.
-    if (!m_items.empty())
-    {
-        m_is_built = true;
-
-        const std::vector<size_t>& ordering = partitioner.get_item_ordering();
-        assert(m_items.size() == ordering.size());
-
-        // Reorder items according to the tree ordering.
-        ItemVector temp(ordering.size());
-        small_item_reorder(
-            &m_items[0],
-            &temp[0],
-            &ordering[0],
-            ordering.size());
-
-        // Set total node importance and level for each node of the LightTree.
-        IndexLUT tri_index_to_node_index;
-        tri_index_to_node_index.resize(m_emitting_shapes.size());
-        recursive_node_update(0, 0, 0, tri_index_to_node_index);
-
-        // Print light tree statistics.
-        Statistics statistics;
-        statistics.insert("nodes", m_nodes.size());
-        statistics.insert("max tree depth", m_tree_depth);
-        statistics.insert_time("total build time", builder.get_build_time());
-        RENDERER_LOG_INFO("%s",
-            StatisticsVector::make(
-                "light tree statistics",
-                statistics).to_string().c_str());
-
-        return tri_index_to_node_index;
-    }
-
-    RENDERER_LOG_INFO("no light tree compatible lights in the scene; light tree not built.");
-    return IndexLUT();
+    const std::vector<size_t>& ordering = partitioner.get_item_ordering();
+    assert(m_items.size() == ordering.size());
+
+    // Reorder items according to the tree ordering.
+    ItemVector temp(ordering.size());
+    small_item_reorder(
+        &m_items[0],
+        &temp[0],
+        &ordering[0],
+        ordering.size());
+
+    // Set total node importance and level for each node of the LightTree.
+    IndexLUT tri_index_to_node_index;
+    tri_index_to_node_index.resize(m_emitting_shapes.size());
+    recursive_node_update(0, 0, 0, tri_index_to_node_index);
+
+    // Print light tree statistics.
+    Statistics statistics;
+    statistics.insert("nodes", m_nodes.size());
+    statistics.insert_size("node size", sizeof(NodeType));
+    statistics.insert("max tree depth", m_tree_depth);
+    statistics.insert("build threads", thread_count);
+    statistics.insert("parallel subtrees", builder.get_subtree_count());
+    statistics.insert_time("total build time", builder.get_build_time());
+    RENDERER_LOG_INFO("%s",
+        StatisticsVector::make(
+            "light tree statistics",
+            statistics).to_string().c_str());
+
+    return tri_index_to_node_index;
 }
 
 bool LightTree::is_built() const
@@ -179,46 +288,33 @@ float LightTree::recursive_node_update(
         const float importance2 = recursive_node_update(node_index, child2, node_level + 1, tri_index_to_node_index);
 
         importance = importance1 + importance2;
+
+        // Bound the normals of both children.
+        Vector3f cone_axis;
+        float cone_cos_angle;
+        merge_normal_cones(
+            m_nodes[child1].get_cone_axis(),
+            m_nodes[child1].get_cone_cos_angle(),
+            m_nodes[child2].get_cone_axis(),
+            m_nodes[child2].get_cone_cos_angle(),
+            cone_axis,
+            cone_cos_angle);
+        m_nodes[node_index].set_orientation_bounds(cone_axis, cone_cos_angle);
     }
     else
     {
         // Retrieve the light source associated to this leaf.
         const size_t item_index = m_nodes[node_index].get_item_index();
-        const size_t light_index = m_items[item_index].m_light_index;
+        const Item& item = m_items[item_index];
 
-        if (m_items[item_index].m_light_type == NonPhysicalLightType)
-        {
-            const Light* light = m_non_physical_lights[light_index].m_light;
+        importance = item.m_emitter.m_energy;
+        m_nodes[node_index].set_orientation_bounds(
+            item.m_emitter.m_cone_axis,
+            item.m_emitter.m_cone_cos_angle);
 
-            // Retrieve the non-physical light importance.
-            Spectrum spectrum;
-            light->get_inputs().find("intensity").source()->evaluate_uniform(spectrum);
-            importance = average_value(spectrum);
-        }
-        else
-        {
-            assert(m_items[item_index].m_light_type == EmittingShapeType);
-
-            const EmittingShape& shape = m_emitting_shapes[light_index];
-
-            // Retrieve the emitting shape importance.
-            const EDF* edf = shape.get_material()->get_uncached_edf();
-            assert(edf != nullptr);
-
-            const float max_contribution = edf->get_uncached_max_contribution();
-
-            // max_contribution is reported as std::numeric_limits<float>::max() when
-            // we can't compute the max_contribution easily (ex: textured lights)
-            // In such cases, we can use a default importance value of 1.0 to avoid
-            // infinite importance values in the light tree nodes.
-            if (max_contribution == std::numeric_limits<float>::max())
-                importance = 1.0f;
-            else
-                importance = max_contribution * edf->get_uncached_importance_multiplier();
-
-            // Save the index of the light tree node containing the EMT in the look up table.
-            tri_index_to_node_index[light_index] = node_index;
-        }
+        // Save the index of the light tree node containing the EMT in the look up table.
+        if (item.m_light_type == EmittingShapeType)
+            tri_index_to_node_index[item.m_light_index] = node_index;
 
         // Keep track of the tree depth.
         if (m_tree_depth < node_level)
@@ -237,7 +333,7 @@ float LightTree::recursive_node_update(
 
 void LightTree::sample(
     const ShadingPoint&     shading_point,
-    float                   s,
+    const float             s,
     LightType&              light_type,
     size_t&                 light_index,
     float&                  light_probability) const
@@ -245,8 +341,49 @@ void LightTree::sample(
     assert(is_built());
 
     light_probability = 1.0f;
-    size_t node_index = 0;
 
+    sample_subtree(
+        shading_point,
+        0,
+        s,
+        light_type,
+        light_index,
+        light_probability);
+}
+
+void LightTree::sample(
+    const ShadingPoint&     shading_point,
+    const LightTreeCut&     cut,
+    const float             s,
+    LightType&              light_type,
+    size_t&                 light_index,
+    float&                  light_probability) const
+{
+    assert(is_built());
+    assert(!cut.empty());
+
+    // Choose a node of the cut, then a light below this node.
+    float remapped_s = s;
+    const LightTreeCut::Entry& entry = cut.sample(remapped_s);
+    light_probability = entry.m_probability;
+
+    sample_subtree(
+        shading_point,
+        entry.m_node_index,
+        remapped_s,
+        light_type,
+        light_index,
+        light_probability);
+}
+
+void LightTree::sample_subtree(
+    const ShadingPoint&     shading_point,
+    size_t                  node_index,
+    float                   s,
+    LightType&              light_type,
+    size_t&                 light_index,
+    float&                  light_probability) const
+{
     while (!m_nodes[node_index].is_leaf())
     {
         const auto& node = m_nodes[node_index];
@@ -283,7 +420,7 @@ float LightTree::evaluate_node_pdf(
 
     do
     {
-        const LightTreeNode<AABB3d>& node = m_nodes[parent_index];
+        const NodeType& node = m_nodes[parent_index];
 
         float p1, p2;
         child_node_probabilites(node, shading_point, p1, p2);
@@ -299,6 +436,113 @@ float LightTree::evaluate_node_pdf(
     return pdf;
 }
 
+void LightTree::select_cut(
+    const ShadingPoint&     shading_point,
+    const size_t            max_size,
+    LightTreeCut&           cut) const
+{
+    assert(is_built());
+    assert(max_size <= LightTreeCut::MaxSize);
+
+    cut.clear();
+
+    if (max_size > 1 && !m_nodes[0].is_leaf())
+    {
+        // Interior nodes of the cut, kept in a max-heap ordered by weight ([3] section 4).
+        LightTreeCut::Entry candidates[LightTreeCut::MaxSize];
+        size_t candidate_count = 0;
+
+        const auto compare =
+            [](const LightTreeCut::Entry& lhs, const LightTreeCut::Entry& rhs)
+            {
+                return lhs.m_probability < rhs.m_probability;
+            };
+
+        size_t node_index = 0;
+
+        while (true)
+        {
+            // Replace the node by its two children.
+            const auto& node = m_nodes[node_index];
+            const size_t child_indices[2] =
+            {
+                node.get_child_node_index(),
+                node.get_child_node_index() + 1
+            };
+            const AABB3d child_bboxes[2] =
+            {
+                AABB3d(node.get_left_bbox()),
+                AABB3d(node.get_right_bbox())
+            };
+
+            for (size_t i = 0; i < 2; ++i)
+            {
+                const auto& child = m_nodes[child_indices[i]];
+                const float weight =
+                    compute_node_probability(child, child_bboxes[i], shading_point);
+
+                // Leave out lights that cannot illuminate the shading point.
+                if (weight <= 0.0f)
+                    continue;
+
+                if (child.is_leaf())
+                    cut.insert(child_indices[i], weight);
+                else
+                {
+                    candidates[candidate_count].m_node_index = child_indices[i];
+                    candidates[candidate_count].m_probability = weight;
+                    std::push_heap(candidates, candidates + ++candidate_count, compare);
+                }
+            }
+
+            // Stop when the cut is full or only contains leaves.
+            if (candidate_count == 0 || cut.size() + candidate_count >= max_size)
+                break;
+
+            // Split the node with the highest weight next.
+            std::pop_heap(candidates, candidates + candidate_count--, compare);
+            node_index = candidates[candidate_count].m_node_index;
+        }
+
+        for (size_t i = 0; i < candidate_count; ++i)
+            cut.insert(candidates[i].m_node_index, candidates[i].m_probability);
+    }
+
+    // Fall back to walking the tree from the root if no light can illuminate
+    // the shading point, or if the cut is limited to a single node.
+    if (cut.empty())
+        cut.insert(0, 1.0f);
+
+    cut.prepare();
+}
+
+float LightTree::evaluate_node_pdf(
+    const ShadingPoint&     shading_point,
+    const LightTreeCut&     cut,
+    size_t                  node_index) const
+{
+    float pdf = 1.0f;
+
+    while (true)
+    {
+        if (const LightTreeCut::Entry* entry = cut.find(node_index))
+            return pdf * entry->m_probability;
+
+        // The node was left out of the cut.
+        if (m_nodes[node_index].is_root())
+            return 0.0f;
+
+        const size_t parent_index = m_nodes[node_index].get_parent();
+        const NodeType& parent = m_nodes[parent_index];
+
+        float p1, p2;
+        child_node_probabilites(parent, shading_point, p1, p2);
+
+        pdf *= parent.get_child_node_index() == node_index ? p1 : p2;
+        node_index = parent_index;
+    }
+}
+
 namespace
 {
     // [1] Section 2.2.
@@ -350,7 +594,7 @@ namespace
 }
 
 float LightTree::compute_node_probability(
-    const LightTreeNode<AABB3d>&    node,
+    const NodeType&                 node,
     const AABB3d&                   bbox,
     const ShadingPoint&             shading_point) const
 {
@@ -371,6 +615,11 @@ float LightTree::compute_node_probability(
 
     const Vector3d& surface_point = shading_point.get_point();
 
+    // Cull nodes whose lights all face away from the shading point ([2] section 4.3).
+    if (m_use_orientation_bounds &&
+        is_facing_away(bbox, node.get_cone_axis(), node.get_cone_cos_angle(), surface_point))
+        return 0.0f;
+
     const float distance2 =
         static_cast<float>(square_distance(surface_point, position));
 
@@ -380,12 +629,7 @@ float LightTree::compute_node_probability(
     if (distance2 <= r2)
         return node.get_importance() / distance2;
 
-    //
-    // Implementation of Lambertian lighting model for sub-hemispherical light sources.
-    // Reference:
-    //  [1] Area Light Sources for Real-Time Graphics
-    //      https://www.microsoft.com/en-us/research/wp-content/uploads/1996/03/arealights.pdf
-    //
+    // Implementation of Lambertian lighting model for sub-hemispherical light sources [1].
     const Vector3d outcoming_light_direction = normalize(bbox.center() - surface_point);
     const float sin_sigma2 = std::min(1.0f, (r2 / distance2));
     const float cos_sigma = std::sqrt(1.0f - sin_sigma2);
@@ -405,7 +649,7 @@ float LightTree::compute_node_probability(
 }
 
 void LightTree::child_node_probabilites(
-    const LightTreeNode<AABB3d>&    node,
+    const NodeType&                 node,
     const ShadingPoint&             shading_point,
     float&                          p1,
     float&                          p2) const
@@ -416,8 +660,8 @@ void LightTree::child_node_probabilites(
     // Node has currently no info about its own bbox characteristics.
     // Hence we have to extract it before from its parent.
     // todo: make LightTreeNode aware of its bbox!
-    const auto& bbox_left = node.get_left_bbox();
-    const auto& bbox_right = node.get_right_bbox();
+    const AABB3d bbox_left(node.get_left_bbox());
+    const AABB3d bbox_right(node.get_right_bbox());
 
     p1 = compute_node_probability(child1, bbox_left, shading_point);
     p2 = compute_node_probability(child2, bbox_right, shading_point);
@@ -469,8 +713,8 @@ void LightTree::draw_tree_structure(
 
                 if (m_nodes[i].get_level() == parent_level)
                 {
-                    const auto& bbox_left = m_nodes[i].get_left_bbox();
-                    const auto& bbox_right = m_nodes[i].get_right_bbox();
+                    const AABB3d bbox_left(m_nodes[i].get_left_bbox());
+                    const AABB3d bbox_right(m_nodes[i].get_right_bbox());
 
                     file.draw_aabb(bbox_left, color, Width);
                     file.draw_aabb(bbox_right, color, Width);
@@ -499,8 +743,8 @@ void LightTree::draw_tree_structure(
                     ? "color.red"
                     : "color.green";
 
-            const auto& bbox_left = m_nodes[i].get_left_bbox();
-            const auto& bbox_right = m_nodes[i].get_right_bbox();
+            const AABB3d bbox_left(m_nodes[i].get_left_bbox());
+            const AABB3d bbox_right(m_nodes[i].get_right_bbox());
 
             file.draw_aabb(bbox_left, color, Width);
             file.draw_aabb(bbox_right, color, Width);
@@ -508,5 +752,70 @@ void LightTree::draw_tree_structure(
     }
 }
 
+
+
+//
+// LightTreeCut class implementation.
+//
+
+void LightTreeCut::prepare()
+{
+    assert(m_size > 0);
+
+    std::sort(
+        m_entries,
+        m_entries + m_size,
+        [](const Entry& lhs, const Entry& rhs)
+        {
+            return lhs.m_node_index < rhs.m_node_index;
+        });
+
+    float total_weight = 0.0f;
+    for (size_t i = 0; i < m_size; ++i)
+        total_weight += m_entries[i].m_probability;
+
+    assert(total_weight > 0.0f);
+    const float rcp_total_weight = 1.0f / total_weight;
+
+    for (size_t i = 0; i < m_size; ++i)
+        m_entries[i].m_probability *= rcp_total_weight;
+}
+
+const LightTreeCut::Entry& LightTreeCut::sample(float& s) const
+{
+    assert(m_size > 0);
+
+    // Cuts are small, a linear search is good enough.
+    float cdf = 0.0f;
+    size_t i = 0;
+    for (; i < m_size - 1; ++i)
+    {
+        if (s < cdf + m_entries[i].m_probability)
+            break;
+        cdf += m_entries[i].m_probability;
+    }
+
+    const Entry& entry = m_entries[i];
+    s = clamp((s - cdf) / entry.m_probability, 0.0f, 1.0f);
+
+    return entry;
+}
+
+const LightTreeCut::Entry* LightTreeCut::find(const size_t node_index) const
+{
+    const Entry* end = m_entries + m_size;
+    const Entry* entry =
+        std::lower_bound(
+            m_entries,
+            end,
+            node_index,
+            [](const Entry& lhs, const size_t rhs)
+            {
+                return lhs.m_node_index < rhs;
+            });
+
+    return entry != end && entry->m_node_index == node_index ? entry : nullptr;
+}
+
 }   // namespace renderer
 
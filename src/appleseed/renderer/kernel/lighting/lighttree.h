@@ -30,6 +30,7 @@
 
 // appleseed.renderer headers.
 #include "renderer/kernel/lighting/lighttree_node.h"
+#include "renderer/kernel/lighting/lighttreepartitioner.h"
 #include "renderer/kernel/lighting/lighttypes.h"
 
 // appleseed.foundation headers.
@@ -39,6 +40,7 @@
 #include "foundation/utility/statistics.h"
 
 // Standard headers.
+#include <cassert>
 #include <cstddef>
 
 // Forward declarations.
@@ -47,6 +49,64 @@ namespace renderer  { class ShadingPoint; }
 namespace renderer
 {
 
+//
+// A cut through the light tree.
+//
+// The subtrees rooted at the nodes of a cut partition the lights of the tree.
+// A cut is selected once for a shading point and then reused for all the light
+// samples taken at this shading point, which saves walking the upper levels of
+// the tree again and again. Nodes whose lights cannot illuminate the shading
+// point are left out of the cut.
+//
+
+class LightTreeCut
+{
+  public:
+    // Maximum number of nodes in a cut.
+    enum { MaxSize = 64 };
+
+    struct Entry
+    {
+        size_t  m_node_index;
+        float   m_probability;
+    };
+
+    LightTreeCut();
+
+    // Return true if the cut contains no node.
+    bool empty() const;
+
+    // Return the number of nodes in the cut.
+    size_t size() const;
+
+    // Remove all nodes from the cut.
+    void clear();
+
+    // Insert a node into the cut with a given (not necessarily normalized) weight.
+    void insert(
+        const size_t                    node_index,
+        const float                     weight);
+
+    // Sort the nodes by index and turn their weights into probabilities.
+    // The sum of the weights must be positive.
+    void prepare();
+
+    // Access the nodes of a prepared cut.
+    const Entry& operator[](const size_t i) const;
+
+    // Choose a node of a prepared cut proportionally to its probability.
+    // On return, s is remapped to [0, 1) so that it can be reused for sampling below the node.
+    const Entry& sample(float& s) const;
+
+    // Find a node of a prepared cut. Return nullptr if the node is not part of the cut.
+    const Entry* find(const size_t node_index) const;
+
+  private:
+    size_t  m_size;
+    Entry   m_entries[MaxSize];
+};
+
+
 //
 // Light tree.
 //
@@ -54,7 +114,7 @@ namespace renderer
 class LightTree
   : public foundation::bvh::Tree<
                foundation::AlignedVector<
-                   LightTreeNode<foundation::AABB3d>
+                   LightTreeNode<foundation::AABB3f>
                >
             >
 {
@@ -63,9 +123,11 @@ class LightTree
     // Build the tree based on the lights collected by the BackwardLightSampler.
     LightTree(
         const std::vector<NonPhysicalLightInfo>&      non_physical_lights,
-        const std::vector<EmittingShape>&             emitting_shapes);
+        const std::vector<EmittingShape>&             emitting_shapes,
+        const bool                                    use_orientation_bounds = false);
 
-    std::vector<size_t> build();
+    // Build the tree using a given number of threads.
+    std::vector<size_t> build(const size_t thread_count);
 
     bool is_built() const;
 
@@ -82,12 +144,36 @@ class LightTree
         const ShadingPoint&             surface_point,
         const size_t                    node_index) const;
 
+    // Select a cut of at most max_size nodes for a given shading point by repeatedly
+    // splitting the node of the cut with the highest contribution.
+    void select_cut(
+        const ShadingPoint&             shading_point,
+        const size_t                    max_size,
+        LightTreeCut&                   cut) const;
+
+    // Sample a light from a cut selected for this shading point.
+    void sample(
+        const ShadingPoint&             shading_point,
+        const LightTreeCut&             cut,
+        const float                     s,
+        LightType&                      light_type,
+        size_t&                         light_index,
+        float&                          light_probability) const;
+
+    // Compute the light probability of a particular tree node when sampling from a cut.
+    // Start from the node and go backwards until a node of the cut is reached.
+    float evaluate_node_pdf(
+        const ShadingPoint&             surface_point,
+        const LightTreeCut&             cut,
+        const size_t                    node_index) const;
+
   private:
     struct Item
     {
-        foundation::AABB3d      m_bbox;
-        size_t                  m_light_index;
-        LightType               m_light_type;
+        foundation::AABB3d                  m_bbox;
+        size_t                              m_light_index;
+        LightType                           m_light_type;
+        LightTreePartitioner::Emitter       m_emitter;
 
         Item() {}
 
@@ -96,12 +182,14 @@ class LightTree
         // external_source_index represents the light index in light_tree_lights
         // and emitting_shapes vectors within the BackwardLightSampler.
         Item(
-            const foundation::AABB3d&       bbox,
-            const size_t                    light_index,
-            const LightType                 light_type)
+            const foundation::AABB3d&               bbox,
+            const size_t                            light_index,
+            const LightType                         light_type,
+            const LightTreePartitioner::Emitter&    emitter)
             : m_bbox(bbox)
             , m_light_index(light_index)
             , m_light_type(light_type)
+            , m_emitter(emitter)
         {
         }
     };
@@ -114,6 +202,7 @@ class LightTree
     const NonPhysicalLightVector&                   m_non_physical_lights;
     const EmittingShapeVector&                      m_emitting_shapes;
     ItemVector                                      m_items;
+    const bool                                      m_use_orientation_bounds;
     size_t                                          m_tree_depth;
     bool                                            m_is_built;
 
@@ -126,13 +215,22 @@ class LightTree
         const size_t                                node_level,
         IndexLUT&                                   tri_index_to_node_index);
 
+    // Walk down the tree from a given node, choosing children according to their probabilities.
+    void sample_subtree(
+        const ShadingPoint&                         shading_point,
+        size_t                                      node_index,
+        float                                       s,
+        LightType&                                  light_type,
+        size_t&                                     light_index,
+        float&                                      light_probability) const;
+
     float compute_node_probability(
-        const LightTreeNode<foundation::AABB3d>&    node,
+        const NodeType&                             node,
         const foundation::AABB3d&                   bbox,
         const ShadingPoint&                         shading_point) const;
 
     void child_node_probabilites(
-        const LightTreeNode<foundation::AABB3d>&    node,
+        const NodeType&                             node,
         const ShadingPoint&                         shading_point,
         float&                                      p1,
         float&                                      p2) const;
@@ -144,4 +242,47 @@ class LightTree
         const bool                                  separate_by_levels = false) const;
 };
 
+
+
+//
+// LightTreeCut class implementation.
+//
+
+inline LightTreeCut::LightTreeCut()
+  : m_size(0)
+{
+}
+
+inline bool LightTreeCut::empty() const
+{
+    return m_size == 0;
+}
+
+inline size_t LightTreeCut::size() const
+{
+    return m_size;
+}
+
+inline void LightTreeCut::clear()
+{
+    m_size = 0;
+}
+
+inline void LightTreeCut::insert(
+    const size_t    node_index,
+    const float     weight)
+{
+    assert(m_size < MaxSize);
+
+    m_entries[m_size].m_node_index = node_index;
+    m_entries[m_size].m_probability = weight;
+    ++m_size;
+}
+
+inline const LightTreeCut::Entry& LightTreeCut::operator[](const size_t i) const
+{
+    assert(i < m_size);
+    return m_entries[i];
+}
+
 }   // namespace renderer
@@ -31,9 +31,14 @@
 // appleseed.foundation headers.
 #include "foundation/math/aabb.h"
 #include "foundation/math/bvh.h"
+#include "foundation/math/scalar.h"
+#include "foundation/math/vector.h"
 
 // Standard headers.
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
 
 namespace renderer
 {
@@ -41,6 +46,9 @@ namespace renderer
 //
 // LightTreeNode class implementation.
 //
+// Light tree specific data is packed into 32-bit fields so that it fits, together
+// with the single precision bounding boxes of the base class, in two cache lines.
+//
 
 template <typename AABB>
 class LightTreeNode
@@ -49,8 +57,11 @@ class LightTreeNode
   public:
     LightTreeNode()
       : m_importance(0.0f)
-      , m_root(false)
+      , m_cone_axis(0.0f, 0.0f, 1.0f)
+      , m_cone_cos_angle(-1.0f)
       , m_parent(0)
+      , m_tree_level(0)
+      , m_root(false)
     {
     }
 
@@ -59,6 +70,18 @@ class LightTreeNode
         return m_importance;
     }
 
+    // Return the axis of the cone bounding the emission normals of the lights below this node.
+    const foundation::Vector3f& get_cone_axis() const
+    {
+        return m_cone_axis;
+    }
+
+    // Return the cosine of the half-angle of the normal cone; -1 means the lights may emit in any direction.
+    float get_cone_cos_angle() const
+    {
+        return m_cone_cos_angle;
+    }
+
     size_t get_level() const
     {
         return m_tree_level;
@@ -79,16 +102,24 @@ class LightTreeNode
         m_importance = importance;
     }
 
+    void set_orientation_bounds(
+        const foundation::Vector3f&     axis,
+        const float                     cos_angle)
+    {
+        m_cone_axis = axis;
+        m_cone_cos_angle = cos_angle;
+    }
+
     // todo: set this during the construction
     void set_level(const size_t node_level)
     {
-        m_tree_level = node_level;
+        m_tree_level = static_cast<std::uint32_t>(node_level);
     }
 
     // todo: set this during the construction
     void set_parent(const size_t node_parent)
     {
-        m_parent = node_parent;
+        m_parent = static_cast<std::uint32_t>(node_parent);
     }
 
     // todo: set this during the construction
@@ -98,10 +129,76 @@ class LightTreeNode
     }
 
   private:
-    float   m_importance;
-    size_t  m_tree_level;
-    size_t  m_parent;
-    bool    m_root;
+    float                   m_importance;
+    foundation::Vector3f    m_cone_axis;
+    float                   m_cone_cos_angle;
+    std::uint32_t           m_parent;
+    std::uint32_t           m_tree_level;
+    bool                    m_root;
 };
 
+
+//
+// Compute a cone bounding two cones of emission normals.
+//
+// Reference:
+//
+//   Importance Sampling of Many Lights with Adaptive Tree Splitting, section 4.1
+//   http://www.aconty.com/pdf/many-lights-hpg2018.pdf
+//
+
+inline void merge_normal_cones(
+    const foundation::Vector3f&     axis1,
+    const float                     cos_angle1,
+    const foundation::Vector3f&     axis2,
+    const float                     cos_angle2,
+    foundation::Vector3f&           axis,
+    float&                          cos_angle)
+{
+    if (cos_angle1 <= -1.0f || cos_angle2 <= -1.0f)
+    {
+        axis = axis1;
+        cos_angle = -1.0f;
+        return;
+    }
+
+    const float theta1 = std::acos(foundation::clamp(cos_angle1, -1.0f, 1.0f));
+    const float theta2 = std::acos(foundation::clamp(cos_angle2, -1.0f, 1.0f));
+    const float theta_d = std::acos(foundation::clamp(foundation::dot(axis1, axis2), -1.0f, 1.0f));
+
+    // One of the cones contains the other.
+    if (std::min(theta_d + theta2, foundation::Pi<float>()) <= theta1)
+    {
+        axis = axis1;
+        cos_angle = cos_angle1;
+        return;
+    }
+    if (std::min(theta_d + theta1, foundation::Pi<float>()) <= theta2)
+    {
+        axis = axis2;
+        cos_angle = cos_angle2;
+        return;
+    }
+
+    const float theta_o = 0.5f * (theta1 + theta_d + theta2);
+    const foundation::Vector3f rotation_axis = foundation::cross(axis1, axis2);
+    const float rotation_axis_norm = foundation::norm(rotation_axis);
+
+    if (theta_o >= foundation::Pi<float>() || rotation_axis_norm == 0.0f)
+    {
+        axis = axis1;
+        cos_angle = -1.0f;
+        return;
+    }
+
+    // Rotate the first axis toward the second one, around an axis orthogonal to both.
+    const float theta_r = theta_o - theta1;
+    const foundation::Vector3f k = rotation_axis / rotation_axis_norm;
+    axis =
+        foundation::normalize(
+            axis1 * std::cos(theta_r) +
+            foundation::cross(k, axis1) * std::sin(theta_r));
+    cos_angle = std::cos(theta_o);
+}
+
 }   // namespace renderer
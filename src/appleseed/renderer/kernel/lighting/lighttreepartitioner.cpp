@@ -0,0 +1,207 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Interface header.
+#include "lighttreepartitioner.h"
+
+// appleseed.renderer headers.
+#include "renderer/kernel/lighting/lighttree_node.h"
+
+// appleseed.foundation headers.
+#include "foundation/math/scalar.h"
+
+// Standard headers.
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+using namespace foundation;
+
+namespace renderer
+{
+
+namespace
+{
+    // Orientation measure of a cone of emission normals, for lights emitting
+    // over the hemisphere around their normal (equation 1 with theta_e = pi/2).
+    double orientation_measure(const float cos_angle)
+    {
+        const double cos_o = clamp(static_cast<double>(cos_angle), -1.0, 1.0);
+        const double theta_o = std::acos(cos_o);
+        const double theta_w = std::min(theta_o + HalfPi<double>(), Pi<double>());
+        const double sin_o = std::sin(theta_o);
+
+        return
+              TwoPi<double>() * (1.0 - cos_o)
+            + HalfPi<double>() * (
+                  2.0 * theta_w * sin_o
+                - std::cos(theta_o - 2.0 * theta_w)
+                - 2.0 * theta_o * sin_o
+                + cos_o);
+    }
+
+    // Difference in size between the two sides of a partition.
+    size_t imbalance(const size_t pivot, const size_t count)
+    {
+        return pivot < count - pivot ? count - 2 * pivot : 2 * pivot - count;
+    }
+
+    // Energy, bounding box and normal cone of a set of lights.
+    struct EmitterAccumulator
+    {
+        AABB3d      m_bbox;
+        double      m_energy;
+        Vector3f    m_cone_axis;
+        float       m_cone_cos_angle;
+        bool        m_empty;
+
+        EmitterAccumulator()
+          : m_energy(0.0)
+          , m_empty(true)
+        {
+            m_bbox.invalidate();
+        }
+
+        void insert(
+            const AABB3d&                               bbox,
+            const LightTreePartitioner::Emitter&        emitter)
+        {
+            m_bbox.insert(bbox);
+            m_energy += emitter.m_energy;
+
+            if (m_empty)
+            {
+                m_cone_axis = emitter.m_cone_axis;
+                m_cone_cos_angle = emitter.m_cone_cos_angle;
+                m_empty = false;
+            }
+            else
+            {
+                merge_normal_cones(
+                    m_cone_axis,
+                    m_cone_cos_angle,
+                    emitter.m_cone_axis,
+                    emitter.m_cone_cos_angle,
+                    m_cone_axis,
+                    m_cone_cos_angle);
+            }
+        }
+
+        double cost() const
+        {
+            return m_energy * half_surface_area(m_bbox) * orientation_measure(m_cone_cos_angle);
+        }
+    };
+}
+
+
+//
+// LightTreePartitioner class implementation.
+//
+
+LightTreePartitioner::LightTreePartitioner(
+    const AABBVectorType&           bboxes,
+    const EmitterVector&            emitters)
+  : foundation::bvh::PartitionerBase<AABBVectorType>(bboxes)
+  , m_emitters(emitters)
+  , m_left_costs(bboxes.size() > 1 ? bboxes.size() - 1 : 0)
+{
+    assert(emitters.size() == bboxes.size());
+}
+
+size_t LightTreePartitioner::partition(
+    const size_t                    begin,
+    const size_t                    end,
+    const AABBType&                 bbox)
+{
+    const size_t count = end - begin;
+    assert(count > 1);
+
+    const Vector3d extent = bbox.extent();
+    const double max_extent = max_value(extent);
+
+    // By default, split in the middle of the longest dimension. This is what
+    // happens when all lights are at the same place.
+    double best_split_cost = std::numeric_limits<double>::max();
+    size_t best_split_dim = max_index(extent);
+    size_t best_split_pivot = count / 2;
+
+    for (size_t d = 0; d < Dimension; ++d)
+    {
+        // Lights can't be told apart along a flat dimension.
+        if (extent[d] <= 0.0)
+            continue;
+
+        // Penalize thin slices through the set of lights (regularization factor Kr).
+        const double regularization = max_extent / extent[d];
+
+        const std::vector<size_t>& indices = m_indices[d];
+
+        // Left-to-right sweep to accumulate the lights and compute their cost.
+        // The costs are stored at the position of the lights so that disjoint sets
+        // of lights can be partitioned concurrently.
+        double* left_costs = &m_left_costs[begin];
+        EmitterAccumulator left;
+        for (size_t i = 0; i < count - 1; ++i)
+        {
+            const size_t index = indices[begin + i];
+            left.insert(m_bboxes[index], m_emitters[index]);
+            left_costs[i] = left.cost();
+        }
+
+        // Right-to-left sweep to accumulate the lights, compute their cost and find the best partition.
+        EmitterAccumulator right;
+        for (size_t i = count - 1; i > 0; --i)
+        {
+            const size_t index = indices[begin + i];
+            right.insert(m_bboxes[index], m_emitters[index]);
+
+            const double split_cost = regularization * (left_costs[i - 1] + right.cost());
+
+            // Keep track of the partition with the lowest cost. Among equally good
+            // partitions, prefer the most balanced one to keep the tree shallow.
+            if (best_split_cost > split_cost ||
+                (best_split_cost == split_cost &&
+                 imbalance(i, count) < imbalance(best_split_pivot, count)))
+            {
+                best_split_cost = split_cost;
+                best_split_dim = d;
+                best_split_pivot = i;
+            }
+        }
+    }
+
+    const size_t pivot = begin + best_split_pivot;
+    assert(pivot > begin && pivot < end);
+
+    sort_indices(best_split_dim, begin, end, pivot);
+
+    return pivot;
+}
+
+}   // namespace renderer
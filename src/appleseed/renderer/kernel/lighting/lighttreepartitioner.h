@@ -0,0 +1,91 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+// appleseed.foundation headers.
+#include "foundation/math/aabb.h"
+#include "foundation/math/bvh.h"
+#include "foundation/math/vector.h"
+
+// Standard headers.
+#include <cstddef>
+#include <vector>
+
+namespace renderer
+{
+
+//
+// A light tree partitioner based on the Surface Area Orientation Heuristic (SAOH).
+//
+// Sets of lights are split so as to minimize the sum, over both sides, of the
+// emitted energy weighted by the surface area of the bounding box and by the
+// solid angle covered by the emission normals. Unlike the SAH partitioner,
+// every set of two or more lights is split since the light tree stores exactly
+// one light per leaf.
+//
+// Reference:
+//
+//   Importance Sampling of Many Lights with Adaptive Tree Splitting, section 4.4
+//   http://www.aconty.com/pdf/many-lights-hpg2018.pdf
+//
+
+class LightTreePartitioner
+  : public foundation::bvh::PartitionerBase<std::vector<foundation::AABB3d>>
+{
+  public:
+    typedef std::vector<foundation::AABB3d> AABBVectorType;
+    typedef foundation::AABB3d AABBType;
+
+    // Energy and orientation bounds of a light.
+    struct Emitter
+    {
+        float                       m_energy;
+        foundation::Vector3f        m_cone_axis;
+        float                       m_cone_cos_angle;   // -1 for lights emitting in all directions
+    };
+
+    typedef std::vector<Emitter> EmitterVector;
+
+    // Constructor.
+    LightTreePartitioner(
+        const AABBVectorType&       bboxes,
+        const EmitterVector&        emitters);
+
+    // Partition a set of lights into two distinct sets.
+    size_t partition(
+        const size_t                begin,
+        const size_t                end,
+        const AABBType&             bbox);
+
+  private:
+    const EmitterVector&            m_emitters;
+    std::vector<double>             m_left_costs;
+};
+
+}   // namespace renderer
@@ -42,6 +42,8 @@
 #include "foundation/math/sampling/mappings.h"
 
 // Standard headers.
+#include <algorithm>
+#include <cassert>
 #include <cstdint>
 
 using namespace foundation;
@@ -330,6 +332,61 @@ float EmittingShape::evaluate_pdf_uniform() const
     return get_shape_prob() * get_rcp_area();
 }
 
+void EmittingShape::compute_normal_cone(
+    Vector3d&               axis,
+    double&                 cos_angle) const
+{
+    const ShapeType shape_type = get_shape_type();
+
+    if (shape_type == TriangleShape)
+    {
+        // Shading normals are interpolated from the vertex normals, so the cone
+        // must contain the vertex normals and not only the geometric normal.
+        axis = m_geom.m_triangle.m_geometric_normal;
+        cos_angle = 1.0;
+
+        const Vector3d* vertex_normals[3] =
+        {
+            &m_geom.m_triangle.m_n0,
+            &m_geom.m_triangle.m_n1,
+            &m_geom.m_triangle.m_n2
+        };
+
+        for (size_t i = 0; i < 3; ++i)
+        {
+            const double n_norm = norm(*vertex_normals[i]);
+
+            if (n_norm == 0.0)
+            {
+                cos_angle = -1.0;
+                return;
+            }
+
+            cos_angle = std::min(cos_angle, dot(axis, *vertex_normals[i]) / n_norm);
+        }
+
+        // The interpolation argument only holds for cones narrower than a hemisphere.
+        if (cos_angle <= 0.0)
+            cos_angle = -1.0;
+    }
+    else if (shape_type == RectangleShape)
+    {
+        axis = m_geom.m_rectangle.m_geometric_normal;
+        cos_angle = 1.0;
+    }
+    else if (shape_type == DiskShape)
+    {
+        axis = m_geom.m_disk.m_geometric_normal;
+        cos_angle = 1.0;
+    }
+    else
+    {
+        assert(shape_type == SphereShape);
+        axis = Vector3d(0.0, 0.0, 1.0);
+        cos_angle = -1.0;
+    }
+}
+
 void EmittingShape::make_shading_point(
     ShadingPoint&           shading_point,
     const Vector3d&         point,
@@ -156,6 +156,12 @@ class EmittingShape
 
     float evaluate_pdf_uniform() const;
 
+    // Compute a cone containing every shading normal of the shape. A cosine of -1
+    // is returned when the shape may emit light in any direction.
+    void compute_normal_cone(
+        foundation::Vector3d&       axis,
+        double&                     cos_angle) const;
+
     void make_shading_point(
         ShadingPoint&               shading_point,
         const foundation::Vector3d& point,
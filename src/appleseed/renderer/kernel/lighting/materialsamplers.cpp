@@ -30,6 +30,7 @@
 #include "materialsamplers.h"
 
 // appleseed.renderer headers.
+#include "renderer/kernel/lighting/sdtree.h"
 #include "renderer/kernel/lighting/tracer.h"
 #include "renderer/kernel/shading/directshadingcomponents.h"
 #include "renderer/kernel/shading/shadingcontext.h"
@@ -40,6 +41,9 @@
 // appleseed.foundation headers.
 #include "foundation/math/basis.h"
 
+// Standard headers.
+#include <cassert>
+
 using namespace foundation;
 
 namespace renderer
@@ -187,6 +191,177 @@ float BSDFSampler::evaluate(
 }
 
 
+//
+// GuidedBSDFSampler class implementation.
+//
+
+GuidedBSDFSampler::GuidedBSDFSampler(
+    const BSDF&                 bsdf,
+    const void*                 bsdf_data,
+    const int                   bsdf_sampling_modes,
+    const ShadingPoint&         shading_point,
+    const DTree*                guiding_distribution,
+    const float                 bsdf_sampling_fraction)
+  : BSDFSampler(bsdf, bsdf_data, bsdf_sampling_modes, shading_point)
+  , m_guiding_distribution(guiding_distribution)
+  , m_bsdf_sampling_fraction(bsdf_sampling_fraction)
+{
+    assert(m_bsdf_sampling_fraction > 0.0f && m_bsdf_sampling_fraction <= 1.0f);
+}
+
+bool GuidedBSDFSampler::sample(
+    SamplingContext&            sampling_context,
+    const Dual3d&               outgoing,
+    Dual3f&                     incoming,
+    DirectShadingComponents&    value,
+    float&                      pdf) const
+{
+    BSDFSample sample;
+    sample_bsdf(sampling_context, Dual3f(outgoing), sample);
+
+    // Filter scattering modes.
+    if (!(m_bsdf_sampling_modes & sample.get_mode()))
+        return false;
+
+    incoming = sample.m_incoming;
+    value = sample.m_value;
+    pdf = sample.get_probability();
+
+    return true;
+}
+
+float GuidedBSDFSampler::evaluate(
+    const Vector3f&             outgoing,
+    const Vector3f&             incoming,
+    const int                   light_sampling_modes,
+    DirectShadingComponents&    value) const
+{
+    const float bsdf_pdf =
+        BSDFSampler::evaluate(
+            outgoing,
+            incoming,
+            light_sampling_modes,
+            value);
+
+    return bsdf_pdf > 0.0f ? mix_pdf(bsdf_pdf, incoming) : 0.0f;
+}
+
+void GuidedBSDFSampler::sample_bsdf(
+    SamplingContext&            sampling_context,
+    const Dual3f&               outgoing,
+    BSDFSample&                 sample) const
+{
+    if (m_guiding_distribution == nullptr)
+    {
+        m_bsdf.sample(
+            sampling_context,
+            m_bsdf_data,
+            false,              // not adjoint
+            true,               // multiply by |cos(incoming, normal)|
+            m_local_geometry,
+            outgoing,
+            m_bsdf_sampling_modes,
+            sample);
+        return;
+    }
+
+    // Choose between sampling the BSDF and sampling the guiding distribution.
+    sampling_context.split_in_place(1, 1);
+    const float s = sampling_context.next2<float>();
+
+    if (s < m_bsdf_sampling_fraction)
+    {
+        m_bsdf.sample(
+            sampling_context,
+            m_bsdf_data,
+            false,              // not adjoint
+            true,               // multiply by |cos(incoming, normal)|
+            m_local_geometry,
+            outgoing,
+            m_bsdf_sampling_modes,
+            sample);
+
+        if (sample.get_mode() == ScatteringMode::None)
+            return;
+
+        if (sample.get_mode() == ScatteringMode::Specular)
+        {
+            // Specular directions can only be generated by the BSDF.
+            sample.m_value /= m_bsdf_sampling_fraction;
+            return;
+        }
+
+        sample.set_to_scattering(
+            sample.get_mode(),
+            mix_pdf(sample.get_probability(), sample.m_incoming.get_value()));
+    }
+    else
+    {
+        sampling_context.split_in_place(2, 1);
+
+        float guiding_pdf;
+        const Vector3f incoming =
+            m_guiding_distribution->sample(
+                sampling_context.next2<Vector2f>(),
+                guiding_pdf);
+
+        const float bsdf_pdf =
+            m_bsdf.evaluate(
+                m_bsdf_data,
+                false,          // not adjoint
+                true,           // multiply by |cos(incoming, normal)|
+                m_local_geometry,
+                outgoing.get_value(),
+                incoming,
+                m_bsdf_sampling_modes,
+                sample.m_value);
+
+        if (bsdf_pdf <= 0.0f)
+        {
+            sample.set_to_absorption();
+            return;
+        }
+
+        // Classify the scattering event: it counts as diffuse if a diffuse lobe
+        // of the BSDF could have produced this direction.
+        const int diffuse_modes = m_bsdf_sampling_modes & ScatteringMode::Diffuse;
+        const ScatteringMode::Mode mode =
+            diffuse_modes != 0 &&
+            m_bsdf.evaluate_pdf(
+                m_bsdf_data,
+                false,          // not adjoint
+                m_local_geometry,
+                outgoing.get_value(),
+                incoming,
+                diffuse_modes) > 0.0f
+                ? ScatteringMode::Diffuse
+                : ScatteringMode::Glossy;
+
+        // Exact for Lambertian BSDFs, an approximation otherwise.
+        sample.m_aov_components.m_albedo = sample.m_value.m_beauty;
+        sample.m_aov_components.m_albedo /= bsdf_pdf;
+
+        sample.m_incoming = Dual3f(incoming);
+        sample.set_to_scattering(
+            mode,
+            m_bsdf_sampling_fraction * bsdf_pdf +
+            (1.0f - m_bsdf_sampling_fraction) * guiding_pdf);
+    }
+}
+
+float GuidedBSDFSampler::mix_pdf(
+    const float                 bsdf_pdf,
+    const Vector3f&             incoming) const
+{
+    if (m_guiding_distribution == nullptr)
+        return bsdf_pdf;
+
+    return
+        m_bsdf_sampling_fraction * bsdf_pdf +
+        (1.0f - m_bsdf_sampling_fraction) * m_guiding_distribution->evaluate(incoming);
+}
+
+
 //
 // VolumeSampler class implementation.
 //
@@ -38,7 +38,9 @@
 #include "foundation/math/vector.h"
 
 // Forward declarations.
+namespace renderer  { class BSDFSample; }
 namespace renderer  { class DirectShadingComponents; }
+namespace renderer  { class DTree; }
 namespace renderer  { class ShadingContext; }
 namespace renderer  { class ShadingPoint; }
 
@@ -135,7 +137,7 @@ class BSDFSampler
         const int                       light_sampling_modes,
         DirectShadingComponents&        value) const override;
 
-  private:
+  protected:
     const BSDF&                         m_bsdf;
     const void*                         m_bsdf_data;
     const int                           m_bsdf_sampling_modes;
@@ -143,6 +145,54 @@ class BSDFSampler
     BSDF::LocalGeometry                 m_local_geometry;
 };
 
+//
+// A BSDF sampler that mixes BSDF sampling with sampling of a path guiding distribution.
+// With probability bsdf_sampling_fraction the BSDF is sampled, otherwise the guiding
+// distribution is. Probability densities are those of the mixture so that multiple
+// importance sampling with light sampling stays consistent. Behaves exactly like
+// BSDFSampler when no guiding distribution is provided.
+//
+
+class GuidedBSDFSampler
+  : public BSDFSampler
+{
+  public:
+    GuidedBSDFSampler(
+        const BSDF&                     bsdf,
+        const void*                     bsdf_data,
+        const int                       bsdf_sampling_modes,
+        const ShadingPoint&             shading_point,
+        const DTree*                    guiding_distribution,
+        const float                     bsdf_sampling_fraction);
+
+    bool sample(
+        SamplingContext&                sampling_context,
+        const foundation::Dual3d&       outgoing,
+        foundation::Dual3f&             incoming,
+        DirectShadingComponents&        value,
+        float&                          pdf) const override;
+
+    float evaluate(
+        const foundation::Vector3f&     outgoing,
+        const foundation::Vector3f&     incoming,
+        const int                       light_sampling_modes,
+        DirectShadingComponents&        value) const override;
+
+    // Sample the mixture and fill a complete BSDF sample, as needed to extend a path.
+    void sample_bsdf(
+        SamplingContext&                sampling_context,
+        const foundation::Dual3f&       outgoing,
+        BSDFSample&                     sample) const;
+
+  private:
+    const DTree*                        m_guiding_distribution;
+    const float                         m_bsdf_sampling_fraction;
+
+    float mix_pdf(
+        const float                     bsdf_pdf,
+        const foundation::Vector3f&     incoming) const;
+};
+
 class VolumeSampler
   : public IMaterialSampler
 {
@@ -34,8 +34,10 @@
 #include "renderer/global/globaltypes.h"
 #include "renderer/kernel/aov/aovcomponents.h"
 #include "renderer/kernel/intersection/intersector.h"
+#include "renderer/kernel/lighting/materialsamplers.h"
 #include "renderer/kernel/lighting/pathvertex.h"
 #include "renderer/kernel/lighting/scatteringmode.h"
+#include "renderer/kernel/lighting/sdtree.h"
 #include "renderer/kernel/shading/shadingcontext.h"
 #include "renderer/kernel/shading/shadingpoint.h"
 #include "renderer/kernel/shading/shadingray.h"
@@ -116,7 +118,9 @@ class PathTracer
         const size_t                max_volume_bounces,
         const bool                  clamp_roughness,
         const size_t                max_iterations = 1000,
-        const double                near_start = 0.0);          // abort tracing if the first ray is shorter than this
+        const double                near_start = 0.0,           // abort tracing if the first ray is shorter than this
+        const SDTree*               sd_tree = nullptr,          // if set, guide scattering using this SD-tree
+        const float                 bsdf_sampling_fraction = 1.0f);
 
     size_t trace(
         SamplingContext&            sampling_context,
@@ -145,6 +149,8 @@ class PathTracer
     const bool                      m_clamp_roughness;
     const size_t                    m_max_iterations;
     const double                    m_near_start;
+    const SDTree*                   m_sd_tree;
+    const float                     m_bsdf_sampling_fraction;
     size_t                          m_diffuse_bounces;
     size_t                          m_glossy_bounces;
     size_t                          m_specular_bounces;
@@ -199,7 +205,9 @@ inline PathTracer<PathVisitor, VolumeVisitor, Adjoint>::PathTracer(
     const size_t                max_volume_bounces,
     const bool                  clamp_roughness,
     const size_t                max_iterations,
-    const double                near_start)
+    const double                near_start,
+    const SDTree*               sd_tree,
+    const float                 bsdf_sampling_fraction)
   : m_path_visitor(path_visitor)
   , m_volume_visitor(volume_visitor)
   , m_rr_min_path_length(rr_min_path_length)
@@ -211,6 +219,8 @@ inline PathTracer<PathVisitor, VolumeVisitor, Adjoint>::PathTracer(
   , m_clamp_roughness(clamp_roughness)
   , m_max_iterations(max_iterations)
   , m_near_start(near_start)
+  , m_sd_tree(sd_tree)
+  , m_bsdf_sampling_fraction(bsdf_sampling_fraction)
 {
 }
 
@@ -711,15 +721,33 @@ bool PathTracer<PathVisitor, VolumeVisitor, Adjoint>::process_bounce(
     // Above-surface scattering.
     if (vertex.m_bssrdf == nullptr)
     {
-        vertex.m_bsdf->sample(
-            sampling_context,
-            vertex.m_bsdf_data,
-            Adjoint,
-            true,       // multiply by |cos(incoming, normal)|
-            local_geometry,
-            foundation::Dual3f(vertex.m_outgoing),
-            vertex.m_scattering_modes,
-            sample);
+        if (!Adjoint && m_sd_tree != nullptr && !vertex.m_bsdf->is_purely_specular())
+        {
+            // Mix BSDF sampling with sampling of the learned incident radiance.
+            const GuidedBSDFSampler guided_sampler(
+                *vertex.m_bsdf,
+                vertex.m_bsdf_data,
+                vertex.m_scattering_modes,
+                *vertex.m_shading_point,
+                m_sd_tree->get_sampling_distribution(foundation::Vector3f(vertex.get_point())),
+                m_bsdf_sampling_fraction);
+            guided_sampler.sample_bsdf(
+                sampling_context,
+                foundation::Dual3f(vertex.m_outgoing),
+                sample);
+        }
+        else
+        {
+            vertex.m_bsdf->sample(
+                sampling_context,
+                vertex.m_bsdf_data,
+                Adjoint,
+                true,       // multiply by |cos(incoming, normal)|
+                local_geometry,
+                foundation::Dual3f(vertex.m_outgoing),
+                vertex.m_scattering_modes,
+                sample);
+        }
 
         next_ray.m_min_roughness = m_clamp_roughness ? sample.m_min_roughness : 0.0f;
 
@@ -114,6 +114,11 @@ class PathVertex
 
     // Return the probability density wrt. surface area measure of reaching this vertex via light sampling.
     float get_light_prob_area(const BackwardLightSampler& light_sampler) const;
+
+    // Same as above, using the light tree cut selected for the parent shading point.
+    float get_light_prob_area(
+        const BackwardLightSampler& light_sampler,
+        const LightTreeCut&         light_cut) const;
 };
 
 
@@ -183,4 +188,11 @@ inline float PathVertex::get_light_prob_area(const BackwardLightSampler& light_s
     return light_sampler.evaluate_pdf(*m_shading_point, *m_parent_shading_point);
 }
 
+inline float PathVertex::get_light_prob_area(
+    const BackwardLightSampler& light_sampler,
+    const LightTreeCut&         light_cut) const
+{
+    return light_sampler.evaluate_pdf(*m_shading_point, *m_parent_shading_point, light_cut);
+}
+
 }   // namespace renderer
@@ -0,0 +1,105 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Interface header.
+#include "pathguidingpasscallback.h"
+
+// appleseed.renderer headers.
+#include "renderer/global/globallogger.h"
+#include "renderer/global/globaltypes.h"
+#include "renderer/modeling/scene/scene.h"
+#include "renderer/utility/paramarray.h"
+
+// appleseed.foundation headers.
+#include "foundation/math/aabb.h"
+#include "foundation/math/scalar.h"
+#include "foundation/utility/job/iabortswitch.h"
+#include "foundation/utility/string.h"
+
+// Standard headers.
+#include <algorithm>
+#include <cstddef>
+
+using namespace foundation;
+
+namespace renderer
+{
+
+namespace
+{
+    const size_t MaxDirectionalDepth = 20;
+}
+
+
+//
+// PathGuidingPassCallback class implementation.
+//
+
+PathGuidingPassCallback::PathGuidingPassCallback(
+    const Scene&            scene,
+    const ParamArray&       params)
+  : m_spatial_threshold(std::max<size_t>(params.get_optional<size_t>("guiding_spatial_threshold", 4000), 1))
+  , m_directional_threshold(clamp(params.get_optional<float>("guiding_directional_threshold", 0.01f), 0.0001f, 1.0f))
+{
+    m_sd_tree.reset(AABB3f(scene.compute_bbox()));
+}
+
+void PathGuidingPassCallback::release()
+{
+    delete this;
+}
+
+void PathGuidingPassCallback::on_pass_begin(
+    const Frame&            frame,
+    JobQueue&               job_queue,
+    IAbortSwitch&           abort_switch)
+{
+}
+
+void PathGuidingPassCallback::on_pass_end(
+    const Frame&            frame,
+    JobQueue&               job_queue,
+    IAbortSwitch&           abort_switch)
+{
+    // Don't learn from an incomplete pass.
+    if (abort_switch.is_aborted())
+        return;
+
+    m_sd_tree.end_iteration(
+        m_spatial_threshold,
+        m_directional_threshold,
+        MaxDirectionalDepth);
+
+    RENDERER_LOG_INFO(
+        "path guiding iteration %s completed, %s %s.",
+        pretty_uint(m_sd_tree.get_iteration()).c_str(),
+        pretty_uint(m_sd_tree.get_leaf_count()).c_str(),
+        plural(m_sd_tree.get_leaf_count(), "spatial region").c_str());
+}
+
+}   // namespace renderer
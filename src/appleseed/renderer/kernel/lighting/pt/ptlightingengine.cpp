@@ -38,9 +38,12 @@
 #include "renderer/kernel/lighting/imagebasedlighting.h"
 #include "renderer/kernel/lighting/lightpathrecorder.h"
 #include "renderer/kernel/lighting/lightpathstream.h"
+#include "renderer/kernel/lighting/materialsamplers.h"
 #include "renderer/kernel/lighting/pathtracer.h"
 #include "renderer/kernel/lighting/pathvertex.h"
+#include "renderer/kernel/lighting/radiancecache.h"
 #include "renderer/kernel/lighting/scatteringmode.h"
+#include "renderer/kernel/lighting/sdtree.h"
 #include "renderer/kernel/lighting/volumelightingintegrator.h"
 #include "renderer/kernel/shading/shadingcomponents.h"
 #include "renderer/kernel/shading/shadingcontext.h"
@@ -56,6 +59,7 @@
 // appleseed.foundation headers.
 #include "foundation/math/mis.h"
 #include "foundation/math/population.h"
+#include "foundation/math/scalar.h"
 #include "foundation/math/vector.h"
 #include "foundation/utility/containers/dictionary.h"
 #include "foundation/utility/statistics.h"
@@ -90,6 +94,15 @@ namespace
     //
     //   http://citeseer.ist.psu.edu/344088.html
     //
+    // When an SD-tree is provided, scattering directions are guided by the incident
+    // radiance learned during previous passes (see sdtree.h), and the radiance found
+    // by every path is recorded into the tree for the next passes.
+    //
+    // When a radiance cache is provided and next event estimation is enabled, paths
+    // reaching a purely diffuse surface after a diffuse bounce end there and pick up
+    // the radiance cached for that surface (see radiancecache.h), if any. Until the
+    // cache is built, the radiance leaving such surfaces is recorded into it instead.
+    //
 
     class PTLightingEngine
       : public ILightingEngine
@@ -98,6 +111,8 @@ namespace
         PTLightingEngine(
             const BackwardLightSampler&     light_sampler,
             LightPathRecorder&              light_path_recorder,
+            SDTree*                         sd_tree,
+            RadianceCache*                  radiance_cache,
             const ParamArray&               params)
           : m_params(params)
           , m_light_sampler(light_sampler)
@@ -105,6 +120,8 @@ namespace
               m_params.m_record_light_paths
                   ? light_path_recorder.create_stream()
                   : nullptr)
+          , m_sd_tree(sd_tree)
+          , m_radiance_cache(radiance_cache)
           , m_path_count(0)
           , m_inf_volume_ray_warnings(0)
         {
@@ -131,11 +148,15 @@ namespace
                 "  next event estimation         %s\n"
                 "  dl light samples              %s\n"
                 "  dl light threshold            %s\n"
+                "  dl resampling candidates      %s\n"
+                "  dl resampling reuse           %s\n"
                 "  ibl env samples               %s\n"
                 "  max ray intensity             %s\n"
                 "  volume distance samples       %s\n"
                 "  equiangular sampling          %s\n"
-                "  clamp roughness               %s",
+                "  clamp roughness               %s\n"
+                "  path guiding                  %s\n"
+                "  radiance cache                %s",
                 m_params.m_enable_dl ? "on" : "off",
                 m_params.m_enable_ibl ? "on" : "off",
                 m_params.m_enable_caustics ? "on" : "off",
@@ -148,11 +169,15 @@ namespace
                 m_params.m_next_event_estimation ? "on" : "off",
                 pretty_scalar(m_params.m_dl_light_sample_count).c_str(),
                 pretty_scalar(m_params.m_dl_low_light_threshold, 3).c_str(),
+                m_params.m_dl_resampling_candidate_count > 1 ? pretty_uint(m_params.m_dl_resampling_candidate_count).c_str() : "off",
+                m_params.m_dl_resampling_reuse ? "on" : "off",
                 pretty_scalar(m_params.m_ibl_env_sample_count).c_str(),
                 m_params.m_has_max_ray_intensity ? pretty_scalar(m_params.m_max_ray_intensity).c_str() : "unlimited",
                 pretty_int(m_params.m_distance_sample_count).c_str(),
                 m_params.m_enable_equiangular_sampling ? "on" : "off",
-                m_params.m_clamp_roughness ? "on" : "off");
+                m_params.m_clamp_roughness ? "on" : "off",
+                m_sd_tree != nullptr ? "on" : "off",
+                m_radiance_cache != nullptr ? "on" : "off");
         }
 
         void compute_lighting(
@@ -210,7 +235,10 @@ namespace
                 shading_point.get_scene(),
                 radiance,
                 aov_components,
-                m_light_path_stream);
+                m_light_path_stream,
+                m_sd_tree,
+                m_radiance_cache,
+                m_params.m_dl_resampling_reuse ? &m_light_reservoir : nullptr);
 
             VolumeVisitor volume_visitor(
                 m_params,
@@ -231,7 +259,10 @@ namespace
                 m_params.m_max_specular_bounces,
                 m_params.m_max_volume_bounces,
                 m_params.m_clamp_roughness,
-                shading_context.get_max_iterations());
+                shading_context.get_max_iterations(),
+                0.0,                                    // near start
+                m_sd_tree,
+                m_params.m_guiding_bsdf_sampling_fraction);
 
             const size_t path_length =
                 path_tracer.trace(
@@ -239,6 +270,14 @@ namespace
                     shading_context,
                     shading_point);
 
+            // Train the path guiding structure with the radiance found by this path.
+            if (m_sd_tree)
+                path_visitor.record_guiding_vertices();
+
+            // Train the radiance cache until it is built.
+            if (m_radiance_cache && !m_radiance_cache->is_built())
+                path_visitor.record_cache_vertices();
+
             // Update statistics.
             ++m_path_count;
             m_path_length.insert(path_length);
@@ -273,6 +312,8 @@ namespace
 
             const float     m_dl_light_sample_count;        // number of light samples used to estimate direct illumination
             const float     m_dl_low_light_threshold;       // light contribution threshold to disable shadow rays
+            const size_t    m_dl_resampling_candidate_count;    // number of candidates each light sample is chosen from, 0 or 1 to disable resampling
+            const bool      m_dl_resampling_reuse;          // reuse light samples between neighboring pixels?
             const float     m_ibl_env_sample_count;         // number of environment samples used to estimate IBL
             float           m_rcp_dl_light_sample_count;
             float           m_rcp_ibl_env_sample_count;
@@ -285,6 +326,8 @@ namespace
 
             const bool      m_record_light_paths;
 
+            const float     m_guiding_bsdf_sampling_fraction;   // probability of sampling the BSDF rather than the guiding distribution
+
             explicit Parameters(const ParamArray& params)
               : m_enable_dl(params.get_optional<bool>("enable_dl", true))
               , m_enable_ibl(params.get_optional<bool>("enable_ibl", true))
@@ -299,12 +342,15 @@ namespace
               , m_next_event_estimation(params.get_optional<bool>("next_event_estimation", true))
               , m_dl_light_sample_count(params.get_optional<float>("dl_light_samples", 1.0f))
               , m_dl_low_light_threshold(params.get_optional<float>("dl_low_light_threshold", 0.0f))
+              , m_dl_resampling_candidate_count(params.get_optional<size_t>("dl_resampling_candidates", 0))
+              , m_dl_resampling_reuse(m_dl_resampling_candidate_count > 1 && params.get_optional<bool>("dl_resampling_reuse", false))
               , m_ibl_env_sample_count(params.get_optional<float>("ibl_env_samples", 1.0f))
               , m_has_max_ray_intensity(params.strings().exist("max_ray_intensity"))
               , m_max_ray_intensity(params.get_optional<float>("max_ray_intensity", 0.0f))
               , m_distance_sample_count(params.get_optional<size_t>("volume_distance_samples", 2))
               , m_enable_equiangular_sampling(!params.get_optional<bool>("optimize_for_lights_outside_volumes", false))
               , m_record_light_paths(params.get_optional<bool>("record_light_paths", false))
+              , m_guiding_bsdf_sampling_fraction(clamp(params.get_optional<float>("guiding_bsdf_sampling_fraction", 0.5f), 0.01f, 1.0f))
             {
                 // Precompute the reciprocal of the number of light samples.
                 m_rcp_dl_light_sample_count =
@@ -333,6 +379,9 @@ namespace
         const Parameters                m_params;
         const BackwardLightSampler&     m_light_sampler;
         LightPathStream*                m_light_path_stream;
+        SDTree*                         m_sd_tree;
+        RadianceCache*                  m_radiance_cache;
+        LightReservoir                  m_light_reservoir;
 
         std::uint64_t                   m_path_count;
         Population<std::uint64_t>       m_path_length;
@@ -376,7 +425,84 @@ namespace
                 return true;
             }
 
+            void record_guiding_vertices() const
+            {
+                assert(m_sd_tree);
+
+                for (size_t i = 0; i < m_guiding_vertex_count; ++i)
+                {
+                    const GuidingVertex& guiding_vertex = m_guiding_vertices[i];
+
+                    // The radiance incident at the vertex is the radiance gathered past it,
+                    // divided by the throughput of the path up to the scattered ray.
+                    float incident_radiance = 0.0f;
+                    for (size_t c = 0, e = Spectrum::size(); c < e; ++c)
+                    {
+                        if (guiding_vertex.m_throughput[c] > 0.0f)
+                        {
+                            incident_radiance +=
+                                (m_path_radiance.m_beauty[c] - guiding_vertex.m_radiance[c]) /
+                                guiding_vertex.m_throughput[c];
+                        }
+                    }
+                    incident_radiance /= Spectrum::size();
+
+                    m_sd_tree->record(
+                        guiding_vertex.m_point,
+                        guiding_vertex.m_direction,
+                        incident_radiance / guiding_vertex.m_probability);
+                }
+            }
+
+            void record_cache_vertices() const
+            {
+                assert(m_radiance_cache);
+
+                for (size_t i = 0; i < m_cache_vertex_count; ++i)
+                {
+                    const CacheVertex& cache_vertex = m_cache_vertices[i];
+
+                    // The radiance leaving the vertex is the radiance gathered from the vertex
+                    // onward, divided by the throughput of the path up to the vertex.
+                    Spectrum radiance(0.0f);
+                    for (size_t c = 0, e = Spectrum::size(); c < e; ++c)
+                    {
+                        if (cache_vertex.m_throughput[c] > 0.0f)
+                        {
+                            radiance[c] =
+                                (m_path_radiance.m_beauty[c] - cache_vertex.m_radiance[c]) /
+                                cache_vertex.m_throughput[c];
+                        }
+                    }
+
+                    m_radiance_cache->record(
+                        cache_vertex.m_point,
+                        cache_vertex.m_normal,
+                        radiance);
+                }
+            }
+
           protected:
+            struct GuidingVertex
+            {
+                Vector3f                        m_point;
+                Vector3f                        m_direction;        // scattered direction
+                Spectrum                        m_radiance;         // path radiance before the scattered ray contributed
+                Spectrum                        m_throughput;       // path throughput of the scattered ray
+                float                           m_probability;      // probability density of the scattered direction
+            };
+
+            struct CacheVertex
+            {
+                Vector3f                        m_point;
+                Vector3f                        m_normal;           // shading normal, on the side of the outgoing direction
+                Spectrum                        m_radiance;         // path radiance before the vertex contributed
+                Spectrum                        m_throughput;       // path throughput up to the vertex
+            };
+
+            static const size_t MaxGuidingVertices = 16;
+            static const size_t MaxCacheVertices = 16;
+
             const Parameters&                   m_params;
             const BackwardLightSampler&         m_light_sampler;
             SamplingContext&                    m_sampling_context;
@@ -386,6 +512,14 @@ namespace
             AOVComponents&                      m_aov_components;
             LightPathStream*                    m_light_path_stream;
             bool                                m_omit_emitted_light;
+            SDTree*                             m_sd_tree;
+            GuidingVertex                       m_guiding_vertices[MaxGuidingVertices];
+            size_t                              m_guiding_vertex_count;
+            bool                                m_has_pending_guiding_vertex;
+            RadianceCache*                      m_radiance_cache;
+            CacheVertex                         m_cache_vertices[MaxCacheVertices];
+            size_t                              m_cache_vertex_count;
+            LightReservoir*                     m_light_reservoir;
 
             PathVisitorBase(
                 const Parameters&               params,
@@ -395,7 +529,10 @@ namespace
                 const Scene&                    scene,
                 ShadingComponents&              path_radiance,
                 AOVComponents&                  aov_components,
-                LightPathStream*                light_path_stream)
+                LightPathStream*                light_path_stream,
+                SDTree*                         sd_tree,
+                RadianceCache*                  radiance_cache,
+                LightReservoir*                 light_reservoir)
               : m_params(params)
               , m_light_sampler(light_sampler)
               , m_sampling_context(sampling_context)
@@ -405,7 +542,111 @@ namespace
               , m_aov_components(aov_components)
               , m_light_path_stream(light_path_stream)
               , m_omit_emitted_light(false)
+              , m_sd_tree(sd_tree)
+              , m_guiding_vertex_count(0)
+              , m_has_pending_guiding_vertex(false)
+              , m_radiance_cache(radiance_cache)
+              , m_cache_vertex_count(0)
+              , m_light_reservoir(light_reservoir)
+            {
+            }
+
+            const DTree* get_guiding_distribution(const ShadingPoint& shading_point) const
             {
+                return
+                    m_sd_tree
+                        ? m_sd_tree->get_sampling_distribution(Vector3f(shading_point.get_point()))
+                        : nullptr;
+            }
+
+            // Called once the path visitor is done with a scattering vertex, before the scattered ray is traced.
+            void begin_guiding_vertex(const PathVertex& vertex)
+            {
+                if (m_sd_tree == nullptr ||
+                    vertex.m_bssrdf != nullptr ||
+                    m_guiding_vertex_count == MaxGuidingVertices)
+                    return;
+
+                GuidingVertex& guiding_vertex = m_guiding_vertices[m_guiding_vertex_count];
+                guiding_vertex.m_point = Vector3f(vertex.get_point());
+                guiding_vertex.m_radiance = m_path_radiance.m_beauty;
+                m_has_pending_guiding_vertex = true;
+            }
+
+            // Called when the scattered ray hits a surface or escapes the scene.
+            void end_guiding_vertex(const PathVertex& vertex)
+            {
+                if (!m_has_pending_guiding_vertex)
+                    return;
+
+                m_has_pending_guiding_vertex = false;
+
+                // Only record directions sampled from a continuous distribution at a surface.
+                if (vertex.m_prev_mode != ScatteringMode::Diffuse &&
+                    vertex.m_prev_mode != ScatteringMode::Glossy)
+                    return;
+
+                GuidingVertex& guiding_vertex = m_guiding_vertices[m_guiding_vertex_count++];
+                guiding_vertex.m_direction = Vector3f(vertex.get_ray().m_dir);
+                guiding_vertex.m_throughput = vertex.m_throughput;
+                guiding_vertex.m_probability = vertex.m_prev_prob;
+            }
+
+            // Return true if the radiance cache applies to a scattering vertex: a purely
+            // diffuse surface reached after a diffuse bounce, whose outgoing radiance does
+            // not depend on the outgoing direction.
+            bool is_cache_vertex(const PathVertex& vertex) const
+            {
+                return
+                    m_radiance_cache != nullptr &&
+                    vertex.m_path_length > 1 &&
+                    vertex.m_prev_mode == ScatteringMode::Diffuse &&
+                    vertex.m_bssrdf == nullptr &&
+                    vertex.m_bsdf != nullptr &&
+                    vertex.m_bsdf->is_purely_diffuse();
+            }
+
+            static Vector3f get_cache_normal(const PathVertex& vertex)
+            {
+                const Vector3d& n = vertex.get_shading_normal();
+                return Vector3f(dot(n, vertex.m_outgoing.get_value()) < 0.0 ? -n : n);
+            }
+
+            // Add the cached radiance leaving a vertex to the path radiance.
+            // Return false if the cache has no value for the vertex.
+            bool add_cached_radiance(const PathVertex& vertex)
+            {
+                Spectrum radiance;
+                if (!m_radiance_cache->lookup(Vector3f(vertex.get_point()), get_cache_normal(vertex), radiance))
+                    return false;
+
+                // Apply path throughput.
+                radiance *= vertex.m_throughput;
+
+                // Optionally clamp secondary rays contribution.
+                if (m_params.m_has_max_ray_intensity)
+                    clamp_contribution(radiance, m_params.m_max_ray_intensity);
+
+                // Update path radiance.
+                m_path_radiance.add_emission(
+                    vertex.m_path_length,
+                    vertex.m_aov_mode,
+                    radiance);
+
+                return true;
+            }
+
+            // Called before a cache vertex contributes to the path radiance.
+            void begin_cache_vertex(const PathVertex& vertex)
+            {
+                if (m_cache_vertex_count == MaxCacheVertices)
+                    return;
+
+                CacheVertex& cache_vertex = m_cache_vertices[m_cache_vertex_count++];
+                cache_vertex.m_point = Vector3f(vertex.get_point());
+                cache_vertex.m_normal = get_cache_normal(vertex);
+                cache_vertex.m_radiance = m_path_radiance.m_beauty;
+                cache_vertex.m_throughput = vertex.m_throughput;
             }
         };
 
@@ -425,7 +666,10 @@ namespace
                 const Scene&                    scene,
                 ShadingComponents&              path_radiance,
                 AOVComponents&                  aov_components,
-                LightPathStream*                light_path_stream)
+                LightPathStream*                light_path_stream,
+                SDTree*                         sd_tree,
+                RadianceCache*                  radiance_cache,
+                LightReservoir*                 light_reservoir)
               : PathVisitorBase(
                     params,
                     light_sampler,
@@ -434,7 +678,10 @@ namespace
                     scene,
                     path_radiance,
                     aov_components,
-                    light_path_stream)
+                    light_path_stream,
+                    sd_tree,
+                    radiance_cache,
+                    light_reservoir)
             {
             }
 
@@ -442,6 +689,8 @@ namespace
             {
                 assert(vertex.m_prev_mode != ScatteringMode::None);
 
+                end_guiding_vertex(vertex);
+
                 // Can't look up the environment if there's no environment EDF.
                 if (m_env_edf == nullptr)
                     return;
@@ -469,6 +718,8 @@ namespace
 
             void on_hit(const PathVertex& vertex)
             {
+                end_guiding_vertex(vertex);
+
                 // Emitted light contribution.
                 if ((!m_omit_emitted_light || m_params.m_enable_caustics) &&
                     vertex.m_edf &&
@@ -511,6 +762,8 @@ namespace
                         vertex.m_prev_mode == ScatteringMode::Volume)
                         vertex.m_scattering_modes &= ~(ScatteringMode::Glossy | ScatteringMode::Specular);
                 }
+
+                begin_guiding_vertex(vertex);
             }
         };
 
@@ -530,7 +783,10 @@ namespace
                 const Scene&                    scene,
                 ShadingComponents&              path_radiance,
                 AOVComponents&                  aov_components,
-                LightPathStream*                light_path_stream)
+                LightPathStream*                light_path_stream,
+                SDTree*                         sd_tree,
+                RadianceCache*                  radiance_cache,
+                LightReservoir*                 light_reservoir)
               : PathVisitorBase(
                     params,
                     light_sampler,
@@ -539,8 +795,12 @@ namespace
                     scene,
                     path_radiance,
                     aov_components,
-                    light_path_stream)
+                    light_path_stream,
+                    sd_tree,
+                    radiance_cache,
+                    light_reservoir)
               , m_is_indirect_lighting(false)
+              , m_light_cut_shading_point(nullptr)
             {
             }
 
@@ -548,6 +808,8 @@ namespace
             {
                 assert(vertex.m_prev_mode != ScatteringMode::None);
 
+                end_guiding_vertex(vertex);
+
                 // Can't look up the environment if there's no environment EDF.
                 if (m_env_edf == nullptr)
                     return;
@@ -598,6 +860,8 @@ namespace
 
             void on_hit(const PathVertex& vertex)
             {
+                end_guiding_vertex(vertex);
+
                 // Emitted light contribution.
                 if ((!m_omit_emitted_light || m_params.m_enable_caustics) &&
                     vertex.m_edf &&
@@ -638,6 +902,9 @@ namespace
             {
                 assert(vertex.m_scattering_modes != ScatteringMode::None);
 
+                // Forget the light tree cut of the previous vertex.
+                m_light_cut_shading_point = nullptr;
+
                 // Any light contribution after a diffuse or glossy bounce is considered indirect.
                 if (ScatteringMode::has_diffuse_or_glossy_or_volume(vertex.m_prev_mode))
                     m_is_indirect_lighting = true;
@@ -654,6 +921,18 @@ namespace
                 if (vertex.m_scattering_modes == ScatteringMode::None)
                     return;
 
+                // Either end the path with the cached radiance, or record the radiance leaving the vertex.
+                if (is_cache_vertex(vertex))
+                {
+                    if (!m_radiance_cache->is_built())
+                        begin_cache_vertex(vertex);
+                    else if (add_cached_radiance(vertex))
+                    {
+                        vertex.m_scattering_modes = ScatteringMode::None;
+                        return;
+                    }
+                }
+
                 DirectShadingComponents vertex_radiance;
 
                 if (vertex.m_bssrdf == nullptr)
@@ -687,6 +966,7 @@ namespace
                             *vertex.m_bsdf,
                             vertex.m_bsdf_data,
                             vertex.m_scattering_modes,
+                            vertex.m_path_length == 1 ? m_light_reservoir : nullptr,
                             vertex_radiance,
                             m_light_path_stream);
                     }
@@ -720,10 +1000,17 @@ namespace
                     vertex.m_path_length,
                     vertex.m_aov_mode,
                     vertex_radiance);
+
+                begin_guiding_vertex(vertex);
             }
 
           private:
-            bool m_is_indirect_lighting;
+            bool                m_is_indirect_lighting;
+
+            // Light tree cut selected for direct lighting at the last scattering vertex,
+            // reused to weight the emitted light found by extending the path from there.
+            LightTreeCut        m_light_cut;
+            const ShadingPoint* m_light_cut_shading_point;
 
             void add_emitted_light_contribution(
                 const PathVertex&           vertex,
@@ -737,10 +1024,15 @@ namespace
                 if (vertex.m_prev_mode != ScatteringMode::Specular)
                 {
                     const float light_sample_count = std::max(m_params.m_dl_light_sample_count, 1.0f);
+                    const float light_prob_area =
+                        m_light_cut_shading_point != nullptr &&
+                        m_light_cut_shading_point == vertex.m_parent_shading_point
+                            ? vertex.get_light_prob_area(m_light_sampler, m_light_cut)
+                            : vertex.get_light_prob_area(m_light_sampler);
                     const float mis_weight =
                         mis_power2(
                             1.0f * vertex.get_bsdf_prob_area(),
-                            light_sample_count * vertex.get_light_prob_area(m_light_sampler));
+                            light_sample_count * light_prob_area);
                     emitted_radiance *= mis_weight;
                 }
 
@@ -754,6 +1046,7 @@ namespace
                 const BSDF&                 bsdf,
                 const void*                 bsdf_data,
                 const int                   scattering_modes,
+                LightReservoir*             light_reservoir,
                 DirectShadingComponents&    vertex_radiance,
                 LightPathStream*            light_path_stream)
             {
@@ -767,11 +1060,13 @@ namespace
                 if (light_sample_count == 0)
                     return;
 
-                const BSDFSampler bsdf_sampler(
+                const GuidedBSDFSampler bsdf_sampler(
                     bsdf,
                     bsdf_data,
                     scattering_modes,       // bsdf_sampling_modes (unused)
-                    shading_point);
+                    shading_point,
+                    get_guiding_distribution(shading_point),
+                    m_params.m_guiding_bsdf_sampling_fraction);
 
                 // This path will be extended via BSDF sampling: sample the lights only.
                 const DirectLightingIntegrator integrator(
@@ -783,7 +1078,9 @@ namespace
                     1,                      // material_sample_count
                     light_sample_count,
                     m_params.m_dl_low_light_threshold,
-                    m_is_indirect_lighting);
+                    m_is_indirect_lighting,
+                    m_params.m_dl_resampling_candidate_count,
+                    light_reservoir);
                 integrator.compute_outgoing_radiance_light_sampling_low_variance(
                     m_sampling_context,
                     MISPower2,
@@ -791,6 +1088,10 @@ namespace
                     dl_radiance,
                     light_path_stream);
 
+                // Keep the light tree cut for the emitted light found by extending the path.
+                m_light_cut = integrator.get_light_cut();
+                m_light_cut_shading_point = &shading_point;
+
                 // Divide by the sample count when this number is less than 1.
                 if (m_params.m_rcp_dl_light_sample_count > 0.0f)
                     dl_radiance *= m_params.m_rcp_dl_light_sample_count;
@@ -815,11 +1116,13 @@ namespace
                         m_sampling_context,
                         m_params.m_ibl_env_sample_count);
 
-                const BSDFSampler bsdf_sampler(
+                const GuidedBSDFSampler bsdf_sampler(
                     bsdf,
                     bsdf_data,
                     scattering_modes,       // bsdf_sampling_modes (unused)
-                    shading_point);
+                    shading_point,
+                    get_guiding_distribution(shading_point),
+                    m_params.m_guiding_bsdf_sampling_fraction);
 
                 // This path will be extended via BSDF sampling: sample the environment only.
                 compute_ibl_environment_sampling(
@@ -1166,6 +1469,23 @@ Dictionary PTLightingEngineFactory::get_params_metadata()
             .insert("label", "Low Light Threshold")
             .insert("help", "Light contribution threshold to disable shadow rays"));
 
+    metadata.dictionaries().insert(
+        "dl_resampling_candidates",
+        Dictionary()
+            .insert("type", "int")
+            .insert("default", "0")
+            .insert("min", "0")
+            .insert("label", "Resampling Candidates")
+            .insert("help", "Number of unshadowed light samples each shadow-tested light sample is chosen from, 0 to disable resampling"));
+
+    metadata.dictionaries().insert(
+        "dl_resampling_reuse",
+        Dictionary()
+            .insert("type", "bool")
+            .insert("default", "false")
+            .insert("label", "Reuse Resampled Light Samples")
+            .insert("help", "Offer the light sample chosen for the previous pixel as a candidate for the next one, trading a small bias for lower noise"));
+
     metadata.dictionaries().insert(
         "ibl_env_samples",
         Dictionary()
@@ -1218,15 +1538,100 @@ Dictionary PTLightingEngineFactory::get_params_metadata()
             .insert("label", "Record Light Paths")
             .insert("help", "Record light paths in memory to later allow visualizing them or saving them to disk"));
 
+    metadata.dictionaries().insert(
+        "enable_path_guiding",
+        Dictionary()
+            .insert("type", "bool")
+            .insert("default", "false")
+            .insert("label", "Enable Path Guiding")
+            .insert("help", "Learn the distribution of incident light during rendering passes and use it to guide paths in subsequent passes"));
+
+    metadata.dictionaries().insert(
+        "guiding_bsdf_sampling_fraction",
+        Dictionary()
+            .insert("type", "float")
+            .insert("default", "0.5")
+            .insert("min", "0.01")
+            .insert("max", "1.0")
+            .insert("label", "Guiding BSDF Sampling Fraction")
+            .insert("help", "Probability of sampling the BSDF instead of the learned light distribution"));
+
+    metadata.dictionaries().insert(
+        "guiding_spatial_threshold",
+        Dictionary()
+            .insert("type", "int")
+            .insert("default", "4000")
+            .insert("min", "1")
+            .insert("label", "Guiding Spatial Threshold")
+            .insert("help", "Number of path vertices a region of space must receive during a pass before it is subdivided"));
+
+    metadata.dictionaries().insert(
+        "guiding_directional_threshold",
+        Dictionary()
+            .insert("type", "float")
+            .insert("default", "0.01")
+            .insert("min", "0.0001")
+            .insert("max", "1.0")
+            .insert("label", "Guiding Directional Threshold")
+            .insert("help", "Fraction of the light of a region above which a set of directions is subdivided"));
+
+    metadata.dictionaries().insert(
+        "enable_radiance_cache",
+        Dictionary()
+            .insert("type", "bool")
+            .insert("default", "false")
+            .insert("label", "Enable Radiance Cache")
+            .insert("help", "Learn the light leaving diffuse surfaces during the first rendering passes and reuse it at secondary diffuse hits in subsequent passes"));
+
+    metadata.dictionaries().insert(
+        "radiance_cache_passes",
+        Dictionary()
+            .insert("type", "int")
+            .insert("default", "1")
+            .insert("min", "1")
+            .insert("label", "Radiance Cache Passes")
+            .insert("help", "Number of rendering passes used to learn the radiance cache"));
+
+    metadata.dictionaries().insert(
+        "radiance_cache_resolution",
+        Dictionary()
+            .insert("type", "int")
+            .insert("default", "256")
+            .insert("min", "1")
+            .insert("max", "65536")
+            .insert("label", "Radiance Cache Resolution")
+            .insert("help", "Number of radiance cache cells along the largest dimension of the scene"));
+
+    metadata.dictionaries().insert(
+        "radiance_cache_min_records",
+        Dictionary()
+            .insert("type", "int")
+            .insert("default", "4")
+            .insert("min", "1")
+            .insert("label", "Radiance Cache Minimum Records")
+            .insert("help", "Number of radiance estimates a cell must receive to be kept in the radiance cache"));
+
+    metadata.dictionaries().insert(
+        "radiance_cache_file",
+        Dictionary()
+            .insert("type", "text")
+            .insert("default", "")
+            .insert("label", "Radiance Cache File")
+            .insert("help", "File from which the radiance cache is loaded, or to which it is saved once learned"));
+
     return metadata;
 }
 
 PTLightingEngineFactory::PTLightingEngineFactory(
     const BackwardLightSampler&     light_sampler,
     LightPathRecorder&              light_path_recorder,
+    SDTree*                         sd_tree,
+    RadianceCache*                  radiance_cache,
     const ParamArray&               params)
   : m_light_sampler(light_sampler)
   , m_light_path_recorder(light_path_recorder)
+  , m_sd_tree(sd_tree)
+  , m_radiance_cache(radiance_cache)
   , m_params(params)
 {
 }
@@ -1242,6 +1647,8 @@ ILightingEngine* PTLightingEngineFactory::create()
         new PTLightingEngine(
             m_light_sampler,
             m_light_path_recorder,
+            m_sd_tree,
+            m_radiance_cache,
             m_params);
 }
 
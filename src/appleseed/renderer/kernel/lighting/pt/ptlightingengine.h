@@ -40,6 +40,8 @@
 namespace foundation    { class Dictionary; }
 namespace renderer      { class BackwardLightSampler; }
 namespace renderer      { class LightPathRecorder; }
+namespace renderer      { class RadianceCache; }
+namespace renderer      { class SDTree; }
 
 namespace renderer
 {
@@ -55,10 +57,13 @@ class PTLightingEngineFactory
     // Return parameters metadata.
     static foundation::Dictionary get_params_metadata();
 
-    // Constructor.
+    // Constructor. Path guiding is enabled when an SD-tree is provided,
+    // radiance caching when a radiance cache is provided.
     PTLightingEngineFactory(
         const BackwardLightSampler&     light_sampler,
         LightPathRecorder&              light_path_recorder,
+        SDTree*                         sd_tree,
+        RadianceCache*                  radiance_cache,
         const ParamArray&               params);
 
     // Delete this instance.
@@ -70,6 +75,8 @@ class PTLightingEngineFactory
   private:
     const BackwardLightSampler&         m_light_sampler;
     LightPathRecorder&                  m_light_path_recorder;
+    SDTree*                             m_sd_tree;
+    RadianceCache*                      m_radiance_cache;
     ParamArray                          m_params;
 };
 
@@ -0,0 +1,134 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Interface header.
+#include "radiancecachepasscallback.h"
+
+// appleseed.renderer headers.
+#include "renderer/global/globallogger.h"
+#include "renderer/modeling/scene/scene.h"
+#include "renderer/utility/paramarray.h"
+
+// appleseed.foundation headers.
+#include "foundation/math/aabb.h"
+#include "foundation/utility/job/iabortswitch.h"
+#include "foundation/utility/string.h"
+
+// Boost headers.
+#include "boost/filesystem.hpp"
+#include "boost/system/error_code.hpp"
+
+// Standard headers.
+#include <algorithm>
+
+using namespace foundation;
+namespace bf = boost::filesystem;
+
+namespace renderer
+{
+
+//
+// RadianceCachePassCallback class implementation.
+//
+
+RadianceCachePassCallback::RadianceCachePassCallback(
+    const Scene&            scene,
+    const ParamArray&       params)
+  : m_learning_pass_count(std::max<size_t>(params.get_optional<size_t>("radiance_cache_passes", 1), 1))
+  , m_min_record_count(std::max<size_t>(params.get_optional<size_t>("radiance_cache_min_records", 4), 1))
+  , m_filepath(params.get_optional<std::string>("radiance_cache_file", ""))
+  , m_radiance_cache(
+        AABB3f(scene.compute_bbox()),
+        params.get_optional<size_t>("radiance_cache_resolution", 256))
+  , m_pass_count(0)
+{
+    if (m_filepath.empty())
+        return;
+
+    boost::system::error_code error;
+    if (!bf::exists(bf::path(m_filepath), error))
+        return;
+
+    if (m_radiance_cache.load(m_filepath))
+    {
+        RENDERER_LOG_INFO(
+            "loaded radiance cache from %s, %s %s.",
+            m_filepath.c_str(),
+            pretty_uint(m_radiance_cache.get_cell_count()).c_str(),
+            plural(m_radiance_cache.get_cell_count(), "cell").c_str());
+    }
+    else
+    {
+        RENDERER_LOG_WARNING(
+            "ignoring radiance cache file %s: file is incompatible with the scene or corrupted.",
+            m_filepath.c_str());
+    }
+}
+
+void RadianceCachePassCallback::release()
+{
+    delete this;
+}
+
+void RadianceCachePassCallback::on_pass_begin(
+    const Frame&            frame,
+    JobQueue&               job_queue,
+    IAbortSwitch&           abort_switch)
+{
+}
+
+void RadianceCachePassCallback::on_pass_end(
+    const Frame&            frame,
+    JobQueue&               job_queue,
+    IAbortSwitch&           abort_switch)
+{
+    // The cache stays fixed once built, and is never built from an incomplete pass.
+    if (m_radiance_cache.is_built() || abort_switch.is_aborted())
+        return;
+
+    if (++m_pass_count < m_learning_pass_count)
+        return;
+
+    m_radiance_cache.build(m_min_record_count);
+
+    RENDERER_LOG_INFO(
+        "built radiance cache from %s %s, %s %s.",
+        pretty_uint(m_radiance_cache.get_record_count()).c_str(),
+        plural(m_radiance_cache.get_record_count(), "estimate").c_str(),
+        pretty_uint(m_radiance_cache.get_cell_count()).c_str(),
+        plural(m_radiance_cache.get_cell_count(), "cell").c_str());
+
+    if (!m_filepath.empty() && !m_radiance_cache.save(m_filepath))
+    {
+        RENDERER_LOG_WARNING(
+            "failed to write radiance cache file %s.",
+            m_filepath.c_str());
+    }
+}
+
+}   // namespace renderer
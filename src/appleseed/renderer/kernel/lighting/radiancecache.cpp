@@ -0,0 +1,426 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Interface header.
+#include "radiancecache.h"
+
+// appleseed.foundation headers.
+#include "foundation/math/bvh/bvh_serializer.h"
+#include "foundation/math/scalar.h"
+#include "foundation/utility/bufferedfile.h"
+
+// Boost headers.
+#include "boost/filesystem.hpp"
+#include "boost/system/error_code.hpp"
+
+// Standard headers.
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <utility>
+
+using namespace foundation;
+namespace bf = boost::filesystem;
+
+namespace renderer
+{
+
+namespace
+{
+    const std::uint32_t MaxResolution = 1 << 16;
+    const std::uint32_t CoordinateBits = 20;
+    const std::uint32_t OrientationBits = 3;
+
+    std::uint32_t compute_orientation(const Vector3f& normal)
+    {
+        const size_t axis = max_abs_index(normal);
+        return static_cast<std::uint32_t>(2 * axis + (normal[axis] < 0.0f ? 1 : 0));
+    }
+
+    size_t compute_shard(const std::uint64_t key, const size_t shard_count)
+    {
+        // Fibonacci hashing spreads neighboring cells over different shards.
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) % shard_count;
+    }
+
+    //
+    // Radiance cache files start with a header identifying the grid and the
+    // spectrum representation. Files that don't match are ignored.
+    //
+
+    const std::uint32_t RadianceCacheMagic = 0x43524241;       // "ABRC"
+    const std::uint32_t RadianceCacheVersion = 1;
+
+    struct RadianceCacheHeader
+    {
+        std::uint32_t   m_magic;
+        std::uint32_t   m_version;
+        std::uint32_t   m_spectrum_size;
+        std::uint32_t   m_channel_count;
+        std::uint32_t   m_resolution[3];
+        float           m_origin[3];
+        float           m_cell_size;
+
+        RadianceCacheHeader(
+            const Vector3f&         origin,
+            const float             cell_size,
+            const std::uint32_t     resolution[3])
+          : m_magic(RadianceCacheMagic)
+          , m_version(RadianceCacheVersion)
+          , m_spectrum_size(static_cast<std::uint32_t>(sizeof(Spectrum)))
+          , m_channel_count(static_cast<std::uint32_t>(Spectrum::size()))
+          , m_cell_size(cell_size)
+        {
+            for (size_t i = 0; i < 3; ++i)
+            {
+                m_resolution[i] = resolution[i];
+                m_origin[i] = origin[i];
+            }
+        }
+
+        bool operator==(const RadianceCacheHeader& rhs) const
+        {
+            return std::memcmp(this, &rhs, sizeof(*this)) == 0;
+        }
+    };
+
+    const size_t RadianceCacheBufferSize = 1024 * 1024;
+}
+
+
+//
+// RadianceCache class implementation.
+//
+
+RadianceCache::RadianceCache(
+    const AABB3f&           bbox,
+    const size_t            resolution)
+  : m_record_count(0)
+  , m_is_built(false)
+{
+    const float max_extent = bbox.is_valid() ? max_value(bbox.extent()) : 0.0f;
+    const std::uint32_t max_resolution =
+        static_cast<std::uint32_t>(clamp<size_t>(resolution, 1, MaxResolution));
+
+    if (max_extent > 0.0f)
+    {
+        m_origin = bbox.min;
+        m_cell_size = max_extent / max_resolution;
+    }
+    else
+    {
+        m_origin = Vector3f(0.0f);
+        m_cell_size = 1.0f;
+    }
+
+    m_rcp_cell_size = 1.0f / m_cell_size;
+
+    for (size_t i = 0; i < 3; ++i)
+    {
+        const float extent = max_extent > 0.0f ? bbox.extent()[i] : 0.0f;
+        m_resolution[i] =
+            clamp<std::uint32_t>(
+                static_cast<std::uint32_t>(std::ceil(extent * m_rcp_cell_size)),
+                1,
+                max_resolution);
+    }
+}
+
+std::uint64_t RadianceCache::make_key(
+    const std::uint32_t     x,
+    const std::uint32_t     y,
+    const std::uint32_t     z,
+    const std::uint32_t     orientation) const
+{
+    assert(x < m_resolution[0]);
+    assert(y < m_resolution[1]);
+    assert(z < m_resolution[2]);
+    assert(orientation < 6);
+
+    std::uint64_t key = z;
+    key = (key << CoordinateBits) | y;
+    key = (key << CoordinateBits) | x;
+    key = (key << OrientationBits) | orientation;
+
+    return key;
+}
+
+void RadianceCache::record(
+    const Vector3f&         point,
+    const Vector3f&         normal,
+    const Spectrum&         radiance)
+{
+    assert(!m_is_built);
+
+    if (!is_finite_non_neg(radiance))
+        return;
+
+    std::uint32_t coords[3];
+    for (size_t i = 0; i < 3; ++i)
+    {
+        const float x = (point[i] - m_origin[i]) * m_rcp_cell_size;
+        coords[i] = static_cast<std::uint32_t>(clamp(x, 0.0f, static_cast<float>(m_resolution[i] - 1)));
+    }
+
+    const std::uint64_t key = make_key(coords[0], coords[1], coords[2], compute_orientation(normal));
+    Shard& shard = m_shards[compute_shard(key, ShardCount)];
+
+    boost::mutex::scoped_lock lock(shard.m_mutex);
+
+    const AccumulatorMap::iterator i = shard.m_accumulators.find(key);
+
+    if (i == shard.m_accumulators.end())
+    {
+        Accumulator accumulator;
+        accumulator.m_sum = radiance;
+        accumulator.m_count = 1;
+        shard.m_accumulators.insert(std::make_pair(key, accumulator));
+    }
+    else
+    {
+        i->second.m_sum += radiance;
+        ++i->second.m_count;
+    }
+}
+
+void RadianceCache::build(const size_t min_record_count)
+{
+    assert(!m_is_built);
+
+    std::vector<std::pair<std::uint64_t, const Accumulator*>> cells;
+
+    for (size_t s = 0; s < ShardCount; ++s)
+    {
+        for (const auto& entry : m_shards[s].m_accumulators)
+        {
+            if (entry.second.m_count >= std::max<size_t>(min_record_count, 1))
+                cells.emplace_back(entry.first, &entry.second);
+        }
+    }
+
+    std::sort(
+        cells.begin(),
+        cells.end(),
+        [](const std::pair<std::uint64_t, const Accumulator*>& lhs,
+           const std::pair<std::uint64_t, const Accumulator*>& rhs)
+        {
+            return lhs.first < rhs.first;
+        });
+
+    m_keys.resize(cells.size());
+    m_values.resize(cells.size());
+    m_record_count = 0;
+
+    for (size_t i = 0, e = cells.size(); i < e; ++i)
+    {
+        const Accumulator& accumulator = *cells[i].second;
+        m_keys[i] = cells[i].first;
+        m_values[i] = accumulator.m_sum / static_cast<float>(accumulator.m_count);
+        m_record_count += accumulator.m_count;
+    }
+
+    for (size_t s = 0; s < ShardCount; ++s)
+        AccumulatorMap().swap(m_shards[s].m_accumulators);
+
+    m_is_built = true;
+}
+
+const Spectrum* RadianceCache::find(const std::uint64_t key) const
+{
+    const std::vector<std::uint64_t>::const_iterator i =
+        std::lower_bound(m_keys.begin(), m_keys.end(), key);
+
+    return
+        i != m_keys.end() && *i == key
+            ? &m_values[i - m_keys.begin()]
+            : nullptr;
+}
+
+bool RadianceCache::lookup(
+    const Vector3f&         point,
+    const Vector3f&         normal,
+    Spectrum&               radiance) const
+{
+    assert(m_is_built);
+
+    // Find the eight cells whose centers surround the point.
+    int base[3];
+    float frac[3];
+    for (size_t i = 0; i < 3; ++i)
+    {
+        const float x =
+            clamp(
+                (point[i] - m_origin[i]) * m_rcp_cell_size - 0.5f,
+                -1.0f,
+                static_cast<float>(m_resolution[i]));
+        const float fx = std::floor(x);
+        base[i] = static_cast<int>(fx);
+        frac[i] = x - fx;
+    }
+
+    const std::uint32_t orientation = compute_orientation(normal);
+
+    // Blend the values of the cells that exist, renormalizing the weights of the others away.
+    radiance.set(0.0f);
+    float weight_sum = 0.0f;
+
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        std::uint32_t coords[3];
+        float weight = 1.0f;
+        bool inside = true;
+
+        for (size_t i = 0; i < 3; ++i)
+        {
+            const int offset = (corner >> i) & 1;
+            const int c = base[i] + offset;
+            if (c < 0 || c >= static_cast<int>(m_resolution[i]))
+            {
+                inside = false;
+                break;
+            }
+            coords[i] = static_cast<std::uint32_t>(c);
+            weight *= offset ? frac[i] : 1.0f - frac[i];
+        }
+
+        if (!inside || weight == 0.0f)
+            continue;
+
+        const Spectrum* value = find(make_key(coords[0], coords[1], coords[2], orientation));
+        if (value == nullptr)
+            continue;
+
+        radiance += *value * weight;
+        weight_sum += weight;
+    }
+
+    if (weight_sum == 0.0f)
+        return false;
+
+    radiance /= weight_sum;
+    return true;
+}
+
+bool RadianceCache::load(const std::string& filepath)
+{
+    BufferedFile file;
+    if (!file.open(filepath.c_str(), BufferedFile::BinaryType, BufferedFile::ReadMode, RadianceCacheBufferSize))
+        return false;
+
+    PassthroughReaderAdapter reader(file);
+
+    const RadianceCacheHeader expected_header(m_origin, m_cell_size, m_resolution);
+    RadianceCacheHeader header(expected_header);
+    if (reader.read(header) != sizeof(header) || !(header == expected_header))
+        return false;
+
+    std::vector<std::uint64_t> keys;
+    std::vector<Spectrum> values;
+    std::uint64_t record_count;
+    bool success = false;
+
+    try
+    {
+        success =
+            reader.read(record_count) == sizeof(record_count) &&
+            bvh::read_plain_vector(reader, keys) &&
+            bvh::read_plain_vector(reader, values) &&
+            keys.size() == values.size() &&
+            std::is_sorted(keys.begin(), keys.end());
+    }
+    catch (const std::exception&)
+    {
+        // Corrupted vector sizes may cause allocations to fail.
+        success = false;
+    }
+
+    if (!success)
+        return false;
+
+    m_keys.swap(keys);
+    m_values.swap(values);
+    m_record_count = record_count;
+    m_is_built = true;
+
+    for (size_t s = 0; s < ShardCount; ++s)
+        AccumulatorMap().swap(m_shards[s].m_accumulators);
+
+    return true;
+}
+
+bool RadianceCache::save(const std::string& filepath) const
+{
+    assert(m_is_built);
+
+    // Write to a temporary file first so that concurrent renders never see a partial file.
+    const bf::path path(filepath);
+    if (path.has_parent_path())
+    {
+        // Failures are reported when opening the file.
+        boost::system::error_code ignored;
+        bf::create_directories(path.parent_path(), ignored);
+    }
+
+    boost::system::error_code error;
+    const bf::path temp_path = bf::unique_path(path.string() + ".%%%%%%%%.tmp", error);
+    if (error)
+        return false;
+
+    bool success = false;
+
+    BufferedFile file;
+    if (file.open(temp_path.string().c_str(), BufferedFile::BinaryType, BufferedFile::WriteMode, RadianceCacheBufferSize))
+    {
+        PassthroughWriterAdapter writer(file);
+
+        const RadianceCacheHeader header(m_origin, m_cell_size, m_resolution);
+
+        success =
+            writer.write(header) == sizeof(header) &&
+            writer.write(m_record_count) == sizeof(m_record_count) &&
+            bvh::write_plain_vector(writer, m_keys) &&
+            bvh::write_plain_vector(writer, m_values);
+
+        success = file.close() && success;
+    }
+
+    if (success)
+    {
+        bf::rename(temp_path, path, error);
+        success = !error;
+    }
+
+    if (!success)
+        bf::remove(temp_path, error);
+
+    return success;
+}
+
+}   // namespace renderer
@@ -0,0 +1,175 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+// appleseed.renderer headers.
+#include "renderer/global/globaltypes.h"
+
+// appleseed.foundation headers.
+#include "foundation/core/concepts/noncopyable.h"
+#include "foundation/math/aabb.h"
+#include "foundation/math/vector.h"
+#include "foundation/platform/thread.h"
+
+// Standard headers.
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace renderer
+{
+
+//
+// World-space cache of the radiance leaving diffuse surfaces.
+//
+// The scene bounding box is divided into a sparse grid of cubic cells. Each
+// cell is further split into six orientation bins (the dominant axis of the
+// surface normal, and its sign) so that both sides of thin walls, and the
+// faces meeting at a corner, do not share values.
+//
+// The cache has two phases. While learning, record() accumulates radiance
+// estimates from any number of threads; the accumulators are sharded and each
+// shard is protected by its own mutex, so that contention stays low. build()
+// then averages the estimates into a compact, read-only table which lookup()
+// interpolates trilinearly between neighboring cells of the same orientation.
+//
+// Since the cached radiance depends neither on the camera nor on the image,
+// a built cache can be saved to disk and reused by later renders of the same
+// scene, for instance by all the frames of a flythrough.
+//
+// Reference:
+//
+//   A Ray Tracing Solution for Diffuse Interreflection
+//   Gregory J. Ward, Francis M. Rubinstein, Robert D. Clear
+//   https://www.radiance-online.org/papers/sg88/paper.html
+//
+
+class RadianceCache
+  : public foundation::NonCopyable
+{
+  public:
+    // Constructor. The cells are cubes, with `resolution` cells along the longest side of `bbox`.
+    RadianceCache(
+        const foundation::AABB3f&       bbox,
+        const size_t                    resolution);
+
+    // Return true once the cache has been built (or loaded) and can be looked up.
+    bool is_built() const;
+
+    // Return the number of cells holding a cached value.
+    size_t get_cell_count() const;
+
+    // Return the number of radiance estimates the cached values were averaged from.
+    std::uint64_t get_record_count() const;
+
+    // Record an estimate of the radiance leaving a diffuse surface at a given point.
+    // `normal` must point toward the side the radiance leaves from. Thread-safe.
+    void record(
+        const foundation::Vector3f&     point,
+        const foundation::Vector3f&     normal,
+        const Spectrum&                 radiance);
+
+    // Average the recorded estimates into the cached values. Cells that received fewer
+    // than `min_record_count` estimates are dropped. Recorded estimates are released.
+    void build(const size_t min_record_count);
+
+    // Look up the radiance leaving a diffuse surface at a given point. Return false if
+    // no cell with the same orientation surrounds the point. Only call once built.
+    bool lookup(
+        const foundation::Vector3f&     point,
+        const foundation::Vector3f&     normal,
+        Spectrum&                       radiance) const;
+
+    // Load a cache written by save(). Return true on success, in which case the cache
+    // is built. Return false if the file is missing, invalid, or was written for a
+    // different grid or a different spectrum representation.
+    bool load(const std::string& filepath);
+
+    // Save a built cache. Return true on success.
+    bool save(const std::string& filepath) const;
+
+  private:
+    struct Accumulator
+    {
+        Spectrum                        m_sum;
+        std::uint32_t                   m_count;
+    };
+
+    typedef std::unordered_map<std::uint64_t, Accumulator> AccumulatorMap;
+
+    struct Shard
+    {
+        boost::mutex                    m_mutex;
+        AccumulatorMap                  m_accumulators;
+    };
+
+    static const size_t ShardCount = 64;
+
+    foundation::Vector3f                m_origin;
+    float                               m_cell_size;
+    float                               m_rcp_cell_size;
+    std::uint32_t                       m_resolution[3];
+    Shard                               m_shards[ShardCount];
+    std::uint64_t                       m_record_count;
+    bool                                m_is_built;
+    std::vector<std::uint64_t>          m_keys;             // sorted cell keys
+    std::vector<Spectrum>               m_values;           // cached radiance of each cell in m_keys
+
+    std::uint64_t make_key(
+        const std::uint32_t             x,
+        const std::uint32_t             y,
+        const std::uint32_t             z,
+        const std::uint32_t             orientation) const;
+
+    const Spectrum* find(const std::uint64_t key) const;
+};
+
+
+//
+// RadianceCache class implementation.
+//
+
+inline bool RadianceCache::is_built() const
+{
+    return m_is_built;
+}
+
+inline size_t RadianceCache::get_cell_count() const
+{
+    return m_keys.size();
+}
+
+inline std::uint64_t RadianceCache::get_record_count() const
+{
+    return m_record_count;
+}
+
+}   // namespace renderer
@@ -0,0 +1,427 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Interface header.
+#include "sdtree.h"
+
+// appleseed.foundation headers.
+#include "foundation/math/scalar.h"
+#include "foundation/platform/atomic.h"
+
+// Standard headers.
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+using namespace foundation;
+
+namespace renderer
+{
+
+namespace
+{
+    // Largest float smaller than 1.
+    const float OneMinusEpsilon = 1.0f - std::numeric_limits<float>::epsilon() * 0.5f;
+
+    size_t compute_quadrant(Vector2f& p)
+    {
+        // Find the quadrant containing p and remap p to the quadrant.
+        size_t quadrant = 0;
+
+        for (size_t i = 0; i < 2; ++i)
+        {
+            if (p[i] < 0.5f)
+                p[i] *= 2.0f;
+            else
+            {
+                p[i] = (p[i] - 0.5f) * 2.0f;
+                quadrant |= size_t(1) << i;
+            }
+        }
+
+        return quadrant;
+    }
+
+    float sum_of(const float sums[4])
+    {
+        return sums[0] + sums[1] + sums[2] + sums[3];
+    }
+}
+
+Vector2f direction_to_canonical(const Vector3f& direction)
+{
+    const float cos_theta = clamp(direction.z, -1.0f, 1.0f);
+
+    float phi = std::atan2(direction.y, direction.x);
+    if (phi < 0.0f)
+        phi += TwoPi<float>();
+
+    return
+        Vector2f(
+            std::min((cos_theta + 1.0f) * 0.5f, OneMinusEpsilon),
+            std::min(phi * RcpTwoPi<float>(), OneMinusEpsilon));
+}
+
+Vector3f canonical_to_direction(const Vector2f& p)
+{
+    const float cos_theta = 2.0f * p.x - 1.0f;
+    const float sin_theta = std::sqrt(std::max(1.0f - cos_theta * cos_theta, 0.0f));
+    const float phi = TwoPi<float>() * p.y;
+
+    return
+        Vector3f(
+            sin_theta * std::cos(phi),
+            sin_theta * std::sin(phi),
+            cos_theta);
+}
+
+
+//
+// DTree class implementation.
+//
+
+DTree::DTree()
+  : m_nodes(1, Node())
+{
+}
+
+float DTree::get_total() const
+{
+    return sum_of(m_nodes[0].m_sums);
+}
+
+void DTree::record(
+    const Vector3f&     direction,
+    const float         radiance)
+{
+    Vector2f p = direction_to_canonical(direction);
+    size_t node_index = 0;
+
+    while (true)
+    {
+        Node& node = m_nodes[node_index];
+        const size_t quadrant = compute_quadrant(p);
+
+        atomic_add(&node.m_sums[quadrant], radiance);
+
+        if (node.m_children[quadrant] == 0)
+            break;
+
+        node_index = node.m_children[quadrant];
+    }
+}
+
+Vector3f DTree::sample(
+    const Vector2f&     s,
+    float&              pdf) const
+{
+    Vector2f u(std::min(s[0], OneMinusEpsilon), std::min(s[1], OneMinusEpsilon));
+    Vector2f origin(0.0f);
+    float size = 1.0f;
+    size_t node_index = 0;
+
+    pdf = 1.0f;
+
+    while (true)
+    {
+        const Node& node = m_nodes[node_index];
+        const float total = sum_of(node.m_sums);
+        assert(total > 0.0f);
+
+        // Choose the column (quadrants 0 and 2 or quadrants 1 and 3).
+        const float left = node.m_sums[0] + node.m_sums[2];
+        const float prob_left = left / total;
+        size_t quadrant;
+        if (u[0] < prob_left)
+        {
+            quadrant = 0;
+            u[0] /= prob_left;
+        }
+        else
+        {
+            quadrant = 1;
+            u[0] = (u[0] - prob_left) / (1.0f - prob_left);
+        }
+
+        // Choose the row within the column.
+        const float column = node.m_sums[quadrant] + node.m_sums[quadrant + 2];
+        const float prob_bottom = node.m_sums[quadrant] / column;
+        if (u[1] < prob_bottom)
+            u[1] /= prob_bottom;
+        else
+        {
+            quadrant += 2;
+            u[1] = (u[1] - prob_bottom) / (1.0f - prob_bottom);
+        }
+
+        u[0] = std::min(u[0], OneMinusEpsilon);
+        u[1] = std::min(u[1], OneMinusEpsilon);
+
+        // Each quadrant covers a fourth of the area of its parent.
+        pdf *= 4.0f * node.m_sums[quadrant] / total;
+
+        size *= 0.5f;
+        origin[0] += (quadrant & 1) ? size : 0.0f;
+        origin[1] += (quadrant & 2) ? size : 0.0f;
+
+        if (node.m_children[quadrant] == 0)
+            break;
+
+        node_index = node.m_children[quadrant];
+    }
+
+    // The mapping from the unit square to the sphere has a constant Jacobian.
+    pdf *= RcpFourPi<float>();
+
+    return canonical_to_direction(origin + size * u);
+}
+
+float DTree::evaluate(const Vector3f& direction) const
+{
+    Vector2f p = direction_to_canonical(direction);
+    size_t node_index = 0;
+    float pdf = 1.0f;
+
+    while (true)
+    {
+        const Node& node = m_nodes[node_index];
+        const float total = sum_of(node.m_sums);
+        if (total <= 0.0f)
+            return 0.0f;
+
+        const size_t quadrant = compute_quadrant(p);
+        pdf *= 4.0f * node.m_sums[quadrant] / total;
+
+        if (node.m_children[quadrant] == 0)
+            break;
+
+        node_index = node.m_children[quadrant];
+    }
+
+    return pdf * RcpFourPi<float>();
+}
+
+void DTree::refine(
+    const DTree&        source,
+    const float         subdivision_threshold,
+    const size_t        max_depth)
+{
+    struct Entry
+    {
+        std::uint32_t   m_node_index;
+        std::uint32_t   m_source_index;     // ~0 if the source tree does not extend this deep
+        float           m_uniform_sum;      // radiance of each quadrant when there is no source node
+        size_t          m_depth;
+    };
+
+    m_nodes.assign(1, Node());
+
+    const float total = source.get_total();
+    if (total <= 0.0f)
+        return;
+
+    std::vector<Entry> stack;
+    Entry root = { 0, 0, 0.0f, 1 };
+    stack.push_back(root);
+
+    while (!stack.empty())
+    {
+        const Entry entry = stack.back();
+        stack.pop_back();
+
+        for (std::uint32_t i = 0; i < 4; ++i)
+        {
+            const Node* source_node =
+                entry.m_source_index != ~std::uint32_t(0)
+                    ? &source.m_nodes[entry.m_source_index]
+                    : nullptr;
+            const float sum = source_node ? source_node->m_sums[i] : entry.m_uniform_sum;
+
+            if (entry.m_depth >= max_depth || sum <= subdivision_threshold * total)
+                continue;
+
+            const std::uint32_t child_index = static_cast<std::uint32_t>(m_nodes.size());
+            m_nodes.push_back(Node());
+            m_nodes[entry.m_node_index].m_children[i] = child_index;
+
+            Entry child_entry;
+            child_entry.m_node_index = child_index;
+            child_entry.m_source_index =
+                source_node && source_node->m_children[i] != 0
+                    ? source_node->m_children[i]
+                    : ~std::uint32_t(0);
+            child_entry.m_uniform_sum = sum * 0.25f;
+            child_entry.m_depth = entry.m_depth + 1;
+            stack.push_back(child_entry);
+        }
+    }
+}
+
+
+//
+// SDTree class implementation.
+//
+
+SDTree::SDTree()
+  : m_iteration(0)
+{
+}
+
+void SDTree::reset(const AABB3f& bbox)
+{
+    // Use a cube so that the spatial subdivision produces well-shaped cells.
+    const Vector3f center = bbox.center();
+    const float half_size = 0.5f * max_value(bbox.extent()) * 1.001f + 1.0e-4f;
+    m_bbox = AABB3f(center - Vector3f(half_size), center + Vector3f(half_size));
+
+    Node root;
+    root.m_first_child = 0;
+    root.m_leaf_index = 0;
+    m_nodes.assign(1, root);
+
+    Leaf leaf;
+    leaf.m_sample_count = 0;
+    m_leaves.assign(1, leaf);
+
+    m_iteration = 0;
+}
+
+const DTree* SDTree::get_sampling_distribution(const Vector3f& point) const
+{
+    if (m_iteration == 0)
+        return nullptr;
+
+    const DTree& d_tree = m_leaves[find_leaf(point)].m_sampling;
+
+    return d_tree.get_total() > 0.0f ? &d_tree : nullptr;
+}
+
+void SDTree::record(
+    const Vector3f&     point,
+    const Vector3f&     direction,
+    const float         radiance)
+{
+    if (m_leaves.empty())
+        return;
+
+    Leaf& leaf = m_leaves[find_leaf(point)];
+
+    atomic_inc(&leaf.m_sample_count);
+
+    if (radiance > 0.0f && std::isfinite(radiance))
+        leaf.m_building.record(direction, radiance);
+}
+
+void SDTree::end_iteration(
+    const size_t        spatial_threshold,
+    const float         directional_threshold,
+    const size_t        max_directional_depth)
+{
+    if (m_leaves.empty())
+        return;
+
+    // The radiance recorded during this iteration becomes the sampling distribution.
+    for (size_t i = 0, e = m_leaves.size(); i < e; ++i)
+        m_leaves[i].m_sampling = m_leaves[i].m_building;
+
+    // Split spatial leaves that received too many samples. Children inherit
+    // half of the samples of their parent and may be split again.
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        if (m_nodes[i].m_first_child != 0)
+            continue;
+
+        const size_t leaf_index = m_nodes[i].m_leaf_index;
+        if (m_leaves[leaf_index].m_sample_count <= spatial_threshold)
+            continue;
+
+        Leaf child_leaf = m_leaves[leaf_index];
+        child_leaf.m_sample_count /= 2;
+
+        const std::uint32_t first_child = static_cast<std::uint32_t>(m_nodes.size());
+        const std::uint32_t second_leaf_index = static_cast<std::uint32_t>(m_leaves.size());
+
+        m_leaves[leaf_index] = child_leaf;
+        m_leaves.push_back(child_leaf);
+
+        Node child;
+        child.m_first_child = 0;
+        child.m_leaf_index = static_cast<std::uint32_t>(leaf_index);
+        m_nodes.push_back(child);
+        child.m_leaf_index = second_leaf_index;
+        m_nodes.push_back(child);
+
+        m_nodes[i].m_first_child = first_child;
+    }
+
+    // Prepare the trees that will record radiance during the next iteration.
+    for (size_t i = 0, e = m_leaves.size(); i < e; ++i)
+    {
+        Leaf& leaf = m_leaves[i];
+        leaf.m_building.refine(leaf.m_sampling, directional_threshold, max_directional_depth);
+        leaf.m_sample_count = 0;
+    }
+
+    ++m_iteration;
+}
+
+size_t SDTree::find_leaf(const Vector3f& point) const
+{
+    assert(!m_nodes.empty());
+
+    // Compute the coordinates of the point relative to the bounding box.
+    const Vector3f extent = m_bbox.extent();
+    Vector3f p;
+    for (size_t i = 0; i < 3; ++i)
+        p[i] = clamp((point[i] - m_bbox.min[i]) / extent[i], 0.0f, OneMinusEpsilon);
+
+    // Descend the tree, splitting along x, y and z in turn.
+    size_t node_index = 0;
+    size_t axis = 0;
+
+    while (m_nodes[node_index].m_first_child != 0)
+    {
+        if (p[axis] < 0.5f)
+        {
+            p[axis] *= 2.0f;
+            node_index = m_nodes[node_index].m_first_child;
+        }
+        else
+        {
+            p[axis] = (p[axis] - 0.5f) * 2.0f;
+            node_index = m_nodes[node_index].m_first_child + 1;
+        }
+
+        axis = axis == 2 ? 0 : axis + 1;
+    }
+
+    return m_nodes[node_index].m_leaf_index;
+}
+
+}   // namespace renderer
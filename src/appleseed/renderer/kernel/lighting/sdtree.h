@@ -0,0 +1,193 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+// appleseed.foundation headers.
+#include "foundation/math/aabb.h"
+#include "foundation/math/vector.h"
+
+// Standard headers.
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace renderer
+{
+
+//
+// Spatial-directional tree (SD-tree) for path guiding.
+//
+// A binary tree subdivides the scene bounding box; each of its leaves stores
+// a quadtree over the sphere of directions (the D-tree) approximating the
+// incident radiance in that region of space. Directions are mapped to the
+// unit square using the equal-area cylindrical mapping.
+//
+// Each spatial leaf holds two D-trees: a read-only one used for sampling and
+// one into which radiance estimates are splatted. During a rendering pass
+// the structure of both trees is fixed; sampling only reads and recording
+// only performs atomic additions, so both are lock-free and can be used from
+// any number of threads. Between passes, end_iteration() turns the recorded
+// radiance into the new sampling distributions and refines the trees.
+//
+// Reference:
+//
+//   Practical Path Guiding for Efficient Light-Transport Simulation
+//   Thomas Muller, Markus Gross, Jan Novak
+//   https://tom94.net/data/publications/mueller17practical/mueller17practical.pdf
+//
+
+class DTree
+{
+  public:
+    // Constructor. The tree initially has a single node.
+    DTree();
+
+    // Return the sum of the radiance estimates recorded into the tree.
+    float get_total() const;
+
+    // Return the number of nodes in the tree.
+    size_t get_node_count() const;
+
+    // Record a radiance estimate in a given direction. Thread-safe.
+    void record(
+        const foundation::Vector3f& direction,
+        const float                 radiance);
+
+    // Sample a direction proportionally to the recorded radiance.
+    // Return the direction and its probability density with respect to solid angle.
+    foundation::Vector3f sample(
+        const foundation::Vector2f& s,
+        float&                      pdf) const;
+
+    // Return the probability density with respect to solid angle of a given direction.
+    float evaluate(const foundation::Vector3f& direction) const;
+
+    // Rebuild the structure of this tree from the radiance recorded in another tree:
+    // quadrants holding more than a given fraction of the total radiance are subdivided.
+    // All radiance estimates of this tree are cleared.
+    void refine(
+        const DTree&                source,
+        const float                 subdivision_threshold,
+        const size_t                max_depth);
+
+  private:
+    struct Node
+    {
+        float           m_sums[4];          // radiance recorded in each quadrant
+        std::uint32_t   m_children[4];      // index of the child node of each quadrant, 0 for leaves
+    };
+
+    std::vector<Node>   m_nodes;
+};
+
+// Map a direction to the unit square and back.
+foundation::Vector2f direction_to_canonical(const foundation::Vector3f& direction);
+foundation::Vector3f canonical_to_direction(const foundation::Vector2f& p);
+
+class SDTree
+{
+  public:
+    // Constructor. The tree is empty until reset() is called.
+    SDTree();
+
+    // Reset the tree to a single spatial leaf covering a given bounding box.
+    void reset(const foundation::AABB3f& bbox);
+
+    // Return the number of completed training iterations.
+    size_t get_iteration() const;
+
+    // Return the number of spatial leaves.
+    size_t get_leaf_count() const;
+
+    // Return the distribution to sample at a given point, or nullptr if nothing
+    // has been learned there yet.
+    const DTree* get_sampling_distribution(const foundation::Vector3f& point) const;
+
+    // Record a radiance estimate at a given point and in a given direction. Thread-safe.
+    void record(
+        const foundation::Vector3f& point,
+        const foundation::Vector3f& direction,
+        const float                 radiance);
+
+    // Make the radiance recorded during the last iteration the new sampling
+    // distribution, then refine the tree for the next iteration.
+    // Must not be called concurrently with any other method.
+    void end_iteration(
+        const size_t                spatial_threshold,      // number of samples above which a spatial leaf is split
+        const float                 directional_threshold,  // fraction of the radiance above which a quadrant is split
+        const size_t                max_directional_depth);
+
+  private:
+    struct Node
+    {
+        std::uint32_t   m_first_child;      // index of the first of two child nodes, 0 for leaves
+        std::uint32_t   m_leaf_index;       // index of the leaf, for leaf nodes
+    };
+
+    struct Leaf
+    {
+        DTree           m_sampling;
+        DTree           m_building;
+        std::uint32_t   m_sample_count;
+    };
+
+    foundation::AABB3f  m_bbox;
+    std::vector<Node>   m_nodes;
+    std::vector<Leaf>   m_leaves;
+    size_t              m_iteration;
+
+    size_t find_leaf(const foundation::Vector3f& point) const;
+};
+
+
+//
+// DTree class implementation.
+//
+
+inline size_t DTree::get_node_count() const
+{
+    return m_nodes.size();
+}
+
+
+//
+// SDTree class implementation.
+//
+
+inline size_t SDTree::get_iteration() const
+{
+    return m_iteration;
+}
+
+inline size_t SDTree::get_leaf_count() const
+{
+    return m_leaves.size();
+}
+
+}   // namespace renderer
@@ -37,7 +37,9 @@
 #include "renderer/kernel/lighting/pathvertex.h"
 #include "renderer/kernel/lighting/scatteringmode.h"
 #include "renderer/kernel/lighting/sppm/sppmpasscallback.h"
+#include "renderer/kernel/lighting/sppm/sppmparameters.h"
 #include "renderer/kernel/lighting/sppm/sppmphoton.h"
+#include "renderer/kernel/lighting/sppm/sppmphotongrid.h"
 #include "renderer/kernel/lighting/sppm/sppmphotonmap.h"
 #include "renderer/kernel/shading/shadingcomponents.h"
 #include "renderer/kernel/shading/shadingcontext.h"
@@ -51,12 +53,15 @@
 #include "renderer/utility/stochasticcast.h"
 
 // appleseed.foundation headers.
+#include "foundation/core/concepts/noncopyable.h"
 #include "foundation/math/knn.h"
 #include "foundation/math/population.h"
 #include "foundation/math/scalar.h"
 #include "foundation/math/vector.h"
+#include "foundation/platform/defaulttimers.h"
 #include "foundation/utility/containers/dictionary.h"
 #include "foundation/utility/statistics.h"
+#include "foundation/utility/stopwatch.h"
 
 // Standard headers.
 #include <cassert>
@@ -98,6 +103,94 @@ namespace
     }
 
 
+    //
+    // Photon lookups in the photon map of the current pass, whichever its structure.
+    //
+
+    class PhotonGatherer
+      : public NonCopyable
+    {
+      public:
+        PhotonGatherer(
+            const SPPMParameters&       params,
+            const SPPMPassCallback&     pass_callback)
+          : m_use_grid(params.m_photon_map_type == SPPMParameters::HashedGrid)
+          , m_pass_callback(pass_callback)
+          , m_answer(params.m_max_photons_per_estimate)
+          , m_gather_count(0)
+          , m_gather_time(0.0)
+        {
+        }
+
+        bool empty_photon_map() const
+        {
+            return
+                m_use_grid
+                    ? m_pass_callback.get_photon_grid().empty()
+                    : m_pass_callback.get_photon_map().empty();
+        }
+
+        // Find the photons within a given distance of a point, or the nearest of them
+        // if there are more than the maximum number of photons per estimate.
+        void gather(
+            const Vector3f&             point,
+            const float                 max_square_dist)
+        {
+            m_stopwatch.start();
+
+            if (m_use_grid)
+                m_pass_callback.get_photon_grid().query(point, max_square_dist, m_answer);
+            else
+            {
+                const knn::Query3f query(m_pass_callback.get_photon_map(), m_answer);
+                query.run(point, max_square_dist);
+            }
+
+            m_stopwatch.measure();
+
+            ++m_gather_count;
+            m_gather_time += m_stopwatch.get_seconds();
+        }
+
+        // Return the number of photons found by the last lookup.
+        size_t size() const
+        {
+            return m_answer.size();
+        }
+
+        // Return the square distance to the i'th photon found by the last lookup.
+        float get_square_dist(const size_t i) const
+        {
+            return m_answer.get(i).m_square_dist;
+        }
+
+        // Return the index in the pass photon vector of the i'th photon found by the last lookup.
+        size_t get_photon_index(const size_t i) const
+        {
+            const size_t index = m_answer.get(i).m_index;
+
+            return
+                m_use_grid
+                    ? m_pass_callback.get_photon_grid().remap(index)
+                    : m_pass_callback.get_photon_map().remap(index);
+        }
+
+        void insert_statistics(Statistics& stats) const
+        {
+            stats.insert("photon lookups", m_gather_count);
+            stats.insert_time("photon lookup time", m_gather_time);
+        }
+
+      private:
+        const bool                          m_use_grid;
+        const SPPMPassCallback&             m_pass_callback;
+        knn::Answer<float>                  m_answer;
+        Stopwatch<DefaultProcessorTimer>    m_stopwatch;
+        std::uint64_t                       m_gather_count;
+        double                              m_gather_time;
+    };
+
+
     //
     // Stochastic Progressive Photon Mapping (SPPM) lighting engine.
     //
@@ -134,7 +227,7 @@ namespace
           , m_forward_light_sampler(forward_light_sampler)
           , m_backward_light_sampler(backward_light_sampler)
           , m_path_count(0)
-          , m_answer(m_params.m_max_photons_per_estimate)
+          , m_photon_gatherer(m_params, pass_callback)
         {
         }
 
@@ -170,7 +263,7 @@ namespace
                 sampling_context,
                 shading_context,
                 shading_point.get_scene(),
-                m_answer,
+                m_photon_gatherer,
                 radiance);
 
             VolumeVisitor volume_visitor;
@@ -203,6 +296,7 @@ namespace
             Statistics stats;
             stats.insert("path count", m_path_count);
             stats.insert("path length", m_path_length);
+            m_photon_gatherer.insert_statistics(stats);
 
             return StatisticsVector::make("sppm statistics", stats);
         }
@@ -214,7 +308,7 @@ namespace
         const BackwardLightSampler&     m_backward_light_sampler;
         std::uint64_t                   m_path_count;
         Population<std::uint64_t>       m_path_length;
-        knn::Answer<float>              m_answer;
+        PhotonGatherer                  m_photon_gatherer;
 
         struct PathVisitor
         {
@@ -225,7 +319,7 @@ namespace
             SamplingContext&                m_sampling_context;
             const ShadingContext&           m_shading_context;
             const EnvironmentEDF*           m_env_edf;
-            knn::Answer<float>&             m_answer;
+            PhotonGatherer&                 m_photon_gatherer;
             ShadingComponents&              m_path_radiance;
 
             PathVisitor(
@@ -236,7 +330,7 @@ namespace
                 SamplingContext&                sampling_context,
                 const ShadingContext&           shading_context,
                 const Scene&                    scene,
-                knn::Answer<float>&             answer,
+                PhotonGatherer&                 photon_gatherer,
                 ShadingComponents&              path_radiance)
               : m_params(params)
               , m_pass_callback(pass_callback)
@@ -245,7 +339,7 @@ namespace
               , m_sampling_context(sampling_context)
               , m_shading_context(shading_context)
               , m_env_edf(scene.get_environment()->get_environment_edf())
-              , m_answer(answer)
+              , m_photon_gatherer(photon_gatherer)
               , m_path_radiance(path_radiance)
             {
             }
@@ -374,7 +468,9 @@ namespace
                     bsdf_sample_count,
                     light_sample_count,
                     m_params.m_dl_low_light_threshold,
-                    false);             // not computing indirect lighting
+                    false,              // not computing indirect lighting
+                    0,                  // resampling_candidate_count
+                    nullptr);           // light_reservoir
 
                 // Always sample both the lights and the BSDF.
                 integrator.compute_outgoing_radiance_combined_sampling_low_variance(
@@ -395,19 +491,16 @@ namespace
                 const PathVertex&           vertex,
                 DirectShadingComponents&    vertex_radiance)
             {
-                const SPPMPhotonMap& photon_map = m_pass_callback.get_photon_map();
-
                 // No indirect lighting if the photon map is empty.
-                if (photon_map.empty())
+                if (m_photon_gatherer.empty_photon_map())
                     return;
 
                 const Vector3f point(vertex.get_point());
                 const float radius = m_pass_callback.get_lookup_radius();
 
                 // Find the nearby photons around the path vertex.
-                const knn::Query3f query(photon_map, m_answer);
-                query.run(point, radius * radius);
-                const size_t photon_count = m_answer.size();
+                m_photon_gatherer.gather(point, radius * radius);
+                const size_t photon_count = m_photon_gatherer.size();
 
                 // Compute the square radius of the lookup disk.
                 float max_square_dist;
@@ -418,7 +511,7 @@ namespace
                     max_square_dist = 0.0f;
                     for (size_t i = 0; i < photon_count; ++i)
                     {
-                        const float square_dist = m_answer.get(i).m_square_dist;
+                        const float square_dist = m_photon_gatherer.get_square_dist(i);
                         if (max_square_dist < square_dist)
                             max_square_dist = square_dist;
                     }
@@ -460,29 +553,28 @@ namespace
                 const float             rcp_max_square_dist,
                 Spectrum&               radiance)
             {
-                const SPPMPhotonMap& photon_map = m_pass_callback.get_photon_map();
+                const SPPMPhotonVector& photons = m_pass_callback.get_photons();
                 const Vector3f normal(vertex.get_geometric_normal());
 
                 for (size_t i = 0; i < photon_count; ++i)
                 {
                     // Retrieve the i'th photon.
-                    const knn::Answer<float>::Entry& entry = m_answer.get(i);
-                    const SPPMMonoPhoton& photon =
-                        m_pass_callback.get_mono_photon(
-                            photon_map.remap(entry.m_index));
+                    const size_t photon_index = m_photon_gatherer.get_photon_index(i);
+                    const Vector3f& incoming = photons.m_incoming[photon_index];
+                    const Vector3f& geometric_normal = photons.m_geometric_normals[photon_index];
 
                     // Reject photons from the opposite hemisphere as they won't contribute.
-                    if (dot(normal, photon.m_incoming) <= 0.0f)
+                    if (dot(normal, incoming) <= 0.0f)
                         continue;
 
                     // Reject photons on a surface with too different an orientation.
                     const float NormalThreshold = 1.0e-3f;
-                    if (dot(normal, photon.m_geometric_normal) < NormalThreshold)
+                    if (dot(normal, geometric_normal) < NormalThreshold)
                         continue;
 
 #if 0
                     // Reject photons on the wrong side of the surface.
-                    if (dot(vertex.m_outgoing, Vector3d(photon.m_geometric_normal)) <= 0.0)
+                    if (dot(vertex.m_outgoing, Vector3d(geometric_normal)) <= 0.0)
                         continue;
 #endif
 
@@ -508,7 +600,7 @@ namespace
                             true,                                       // multiply by |cos(incoming, normal)|
                             local_geometry,
                             Vector3f(vertex.m_outgoing.get_value()),    // toward the camera
-                            normalize(photon.m_incoming),               // toward the light
+                            normalize(incoming),                        // toward the light
                             ScatteringMode::Diffuse,
                             bsdf_value);
                     if (bsdf_prob == 0.0f)
@@ -517,15 +609,16 @@ namespace
                     // The photons store flux but we are computing reflected radiance.
                     // The first step of the flux -> radiance conversion is done here.
                     // The conversion will be completed when doing density estimation.
-                    float bsdf_mono_value = bsdf_value.m_beauty[photon.m_flux.m_wavelength];
-                    bsdf_mono_value /= std::abs(dot(photon.m_incoming, photon.m_geometric_normal));
-                    bsdf_mono_value *= photon.m_flux.m_amplitude;
+                    const SpectrumLine& flux = photons.m_mono_fluxes[photon_index];
+                    float bsdf_mono_value = bsdf_value.m_beauty[flux.m_wavelength];
+                    bsdf_mono_value /= std::abs(dot(incoming, geometric_normal));
+                    bsdf_mono_value *= flux.m_amplitude;
 
                     // Apply kernel weight.
-                    bsdf_mono_value *= epanechnikov2d(entry.m_square_dist * rcp_max_square_dist);
+                    bsdf_mono_value *= epanechnikov2d(m_photon_gatherer.get_square_dist(i) * rcp_max_square_dist);
 
                     // Accumulate reflected flux.
-                    radiance[photon.m_flux.m_wavelength] += bsdf_mono_value;
+                    radiance[flux.m_wavelength] += bsdf_mono_value;
                 }
             }
 
@@ -535,29 +628,28 @@ namespace
                 const float             rcp_max_square_dist,
                 Spectrum&               radiance)
             {
-                const SPPMPhotonMap& photon_map = m_pass_callback.get_photon_map();
+                const SPPMPhotonVector& photons = m_pass_callback.get_photons();
                 const Vector3f normal(vertex.get_geometric_normal());
 
                 for (size_t i = 0; i < photon_count; ++i)
                 {
                     // Retrieve the i'th photon.
-                    const knn::Answer<float>::Entry& entry = m_answer.get(i);
-                    const SPPMPolyPhoton& photon =
-                        m_pass_callback.get_poly_photon(
-                            photon_map.remap(entry.m_index));
+                    const size_t photon_index = m_photon_gatherer.get_photon_index(i);
+                    const Vector3f& incoming = photons.m_incoming[photon_index];
+                    const Vector3f& geometric_normal = photons.m_geometric_normals[photon_index];
 
                     // Reject photons from the opposite hemisphere as they won't contribute.
-                    if (dot(normal, photon.m_incoming) <= 0.0f)
+                    if (dot(normal, incoming) <= 0.0f)
                         continue;
 
                     // Reject photons on a surface with too different an orientation.
                     const float NormalThreshold = 1.0e-3f;
-                    if (dot(normal, photon.m_geometric_normal) < NormalThreshold)
+                    if (dot(normal, geometric_normal) < NormalThreshold)
                         continue;
 
 #if 0
                     // Reject photons on the wrong side of the surface.
-                    if (dot(vertex.m_outgoing, Vector3d(photon.m_geometric_normal)) <= 0.0)
+                    if (dot(vertex.m_outgoing, Vector3d(geometric_normal)) <= 0.0)
                         continue;
 #endif
 
@@ -583,7 +675,7 @@ namespace
                             true,                                       // multiply by |cos(incoming, normal)|
                             local_geometry,
                             Vector3f(vertex.m_outgoing.get_value()),    // toward the camera
-                            normalize(photon.m_incoming),               // toward the light
+                            normalize(incoming),                        // toward the light
                             ScatteringMode::Diffuse,
                             bsdf_value);
                     if (bsdf_prob == 0.0f)
@@ -592,11 +684,11 @@ namespace
                     // The photons store flux but we are computing reflected radiance.
                     // The first step of the flux -> radiance conversion is done here.
                     // The conversion will be completed when doing density estimation.
-                    bsdf_value.m_beauty /= std::abs(dot(photon.m_incoming, photon.m_geometric_normal));
-                    bsdf_value.m_beauty *= photon.m_flux;
+                    bsdf_value.m_beauty /= std::abs(dot(incoming, geometric_normal));
+                    bsdf_value.m_beauty *= photons.m_poly_fluxes[photon_index];
 
                     // Apply kernel weight.
-                    bsdf_value.m_beauty *= epanechnikov2d(entry.m_square_dist * rcp_max_square_dist);
+                    bsdf_value.m_beauty *= epanechnikov2d(m_photon_gatherer.get_square_dist(i) * rcp_max_square_dist);
 
                     // Accumulate reflected flux.
                     radiance += bsdf_value.m_beauty;
@@ -625,34 +717,28 @@ namespace
             const ShadingPoint&     shading_point,
             Spectrum&               radiance)
         {
-            const SPPMPhotonMap& photon_map = m_pass_callback.get_photon_map();
-            const knn::Query3f query(photon_map, m_answer);
-
-            query.run(
+            m_photon_gatherer.gather(
                 Vector3f(shading_point.get_point()),
                 square(m_params.m_view_photons_radius));
 
             radiance.set(0.0f);
 
-            const size_t photon_count = m_answer.size();
+            const size_t photon_count = m_photon_gatherer.size();
+
+            const SPPMPhotonVector& photons = m_pass_callback.get_photons();
 
             if (m_params.m_photon_type == SPPMParameters::Monochromatic)
             {
                 for (size_t i = 0; i < photon_count; ++i)
                 {
-                    const knn::Answer<float>::Entry& photon = m_answer.get(i);
-                    const SpectrumLine& flux =
-                        m_pass_callback.get_mono_photon(photon_map.remap(photon.m_index)).m_flux;
+                    const SpectrumLine& flux = photons.m_mono_fluxes[m_photon_gatherer.get_photon_index(i)];
                     radiance[flux.m_wavelength] += flux.m_amplitude;
                 }
             }
             else
             {
                 for (size_t i = 0; i < photon_count; ++i)
-                {
-                    const knn::Answer<float>::Entry& photon = m_answer.get(i);
-                    radiance += m_pass_callback.get_poly_photon(photon_map.remap(photon.m_index)).m_flux;
-                }
+                    radiance += photons.m_poly_fluxes[m_photon_gatherer.get_photon_index(i)];
             }
 
             const float m = max_value(radiance);
@@ -709,6 +795,28 @@ Dictionary SPPMLightingEngineFactory::get_params_metadata()
                             .insert("label", "Poly")
                             .insert("help", "Polychromatic photons"))));
 
+    metadata.dictionaries().insert(
+        "photon_map_type",
+        Dictionary()
+            .insert("type", "enum")
+            .insert("values", "kd_tree|hashed_grid")
+            .insert("default", "kd_tree")
+            .insert("label", "Photon Map Type")
+            .insert("help", "Acceleration structure used to find photons")
+            .insert(
+                "options",
+                Dictionary()
+                    .insert(
+                        "kd_tree",
+                        Dictionary()
+                            .insert("label", "Kd-Tree")
+                            .insert("help", "Kd-tree built on a single thread, supports k-nearest photon lookups"))
+                    .insert(
+                        "hashed_grid",
+                        Dictionary()
+                            .insert("label", "Hashed Grid")
+                            .insert("help", "Hashed grid built in parallel, faster to build and to query with small lookup radii"))));
+
     metadata.dictionaries().insert(
         "dl_type",
         Dictionary()
@@ -76,6 +76,23 @@ namespace
                 : SPPMParameters::Polychromatic;
     }
 
+    SPPMParameters::PhotonMapType get_photon_map_type(
+        const ParamArray&   params,
+        const char*         name,
+        const char*         default_value)
+    {
+        const std::string value =
+            params.get_optional<std::string>(
+                name,
+                default_value,
+                make_vector("kd_tree", "hashed_grid"));
+
+        return
+            value == "kd_tree"
+                ? SPPMParameters::KDTree
+                : SPPMParameters::HashedGrid;
+    }
+
     SPPMParameters::Mode get_mode(
         const ParamArray&   params,
         const char*         name,
@@ -98,6 +115,7 @@ SPPMParameters::SPPMParameters(const ParamArray& params)
   : m_spectrum_mode(get_spectrum_mode(params))
   , m_sampling_mode(get_sampling_context_mode(params))
   , m_photon_type(get_photon_type(params, "photon_type", "poly"))
+  , m_photon_map_type(get_photon_map_type(params, "photon_map_type", "kd_tree"))
   , m_dl_mode(get_mode(params, "dl_mode", "rt"))
   , m_enable_ibl(params.get_optional<bool>("enable_ibl", true))
   , m_enable_caustics(params.get_optional<bool>("enable_caustics", true))
@@ -132,9 +150,11 @@ void SPPMParameters::print() const
     RENDERER_LOG_INFO(
         "sppm settings:\n"
         "  photon type                   %s\n"
+        "  photon map type               %s\n"
         "  dl                            %s\n"
         "  ibl                           %s",
         m_photon_type == Monochromatic ? "monochromatic" : "polychromatic",
+        m_photon_map_type == KDTree ? "kd-tree" : "hashed grid",
         m_dl_mode == RayTraced ? "ray traced" :
         m_dl_mode == SPPM ? "sppm" : "off",
         m_enable_ibl ? "on" : "off");
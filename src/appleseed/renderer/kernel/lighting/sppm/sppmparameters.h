@@ -44,12 +44,14 @@ namespace renderer
 struct SPPMParameters
 {
     enum PhotonType { Monochromatic, Polychromatic };
+    enum PhotonMapType { KDTree, HashedGrid };
     enum Mode { RayTraced, SPPM, Off };
 
     const Spectrum::Mode        m_spectrum_mode;
     const SamplingContext::Mode m_sampling_mode;
 
     const PhotonType            m_photon_type;
+    const PhotonMapType         m_photon_map_type;                      // acceleration structure used for photon lookups
 
     const Mode                  m_dl_mode;                              // direct lighting mode
     const bool                  m_enable_ibl;                           // is image-based lighting enabled?
@@ -76,6 +76,8 @@ SPPMPassCallback::SPPMPassCallback(
         shading_system,
         params)
   , m_pass_number(0)
+  , m_photon_tracing_time(0.0)
+  , m_photon_map_build_time(0.0)
 {
     // Compute the initial lookup radius.
     const GAABB3 scene_bbox = scene.compute_bbox();
@@ -120,8 +122,14 @@ void SPPMPassCallback::on_pass_begin(
     if (abort_switch.is_aborted())
         return;
 
+    m_photon_tracing_time = m_stopwatch.measure().get_seconds();
+
     // Build a new photon map.
-    m_photon_map.reset(new SPPMPhotonMap(m_photons));
+    if (m_params.m_photon_map_type == SPPMParameters::HashedGrid)
+        m_photon_grid.reset(new SPPMPhotonGrid(m_photons, m_lookup_radius, job_queue));
+    else m_photon_map.reset(new SPPMPhotonMap(m_photons));
+
+    m_photon_map_build_time = m_stopwatch.measure().get_seconds() - m_photon_tracing_time;
 }
 
 void SPPMPassCallback::on_pass_end(
@@ -137,9 +145,11 @@ void SPPMPassCallback::on_pass_end(
     m_stopwatch.measure();
 
     RENDERER_LOG_INFO(
-        "sppm pass %s completed in %s.",
+        "sppm pass %s completed in %s (photon tracing: %s, photon map construction: %s).",
         pretty_uint(m_pass_number + 1).c_str(),
-        pretty_time(m_stopwatch.get_seconds()).c_str());
+        pretty_time(m_stopwatch.get_seconds()).c_str(),
+        pretty_time(m_photon_tracing_time).c_str(),
+        pretty_time(m_photon_map_build_time).c_str());
 
     ++m_pass_number;
 }
@@ -32,6 +32,7 @@
 // appleseed.renderer headers.
 #include "renderer/kernel/lighting/sppm/sppmparameters.h"
 #include "renderer/kernel/lighting/sppm/sppmphoton.h"
+#include "renderer/kernel/lighting/sppm/sppmphotongrid.h"
 #include "renderer/kernel/lighting/sppm/sppmphotonmap.h"
 #include "renderer/kernel/lighting/sppm/sppmphotontracer.h"
 #include "renderer/kernel/rendering/ipasscallback.h"
@@ -92,13 +93,15 @@ class SPPMPassCallback
         foundation::JobQueue&           job_queue,
         foundation::IAbortSwitch&       abort_switch) override;
 
-    // Return the i'th photon.
-    const SPPMMonoPhoton& get_mono_photon(const size_t i) const;
-    const SPPMPolyPhoton& get_poly_photon(const size_t i) const;
+    // Return the photons of the current pass.
+    const SPPMPhotonVector& get_photons() const;
 
-    // Return the current photon map.
+    // Return the current photon map, when photons are stored in a kd-tree.
     const SPPMPhotonMap& get_photon_map() const;
 
+    // Return the current photon grid, when photons are stored in a hashed grid.
+    const SPPMPhotonGrid& get_photon_grid() const;
+
     // Return the current lookup radius.
     float get_lookup_radius() const;
 
@@ -108,10 +111,13 @@ class SPPMPassCallback
     size_t                              m_pass_number;
     SPPMPhotonVector                    m_photons;
     std::unique_ptr<SPPMPhotonMap>      m_photon_map;
+    std::unique_ptr<SPPMPhotonGrid>     m_photon_grid;
     float                               m_initial_lookup_radius;
     float                               m_lookup_radius;
     foundation::Stopwatch<foundation::DefaultWallclockTimer>
                                         m_stopwatch;
+    double                              m_photon_tracing_time;
+    double                              m_photon_map_build_time;
 };
 
 
@@ -119,19 +125,19 @@ class SPPMPassCallback
 // SPPMPassCallback class implementation.
 //
 
-inline const SPPMMonoPhoton& SPPMPassCallback::get_mono_photon(const size_t i) const
+inline const SPPMPhotonVector& SPPMPassCallback::get_photons() const
 {
-    return m_photons.m_mono_photons[i];
+    return m_photons;
 }
 
-inline const SPPMPolyPhoton& SPPMPassCallback::get_poly_photon(const size_t i) const
+inline const SPPMPhotonMap& SPPMPassCallback::get_photon_map() const
 {
-    return m_photons.m_poly_photons[i];
+    return *m_photon_map.get();
 }
 
-inline const SPPMPhotonMap& SPPMPassCallback::get_photon_map() const
+inline const SPPMPhotonGrid& SPPMPassCallback::get_photon_grid() const
 {
-    return *m_photon_map.get();
+    return *m_photon_grid.get();
 }
 
 inline float SPPMPassCallback::get_lookup_radius() const
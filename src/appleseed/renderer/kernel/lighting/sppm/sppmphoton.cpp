@@ -31,13 +31,67 @@
 #include "sppmphoton.h"
 
 // appleseed.foundation headers.
+#include "foundation/utility/job/ijob.h"
+#include "foundation/utility/job/jobqueue.h"
 #include "foundation/utility/memory.h"
 
+// Standard headers.
+#include <algorithm>
+#include <cassert>
+
 using namespace foundation;
 
 namespace renderer
 {
 
+namespace
+{
+    template <typename T>
+    void copy_at(
+        const std::vector<T>&   source,
+        std::vector<T>&         destination,
+        const size_t            index)
+    {
+        assert(index + source.size() <= destination.size());
+        std::copy(source.begin(), source.end(), destination.begin() + index);
+    }
+
+    // Copy the photons of a vector into a range of another vector.
+    class PhotonCopyJob
+      : public IJob
+    {
+      public:
+        PhotonCopyJob(
+            const SPPMPhotonVector& source,
+            SPPMPhotonVector&       destination,
+            const size_t            index)
+          : m_source(source)
+          , m_destination(destination)
+          , m_index(index)
+        {
+        }
+
+        void execute(const size_t thread_index) override
+        {
+            copy_at(m_source.m_positions, m_destination.m_positions, m_index);
+            copy_at(m_source.m_incoming, m_destination.m_incoming, m_index);
+            copy_at(m_source.m_geometric_normals, m_destination.m_geometric_normals, m_index);
+
+            if (!m_source.m_mono_fluxes.empty())
+                copy_at(m_source.m_mono_fluxes, m_destination.m_mono_fluxes, m_index);
+
+            if (!m_source.m_poly_fluxes.empty())
+                copy_at(m_source.m_poly_fluxes, m_destination.m_poly_fluxes, m_index);
+        }
+
+      private:
+        const SPPMPhotonVector&     m_source;
+        SPPMPhotonVector&           m_destination;
+        const size_t                m_index;
+    };
+}
+
+
 //
 // SPPMPhotonVector class implementation.
 //
@@ -56,59 +110,108 @@ size_t SPPMPhotonVector::get_memory_size() const
 {
     return
         m_positions.capacity() * sizeof(Vector3f) +
-        m_mono_photons.capacity() * sizeof(SPPMMonoPhoton) +
-        m_poly_photons.capacity() * sizeof(SPPMPolyPhoton);
+        m_incoming.capacity() * sizeof(Vector3f) +
+        m_geometric_normals.capacity() * sizeof(Vector3f) +
+        m_mono_fluxes.capacity() * sizeof(SpectrumLine) +
+        m_poly_fluxes.capacity() * sizeof(Spectrum);
 }
 
 void SPPMPhotonVector::swap(SPPMPhotonVector& rhs)
 {
     m_positions.swap(rhs.m_positions);
-    m_mono_photons.swap(rhs.m_mono_photons);
-    m_poly_photons.swap(rhs.m_poly_photons);
+    m_incoming.swap(rhs.m_incoming);
+    m_geometric_normals.swap(rhs.m_geometric_normals);
+    m_mono_fluxes.swap(rhs.m_mono_fluxes);
+    m_poly_fluxes.swap(rhs.m_poly_fluxes);
 }
 
 void SPPMPhotonVector::clear_keep_memory()
 {
     foundation::clear_keep_memory(m_positions);
-    foundation::clear_keep_memory(m_mono_photons);
-    foundation::clear_keep_memory(m_poly_photons);
+    foundation::clear_keep_memory(m_incoming);
+    foundation::clear_keep_memory(m_geometric_normals);
+    foundation::clear_keep_memory(m_mono_fluxes);
+    foundation::clear_keep_memory(m_poly_fluxes);
 }
 
 void SPPMPhotonVector::reserve_mono_photons(const size_t capacity)
 {
     m_positions.reserve(capacity);
-    m_mono_photons.reserve(capacity);
+    m_incoming.reserve(capacity);
+    m_geometric_normals.reserve(capacity);
+    m_mono_fluxes.reserve(capacity);
 }
 
 void SPPMPhotonVector::reserve_poly_photons(const size_t capacity)
 {
     m_positions.reserve(capacity);
-    m_poly_photons.reserve(capacity);
+    m_incoming.reserve(capacity);
+    m_geometric_normals.reserve(capacity);
+    m_poly_fluxes.reserve(capacity);
 }
 
 void SPPMPhotonVector::push_back(
     const Vector3f&         position,
     const SPPMMonoPhoton&   photon)
 {
+    assert(m_poly_fluxes.empty());
+
     m_positions.push_back(position);
-    m_mono_photons.push_back(photon);
+    m_incoming.push_back(photon.m_incoming);
+    m_geometric_normals.push_back(photon.m_geometric_normal);
+    m_mono_fluxes.push_back(photon.m_flux);
 }
 
 void SPPMPhotonVector::push_back(
     const Vector3f&         position,
     const SPPMPolyPhoton&   photon)
 {
+    assert(m_mono_fluxes.empty());
+
     m_positions.push_back(position);
-    m_poly_photons.push_back(photon);
+    m_incoming.push_back(photon.m_incoming);
+    m_geometric_normals.push_back(photon.m_geometric_normal);
+    m_poly_fluxes.push_back(photon.m_flux);
 }
 
-void SPPMPhotonVector::append(const SPPMPhotonVector& rhs)
+void SPPMPhotonVector::assign_concatenation(
+    const std::vector<SPPMPhotonVector>&    vectors,
+    JobQueue&                               job_queue)
 {
-    boost::mutex::scoped_lock lock(m_mutex);
-
-    m_positions.insert(m_positions.end(), rhs.m_positions.begin(), rhs.m_positions.end());
-    m_mono_photons.insert(m_mono_photons.end(), rhs.m_mono_photons.begin(), rhs.m_mono_photons.end());
-    m_poly_photons.insert(m_poly_photons.end(), rhs.m_poly_photons.begin(), rhs.m_poly_photons.end());
+    size_t photon_count = 0;
+    size_t mono_photon_count = 0;
+    size_t poly_photon_count = 0;
+
+    for (const SPPMPhotonVector& v : vectors)
+    {
+        photon_count += v.size();
+        mono_photon_count += v.m_mono_fluxes.size();
+        poly_photon_count += v.m_poly_fluxes.size();
+    }
+
+    // A vector holds either monochromatic or polychromatic photons.
+    assert(mono_photon_count == 0 || mono_photon_count == photon_count);
+    assert(poly_photon_count == 0 || poly_photon_count == photon_count);
+
+    // Resizing keeps the capacity of the vectors, so that nothing is allocated from one pass to the next.
+    m_positions.resize(photon_count);
+    m_incoming.resize(photon_count);
+    m_geometric_normals.resize(photon_count);
+    m_mono_fluxes.resize(mono_photon_count);
+    m_poly_fluxes.resize(poly_photon_count);
+
+    // Copy each vector at its offset in the concatenation.
+    size_t index = 0;
+    for (const SPPMPhotonVector& v : vectors)
+    {
+        if (!v.empty())
+        {
+            job_queue.schedule(new PhotonCopyJob(v, *this, index));
+            index += v.size();
+        }
+    }
+
+    job_queue.wait_until_completion();
 }
 
 }   // namespace renderer
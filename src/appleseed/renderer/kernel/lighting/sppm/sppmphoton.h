@@ -34,13 +34,15 @@
 
 // appleseed.foundation headers.
 #include "foundation/math/vector.h"
-#include "foundation/platform/thread.h"
 
 // Standard headers.
 #include <cstddef>
 #include <cstdint>
 #include <vector>
 
+// Forward declarations.
+namespace foundation    { class JobQueue; }
+
 namespace renderer
 {
 
@@ -79,14 +81,20 @@ class SPPMPolyPhoton
 //
 // A vector of photons.
 //
+// Photons are stored as a structure of arrays: photon lookups first test the
+// direction and the normal of many photons before reading the flux of the few
+// that pass, so keeping the flux apart avoids loading it for rejected photons.
+// A vector holds either monochromatic or polychromatic photons.
+//
 
 class SPPMPhotonVector
 {
   public:
     std::vector<foundation::Vector3f>   m_positions;
-    std::vector<SPPMMonoPhoton>         m_mono_photons;
-    std::vector<SPPMPolyPhoton>         m_poly_photons;
-    boost::mutex                        m_mutex;
+    std::vector<foundation::Vector3f>   m_incoming;             // incoming directions, world space, unit length
+    std::vector<foundation::Vector3f>   m_geometric_normals;    // geometric normals at the photon locations, world space, unit length
+    std::vector<SpectrumLine>           m_mono_fluxes;          // flux carried by monochromatic photons (in W)
+    std::vector<Spectrum>               m_poly_fluxes;          // flux carried by polychromatic photons (in W)
 
     bool empty() const;
     size_t size() const;
@@ -105,8 +113,12 @@ class SPPMPhotonVector
         const foundation::Vector3f&     position,
         const SPPMPolyPhoton&           photon);
 
-    // The only thread-safe method of this class.
-    void append(const SPPMPhotonVector& rhs);
+    // Replace the content of this vector by the concatenation of a set of vectors,
+    // in order. The vectors are copied in parallel and memory is only allocated
+    // when this vector grows beyond its capacity.
+    void assign_concatenation(
+        const std::vector<SPPMPhotonVector>&    vectors,
+        foundation::JobQueue&                   job_queue);
 };
 
 }   // namespace renderer
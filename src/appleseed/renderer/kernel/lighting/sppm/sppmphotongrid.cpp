@@ -0,0 +1,343 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Interface header.
+#include "sppmphotongrid.h"
+
+// appleseed.renderer headers.
+#include "renderer/global/globallogger.h"
+#include "renderer/kernel/lighting/sppm/sppmphoton.h"
+
+// appleseed.foundation headers.
+#include "foundation/math/scalar.h"
+#include "foundation/platform/atomic.h"
+#include "foundation/platform/defaulttimers.h"
+#include "foundation/utility/job/ijob.h"
+#include "foundation/utility/job/jobqueue.h"
+#include "foundation/utility/memory.h"
+#include "foundation/utility/statistics.h"
+#include "foundation/utility/stopwatch.h"
+#include "foundation/utility/string.h"
+
+// Standard headers.
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <string>
+
+using namespace foundation;
+
+namespace renderer
+{
+
+namespace
+{
+    // Number of photons or buckets processed by a single construction job.
+    const size_t JobRangeSize = 16 * 1024;
+
+    // Beyond this number of cells per axis, a lookup scans all photons.
+    const std::int64_t MaxCellsPerAxis = 4;
+
+    // A job that applies a function to a range of indices.
+    template <typename Function>
+    class RangeJob
+      : public IJob
+    {
+      public:
+        RangeJob(
+            const Function&     function,
+            const size_t        begin,
+            const size_t        end)
+          : m_function(function)
+          , m_begin(begin)
+          , m_end(end)
+        {
+        }
+
+        void execute(const size_t thread_index) override
+        {
+            m_function(m_begin, m_end);
+        }
+
+      private:
+        const Function          m_function;
+        const size_t            m_begin;
+        const size_t            m_end;
+    };
+
+    // Apply a function to consecutive ranges of [0, count) in parallel, and wait for all of them.
+    template <typename Function>
+    void parallel_for_ranges(
+        JobQueue&               job_queue,
+        const size_t            count,
+        const Function&         function)
+    {
+        for (size_t begin = 0; begin < count; begin += JobRangeSize)
+        {
+            job_queue.schedule(
+                new RangeJob<Function>(
+                    function,
+                    begin,
+                    std::min(begin + JobRangeSize, count)));
+        }
+
+        job_queue.wait_until_completion();
+    }
+
+    std::int64_t cell_coordinate(const float x, const float rcp_cell_size)
+    {
+        // Clamp to keep the conversion well-defined for points very far from the origin.
+        const float Limit = static_cast<float>(std::int64_t(1) << 62);
+        return static_cast<std::int64_t>(clamp(std::floor(x * rcp_cell_size), -Limit, Limit));
+    }
+}
+
+
+//
+// SPPMPhotonGrid class implementation.
+//
+
+SPPMPhotonGrid::SPPMPhotonGrid(
+    SPPMPhotonVector&       photons,
+    const float             lookup_radius,
+    JobQueue&               job_queue)
+  : m_rcp_cell_size(lookup_radius > 0.0f ? 0.5f / lookup_radius : 0.0f)
+  , m_bucket_mask(0)
+  , m_build_time(0.0)
+{
+    const size_t photon_count = photons.size();
+
+    if (photon_count == 0)
+    {
+        RENDERER_LOG_WARNING(
+            "cannot build sppm photon grid because no photon were stored by the photon tracing pass.");
+        return;
+    }
+
+    assert(photon_count < std::numeric_limits<std::uint32_t>::max());
+
+    RENDERER_LOG_INFO(
+        "building sppm photon grid from %s %s...",
+        pretty_uint(photon_count).c_str(),
+        photon_count > 1 ? "photons" : "photon");
+
+    Stopwatch<DefaultWallclockTimer> stopwatch;
+    stopwatch.start();
+
+    std::vector<Vector3f> positions;
+    positions.swap(photons.m_positions);
+
+    const size_t bucket_count = static_cast<size_t>(next_pow2<std::uint64_t>(photon_count));
+    m_bucket_mask = static_cast<std::uint32_t>(bucket_count - 1);
+
+    // Find the bucket of each photon and count the photons in each bucket.
+    std::vector<std::uint32_t> photon_buckets(photon_count);
+    std::vector<std::uint32_t> bucket_sizes(bucket_count, 0);
+    parallel_for_ranges(
+        job_queue,
+        photon_count,
+        [&](const size_t begin, const size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const Vector3f& p = positions[i];
+                const std::uint32_t bucket =
+                    hash_cell(
+                        cell_coordinate(p.x, m_rcp_cell_size),
+                        cell_coordinate(p.y, m_rcp_cell_size),
+                        cell_coordinate(p.z, m_rcp_cell_size));
+                photon_buckets[i] = bucket;
+                atomic_inc(&bucket_sizes[bucket]);
+            }
+        });
+
+    // Compute the index of the first photon of each bucket.
+    m_buckets.resize(bucket_count + 1);
+    std::uint32_t photon_index = 0;
+    size_t occupied_bucket_count = 0;
+    size_t max_bucket_size = 0;
+    for (size_t i = 0; i < bucket_count; ++i)
+    {
+        m_buckets[i] = photon_index;
+        photon_index += bucket_sizes[i];
+
+        if (bucket_sizes[i] > 0)
+            ++occupied_bucket_count;
+
+        max_bucket_size = std::max<size_t>(max_bucket_size, bucket_sizes[i]);
+    }
+    m_buckets[bucket_count] = photon_index;
+
+    // Scatter the photon indices into their buckets, reusing the bucket sizes as insertion cursors.
+    std::copy(m_buckets.begin(), m_buckets.end() - 1, bucket_sizes.begin());
+    m_indices.resize(photon_count);
+    parallel_for_ranges(
+        job_queue,
+        photon_count,
+        [&](const size_t begin, const size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const std::uint32_t slot = atomic_inc(&bucket_sizes[photon_buckets[i]]);
+                m_indices[slot] = static_cast<std::uint32_t>(i);
+            }
+        });
+
+    // Sort the photons of each bucket so that the grid does not depend on thread
+    // scheduling, then gather the photon positions in bucket order.
+    m_points.resize(photon_count);
+    parallel_for_ranges(
+        job_queue,
+        bucket_count,
+        [&](const size_t begin, const size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+                std::sort(m_indices.begin() + m_buckets[i], m_indices.begin() + m_buckets[i + 1]);
+
+            for (size_t i = m_buckets[begin], e = m_buckets[end]; i < e; ++i)
+                m_points[i] = positions[m_indices[i]];
+        });
+
+    // Hand the memory back to the photon vector so that the next pass can reuse it.
+    clear_keep_memory(positions);
+    photons.m_positions.swap(positions);
+
+    stopwatch.measure();
+    m_build_time = stopwatch.get_seconds();
+
+    Statistics statistics;
+    statistics.insert_time("build time", m_build_time);
+    statistics.insert_size("size", get_memory_size());
+    statistics.insert("cell size", lookup_radius * 2.0f);
+    statistics.insert<std::uint64_t>("buckets", bucket_count);
+    statistics.insert_percent("occupied buckets", occupied_bucket_count, bucket_count);
+    statistics.insert<std::uint64_t>("max photons per bucket", max_bucket_size);
+
+    RENDERER_LOG_DEBUG("%s",
+        StatisticsVector::make(
+            "sppm photon grid statistics",
+            statistics).to_string().c_str());
+}
+
+size_t SPPMPhotonGrid::get_memory_size() const
+{
+    return
+          sizeof(*this)
+        + m_buckets.capacity() * sizeof(std::uint32_t)
+        + m_points.capacity() * sizeof(Vector3f)
+        + m_indices.capacity() * sizeof(std::uint32_t);
+}
+
+void SPPMPhotonGrid::query(
+    const Vector3f&         point,
+    const float             max_square_dist,
+    knn::Answer<float>&     answer) const
+{
+    answer.clear();
+
+    if (m_points.empty() || answer.max_size() == 0)
+        return;
+
+    // Find the range of cells overlapping the lookup sphere.
+    const float radius = std::sqrt(max_square_dist);
+    const std::int64_t min_x = cell_coordinate(point.x - radius, m_rcp_cell_size);
+    const std::int64_t min_y = cell_coordinate(point.y - radius, m_rcp_cell_size);
+    const std::int64_t min_z = cell_coordinate(point.z - radius, m_rcp_cell_size);
+    const std::int64_t max_x = cell_coordinate(point.x + radius, m_rcp_cell_size);
+    const std::int64_t max_y = cell_coordinate(point.y + radius, m_rcp_cell_size);
+    const std::int64_t max_z = cell_coordinate(point.z + radius, m_rcp_cell_size);
+
+    // The lookup radius is much larger than the cells: scan all photons.
+    if (max_x - min_x >= MaxCellsPerAxis ||
+        max_y - min_y >= MaxCellsPerAxis ||
+        max_z - min_z >= MaxCellsPerAxis)
+    {
+        query_range(point, max_square_dist, 0, m_points.size(), answer);
+        return;
+    }
+
+    // Visit the buckets of these cells. Distinct cells may share a bucket, which must only be visited once.
+    std::uint32_t visited_buckets[MaxCellsPerAxis * MaxCellsPerAxis * MaxCellsPerAxis];
+    size_t visited_bucket_count = 0;
+
+    for (std::int64_t z = min_z; z <= max_z; ++z)
+    {
+        for (std::int64_t y = min_y; y <= max_y; ++y)
+        {
+            for (std::int64_t x = min_x; x <= max_x; ++x)
+            {
+                const std::uint32_t bucket = hash_cell(x, y, z);
+                std::uint32_t* visited_buckets_end = visited_buckets + visited_bucket_count;
+
+                if (std::find(visited_buckets, visited_buckets_end, bucket) != visited_buckets_end)
+                    continue;
+
+                visited_buckets[visited_bucket_count++] = bucket;
+
+                query_range(
+                    point,
+                    max_square_dist,
+                    m_buckets[bucket],
+                    m_buckets[bucket + 1],
+                    answer);
+            }
+        }
+    }
+}
+
+void SPPMPhotonGrid::query_range(
+    const Vector3f&         point,
+    const float             max_square_dist,
+    const size_t            begin,
+    const size_t            end,
+    knn::Answer<float>&     answer) const
+{
+    const size_t max_answer_size = answer.max_size();
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        const float square_dist = square_norm(m_points[i] - point);
+
+        if (square_dist > max_square_dist)
+            continue;
+
+        if (answer.size() < max_answer_size)
+        {
+            answer.array_insert(i, square_dist);
+
+            // Once the answer is full, turn it into a heap to only keep the nearest photons.
+            if (answer.size() == max_answer_size)
+                answer.make_heap();
+        }
+        else if (square_dist < answer.top().m_square_dist)
+            answer.heap_insert(i, square_dist);
+    }
+}
+
+}   // namespace renderer
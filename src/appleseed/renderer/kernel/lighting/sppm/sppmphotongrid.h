@@ -0,0 +1,158 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+// appleseed.foundation headers.
+#include "foundation/math/knn.h"
+#include "foundation/math/vector.h"
+
+// Standard headers.
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Forward declarations.
+namespace foundation    { class JobQueue; }
+namespace renderer      { class SPPMPhotonVector; }
+
+namespace renderer
+{
+
+//
+// A spatial hash grid over the photon positions, an alternative to SPPMPhotonMap
+// for fixed-radius photon gathers.
+//
+// The grid cells are cubes whose edge is twice the lookup radius, so that a gather
+// visits at most 2x2x2 cells. Cells are hashed into a table with as many buckets as
+// there are photons, and photons are sorted by bucket so that the photons of a bucket
+// are contiguous in memory. All steps of the construction run in parallel.
+//
+// Reference:
+//
+//   Optimized Spatial Hashing for Collision Detection of Deformable Objects
+//   http://www.beosil.com/download/CollisionDetectionHashing_VMV03.pdf
+//
+
+class SPPMPhotonGrid
+{
+  public:
+    // Constructor, consumes the photon positions.
+    SPPMPhotonGrid(
+        SPPMPhotonVector&               photons,
+        const float                     lookup_radius,
+        foundation::JobQueue&           job_queue);
+
+    bool empty() const;
+    size_t size() const;
+
+    // Return the index in the photon vector of the i'th photon of the grid.
+    size_t remap(const size_t i) const;
+
+    // Return the position of the i'th photon of the grid.
+    const foundation::Vector3f& get_point(const size_t i) const;
+
+    // Return the size (in bytes) of this object in memory.
+    size_t get_memory_size() const;
+
+    // Return the construction time.
+    double get_build_time() const;
+
+    // Find the photons within a given distance of a point. If there are more photons
+    // than the answer can hold, only the nearest ones are kept. Indices in the answer
+    // must be remapped with remap().
+    void query(
+        const foundation::Vector3f&     point,
+        const float                     max_square_dist,
+        foundation::knn::Answer<float>& answer) const;
+
+  private:
+    float                               m_rcp_cell_size;
+    std::uint32_t                       m_bucket_mask;
+    std::vector<std::uint32_t>          m_buckets;          // index of the first photon of each bucket, plus one past the last photon
+    std::vector<foundation::Vector3f>   m_points;           // photon positions, sorted by bucket
+    std::vector<std::uint32_t>          m_indices;          // photon indices, sorted by bucket
+    double                              m_build_time;
+
+    std::uint32_t hash_cell(
+        const std::int64_t              x,
+        const std::int64_t              y,
+        const std::int64_t              z) const;
+
+    void query_range(
+        const foundation::Vector3f&     point,
+        const float                     max_square_dist,
+        const size_t                    begin,
+        const size_t                    end,
+        foundation::knn::Answer<float>& answer) const;
+};
+
+
+//
+// SPPMPhotonGrid class implementation.
+//
+
+inline bool SPPMPhotonGrid::empty() const
+{
+    return m_points.empty();
+}
+
+inline size_t SPPMPhotonGrid::size() const
+{
+    return m_points.size();
+}
+
+inline size_t SPPMPhotonGrid::remap(const size_t i) const
+{
+    return m_indices[i];
+}
+
+inline const foundation::Vector3f& SPPMPhotonGrid::get_point(const size_t i) const
+{
+    return m_points[i];
+}
+
+inline double SPPMPhotonGrid::get_build_time() const
+{
+    return m_build_time;
+}
+
+inline std::uint32_t SPPMPhotonGrid::hash_cell(
+    const std::int64_t                  x,
+    const std::int64_t                  y,
+    const std::int64_t                  z) const
+{
+    const std::uint32_t h =
+        (static_cast<std::uint32_t>(x) * 73856093u) ^
+        (static_cast<std::uint32_t>(y) * 19349663u) ^
+        (static_cast<std::uint32_t>(z) * 83492791u);
+
+    return h & m_bucket_mask;
+}
+
+}   // namespace renderer
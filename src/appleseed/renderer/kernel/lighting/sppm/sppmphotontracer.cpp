@@ -237,7 +237,7 @@ namespace
             OIIOTextureSystem&              oiio_texture_system,
             OSLShadingSystem&               shading_system,
             const SPPMParameters&           params,
-            SPPMPhotonVector&               global_photons,
+            SPPMPhotonVector&               photons,
             const size_t                    photon_begin,
             const size_t                    photon_end,
             const std::uint32_t             pass_hash,
@@ -257,11 +257,11 @@ namespace
                 m_params.m_transparency_threshold,
                 m_params.m_max_iterations,
                 false)
-          , m_global_photons(global_photons)
           , m_photon_begin(photon_begin)
           , m_photon_end(photon_end)
           , m_pass_hash(pass_hash)
           , m_abort_switch(abort_switch)
+          , m_local_photons(photons)
         {
             const Camera* camera = scene.get_render_data().m_active_camera;
             m_shutter_open_begin_time = camera->get_shutter_open_begin_time();
@@ -273,6 +273,9 @@ namespace
             // Initialize thread-local variables.
             Spectrum::set_mode(m_params.m_spectrum_mode);
 
+            // Reuse the memory of the photons stored by this job during the previous pass.
+            m_local_photons.clear_keep_memory();
+
             const ShadingContext shading_context(
                 m_intersector,
                 m_tracer,
@@ -303,7 +306,6 @@ namespace
                 trace_light_photon(shading_context, child_sampling_context, light_sample_s);
             }
 
-            m_global_photons.append(m_local_photons);
         }
 
       private:
@@ -317,12 +319,11 @@ namespace
         OSLShaderGroupExec          m_shadergroup_exec;
         const SPPMParameters        m_params;
         Tracer                      m_tracer;
-        SPPMPhotonVector&           m_global_photons;
         const size_t                m_photon_begin;
         const size_t                m_photon_end;
         const std::uint32_t         m_pass_hash;
         IAbortSwitch&               m_abort_switch;
-        SPPMPhotonVector            m_local_photons;
+        SPPMPhotonVector&           m_local_photons;
         float                       m_shutter_open_begin_time;
         float                       m_shutter_close_end_time;
 
@@ -532,7 +533,7 @@ namespace
             OIIOTextureSystem&          oiio_texture_system,
             OSLShadingSystem&           shading_system,
             const SPPMParameters&       params,
-            SPPMPhotonVector&           global_photons,
+            SPPMPhotonVector&           photons,
             const size_t                photon_begin,
             const size_t                photon_end,
             const std::uint32_t         pass_hash,
@@ -552,11 +553,11 @@ namespace
                 m_params.m_transparency_threshold,
                 m_params.m_max_iterations,
                 false)
-          , m_global_photons(global_photons)
           , m_photon_begin(photon_begin)
           , m_photon_end(photon_end)
           , m_pass_hash(pass_hash)
           , m_abort_switch(abort_switch)
+          , m_local_photons(photons)
         {
             const Scene::RenderData& scene_data = m_scene.get_render_data();
             m_scene_center = Vector3d(scene_data.m_center);
@@ -573,6 +574,9 @@ namespace
             // Initialize thread-local variables.
             Spectrum::set_mode(m_params.m_spectrum_mode);
 
+            // Reuse the memory of the photons stored by this job during the previous pass.
+            m_local_photons.clear_keep_memory();
+
             const ShadingContext shading_context(
                 m_intersector,
                 m_tracer,
@@ -603,7 +607,6 @@ namespace
                 trace_env_photon(shading_context, child_sampling_context, env_edf_s);
             }
 
-            m_global_photons.append(m_local_photons);
         }
 
       private:
@@ -617,12 +620,11 @@ namespace
         OSLShaderGroupExec          m_shadergroup_exec;
         const SPPMParameters        m_params;
         Tracer                      m_tracer;
-        SPPMPhotonVector&           m_global_photons;
         const size_t                m_photon_begin;
         const size_t                m_photon_end;
         const std::uint32_t         m_pass_hash;
         IAbortSwitch&               m_abort_switch;
-        SPPMPhotonVector            m_local_photons;
+        SPPMPhotonVector&           m_local_photons;
         float                       m_shutter_open_begin_time;
         float                       m_shutter_close_end_time;
 
@@ -824,35 +826,47 @@ void SPPMPhotonTracer::trace_photons(
         Transformd::identity(),
         photon_targets);
 
+    // Allocate one photon vector per photon tracing job.
+    const bool trace_light_photons = m_light_sampler.has_lights();
+    const bool trace_env_photons = m_params.m_enable_ibl && m_scene.get_environment()->get_environment_edf();
+    size_t max_job_count = 0;
+    if (trace_light_photons)
+        max_job_count += (m_params.m_light_photon_count + m_params.m_photon_packet_size - 1) / m_params.m_photon_packet_size;
+    if (trace_env_photons)
+        max_job_count += (m_params.m_env_photon_count + m_params.m_photon_packet_size - 1) / m_params.m_photon_packet_size;
+    m_job_photons.resize(max_job_count);
+
     // Schedule photon tracing jobs.
     size_t job_count = 0;
     size_t emitted_photon_count = 0;
-    if (m_light_sampler.has_lights())
+    if (trace_light_photons)
     {
         schedule_light_photon_tracing_jobs(
             photon_targets,
-            photons,
             pass_hash,
             job_queue,
             job_count,
             emitted_photon_count,
             abort_switch);
     }
-    if (m_params.m_enable_ibl && m_scene.get_environment()->get_environment_edf())
+    if (trace_env_photons)
     {
         schedule_environment_photon_tracing_jobs(
             photon_targets,
-            photons,
             pass_hash,
             job_queue,
             job_count,
             emitted_photon_count,
             abort_switch);
     }
+    assert(job_count == max_job_count);
 
     // Wait until the photon tracing jobs have completed.
     job_queue.wait_until_completion();
 
+    // Gather the photons of all jobs, in job order so that the result doesn't depend on thread scheduling.
+    photons.assign_concatenation(m_job_photons, job_queue);
+
     // Update photon tracing statistics.
     m_total_emitted_photon_count += emitted_photon_count;
     m_total_stored_photon_count += photons.size();
@@ -875,7 +889,6 @@ void SPPMPhotonTracer::trace_photons(
 
 void SPPMPhotonTracer::schedule_light_photon_tracing_jobs(
     const LightTargetArray& photon_targets,
-    SPPMPhotonVector&       photons,
     const std::uint32_t     pass_hash,
     JobQueue&               job_queue,
     size_t&                 job_count,
@@ -902,7 +915,7 @@ void SPPMPhotonTracer::schedule_light_photon_tracing_jobs(
                 m_oiio_texture_system,
                 m_shading_system,
                 m_params,
-                photons,
+                m_job_photons[job_count],
                 photon_begin,
                 photon_end,
                 pass_hash,
@@ -915,7 +928,6 @@ void SPPMPhotonTracer::schedule_light_photon_tracing_jobs(
 
 void SPPMPhotonTracer::schedule_environment_photon_tracing_jobs(
     const LightTargetArray& photon_targets,
-    SPPMPhotonVector&       photons,
     const std::uint32_t     pass_hash,
     JobQueue&               job_queue,
     size_t&                 job_count,
@@ -941,7 +953,7 @@ void SPPMPhotonTracer::schedule_environment_photon_tracing_jobs(
                 m_oiio_texture_system,
                 m_shading_system,
                 m_params,
-                photons,
+                m_job_photons[job_count],
                 photon_begin,
                 photon_end,
                 pass_hash,
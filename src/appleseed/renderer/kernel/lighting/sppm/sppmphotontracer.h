@@ -31,6 +31,7 @@
 
 // appleseed.renderer headers.
 #include "renderer/kernel/lighting/sppm/sppmparameters.h"
+#include "renderer/kernel/lighting/sppm/sppmphoton.h"
 
 // appleseed.foundation headers.
 #include "foundation/core/concepts/noncopyable.h"
@@ -38,6 +39,7 @@
 // Standard headers.
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
 // Forward declarations.
 namespace foundation    { class IAbortSwitch; }
@@ -47,7 +49,6 @@ namespace renderer      { class LightTargetArray; }
 namespace renderer      { class OIIOTextureSystem; }
 namespace renderer      { class OSLShadingSystem; }
 namespace renderer      { class Scene; }
-namespace renderer      { class SPPMPhotonVector; }
 namespace renderer      { class TextureStore; }
 namespace renderer      { class TraceContext; }
 
@@ -83,10 +84,10 @@ class SPPMPhotonTracer
     size_t                          m_total_stored_photon_count;
     OIIOTextureSystem&              m_oiio_texture_system;
     OSLShadingSystem&               m_shading_system;
+    std::vector<SPPMPhotonVector>   m_job_photons;              // photons stored by each tracing job, kept from one pass to the next
 
     void schedule_light_photon_tracing_jobs(
         const LightTargetArray&     photon_targets,
-        SPPMPhotonVector&           photons,
         const std::uint32_t         pass_hash,
         foundation::JobQueue&       job_queue,
         size_t&                     job_count,
@@ -95,7 +96,6 @@ class SPPMPhotonTracer
 
     void schedule_environment_photon_tracing_jobs(
         const LightTargetArray&     photon_targets,
-        SPPMPhotonVector&           photons,
         const std::uint32_t         pass_hash,
         foundation::JobQueue&       job_queue,
         size_t&                     job_count,
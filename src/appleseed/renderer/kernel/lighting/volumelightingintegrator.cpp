@@ -544,7 +544,9 @@ void VolumeLightingIntegrator::take_single_direction_sample(
         1,
         m_light_sample_count,
         m_low_light_threshold,
-        m_indirect);
+        m_indirect,
+        0,                          // resampling_candidate_count
+        nullptr);                   // light_reservoir
 
     if (sample_phase_function)
     {
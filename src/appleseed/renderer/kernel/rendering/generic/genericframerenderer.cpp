@@ -56,10 +56,14 @@
 #include "foundation/utility/statistics.h"
 #include "foundation/utility/string.h"
 
+// Boost headers.
+#include "boost/thread/mutex.hpp"
+
 // Standard headers.
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <exception>
 #include <memory>
 #include <string>
 #include <vector>
@@ -105,12 +109,38 @@ namespace
                     global_logger(),
                     m_job_queue,
                     m_params.m_thread_count,
-                    JobManager::KeepRunningOnEmptyQueue));
+                    JobManager::KeepRunningOnEmptyQueue |
+                    (m_params.m_thread_pinning ? JobManager::PinWorkerThreads : 0)));
 
             // Instantiate tile renderers, one per rendering thread.
-            m_tile_renderers.reserve(m_params.m_thread_count);
-            for (size_t i = 0; i < m_params.m_thread_count; ++i)
-                m_tile_renderers.push_back(tile_renderer_factory->create(i));
+            if (m_params.m_thread_pinning)
+            {
+                // Create each tile renderer in the rendering thread that will use it so that
+                // its memory is allocated on the NUMA node of that thread by first touch.
+                m_tile_renderers.assign(m_params.m_thread_count, nullptr);
+                TileRendererCreationJob creation_job(tile_renderer_factory, m_tile_renderers);
+                m_job_manager->start();
+                m_job_manager->execute_on_each_thread(creation_job);
+                m_job_manager->stop();
+
+                // Propagate creation failures to the caller, as when creating renderers in this thread.
+                if (creation_job.has_failed())
+                {
+                    for (auto tile_renderer : m_tile_renderers)
+                    {
+                        if (tile_renderer != nullptr)
+                            tile_renderer->release();
+                    }
+
+                    creation_job.rethrow_failure();
+                }
+            }
+            else
+            {
+                m_tile_renderers.reserve(m_params.m_thread_count);
+                for (size_t i = 0; i < m_params.m_thread_count; ++i)
+                    m_tile_renderers.push_back(tile_renderer_factory->create(i));
+            }
 
             if (tile_callback_factory)
             {
@@ -151,11 +181,13 @@ namespace
                 "  spectrum mode                 %s\n"
                 "  sampling mode                 %s\n"
                 "  rendering threads             %s\n"
+                "  thread pinning                %s\n"
                 "  tile ordering                 %s\n"
                 "  passes                        %s",
                 get_spectrum_mode_name(m_params.m_spectrum_mode).c_str(),
                 get_sampling_context_mode_name(m_params.m_sampling_mode).c_str(),
                 pretty_uint(m_params.m_thread_count).c_str(),
+                m_params.m_thread_pinning ? "on" : "off",
                 m_params.m_tile_ordering == TileJobFactory::TileOrdering::LinearOrdering ? "linear" :
                 m_params.m_tile_ordering == TileJobFactory::TileOrdering::SpiralOrdering ? "spiral" :
                 m_params.m_tile_ordering == TileJobFactory::TileOrdering::HilbertOrdering ? "hilbert" : "random",
@@ -248,6 +280,7 @@ namespace
             const Spectrum::Mode                m_spectrum_mode;
             const SamplingContext::Mode         m_sampling_mode;
             const size_t                        m_thread_count;     // number of rendering threads
+            const bool                          m_thread_pinning;   // pin rendering threads to logical cores?
             const TileJobFactory::TileOrdering  m_tile_ordering;    // tile rendering order
             const size_t                        m_pass_count;       // number of rendering passes
 
@@ -255,6 +288,7 @@ namespace
               : m_spectrum_mode(get_spectrum_mode(params))
               , m_sampling_mode(get_sampling_context_mode(params))
               , m_thread_count(get_rendering_thread_count(params))
+              , m_thread_pinning(get_rendering_thread_pinning(params))
               , m_tile_ordering(get_tile_ordering(params))
               , m_pass_count(params.get_optional<size_t>("passes", 1))
             {
@@ -294,6 +328,55 @@ namespace
             }
         };
 
+        class TileRendererCreationJob
+          : public IJob
+        {
+          public:
+            TileRendererCreationJob(
+                ITileRendererFactory*               tile_renderer_factory,
+                std::vector<ITileRenderer*>&        tile_renderers)
+              : m_tile_renderer_factory(tile_renderer_factory)
+              , m_tile_renderers(tile_renderers)
+            {
+            }
+
+            void execute(const size_t thread_index) override
+            {
+                // Factories are not required to be thread-safe.
+                boost::mutex::scoped_lock lock(m_mutex);
+
+                try
+                {
+                    m_tile_renderers[thread_index] = m_tile_renderer_factory->create(thread_index);
+                }
+                catch (...)
+                {
+                    // Exceptions must not escape worker threads; keep the first one for the caller.
+                    if (!m_exception)
+                        m_exception = std::current_exception();
+                }
+            }
+
+            // Return true if creating any of the tile renderers failed.
+            bool has_failed() const
+            {
+                return static_cast<bool>(m_exception);
+            }
+
+            // Rethrow the exception that made the creation of a tile renderer fail.
+            void rethrow_failure() const
+            {
+                assert(m_exception);
+                std::rethrow_exception(m_exception);
+            }
+
+          private:
+            ITileRendererFactory*                   m_tile_renderer_factory;
+            std::vector<ITileRenderer*>&            m_tile_renderers;
+            boost::mutex                            m_mutex;
+            std::exception_ptr                      m_exception;
+        };
+
         class PassManagerFunc
           : public NonCopyable
         {
@@ -501,6 +584,8 @@ namespace
             for (auto tile_renderer : m_tile_renderers)
                 stats.merge(tile_renderer->get_statistics());
 
+            stats.merge(m_job_manager->get_statistics());
+
             RENDERER_LOG_DEBUG("%s", stats.to_string().c_str());
         }
     };
@@ -374,6 +374,18 @@ struct MasterRenderer::Impl
         // Print render device settings.
         m_render_device->print_settings();
 
+        // Set the number of children per interior node of triangle trees.
+        m_project.set_triangle_tree_node_width(get_triangle_tree_node_width(m_params));
+
+        // Set the precision of triangle intersections.
+        m_project.set_triangle_tree_single_precision(get_triangle_tree_single_precision(m_params));
+
+        // Set the node format of wide triangle trees and curve trees.
+        m_project.set_quantized_bvh_nodes(get_quantized_bvh_nodes(m_params));
+
+        // Set the directory where triangle trees are cached between renders.
+        m_project.set_bvh_cache_directory(get_bvh_cache_directory(m_params).c_str());
+
         // Report whether Embree is used or not.
 #ifdef APPLESEED_WITH_EMBREE
         const bool use_embree = m_params.get_optional<bool>("use_embree", false);
@@ -67,12 +67,14 @@
 
 // Boost headers.
 #include "boost/filesystem.hpp"
+#include "boost/thread/mutex.hpp"
 
 // Standard headers.
 #include <cassert>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <exception>
 #include <limits>
 #include <memory>
 #include <string>
@@ -458,14 +460,40 @@ namespace
                     global_logger(),
                     m_job_queue,
                     m_params.m_thread_count,
-                    JobManager::KeepRunningOnEmptyQueue));
+                    JobManager::KeepRunningOnEmptyQueue |
+                    (m_params.m_thread_pinning ? JobManager::PinWorkerThreads : 0)));
 
             // Instantiate sample generators, one per rendering thread.
-            m_sample_generators.reserve(m_params.m_thread_count);
-            for (size_t i = 0; i < m_params.m_thread_count; ++i)
+            if (m_params.m_thread_pinning)
             {
-                m_sample_generators.push_back(
-                    generator_factory->create(i, m_params.m_thread_count));
+                // Create each sample generator in the rendering thread that will use it so that
+                // its memory is allocated on the NUMA node of that thread by first touch.
+                m_sample_generators.assign(m_params.m_thread_count, nullptr);
+                SampleGeneratorCreationJob creation_job(generator_factory, m_sample_generators);
+                m_job_manager->start();
+                m_job_manager->execute_on_each_thread(creation_job);
+                m_job_manager->stop();
+
+                // Propagate creation failures to the caller, as when creating generators in this thread.
+                if (creation_job.has_failed())
+                {
+                    for (auto sample_generator : m_sample_generators)
+                    {
+                        if (sample_generator != nullptr)
+                            sample_generator->release();
+                    }
+
+                    creation_job.rethrow_failure();
+                }
+            }
+            else
+            {
+                m_sample_generators.reserve(m_params.m_thread_count);
+                for (size_t i = 0; i < m_params.m_thread_count; ++i)
+                {
+                    m_sample_generators.push_back(
+                        generator_factory->create(i, m_params.m_thread_count));
+                }
             }
 
             // Create rendering jobs, one per rendering thread.
@@ -534,6 +562,7 @@ namespace
                 "  spectrum mode                 %s\n"
                 "  sampling mode                 %s\n"
                 "  rendering threads             %s\n"
+                "  thread pinning                %s\n"
                 "  max average samples per pixel %s\n"
                 "  time limit                    %s\n"
                 "  max fps                       %f\n"
@@ -542,6 +571,7 @@ namespace
                 get_spectrum_mode_name(m_params.m_spectrum_mode).c_str(),
                 get_sampling_context_mode_name(m_params.m_sampling_mode).c_str(),
                 pretty_uint(m_params.m_thread_count).c_str(),
+                m_params.m_thread_pinning ? "on" : "off",
                 m_params.m_max_average_spp == std::numeric_limits<std::uint64_t>::max()
                     ? "unlimited"
                     : pretty_uint(m_params.m_max_average_spp).c_str(),
@@ -716,6 +746,7 @@ namespace
             const Spectrum::Mode                    m_spectrum_mode;
             const SamplingContext::Mode             m_sampling_mode;
             const size_t                            m_thread_count;       // number of rendering threads
+            const bool                              m_thread_pinning;     // pin rendering threads to logical cores?
             const std::uint64_t                     m_max_average_spp;    // maximum average number of samples to compute per pixel
             const double                            m_time_limit;         // maximum rendering time in seconds
             const double                            m_max_fps;            // maximum display frequency in frames/second
@@ -727,6 +758,7 @@ namespace
               : m_spectrum_mode(get_spectrum_mode(params))
               , m_sampling_mode(get_sampling_context_mode(params))
               , m_thread_count(get_rendering_thread_count(params))
+              , m_thread_pinning(get_rendering_thread_pinning(params))
               , m_max_average_spp(params.get_optional<std::uint64_t>("max_average_spp", std::numeric_limits<std::uint64_t>::max()))
               , m_time_limit(params.get_optional<double>("time_limit", std::numeric_limits<double>::max()))
               , m_max_fps(params.get_optional<double>("max_fps", 30.0))
@@ -750,6 +782,56 @@ namespace
         using SampleGeneratorVector = std::vector<ISampleGenerator*>;
         using SampleGeneratorJobVector = std::vector<SampleGeneratorJob*>;
 
+        class SampleGeneratorCreationJob
+          : public IJob
+        {
+          public:
+            SampleGeneratorCreationJob(
+                ISampleGeneratorFactory*            generator_factory,
+                SampleGeneratorVector&              sample_generators)
+              : m_generator_factory(generator_factory)
+              , m_sample_generators(sample_generators)
+            {
+            }
+
+            void execute(const size_t thread_index) override
+            {
+                // Factories are not required to be thread-safe.
+                boost::mutex::scoped_lock lock(m_mutex);
+
+                try
+                {
+                    m_sample_generators[thread_index] =
+                        m_generator_factory->create(thread_index, m_sample_generators.size());
+                }
+                catch (...)
+                {
+                    // Exceptions must not escape worker threads; keep the first one for the caller.
+                    if (!m_exception)
+                        m_exception = std::current_exception();
+                }
+            }
+
+            // Return true if creating any of the sample generators failed.
+            bool has_failed() const
+            {
+                return static_cast<bool>(m_exception);
+            }
+
+            // Rethrow the exception that made the creation of a sample generator fail.
+            void rethrow_failure() const
+            {
+                assert(m_exception);
+                std::rethrow_exception(m_exception);
+            }
+
+          private:
+            ISampleGeneratorFactory*                m_generator_factory;
+            SampleGeneratorVector&                  m_sample_generators;
+            boost::mutex                            m_mutex;
+            std::exception_ptr                      m_exception;
+        };
+
         const Project&                              m_project;
         const Parameters                            m_params;
         SampleCounter                               m_sample_counter;
@@ -786,6 +868,8 @@ namespace
             for (auto sample_generator : m_sample_generators)
                 stats.merge(sample_generator->get_statistics());
 
+            stats.merge(m_job_manager->get_statistics());
+
             RENDERER_LOG_DEBUG("%s", stats.to_string().c_str());
         }
     };
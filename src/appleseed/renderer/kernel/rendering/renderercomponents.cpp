@@ -33,7 +33,9 @@
 #include "renderer/global/globallogger.h"
 #include "renderer/kernel/lighting/bdpt/bdptlightingengine.h"
 #include "renderer/kernel/lighting/lighttracing/lighttracingsamplegenerator.h"
+#include "renderer/kernel/lighting/pt/pathguidingpasscallback.h"
 #include "renderer/kernel/lighting/pt/ptlightingengine.h"
+#include "renderer/kernel/lighting/pt/radiancecachepasscallback.h"
 #include "renderer/kernel/lighting/sppm/sppmlightingengine.h"
 #include "renderer/kernel/lighting/sppm/sppmparameters.h"
 #include "renderer/kernel/lighting/sppm/sppmpasscallback.h"
@@ -62,7 +64,10 @@
 #include "foundation/platform/_endoiioheaders.h"
 
 // Standard headers.
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 using namespace foundation;
 using namespace OIIO;
@@ -94,8 +99,58 @@ namespace
         copy_param(child, source, "spectrum_mode");
         copy_param(child, source, "sampling_mode");
         copy_param(child, source, "rendering_threads");
+        copy_param(child, source, "rendering_threads_pinning");
         return child;
     }
+
+    // Pass callback forwarding pass events to several pass callbacks, in order.
+    class PassCallbackList
+      : public IPassCallback
+    {
+      public:
+        ~PassCallbackList() override
+        {
+            for (IPassCallback* pass_callback : m_pass_callbacks)
+                pass_callback->release();
+        }
+
+        void release() override
+        {
+            delete this;
+        }
+
+        bool empty() const
+        {
+            return m_pass_callbacks.empty();
+        }
+
+        // Take ownership of a pass callback.
+        void insert(IPassCallback* pass_callback)
+        {
+            m_pass_callbacks.push_back(pass_callback);
+        }
+
+        void on_pass_begin(
+            const Frame&    frame,
+            JobQueue&       job_queue,
+            IAbortSwitch&   abort_switch) override
+        {
+            for (IPassCallback* pass_callback : m_pass_callbacks)
+                pass_callback->on_pass_begin(frame, job_queue, abort_switch);
+        }
+
+        void on_pass_end(
+            const Frame&    frame,
+            JobQueue&       job_queue,
+            IAbortSwitch&   abort_switch) override
+        {
+            for (IPassCallback* pass_callback : m_pass_callbacks)
+                pass_callback->on_pass_end(frame, job_queue, abort_switch);
+        }
+
+      private:
+        std::vector<IPassCallback*> m_pass_callbacks;
+    };
 }
 
 RendererComponents::RendererComponents(
@@ -187,11 +242,55 @@ bool RendererComponents::create_lighting_engine_factory()
                 m_scene,
                 get_child_and_inherit_globals(m_params, "light_sampler")));
 
+        const ParamArray pt_params = get_child_and_inherit_globals(m_params, "pt");   // todo: change to "pt_lighting_engine"?
+
+        // Path guiding and radiance caching learn from one pass to the next,
+        // using pass callbacks to train the SD-tree and the radiance cache.
+        // The progressive frame renderer has no passes and never invokes them.
+        std::unique_ptr<PassCallbackList> pass_callbacks(new PassCallbackList());
+        const bool has_passes =
+            m_params.get_optional<std::string>("frame_renderer", "generic") != "progressive";
+
+        SDTree* sd_tree = nullptr;
+        if (pt_params.get_optional<bool>("enable_path_guiding", false))
+        {
+            if (has_passes)
+            {
+                PathGuidingPassCallback* path_guiding_pass_callback =
+                    new PathGuidingPassCallback(m_scene, pt_params);
+
+                pass_callbacks->insert(path_guiding_pass_callback);
+
+                sd_tree = &path_guiding_pass_callback->get_sd_tree();
+            }
+            else RENDERER_LOG_WARNING("path guiding is not supported by the progressive frame renderer and was disabled.");
+        }
+
+        RadianceCache* radiance_cache = nullptr;
+        if (pt_params.get_optional<bool>("enable_radiance_cache", false))
+        {
+            if (has_passes)
+            {
+                RadianceCachePassCallback* radiance_cache_pass_callback =
+                    new RadianceCachePassCallback(m_scene, pt_params);
+
+                pass_callbacks->insert(radiance_cache_pass_callback);
+
+                radiance_cache = &radiance_cache_pass_callback->get_radiance_cache();
+            }
+            else RENDERER_LOG_WARNING("radiance caching is not supported by the progressive frame renderer and was disabled.");
+        }
+
+        if (!pass_callbacks->empty())
+            m_pass_callback = std::move(pass_callbacks);
+
         m_lighting_engine_factory.reset(
             new PTLightingEngineFactory(
                 *m_backward_light_sampler,
                 m_project.get_light_path_recorder(),
-                get_child_and_inherit_globals(m_params, "pt")));    // todo: change to "pt_lighting_engine"?
+                sd_tree,
+                radiance_cache,
+                pt_params));
 
         return true;
     }
@@ -59,12 +59,13 @@ class TextureCache
     // Constructor.
     explicit TextureCache(TextureStore& store);
 
-    // Get a tile from the cache.
+    // Get a tile of a given MIP level from the cache.
     foundation::Tile& get(
         const foundation::UniqueID  assembly_uid,
         const foundation::UniqueID  texture_uid,
         const size_t                tile_x,
-        const size_t                tile_y);
+        const size_t                tile_y,
+        const size_t                level = 0);
 
     // Retrieve performance statistics.
     foundation::StatisticsVector get_statistics() const;
@@ -123,9 +124,10 @@ inline foundation::Tile& TextureCache::get(
     const foundation::UniqueID      assembly_uid,
     const foundation::UniqueID      texture_uid,
     const size_t                    tile_x,
-    const size_t                    tile_y)
+    const size_t                    tile_y,
+    const size_t                    level)
 {
-    const TileKey key(assembly_uid, texture_uid, tile_x, tile_y);
+    const TileKey key(assembly_uid, texture_uid, tile_x, tile_y, level);
     return *m_tile_cache.get(key)->m_tile_ptr.get_tile();
 }
 
@@ -38,19 +38,28 @@
 #include "renderer/utility/paramarray.h"
 
 // appleseed.foundation headers.
+#include "foundation/core/concepts/noncopyable.h"
+#include "foundation/image/canvasproperties.h"
 #include "foundation/image/color.h"
 #include "foundation/image/colorspace.h"
 #include "foundation/image/tile.h"
+#include "foundation/platform/defaulttimers.h"
 #include "foundation/platform/types.h"
 #include "foundation/utility/api/apistring.h"
 #include "foundation/utility/containers/dictionary.h"
 #include "foundation/utility/memory.h"
 #include "foundation/utility/statistics.h"
+#include "foundation/utility/stopwatch.h"
 #include "foundation/utility/string.h"
 
 // Standard headers.
 #include <algorithm>
+#include <fstream>
+#include <memory>
+#include <ostream>
 #include <string>
+#include <utility>
+#include <vector>
 
 using namespace foundation;
 
@@ -72,6 +81,14 @@ Dictionary TextureStore::get_params_metadata()
             .insert("label", "Texture Cache Size")
             .insert("help", "Texture cache size in bytes"));
 
+    metadata.dictionaries().insert(
+        "usage_report",
+        Dictionary()
+            .insert("type", "text")
+            .insert("default", "")
+            .insert("label", "Texture Usage Report")
+            .insert("help", "Path of a JSON file to write per-texture usage statistics to at the end of each frame"));
+
     return metadata;
 }
 
@@ -83,18 +100,311 @@ size_t TextureStore::get_default_size()
 TextureStore::TextureStore(
     const Scene&        scene,
     const ParamArray&   params)
-  : m_tile_swapper(scene, params)
-  , m_tile_cache(m_tile_key_hasher, m_tile_swapper)
+  : m_scene(scene)
+  , m_params(params)
+  , m_memory_size(0)
+  , m_peak_memory_size(0)
 {
+    gather_assemblies(scene.assemblies());
+
+    // Each shard gets an equal share of the memory budget.
+    const size_t shard_memory_limit = std::max<size_t>(m_params.m_memory_limit / ShardCount, 1);
+    for (size_t i = 0; i < ShardCount; ++i)
+        m_shards[i].reset(new Shard(*this, shard_memory_limit));
+
+    print_settings();
 }
 
 StatisticsVector TextureStore::get_statistics() const
 {
-    Statistics stats = make_single_stage_cache_stats(m_tile_cache);
-    stats.insert_size("peak size", m_tile_swapper.get_peak_memory_size());
+    Statistics stats = make_single_stage_cache_stats(m_shards[0]->m_tile_cache);
+    for (size_t i = 1; i < ShardCount; ++i)
+        stats.merge(make_single_stage_cache_stats(m_shards[i]->m_tile_cache));
+
+    stats.insert_size("peak size", m_peak_memory_size.load());
     return StatisticsVector::make("texture store statistics", stats);
 }
 
+void TextureStore::print_settings() const
+{
+    RENDERER_LOG_INFO(
+        "texture store settings:\n"
+        "  max store size                %s\n"
+        "  shards                        %s\n"
+        "  track store size              %s\n"
+        "  track tile loading            %s\n"
+        "  track tile unloading          %s\n"
+        "  usage report                  %s",
+        pretty_size(m_params.m_memory_limit).c_str(),
+        pretty_uint(ShardCount).c_str(),
+        m_params.m_track_store_size ? "on" : "off",
+        m_params.m_track_tile_loading ? "on" : "off",
+        m_params.m_track_tile_unloading ? "on" : "off",
+        m_params.m_track_texture_usage ? m_params.m_usage_report_path.c_str() : "off");
+}
+
+namespace
+{
+    void write_json_string(std::ostream& out, const std::string& s)
+    {
+        static const char HexDigits[] = "0123456789abcdef";
+
+        out << '"';
+
+        for (const char c : s)
+        {
+            switch (c)
+            {
+              case '"': out << "\\\""; break;
+              case '\\': out << "\\\\"; break;
+              case '\n': out << "\\n"; break;
+              case '\r': out << "\\r"; break;
+              case '\t': out << "\\t"; break;
+
+              default:
+                {
+                    const unsigned char uc = static_cast<unsigned char>(c);
+                    if (uc < 0x20)
+                        out << "\\u00" << HexDigits[uc >> 4] << HexDigits[uc & 15];
+                    else out << c;
+                }
+                break;
+            }
+        }
+
+        out << '"';
+    }
+}
+
+void TextureStore::write_usage_report() const
+{
+    if (!m_params.m_track_texture_usage)
+        return;
+
+    // Merge the usage recorded by all shards.
+    TextureUsageMap usage;
+    for (size_t i = 0; i < ShardCount; ++i)
+    {
+        boost::mutex::scoped_lock lock(m_shards[i]->m_mutex);
+
+        for (const auto& entry : m_shards[i]->m_texture_usage)
+            usage[entry.first].merge(entry.second);
+    }
+
+    // List the textures by decreasing amount of data loaded.
+    typedef std::pair<TextureID, const TextureUsage*> Entry;
+    std::vector<Entry> entries;
+    entries.reserve(usage.size());
+    for (const auto& entry : usage)
+        entries.emplace_back(entry.first, &entry.second);
+    std::sort(
+        entries.begin(),
+        entries.end(),
+        [](const Entry& lhs, const Entry& rhs)
+        {
+            return lhs.second->m_loaded_bytes > rhs.second->m_loaded_bytes;
+        });
+
+    std::ofstream file(m_params.m_usage_report_path.c_str());
+    if (!file.is_open())
+    {
+        RENDERER_LOG_ERROR(
+            "failed to write texture usage report %s.",
+            m_params.m_usage_report_path.c_str());
+        return;
+    }
+
+    file << "{\n";
+    file << "  \"max_size\": " << m_params.m_memory_limit << ",\n";
+    file << "  \"peak_size\": " << m_peak_memory_size.load() << ",\n";
+    file << "  \"textures\": [";
+
+    for (size_t i = 0, e = entries.size(); i < e; ++i)
+    {
+        const TextureID& id = entries[i].first;
+        const TextureUsage& u = *entries[i].second;
+
+        const Texture* texture = get_texture(TileKey(id.first, id.second, 0, 0));
+        const std::uint64_t request_count = u.m_hit_count + u.m_wait_count + u.m_load_count;
+
+        file << (i > 0 ? ",\n" : "\n") << "    {\n";
+        file << "      \"name\": ";
+        write_json_string(file, texture != nullptr ? texture->get_name() : "");
+        file << ",\n      \"path\": ";
+        write_json_string(file, texture != nullptr ? texture->get_path().c_str() : "");
+        file << ",\n";
+        file << "      \"requests\": " << request_count << ",\n";
+        file << "      \"hits\": " << u.m_hit_count << ",\n";
+        file << "      \"waits\": " << u.m_wait_count << ",\n";
+        file << "      \"loads\": " << u.m_load_count << ",\n";
+        file << "      \"hit_rate\": " << (request_count > 0 ? static_cast<double>(u.m_hit_count) / request_count : 0.0) << ",\n";
+        file << "      \"tiles_touched\": " << u.m_loaded_tiles.size() << ",\n";
+        file << "      \"bytes_loaded\": " << u.m_loaded_bytes << ",\n";
+        file << "      \"load_time\": " << u.m_load_time << ",\n";
+        file << "      \"wait_time\": " << u.m_wait_time << ",\n";
+        file << "      \"mip_level_loads\": [";
+
+        for (size_t level = 0, level_count = u.m_level_load_counts.size(); level < level_count; ++level)
+            file << (level > 0 ? ", " : "") << u.m_level_load_counts[level];
+
+        file << "]\n    }";
+    }
+
+    file << (entries.empty() ? "]\n" : "\n  ]\n") << "}\n";
+    file.close();
+
+    if (file.fail())
+    {
+        RENDERER_LOG_ERROR(
+            "failed to write texture usage report %s: i/o error.",
+            m_params.m_usage_report_path.c_str());
+        return;
+    }
+
+    RENDERER_LOG_INFO(
+        "wrote usage report for %s %s to %s.",
+        pretty_uint(entries.size()).c_str(),
+        plural(entries.size(), "texture").c_str(),
+        m_params.m_usage_report_path.c_str());
+}
+
+void TextureStore::gather_assemblies(const AssemblyContainer& assemblies)
+{
+    for (const Assembly& assembly : assemblies)
+    {
+        m_assemblies[assembly.get_uid()] = &assembly;
+        gather_assemblies(assembly.assemblies());
+    }
+}
+
+Texture* TextureStore::get_texture(const TileKey& key) const
+{
+    // Fetch the texture container.
+    if (key.m_assembly_uid == ~UniqueID(0))
+        return m_scene.textures().get_by_uid(key.m_texture_uid);
+
+    const AssemblyMap::const_iterator i = m_assemblies.find(key.m_assembly_uid);
+    assert(i != m_assemblies.end());
+
+    // Fetch the texture.
+    return i->second->textures().get_by_uid(key.m_texture_uid);
+}
+
+void TextureStore::load_or_wait(const TileKey& key, Shard& shard, TileRecord& record)
+{
+    Stopwatch<DefaultWallclockTimer> stopwatch;
+
+    if (m_params.m_track_texture_usage)
+        stopwatch.start();
+
+    while (atomic_cas(&record.m_state, TileRecord::Unloaded, TileRecord::Loading) != TileRecord::Unloaded)
+    {
+        // Another thread is loading this very tile.
+        std::uint32_t state;
+        while ((state = atomic_read(&record.m_state)) == TileRecord::Loading)
+            yield();
+
+        if (state == TileRecord::Loaded)
+        {
+            if (m_params.m_track_texture_usage)
+            {
+                boost::mutex::scoped_lock lock(shard.m_mutex);
+                TextureUsage& usage = get_texture_usage(shard, key);
+                ++usage.m_wait_count;
+                usage.m_wait_time += stopwatch.measure().get_seconds();
+            }
+
+            return;
+        }
+
+        // The other thread failed to load the tile: try loading it ourselves.
+    }
+
+    // This thread is the first one to need the tile: load it without holding any lock.
+    // The record can't be evicted in the meantime since this thread owns it.
+    try
+    {
+        load_tile(key, record);
+    }
+    catch (...)
+    {
+        // Leave the record unloaded so that waiting threads can retry, and give up ownership.
+        if (record.m_tile_ptr.has_ownership())
+            delete record.m_tile_ptr.get_tile();
+        record.m_tile_ptr = TilePtr::make_non_owning(nullptr);
+        atomic_write(&record.m_state, TileRecord::Unloaded);
+        release(record);
+        throw;
+    }
+
+    {
+        boost::mutex::scoped_lock lock(shard.m_mutex);
+        shard.m_tile_swapper.on_tile_loaded(record);
+
+        if (m_params.m_track_texture_usage)
+        {
+            const size_t level = key.get_level();
+            TextureUsage& usage = get_texture_usage(shard, key);
+            ++usage.m_load_count;
+            usage.m_loaded_bytes += record.m_tile_ptr.get_tile()->get_memory_size();
+            usage.m_load_time += stopwatch.measure().get_seconds();
+            if (usage.m_level_load_counts.size() <= level)
+                usage.m_level_load_counts.resize(level + 1, 0);
+            ++usage.m_level_load_counts[level];
+            usage.m_loaded_tiles.insert((static_cast<std::uint64_t>(key.m_level) << 32) | key.m_tile_xy);
+        }
+    }
+
+    atomic_write(&record.m_state, TileRecord::Loaded);
+}
+
+void TextureStore::add_memory_size(const size_t size)
+{
+    const size_t memory_size = m_memory_size.fetch_add(size) + size;
+
+    size_t peak_memory_size = m_peak_memory_size.load();
+    while (memory_size > peak_memory_size &&
+           !m_peak_memory_size.compare_exchange_weak(peak_memory_size, memory_size)) ;
+
+    if (m_params.m_track_store_size)
+    {
+        if (memory_size > m_params.m_memory_limit)
+        {
+            RENDERER_LOG_DEBUG(
+                "texture store size is %s, exceeding capacity %s by %s.",
+                pretty_size(memory_size).c_str(),
+                pretty_size(m_params.m_memory_limit).c_str(),
+                pretty_size(memory_size - m_params.m_memory_limit).c_str());
+        }
+        else
+        {
+            RENDERER_LOG_DEBUG(
+                "texture store size is %s, below capacity %s by %s.",
+                pretty_size(memory_size).c_str(),
+                pretty_size(m_params.m_memory_limit).c_str(),
+                pretty_size(m_params.m_memory_limit - memory_size).c_str());
+        }
+    }
+}
+
+void TextureStore::remove_memory_size(const size_t size)
+{
+    assert(m_memory_size.load() >= size);
+    m_memory_size.fetch_sub(size);
+}
+
+TextureStore::TextureUsage& TextureStore::get_texture_usage(Shard& shard, const TileKey& key)
+{
+    return shard.m_texture_usage[TextureID(key.m_assembly_uid, key.m_texture_uid)];
+}
+
+void TextureStore::record_hit(Shard& shard, const TileKey& key)
+{
+    ++get_texture_usage(shard, key).m_hit_count;
+}
+
+APPLESEED_TLS std::uint64_t TextureStore::s_thread_request_count = 0;
+
 
 //
 // TextureStore::TileSwapper class implementation.
@@ -159,100 +469,280 @@ namespace
             }
         }
     }
-}
 
-TextureStore::TileSwapper::TileSwapper(
-    const Scene&        scene,
-    const ParamArray&   params)
-  : m_scene(scene)
-  , m_params(params)
-  , m_memory_size(0)
-  , m_peak_memory_size(0)
-{
-    gather_assemblies(scene.assemblies());
-    print_settings();
-}
+    // Own the tiles of a stored MIP level loaded to build a tile of the next level.
+    struct StoredTileBlock
+      : public NonCopyable
+    {
+        TilePtr m_tiles[2][2];
 
-void TextureStore::TileSwapper::print_settings() const
-{
-    RENDERER_LOG_INFO(
-        "texture store settings:\n"
-        "  max store size                %s\n"
-        "  track store size              %s\n"
-        "  track tile loading            %s\n"
-        "  track tile unloading          %s",
-        pretty_size(m_params.m_memory_limit).c_str(),
-        m_params.m_track_store_size ? "on" : "off",
-        m_params.m_track_tile_loading ? "on" : "off",
-        m_params.m_track_tile_unloading ? "on" : "off");
+        StoredTileBlock()
+        {
+            for (size_t j = 0; j < 2; ++j)
+            {
+                for (size_t i = 0; i < 2; ++i)
+                    m_tiles[j][i] = TilePtr::make_non_owning(nullptr);
+            }
+        }
+
+        ~StoredTileBlock()
+        {
+            for (size_t j = 0; j < 2; ++j)
+            {
+                for (size_t i = 0; i < 2; ++i)
+                {
+                    if (m_tiles[j][i].has_ownership())
+                        delete m_tiles[j][i].get_tile();
+                }
+            }
+        }
+    };
 }
 
-void TextureStore::TileSwapper::load(const TileKey& key, TileRecord& record)
+void TextureStore::load_tile(const TileKey& key, TileRecord& record)
 {
-    // Fetch the texture container.
-    const TextureContainer& textures =
-        key.m_assembly_uid == ~UniqueID(0)
-            ? m_scene.textures()
-            : m_assemblies[key.m_assembly_uid]->textures();
-
     // Fetch the texture.
-    Texture* texture = textures.get_by_uid(key.m_texture_uid);
+    Texture* texture = get_texture(key);
     assert(texture != nullptr);
 
     if (m_params.m_track_tile_loading)
     {
         RENDERER_LOG_DEBUG(
-            "loading tile (" FMT_SIZE_T ", " FMT_SIZE_T ") "
+            "loading tile (" FMT_SIZE_T ", " FMT_SIZE_T ") of level " FMT_SIZE_T " "
             "from texture \"%s\"...",
             key.get_tile_x(),
             key.get_tile_y(),
+            key.get_level(),
             texture->get_path().c_str());
     }
 
+    // Tiles of MIP levels the texture doesn't store are owned by the texture's MIP pyramid.
+    if (key.get_level() >= texture->get_stored_mip_level_count())
+    {
+        record.m_tile_ptr = TilePtr::make_non_owning(get_mip_tile(key, *texture));
+        return;
+    }
+
+    record.m_tile_ptr = load_stored_tile(*texture, key.get_level(), key.get_tile_x(), key.get_tile_y());
+}
+
+TilePtr TextureStore::load_stored_tile(
+    Texture&            texture,
+    const size_t        level,
+    const size_t        tile_x,
+    const size_t        tile_y)
+{
     // Load the tile.
-    record.m_tile_ptr = texture->load_tile(key.get_tile_x(), key.get_tile_y());
-    record.m_owners = 0;
+    TilePtr tile_ptr = texture.load_mip_tile(level, tile_x, tile_y);
 
     // Convert the tile to the linear RGB color space.
-    switch (texture->get_color_space())
+    switch (texture.get_color_space())
     {
       case ColorSpaceLinearRGB:
         break;
 
       case ColorSpaceSRGB:
-        convert_tile_srgb_to_linear_rgb(*record.m_tile_ptr.get_tile());
+        convert_tile_srgb_to_linear_rgb(*tile_ptr.get_tile());
         break;
 
       case ColorSpaceCIEXYZ:
-        convert_tile_ciexyz_to_linear_rgb(*record.m_tile_ptr.get_tile());
+        convert_tile_ciexyz_to_linear_rgb(*tile_ptr.get_tile());
         break;
 
       assert_otherwise;
     }
 
-    // Track the amount of memory used by the tile cache.
-    m_memory_size += record.m_tile_ptr.get_tile()->get_memory_size();
-    m_peak_memory_size = std::max(m_peak_memory_size, m_memory_size);
+    return tile_ptr;
+}
+
+Tile* TextureStore::get_mip_tile(const TileKey& key, Texture& texture)
+{
+    MipPyramid* pyramid;
 
-    if (m_params.m_track_store_size)
     {
-        if (m_memory_size > m_params.m_memory_limit)
+        boost::mutex::scoped_lock lock(m_mip_pyramids_mutex);
+        std::unique_ptr<MipPyramid>& entry = m_mip_pyramids[TextureID(key.m_assembly_uid, key.m_texture_uid)];
+        if (!entry)
+            entry.reset(new MipPyramid());
+        pyramid = entry.get();
+    }
+
+    // Threads that need a level of this texture wait for the one building the pyramid.
+    // Once built, the pyramid is never modified again and can be read without the lock.
+    {
+        boost::mutex::scoped_lock lock(pyramid->m_mutex);
+        if (pyramid->m_levels.empty())
+            build_mip_pyramid(texture, pyramid->m_levels);
+    }
+
+    const size_t first_level = texture.get_stored_mip_level_count();
+    const size_t level = key.get_level();
+    assert(level >= first_level);
+    assert(level - first_level < pyramid->m_levels.size());
+
+    const CanvasProperties props = texture.properties().get_mip_level(level);
+    assert(key.get_tile_x() < props.m_tile_count_x);
+    assert(key.get_tile_y() < props.m_tile_count_y);
+
+    return pyramid->m_levels[level - first_level][key.get_tile_y() * props.m_tile_count_x + key.get_tile_x()].get();
+}
+
+void TextureStore::build_mip_pyramid(Texture& texture, MipLevelVector& levels)
+{
+    const CanvasProperties& base_props = texture.properties();
+    const size_t level_count = base_props.get_mip_level_count();
+    const size_t first_level = texture.get_stored_mip_level_count();
+    assert(first_level > 0);
+    assert(first_level < level_count);
+
+    // Build the levels into a local vector so that the pyramid stays empty if loading fails.
+    MipLevelVector built_levels(level_count - first_level);
+
+    for (size_t level = first_level; level < level_count; ++level)
+    {
+        const CanvasProperties props = base_props.get_mip_level(level);
+        const CanvasProperties fine_props = base_props.get_mip_level(level - 1);
+
+        std::vector<std::unique_ptr<Tile>>& tiles = built_levels[level - first_level];
+        tiles.resize(props.m_tile_count_x * props.m_tile_count_y);
+
+        for (size_t tile_y = 0; tile_y < props.m_tile_count_y; ++tile_y)
         {
-            RENDERER_LOG_DEBUG(
-                "texture store size is %s, exceeding capacity %s by %s.",
-                pretty_size(m_memory_size).c_str(),
-                pretty_size(m_params.m_memory_limit).c_str(),
-                pretty_size(m_memory_size - m_params.m_memory_limit).c_str());
+            for (size_t tile_x = 0; tile_x < props.m_tile_count_x; ++tile_x)
+            {
+                // Since tiles have the same size at all levels, this tile covers a block of at
+                // most 2x2 tiles of the finer level that no other tile of this level covers:
+                // tiles of the last stored level are only ever loaded once, here.
+                StoredTileBlock stored_tiles;
+                const Tile* fine_tiles[2][2] = { { nullptr, nullptr }, { nullptr, nullptr } };
+                const size_t fine_tile_x_end = std::min(2 * tile_x + 2, fine_props.m_tile_count_x);
+                const size_t fine_tile_y_end = std::min(2 * tile_y + 2, fine_props.m_tile_count_y);
+
+                for (size_t fty = 2 * tile_y; fty < fine_tile_y_end; ++fty)
+                {
+                    for (size_t ftx = 2 * tile_x; ftx < fine_tile_x_end; ++ftx)
+                    {
+                        const size_t j = fty - 2 * tile_y;
+                        const size_t i = ftx - 2 * tile_x;
+
+                        if (level == first_level)
+                        {
+                            stored_tiles.m_tiles[j][i] = load_stored_tile(texture, level - 1, ftx, fty);
+                            fine_tiles[j][i] = stored_tiles.m_tiles[j][i].get_tile();
+                        }
+                        else
+                        {
+                            fine_tiles[j][i] =
+                                built_levels[level - 1 - first_level][fty * fine_props.m_tile_count_x + ftx].get();
+                        }
+                    }
+                }
+
+                tiles[tile_y * props.m_tile_count_x + tile_x].reset(
+                    downsample_tiles(props, fine_props, tile_x, tile_y, fine_tiles));
+            }
         }
-        else
+    }
+
+    levels = std::move(built_levels);
+}
+
+Tile* TextureStore::downsample_tiles(
+    const CanvasProperties&     props,
+    const CanvasProperties&     fine_props,
+    const size_t                tile_x,
+    const size_t                tile_y,
+    const Tile*                 fine_tiles[2][2])
+{
+    const size_t channel_count = props.m_channel_count;
+
+    assert(tile_x < props.m_tile_count_x);
+    assert(tile_y < props.m_tile_count_y);
+    assert(fine_tiles[0][0] != nullptr);
+
+    Tile* tile =
+        new Tile(
+            props.get_tile_width(tile_x),
+            props.get_tile_height(tile_y),
+            channel_count,
+            fine_tiles[0][0]->get_pixel_format());
+
+    std::vector<float> sum(channel_count);
+    std::vector<float> texel(channel_count);
+
+    for (size_t y = 0; y < tile->get_height(); ++y)
+    {
+        const size_t iy = tile_y * props.m_tile_height + y;
+        const size_t fine_y[2] =
         {
-            RENDERER_LOG_DEBUG(
-                "texture store size is %s, below capacity %s by %s.",
-                pretty_size(m_memory_size).c_str(),
-                pretty_size(m_params.m_memory_limit).c_str(),
-                pretty_size(m_params.m_memory_limit - m_memory_size).c_str());
+            std::min(2 * iy + 0, fine_props.m_canvas_height - 1),
+            std::min(2 * iy + 1, fine_props.m_canvas_height - 1)
+        };
+
+        for (size_t x = 0; x < tile->get_width(); ++x)
+        {
+            const size_t ix = tile_x * props.m_tile_width + x;
+            const size_t fine_x[2] =
+            {
+                std::min(2 * ix + 0, fine_props.m_canvas_width - 1),
+                std::min(2 * ix + 1, fine_props.m_canvas_width - 1)
+            };
+
+            std::fill(sum.begin(), sum.end(), 0.0f);
+
+            for (size_t j = 0; j < 2; ++j)
+            {
+                const size_t fty = fine_y[j] / fine_props.m_tile_height;
+
+                for (size_t i = 0; i < 2; ++i)
+                {
+                    const size_t ftx = fine_x[i] / fine_props.m_tile_width;
+                    const Tile& fine_tile = *fine_tiles[fty - 2 * tile_y][ftx - 2 * tile_x];
+
+                    fine_tile.get_pixel(
+                        fine_x[i] - ftx * fine_props.m_tile_width,
+                        fine_y[j] - fty * fine_props.m_tile_height,
+                        &texel[0],
+                        channel_count);
+
+                    for (size_t c = 0; c < channel_count; ++c)
+                        sum[c] += texel[c];
+                }
+            }
+
+            for (size_t c = 0; c < channel_count; ++c)
+                sum[c] *= 0.25f;
+
+            tile->set_pixel(x, y, &sum[0], channel_count);
         }
     }
+
+    return tile;
+}
+
+TextureStore::TileSwapper::TileSwapper(
+    TextureStore&       store,
+    const size_t        memory_limit)
+  : m_store(store)
+  , m_memory_limit(memory_limit)
+  , m_memory_size(0)
+{
+}
+
+void TextureStore::TileSwapper::load(const TileKey& key, TileRecord& record)
+{
+    // The tile is read later, outside of the shard lock.
+    record.m_tile_ptr = TilePtr::make_non_owning(nullptr);
+    record.m_owners = 0;
+    record.m_state = TileRecord::Unloaded;
+}
+
+void TextureStore::TileSwapper::on_tile_loaded(const TileRecord& record)
+{
+    // Track the amount of memory used by the tile cache.
+    const size_t tile_memory_size = record.m_tile_ptr.get_tile()->get_memory_size();
+    m_memory_size += tile_memory_size;
+    m_store.add_memory_size(tile_memory_size);
 }
 
 bool TextureStore::TileSwapper::unload(const TileKey& key, TileRecord& record)
@@ -261,38 +751,41 @@ bool TextureStore::TileSwapper::unload(const TileKey& key, TileRecord& record)
     if (atomic_read(&record.m_owners) > 0)
         return false;
 
+    // Records of tiles that failed to load hold no tile.
+    if (atomic_read(&record.m_state) == TileRecord::Unloaded)
+        return true;
+
+    assert(atomic_read(&record.m_state) == TileRecord::Loaded);
+
     // Track the amount of memory used by the tile cache.
     const size_t tile_memory_size = record.m_tile_ptr.get_tile()->get_memory_size();
     assert(m_memory_size >= tile_memory_size);
     m_memory_size -= tile_memory_size;
+    m_store.remove_memory_size(tile_memory_size);
 
-    if (m_params.m_track_tile_unloading)
+    if (m_store.m_params.m_track_tile_unloading)
     {
-        // Fetch the texture container.
-        const TextureContainer& textures =
-            key.m_assembly_uid == ~UniqueID(0)
-            ? m_scene.textures()
-            : m_assemblies[key.m_assembly_uid]->textures();
-
         // Fetch the texture.
-        Texture* texture = textures.get_by_uid(key.m_texture_uid);
+        const Texture* texture = m_store.get_texture(key);
 
         if (texture != nullptr)
         {
             RENDERER_LOG_DEBUG(
-                "unloading tile (" FMT_SIZE_T ", " FMT_SIZE_T ") "
+                "unloading tile (" FMT_SIZE_T ", " FMT_SIZE_T ") of level " FMT_SIZE_T " "
                 "from texture \"%s\"...",
                 key.get_tile_x(),
                 key.get_tile_y(),
+                key.get_level(),
                 texture->get_path().c_str());
         }
         else
         {
             RENDERER_LOG_DEBUG(
-                "unloading tile (" FMT_SIZE_T ", " FMT_SIZE_T ") "
+                "unloading tile (" FMT_SIZE_T ", " FMT_SIZE_T ") of level " FMT_SIZE_T " "
                 "from defunct texture...",
                 key.get_tile_x(),
-                key.get_tile_y());
+                key.get_tile_y(),
+                key.get_level());
         }
     }
 
@@ -304,25 +797,77 @@ bool TextureStore::TileSwapper::unload(const TileKey& key, TileRecord& record)
     return true;
 }
 
-void TextureStore::TileSwapper::gather_assemblies(const AssemblyContainer& assemblies)
+
+//
+// TextureStore::Shard class implementation.
+//
+
+TextureStore::Shard::Shard(
+    TextureStore&       store,
+    const size_t        memory_limit)
+  : m_tile_swapper(store, memory_limit)
+  , m_tile_cache(store.m_tile_key_hasher, m_tile_swapper)
 {
-    for (const Assembly& assembly : assemblies)
-    {
-        m_assemblies[assembly.get_uid()] = &assembly;
-        gather_assemblies(assembly.assemblies());
-    }
 }
 
 
 //
-// TextureStore::TileSwapper::Parameters class implementation.
+// TextureStore::MipPyramid class implementation.
+//
+
+TextureStore::MipPyramid::MipPyramid()
+{
+}
+
+TextureStore::MipPyramid::~MipPyramid()
+{
+}
+
+
+//
+// TextureStore::TextureUsage class implementation.
+//
+
+TextureStore::TextureUsage::TextureUsage()
+  : m_hit_count(0)
+  , m_wait_count(0)
+  , m_load_count(0)
+  , m_loaded_bytes(0)
+  , m_load_time(0.0)
+  , m_wait_time(0.0)
+{
+}
+
+void TextureStore::TextureUsage::merge(const TextureUsage& rhs)
+{
+    m_hit_count += rhs.m_hit_count;
+    m_wait_count += rhs.m_wait_count;
+    m_load_count += rhs.m_load_count;
+    m_loaded_bytes += rhs.m_loaded_bytes;
+    m_load_time += rhs.m_load_time;
+    m_wait_time += rhs.m_wait_time;
+
+    if (m_level_load_counts.size() < rhs.m_level_load_counts.size())
+        m_level_load_counts.resize(rhs.m_level_load_counts.size(), 0);
+
+    for (size_t i = 0, e = rhs.m_level_load_counts.size(); i < e; ++i)
+        m_level_load_counts[i] += rhs.m_level_load_counts[i];
+
+    m_loaded_tiles.insert(rhs.m_loaded_tiles.begin(), rhs.m_loaded_tiles.end());
+}
+
+
+//
+// TextureStore::Parameters class implementation.
 //
 
-TextureStore::TileSwapper::Parameters::Parameters(const ParamArray& params)
+TextureStore::Parameters::Parameters(const ParamArray& params)
   : m_memory_limit(params.get_optional<size_t>("max_size", TextureStore::get_default_size()))
   , m_track_tile_loading(params.get_optional<bool>("track_tile_loading", false))
   , m_track_tile_unloading(params.get_optional<bool>("track_tile_unloading", false))
   , m_track_store_size(params.get_optional<bool>("track_store_size", false))
+  , m_usage_report_path(params.get_optional<std::string>("usage_report", ""))
+  , m_track_texture_usage(!m_usage_report_path.empty())
 {
     assert(m_memory_limit > 0);
 }
@@ -37,21 +37,33 @@
 #include "foundation/core/concepts/noncopyable.h"
 #include "foundation/math/hash.h"
 #include "foundation/platform/atomic.h"
+#include "foundation/platform/compiler.h"
 #include "foundation/platform/thread.h"
 #include "foundation/utility/cache.h"
 #include "foundation/utility/uid.h"
 
+// Boost headers.
+#include "boost/atomic/atomic.hpp"
+
 // Standard headers.
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
 #include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
 
 // Forward declarations.
+namespace foundation    { class CanvasProperties; }
 namespace foundation    { class Dictionary; }
 namespace foundation    { class StatisticsVector; }
+namespace foundation    { class Tile; }
 namespace renderer      { class ParamArray; }
 namespace renderer      { class Scene; }
+namespace renderer      { class Texture; }
 
 namespace renderer
 {
@@ -59,6 +71,21 @@ namespace renderer
 //
 // A shared store for texture tiles (the backend of the thread-local texture cache).
 //
+// Tiles are spread over a fixed number of shards according to the hash of their key.
+// Each shard has its own lock and its own share of the memory budget. Locks are only
+// held to look up and update the LRU caches: tiles are read and converted outside of
+// any lock, and a thread that needs a tile being loaded by another thread only waits
+// for that tile.
+//
+// MIP levels that a texture doesn't store itself are all built the first time one of
+// them is needed, each level from the one below it. Tiles of the last stored level are
+// read once for that purpose, without going through the cache. Built levels are kept
+// until the store is destroyed, and the cache refers to their tiles without owning them.
+//
+// When a usage report is requested, the store also records, for each texture, how
+// many of its tiles were requested, loaded and waited for, how long loading took and
+// which MIP levels were used, and writes it all as JSON at the end of each frame.
+//
 
 class TextureStore
   : public foundation::NonCopyable
@@ -70,6 +97,7 @@ class TextureStore
         foundation::UniqueID    m_assembly_uid;
         foundation::UniqueID    m_texture_uid;
         std::uint32_t           m_tile_xy;
+        std::uint32_t           m_level;                // MIP level, 0 is the full resolution texture
 
         TileKey();
 
@@ -77,17 +105,14 @@ class TextureStore
             const foundation::UniqueID  assembly_uid,
             const foundation::UniqueID  texture_uid,
             const size_t                tile_x,
-            const size_t                tile_y);
-
-        TileKey(
-            const foundation::UniqueID  assembly_uid,
-            const foundation::UniqueID  texture_uid,
-            const std::uint32_t         tile_xy);
+            const size_t                tile_y,
+            const size_t                level = 0);
 
         TileKey(const TileKey& rhs);
 
         size_t get_tile_x() const;
         size_t get_tile_y() const;
+        size_t get_level() const;
 
         // Return an invalid key.
         static TileKey invalid();
@@ -105,8 +130,16 @@ class TextureStore
 
     struct TileRecord
     {
+        enum State
+        {
+            Unloaded,
+            Loading,
+            Loaded
+        };
+
         TilePtr                 m_tile_ptr;
         volatile std::uint32_t  m_owners;
+        volatile std::uint32_t  m_state;                // one of State, the tile may only be used once Loaded
     };
 
     // Return parameters metadata.
@@ -120,7 +153,8 @@ class TextureStore
         const Scene&        scene,
         const ParamArray&   params = ParamArray());
 
-    // Acquire an element from the store. Thread-safe.
+    // Acquire an element from the store. The tile is loaded if necessary. Thread-safe.
+    // If loading the tile throws, the exception is propagated and the element is not acquired.
     TileRecord& acquire(const TileKey& key);
 
     // Release a previously-acquired element. Thread-safe.
@@ -129,20 +163,36 @@ class TextureStore
     // Retrieve performance statistics.
     foundation::StatisticsVector get_statistics() const;
 
+    // Write the per-texture usage report, if one was requested. Thread-safe.
+    void write_usage_report() const;
+
+    // Return the number of tiles the calling thread has requested from any store so far,
+    // that is, the number of misses of its texture cache.
+    static std::uint64_t get_thread_request_count();
+
   private:
+    struct Parameters
+    {
+        const size_t        m_memory_limit;
+        const bool          m_track_tile_loading;
+        const bool          m_track_tile_unloading;
+        const bool          m_track_store_size;
+        const std::string   m_usage_report_path;
+        const bool          m_track_texture_usage;
+
+        explicit Parameters(const ParamArray& params);
+    };
+
     class TileSwapper
       : public foundation::NonCopyable
     {
       public:
         // Constructor.
         TileSwapper(
-            const Scene&        scene,
-            const ParamArray&   params);
-
-        // Print tile swapper's settings.
-        void print_settings() const;
+            TextureStore&       store,
+            const size_t        memory_limit);
 
-        // Load a cache line.
+        // Prepare a cache line; the tile itself is loaded by TextureStore::load_tile().
         void load(const TileKey& key, TileRecord& record);
 
         // Unload a cache line.
@@ -151,29 +201,13 @@ class TextureStore
         // Return true if the cache is full, false otherwise.
         bool is_full(const size_t element_count) const;
 
-        // Return the peak memory size in bytes of the tile cache.
-        size_t get_peak_memory_size() const;
+        // Account for a tile that just finished loading.
+        void on_tile_loaded(const TileRecord& record);
 
       private:
-        struct Parameters
-        {
-            const size_t    m_memory_limit;
-            const bool      m_track_tile_loading;
-            const bool      m_track_tile_unloading;
-            const bool      m_track_store_size;
-
-            explicit Parameters(const ParamArray& params);
-        };
-
-        typedef std::map<foundation::UniqueID, const Assembly*> AssemblyMap;
-
-        const Scene&        m_scene;
-        const Parameters    m_params;
+        TextureStore&       m_store;
+        const size_t        m_memory_limit;
         size_t              m_memory_size;
-        size_t              m_peak_memory_size;
-        AssemblyMap         m_assemblies;
-
-        void gather_assemblies(const AssemblyContainer& assemblies);
     };
 
     typedef foundation::LRUCache<
@@ -183,10 +217,113 @@ class TextureStore
         TileSwapper
     > TileCache;
 
-    boost::mutex            m_mutex;
-    TileKeyHasher           m_tile_key_hasher;
-    TileSwapper             m_tile_swapper;
-    TileCache               m_tile_cache;
+    // Usage of a single texture. Misses of the store are either loads or waits.
+    struct TextureUsage
+    {
+        std::uint64_t               m_hit_count;            // requests for tiles that were already loaded
+        std::uint64_t               m_wait_count;           // requests for tiles that another thread was loading
+        std::uint64_t               m_load_count;           // tiles loaded or built, including reloads
+        std::uint64_t               m_loaded_bytes;
+        double                      m_load_time;            // in seconds, includes building MIP levels
+        double                      m_wait_time;            // in seconds
+        std::vector<std::uint64_t>  m_level_load_counts;    // number of tiles loaded at each MIP level
+        std::set<std::uint64_t>     m_loaded_tiles;         // MIP level and coordinates of the distinct tiles loaded
+
+        TextureUsage();
+
+        void merge(const TextureUsage& rhs);
+    };
+
+    // Textures are identified by the UIDs of their assembly and of themselves.
+    typedef std::pair<foundation::UniqueID, foundation::UniqueID> TextureID;
+    typedef std::map<TextureID, TextureUsage> TextureUsageMap;
+
+    struct Shard
+      : public foundation::NonCopyable
+    {
+        boost::mutex        m_mutex;
+        TileSwapper         m_tile_swapper;
+        TileCache           m_tile_cache;
+        TextureUsageMap     m_texture_usage;        // only filled when tracking texture usage
+
+        Shard(
+            TextureStore&       store,
+            const size_t        memory_limit);
+    };
+
+    enum { ShardCount = 32 };
+
+    // Tiles of each MIP level past the last one stored by a texture, row by row.
+    typedef std::vector<std::vector<std::unique_ptr<foundation::Tile>>> MipLevelVector;
+
+    struct MipPyramid
+      : public foundation::NonCopyable
+    {
+        boost::mutex        m_mutex;
+        MipLevelVector      m_levels;               // empty until built
+
+        MipPyramid();
+        ~MipPyramid();
+    };
+
+    typedef std::map<TextureID, std::unique_ptr<MipPyramid>> MipPyramidMap;
+
+    typedef std::map<foundation::UniqueID, const Assembly*> AssemblyMap;
+
+    const Scene&                m_scene;
+    const Parameters            m_params;
+    AssemblyMap                 m_assemblies;
+    TileKeyHasher               m_tile_key_hasher;
+    boost::atomic<size_t>       m_memory_size;
+    boost::atomic<size_t>       m_peak_memory_size;
+    std::unique_ptr<Shard>      m_shards[ShardCount];
+    boost::mutex                m_mip_pyramids_mutex;
+    MipPyramidMap               m_mip_pyramids;
+
+    void print_settings() const;
+
+    void gather_assemblies(const AssemblyContainer& assemblies);
+
+    Shard& get_shard(const TileKey& key);
+
+    Texture* get_texture(const TileKey& key) const;
+
+    // Load the tile of a record acquired by this thread, or wait until another thread has loaded it.
+    // If loading fails, the record is left unloaded, released, and the exception is rethrown.
+    void load_or_wait(const TileKey& key, Shard& shard, TileRecord& record);
+
+    // Read a tile and convert it to the linear RGB color space, or fetch it from the texture's MIP pyramid.
+    void load_tile(const TileKey& key, TileRecord& record);
+
+    // Read a tile of a MIP level stored by a texture and convert it to the linear RGB color space.
+    static TilePtr load_stored_tile(
+        Texture&                                texture,
+        const size_t                            level,
+        const size_t                            tile_x,
+        const size_t                            tile_y);
+
+    // Return a tile of a MIP level that the texture doesn't store, building the texture's MIP pyramid if necessary.
+    foundation::Tile* get_mip_tile(const TileKey& key, Texture& texture);
+
+    // Build all the MIP levels that a texture doesn't store. Throws if a stored tile can't be read.
+    static void build_mip_pyramid(Texture& texture, MipLevelVector& levels);
+
+    // Build a tile by averaging 2x2 blocks of pixels of the (at most) 2x2 tiles of the next finer level it covers.
+    static foundation::Tile* downsample_tiles(
+        const foundation::CanvasProperties&     props,
+        const foundation::CanvasProperties&     fine_props,
+        const size_t                            tile_x,
+        const size_t                            tile_y,
+        const foundation::Tile*                 fine_tiles[2][2]);
+
+    void add_memory_size(const size_t size);
+    void remove_memory_size(const size_t size);
+
+    // Record texture usage. The shard's lock must be held.
+    static TextureUsage& get_texture_usage(Shard& shard, const TileKey& key);
+    static void record_hit(Shard& shard, const TileKey& key);
+
+    static APPLESEED_TLS std::uint64_t s_thread_request_count;
 };
 
 
@@ -196,12 +333,25 @@ class TextureStore
 
 inline TextureStore::TileRecord& TextureStore::acquire(const TileKey& key)
 {
-    boost::mutex::scoped_lock lock(m_mutex);
+    ++s_thread_request_count;
+
+    Shard& shard = get_shard(key);
+    TileRecord* record;
+
+    {
+        boost::mutex::scoped_lock lock(shard.m_mutex);
+        record = &shard.m_tile_cache.get(key);
+        foundation::atomic_inc(&record->m_owners);
+
+        if (m_params.m_track_texture_usage &&
+            foundation::atomic_read(&record->m_state) == TileRecord::Loaded)
+            record_hit(shard, key);
+    }
 
-    TileRecord& record = m_tile_cache.get(key);
-    foundation::atomic_inc(&record.m_owners);
+    if (foundation::atomic_read(&record->m_state) != TileRecord::Loaded)
+        load_or_wait(key, shard, *record);
 
-    return record;
+    return *record;
 }
 
 inline void TextureStore::release(TileRecord& record) const
@@ -210,6 +360,17 @@ inline void TextureStore::release(TileRecord& record) const
     foundation::atomic_dec(&record.m_owners);
 }
 
+inline std::uint64_t TextureStore::get_thread_request_count()
+{
+    return s_thread_request_count;
+}
+
+inline TextureStore::Shard& TextureStore::get_shard(const TileKey& key)
+{
+    // Don't use the lowest bits, they also pick the buckets of the shard's index.
+    return *m_shards[(m_tile_key_hasher(key) >> 16) % ShardCount];
+}
+
 
 //
 // TextureStore::TileKey class implementation.
@@ -223,29 +384,22 @@ inline TextureStore::TileKey::TileKey(
     const foundation::UniqueID  assembly_uid,
     const foundation::UniqueID  texture_uid,
     const size_t                tile_x,
-    const size_t                tile_y)
+    const size_t                tile_y,
+    const size_t                level)
   : m_assembly_uid(assembly_uid)
   , m_texture_uid(texture_uid)
   , m_tile_xy(static_cast<std::uint32_t>((tile_y << 16) | tile_x))
+  , m_level(static_cast<std::uint32_t>(level))
 {
     assert(tile_x < (1UL << 16));
     assert(tile_y < (1UL << 16));
 }
 
-inline TextureStore::TileKey::TileKey(
-    const foundation::UniqueID  assembly_uid,
-    const foundation::UniqueID  texture_uid,
-    const std::uint32_t         tile_xy)
-  : m_assembly_uid(assembly_uid)
-  , m_texture_uid(texture_uid)
-  , m_tile_xy(tile_xy)
-{
-}
-
 inline TextureStore::TileKey::TileKey(const TileKey& rhs)
   : m_assembly_uid(rhs.m_assembly_uid)
   , m_texture_uid(rhs.m_texture_uid)
   , m_tile_xy(rhs.m_tile_xy)
+  , m_level(rhs.m_level)
 {
 }
 
@@ -259,19 +413,26 @@ inline size_t TextureStore::TileKey::get_tile_y() const
     return static_cast<size_t>(m_tile_xy >> 16);
 }
 
+inline size_t TextureStore::TileKey::get_level() const
+{
+    return static_cast<size_t>(m_level);
+}
+
 inline TextureStore::TileKey TextureStore::TileKey::invalid()
 {
-    return
-        TileKey(
-            ~foundation::UniqueID(0),   // assembly unique ID
-            ~foundation::UniqueID(0),   // texture unique ID
-            ~std::uint32_t(0));         // tile X and Y coordinates
+    TileKey key;
+    key.m_assembly_uid = ~foundation::UniqueID(0);
+    key.m_texture_uid = ~foundation::UniqueID(0);
+    key.m_tile_xy = ~std::uint32_t(0);
+    key.m_level = ~std::uint32_t(0);
+    return key;
 }
 
 inline bool TextureStore::TileKey::operator==(const TileKey& rhs) const
 {
     return
         m_tile_xy == rhs.m_tile_xy &&
+        m_level == rhs.m_level &&
         m_texture_uid == rhs.m_texture_uid &&
         m_assembly_uid == rhs.m_assembly_uid;
 }
@@ -286,7 +447,9 @@ inline bool TextureStore::TileKey::operator<(const TileKey& rhs) const
     return
         m_assembly_uid == rhs.m_assembly_uid ?
             m_texture_uid == rhs.m_texture_uid ?
-                m_tile_xy < rhs.m_tile_xy :
+                m_level == rhs.m_level ?
+                    m_tile_xy < rhs.m_tile_xy :
+                m_level < rhs.m_level :
             m_texture_uid < rhs.m_texture_uid :
         m_assembly_uid < rhs.m_assembly_uid;
 }
@@ -302,7 +465,8 @@ inline size_t TextureStore::TileKeyHasher::operator()(const TileKey& key) const
         foundation::mix_uint32(
             static_cast<std::uint32_t>(key.m_assembly_uid),
             static_cast<std::uint32_t>(key.m_texture_uid),
-            static_cast<std::uint32_t>(key.m_tile_xy));
+            static_cast<std::uint32_t>(key.m_tile_xy),
+            static_cast<std::uint32_t>(key.m_level));
 }
 
 
@@ -312,12 +476,7 @@ inline size_t TextureStore::TileKeyHasher::operator()(const TileKey& key) const
 
 inline bool TextureStore::TileSwapper::is_full(const size_t element_count) const
 {
-    return m_memory_size >= m_params.m_memory_limit;
-}
-
-inline size_t TextureStore::TileSwapper::get_peak_memory_size() const
-{
-    return m_peak_memory_size;
+    return m_memory_size >= m_memory_limit;
 }
 
 }   // namespace renderer
@@ -0,0 +1,285 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// appleseed.renderer headers.
+#include "renderer/global/globaltypes.h"
+#include "renderer/kernel/aov/aovcomponents.h"
+#include "renderer/kernel/intersection/intersector.h"
+#include "renderer/kernel/intersection/tracecontext.h"
+#include "renderer/kernel/lighting/bdpt/bdptlightingengine.h"
+#include "renderer/kernel/lighting/forwardlightsampler.h"
+#include "renderer/kernel/lighting/ilightingengine.h"
+#include "renderer/kernel/lighting/tracer.h"
+#include "renderer/kernel/rendering/pixelcontext.h"
+#include "renderer/kernel/rendering/rendererservices.h"
+#include "renderer/kernel/shading/oslshadergroupexec.h"
+#include "renderer/kernel/shading/oslshadingsystem.h"
+#include "renderer/kernel/shading/shadingcomponents.h"
+#include "renderer/kernel/shading/shadingcontext.h"
+#include "renderer/kernel/shading/shadingpoint.h"
+#include "renderer/kernel/shading/shadingray.h"
+#include "renderer/kernel/texturing/oiiotexturesystem.h"
+#include "renderer/kernel/texturing/texturecache.h"
+#include "renderer/kernel/texturing/texturestore.h"
+#include "renderer/modeling/bsdf/lambertianbrdf.h"
+#include "renderer/modeling/camera/pinholecamera.h"
+#include "renderer/modeling/edf/diffuseedf.h"
+#include "renderer/modeling/frame/frame.h"
+#include "renderer/modeling/material/genericmaterial.h"
+#include "renderer/modeling/object/meshobject.h"
+#include "renderer/modeling/object/triangle.h"
+#include "renderer/modeling/project/project.h"
+#include "renderer/modeling/scene/assembly.h"
+#include "renderer/modeling/scene/assemblyinstance.h"
+#include "renderer/modeling/scene/objectinstance.h"
+#include "renderer/modeling/scene/scene.h"
+#include "renderer/modeling/scene/visibilityflags.h"
+#include "renderer/utility/paramarray.h"
+#include "renderer/utility/testutils.h"
+
+// appleseed.foundation headers.
+#include "foundation/math/transform.h"
+#include "foundation/math/vector.h"
+#include "foundation/utility/arena.h"
+#include "foundation/utility/autoreleaseptr.h"
+#include "foundation/utility/containers/dictionary.h"
+#include "foundation/utility/test.h"
+
+// OpenImageIO headers.
+#include "foundation/platform/_beginoiioheaders.h"
+#include "OpenImageIO/texture.h"
+#include "foundation/platform/_endoiioheaders.h"
+
+// Standard headers.
+#include <exception>
+#include <memory>
+#include <string>
+
+using namespace foundation;
+using namespace renderer;
+
+TEST_SUITE(Renderer_Kernel_Lighting_BDPTLightingEngine)
+{
+    // A diffuse floor lit by a small area light facing it.
+    struct LitFloorScene
+      : public TestSceneBase
+    {
+        Assembly* m_assembly;
+
+        LitFloorScene()
+        {
+            m_scene.cameras().insert(
+                PinholeCameraFactory().create(
+                    "camera",
+                    ParamArray()
+                        .insert("film_width", "0.025")
+                        .insert("film_height", "0.025")
+                        .insert("focal_length", "0.035")));
+
+            m_project.set_frame(
+                FrameFactory::create(
+                    "frame",
+                    ParamArray()
+                        .insert("resolution", "512 512")
+                        .insert("camera", "camera")));
+
+            m_scene.assemblies().insert(
+                AssemblyFactory().create("assembly", ParamArray()));
+            m_assembly = m_scene.assemblies().get_by_name("assembly");
+
+            m_scene.assembly_instances().insert(
+                AssemblyInstanceFactory::create(
+                    "assembly_inst",
+                    ParamArray(),
+                    "assembly"));
+
+            m_assembly->bsdfs().insert(
+                LambertianBRDFFactory().create(
+                    "floor_brdf",
+                    ParamArray().insert("reflectance", "0.8")));
+
+            m_assembly->edfs().insert(
+                DiffuseEDFFactory().create(
+                    "light_edf",
+                    ParamArray().insert("radiance", "10.0")));
+
+            m_assembly->materials().insert(
+                GenericMaterialFactory().create(
+                    "floor_material",
+                    ParamArray().insert("bsdf", "floor_brdf")));
+
+            m_assembly->materials().insert(
+                GenericMaterialFactory().create(
+                    "light_material",
+                    ParamArray().insert("edf", "light_edf")));
+
+            create_square_object("floor", 10.0f, 0.0f, +1.0f);
+            create_square_object("light", 1.0f, 2.0f, -1.0f);
+        }
+
+        // Create a horizontal square of a given size at a given height, facing up or down.
+        void create_square_object(
+            const char*     name,
+            const float     size,
+            const float     height,
+            const float     normal_y)
+        {
+            auto_release_ptr<MeshObject> mesh_object(
+                MeshObjectFactory().create(name, ParamArray()));
+
+            const float h = 0.5f * size;
+            mesh_object->push_vertex(GVector3(-h, height, -h));
+            mesh_object->push_vertex(GVector3(+h, height, -h));
+            mesh_object->push_vertex(GVector3(+h, height, +h));
+            mesh_object->push_vertex(GVector3(-h, height, +h));
+
+            mesh_object->push_vertex_normal(GVector3(0.0f, normal_y, 0.0f));
+
+            if (normal_y > 0.0f)
+            {
+                mesh_object->push_triangle(Triangle(0, 2, 1, 0, 0, 0, 0));
+                mesh_object->push_triangle(Triangle(0, 3, 2, 0, 0, 0, 0));
+            }
+            else
+            {
+                mesh_object->push_triangle(Triangle(0, 1, 2, 0, 0, 0, 0));
+                mesh_object->push_triangle(Triangle(0, 2, 3, 0, 0, 0, 0));
+            }
+
+            mesh_object->push_material_slot("material");
+
+            auto_release_ptr<Object> object(mesh_object.release());
+            m_assembly->objects().insert(object);
+
+            StringDictionary material_mappings;
+            material_mappings.insert("material", std::string(name) + "_material");
+
+            const std::string instance_name = std::string(name) + "_inst";
+            m_assembly->object_instances().insert(
+                ObjectInstanceFactory::create(
+                    instance_name.c_str(),
+                    ParamArray(),
+                    name,
+                    Transformd::identity(),
+                    material_mappings,
+                    material_mappings));
+        }
+    };
+
+    struct Fixture
+      : public StaticTestSceneContext<LitFloorScene>
+    {
+        TraceContext                            m_trace_context;
+        TextureStore                            m_texture_store;
+        TextureCache                            m_texture_cache;
+        Intersector                             m_intersector;
+        std::shared_ptr<OIIOTextureSystem>      m_texture_system;
+        RendererServices                        m_renderer_services;
+        std::shared_ptr<OSLShadingSystem>       m_shading_system;
+        Arena                                   m_arena;
+        OSLShaderGroupExec                      m_shading_group_exec;
+        Tracer                                  m_tracer;
+        ShadingContext                          m_shading_context;
+        ForwardLightSampler                     m_light_sampler;
+
+        Fixture()
+          : m_trace_context(m_scene)
+          , m_texture_store(m_scene)
+          , m_texture_cache(m_texture_store)
+          , m_intersector(m_trace_context, m_texture_cache)
+          , m_texture_system(
+                OIIOTextureSystemFactory::create(),
+                [](OIIOTextureSystem* object) { object->release(); })
+          , m_renderer_services(
+                m_project,
+                reinterpret_cast<OIIO::TextureSystem&>(*m_texture_system))
+          , m_shading_system(
+                OSLShadingSystemFactory::create(&m_renderer_services, m_texture_system.get()),
+                [](OSLShadingSystem* object) { object->release(); })
+          , m_shading_group_exec(*m_shading_system, m_arena)
+          , m_tracer(m_scene, m_intersector, m_shading_group_exec)
+          , m_shading_context(
+                m_intersector,
+                m_tracer,
+                m_texture_cache,
+                *m_texture_system,
+                m_shading_group_exec,
+                m_arena,
+                0)  // thread index
+          , m_light_sampler(m_scene)
+        {
+            m_trace_context.update();
+        }
+    };
+
+    TEST_CASE_F(ComputeLighting_GivenLightVertexCacheOfDefaultSize_DoesNotRunOutOfArenaMemory, Fixture)
+    {
+        // Keep the default number of light subpaths in the cache.
+        BDPTLightingEngineFactory factory(
+            m_project,
+            m_light_sampler,
+            ParamArray().insert("enable_light_vertex_cache", true));
+        auto_release_ptr<ILightingEngine> engine(factory.create());
+
+        ShadingPoint shading_point;
+        const ShadingRay ray(
+            Vector3d(0.0, 1.0, 0.0),
+            Vector3d(0.0, -1.0, 0.0),
+            ShadingRay::Time(),
+            VisibilityFlags::CameraRay,
+            0);
+        m_intersector.trace(ray, shading_point);
+        ASSERT_TRUE(shading_point.hit_surface());
+
+        SamplingContext::RNGType rng;
+        SamplingContext sampling_context(rng, SamplingContext::RNGMode);
+
+        ShadingComponents radiance;
+        AOVComponents aov_components;
+        bool succeeded = true;
+
+        try
+        {
+            // Building the cache traces all the light subpaths during this call.
+            engine->compute_lighting(
+                sampling_context,
+                PixelContext(Vector2i(0, 0), Vector2d(0.5, 0.5)),
+                m_shading_context,
+                shading_point,
+                radiance,
+                aov_components);
+        }
+        catch (const std::exception&)
+        {
+            succeeded = false;
+        }
+
+        EXPECT_TRUE(succeeded);
+        EXPECT_TRUE(radiance.is_valid());
+    }
+}
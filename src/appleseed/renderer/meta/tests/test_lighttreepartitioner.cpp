@@ -0,0 +1,173 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// appleseed.renderer headers.
+#include "renderer/kernel/lighting/lighttree_node.h"
+#include "renderer/kernel/lighting/lighttreepartitioner.h"
+
+// appleseed.foundation headers.
+#include "foundation/math/aabb.h"
+#include "foundation/math/rng/distribution.h"
+#include "foundation/math/rng/mersennetwister.h"
+#include "foundation/math/vector.h"
+#include "foundation/utility/test.h"
+
+// Standard headers.
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+using namespace foundation;
+using namespace renderer;
+
+TEST_SUITE(Renderer_Kernel_Lighting_LightTreePartitioner)
+{
+    struct Fixture
+    {
+        std::vector<AABB3d>                     m_bboxes;
+        LightTreePartitioner::EmitterVector     m_emitters;
+
+        void add_light(
+            const Vector3d&     position,
+            const Vector3f&     normal,
+            const float         energy = 1.0f)
+        {
+            m_bboxes.push_back(
+                AABB3d(
+                    position - Vector3d(0.1),
+                    position + Vector3d(0.1)));
+
+            LightTreePartitioner::Emitter emitter;
+            emitter.m_energy = energy;
+            emitter.m_cone_axis = normal;
+            emitter.m_cone_cos_angle = 1.0f;
+            m_emitters.push_back(emitter);
+        }
+
+        AABB3d compute_bbox() const
+        {
+            AABB3d bbox;
+            bbox.invalidate();
+
+            for (const auto& b : m_bboxes)
+                bbox.insert(b);
+
+            return bbox;
+        }
+    };
+
+    TEST_CASE_F(Partition_LightsWithDifferentOrientations_SeparatesThemRatherThanSplittingInTheMiddle, Fixture)
+    {
+        // Two lights facing up followed by four lights facing down, evenly spaced along X.
+        for (size_t i = 0; i < 6; ++i)
+            add_light(Vector3d(static_cast<double>(i), 0.0, 0.0), Vector3f(0.0f, 0.0f, i < 2 ? 1.0f : -1.0f));
+
+        LightTreePartitioner partitioner(m_bboxes, m_emitters);
+        const size_t pivot = partitioner.partition(0, m_bboxes.size(), compute_bbox());
+
+        EXPECT_EQ(2, pivot);
+    }
+
+    TEST_CASE_F(Partition_BrightLightAmongDimOnes_IsolatesBrightLight, Fixture)
+    {
+        add_light(Vector3d(0.0, 0.0, 0.0), Vector3f(0.0f, 0.0f, 1.0f), 1000.0f);
+
+        for (size_t i = 1; i < 8; ++i)
+            add_light(Vector3d(static_cast<double>(i), 0.0, 0.0), Vector3f(0.0f, 0.0f, 1.0f));
+
+        LightTreePartitioner partitioner(m_bboxes, m_emitters);
+        const size_t pivot = partitioner.partition(0, m_bboxes.size(), compute_bbox());
+
+        EXPECT_EQ(1, pivot);
+    }
+
+    TEST_CASE_F(Partition_CoincidentLights_SplitsThemInHalves, Fixture)
+    {
+        for (size_t i = 0; i < 7; ++i)
+            add_light(Vector3d(1.0, 2.0, 3.0), Vector3f(0.0f, 1.0f, 0.0f));
+
+        LightTreePartitioner partitioner(m_bboxes, m_emitters);
+        const size_t pivot = partitioner.partition(0, m_bboxes.size(), compute_bbox());
+
+        EXPECT_TRUE(pivot == 3 || pivot == 4);
+    }
+
+    TEST_CASE_F(Partition_DisjointSubsets_ReturnsPivotsInsideEachSubset, Fixture)
+    {
+        MersenneTwister rng;
+
+        for (size_t i = 0; i < 100; ++i)
+        {
+            const Vector3d position(
+                rand_double1(rng, -10.0, 10.0),
+                rand_double1(rng, -10.0, 10.0),
+                rand_double1(rng, -10.0, 10.0));
+            const Vector3f normal(
+                normalize(
+                    Vector3f(
+                        rand_float1(rng, -1.0f, 1.0f),
+                        rand_float1(rng, -1.0f, 1.0f),
+                        rand_float1(rng, -1.0f, 1.0f))));
+            add_light(position, normal, rand_float1(rng, 0.1f, 10.0f));
+        }
+
+        LightTreePartitioner partitioner(m_bboxes, m_emitters);
+        const size_t pivot = partitioner.partition(0, 100, partitioner.compute_bbox(0, 100));
+
+        ASSERT_TRUE(pivot > 0 && pivot < 100);
+
+        const size_t left_pivot = partitioner.partition(0, pivot, partitioner.compute_bbox(0, pivot));
+        const size_t right_pivot = partitioner.partition(pivot, 100, partitioner.compute_bbox(pivot, 100));
+
+        EXPECT_TRUE(left_pivot > 0 && left_pivot < pivot);
+        EXPECT_TRUE(right_pivot > pivot && right_pivot < 100);
+    }
+
+    TEST_CASE(MergeNormalCones_ReturnsConeContainingBothCones)
+    {
+        MersenneTwister rng;
+
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            const Vector3f axis1(normalize(Vector3f(rand_float1(rng, -1.0f, 1.0f), rand_float1(rng, -1.0f, 1.0f), rand_float1(rng, -1.0f, 1.0f))));
+            const Vector3f axis2(normalize(Vector3f(rand_float1(rng, -1.0f, 1.0f), rand_float1(rng, -1.0f, 1.0f), rand_float1(rng, -1.0f, 1.0f))));
+            const float cos_angle1 = rand_float1(rng, 0.0f, 1.0f);
+            const float cos_angle2 = rand_float1(rng, 0.0f, 1.0f);
+
+            Vector3f axis;
+            float cos_angle;
+            merge_normal_cones(axis1, cos_angle1, axis2, cos_angle2, axis, cos_angle);
+
+            // The axes of both cones must be inside the merged cone, with room for their spread.
+            const float angle = std::acos(cos_angle);
+            EXPECT_TRUE(std::acos(std::min(dot(axis, axis1), 1.0f)) + std::acos(cos_angle1) <= angle + 1.0e-3f);
+            EXPECT_TRUE(std::acos(std::min(dot(axis, axis2), 1.0f)) + std::acos(cos_angle2) <= angle + 1.0e-3f);
+        }
+    }
+}
@@ -0,0 +1,155 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// appleseed.renderer headers.
+#include "renderer/global/globaltypes.h"
+#include "renderer/kernel/lighting/radiancecache.h"
+
+// appleseed.foundation headers.
+#include "foundation/math/aabb.h"
+#include "foundation/math/vector.h"
+#include "foundation/utility/test.h"
+
+// Boost headers.
+#include "boost/filesystem.hpp"
+
+// Standard headers.
+#include <cstddef>
+#include <string>
+
+using namespace foundation;
+using namespace renderer;
+namespace bf = boost::filesystem;
+
+TEST_SUITE(Renderer_Kernel_Lighting_RadianceCache)
+{
+    const AABB3f Bounds(Vector3f(0.0f), Vector3f(10.0f, 10.0f, 5.0f));
+    const Vector3f Up(0.0f, 1.0f, 0.0f);
+
+    TEST_CASE(Lookup_GivenRecordsInSingleCell_ReturnsTheirAverage)
+    {
+        RadianceCache cache(Bounds, 10);
+        cache.record(Vector3f(2.2f, 3.5f, 1.5f), Up, Spectrum(1.0f));
+        cache.record(Vector3f(2.8f, 3.1f, 1.7f), Up, Spectrum(3.0f));
+        cache.build(1);
+
+        Spectrum radiance;
+        const bool found = cache.lookup(Vector3f(2.5f, 3.5f, 1.5f), Up, radiance);
+
+        ASSERT_TRUE(found);
+        EXPECT_EQ(1, cache.get_cell_count());
+        EXPECT_EQ(2, cache.get_record_count());
+        EXPECT_FEQ(2.0f, radiance[0]);
+    }
+
+    TEST_CASE(Lookup_BetweenTwoCells_InterpolatesLinearly)
+    {
+        RadianceCache cache(Bounds, 10);
+        cache.record(Vector3f(2.5f, 3.5f, 1.5f), Up, Spectrum(1.0f));
+        cache.record(Vector3f(3.5f, 3.5f, 1.5f), Up, Spectrum(5.0f));
+        cache.build(1);
+
+        Spectrum radiance;
+        const bool found = cache.lookup(Vector3f(3.25f, 3.5f, 1.5f), Up, radiance);
+
+        ASSERT_TRUE(found);
+        EXPECT_FEQ(4.0f, radiance[0]);
+    }
+
+    TEST_CASE(Lookup_GivenOppositeNormal_ReturnsFalse)
+    {
+        RadianceCache cache(Bounds, 10);
+        cache.record(Vector3f(2.5f, 3.5f, 1.5f), Up, Spectrum(1.0f));
+        cache.build(1);
+
+        Spectrum radiance;
+        const bool found = cache.lookup(Vector3f(2.5f, 3.5f, 1.5f), -Up, radiance);
+
+        EXPECT_FALSE(found);
+    }
+
+    TEST_CASE(Build_DropsCellsWithTooFewRecords)
+    {
+        RadianceCache cache(Bounds, 10);
+        cache.record(Vector3f(2.5f, 3.5f, 1.5f), Up, Spectrum(1.0f));
+        cache.record(Vector3f(2.5f, 3.5f, 1.5f), Up, Spectrum(1.0f));
+        cache.record(Vector3f(7.5f, 3.5f, 1.5f), Up, Spectrum(1.0f));
+        cache.build(2);
+
+        Spectrum radiance;
+
+        EXPECT_EQ(1, cache.get_cell_count());
+        EXPECT_TRUE(cache.lookup(Vector3f(2.5f, 3.5f, 1.5f), Up, radiance));
+        EXPECT_FALSE(cache.lookup(Vector3f(7.5f, 3.5f, 1.5f), Up, radiance));
+    }
+
+    TEST_CASE(Load_GivenSavedCache_RestoresCachedValues)
+    {
+        const std::string filepath =
+            (bf::temp_directory_path() / bf::unique_path("test_radiancecache_%%%%%%%%.bin")).string();
+
+        RadianceCache saved_cache(Bounds, 10);
+        saved_cache.record(Vector3f(2.5f, 3.5f, 1.5f), Up, Spectrum(1.0f));
+        saved_cache.record(Vector3f(7.5f, 0.5f, 4.5f), -Up, Spectrum(2.0f));
+        saved_cache.build(1);
+        const bool saved = saved_cache.save(filepath);
+
+        RadianceCache loaded_cache(Bounds, 10);
+        const bool loaded = loaded_cache.load(filepath);
+
+        bf::remove(filepath);
+
+        ASSERT_TRUE(saved);
+        ASSERT_TRUE(loaded);
+        ASSERT_TRUE(loaded_cache.is_built());
+        EXPECT_EQ(2, loaded_cache.get_cell_count());
+
+        Spectrum radiance;
+        ASSERT_TRUE(loaded_cache.lookup(Vector3f(7.5f, 0.5f, 4.5f), -Up, radiance));
+        EXPECT_FEQ(2.0f, radiance[0]);
+    }
+
+    TEST_CASE(Load_GivenCacheSavedForDifferentGrid_ReturnsFalse)
+    {
+        const std::string filepath =
+            (bf::temp_directory_path() / bf::unique_path("test_radiancecache_%%%%%%%%.bin")).string();
+
+        RadianceCache saved_cache(Bounds, 10);
+        saved_cache.record(Vector3f(2.5f, 3.5f, 1.5f), Up, Spectrum(1.0f));
+        saved_cache.build(1);
+        saved_cache.save(filepath);
+
+        RadianceCache loaded_cache(Bounds, 20);
+        const bool loaded = loaded_cache.load(filepath);
+
+        bf::remove(filepath);
+
+        EXPECT_FALSE(loaded);
+        EXPECT_FALSE(loaded_cache.is_built());
+    }
+}
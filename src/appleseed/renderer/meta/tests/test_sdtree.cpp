@@ -0,0 +1,157 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+// appleseed.renderer headers.
+#include "renderer/kernel/lighting/sdtree.h"
+
+// appleseed.foundation headers.
+#include "foundation/math/aabb.h"
+#include "foundation/math/scalar.h"
+#include "foundation/math/vector.h"
+#include "foundation/utility/iostreamop.h"
+#include "foundation/utility/test.h"
+
+// Standard headers.
+#include <cstddef>
+
+using namespace foundation;
+using namespace renderer;
+
+TEST_SUITE(Renderer_Kernel_Lighting_SDTree)
+{
+    TEST_CASE(CanonicalToDirection_IsInverseOfDirectionToCanonical)
+    {
+        const Vector3f direction = normalize(Vector3f(0.3f, -0.5f, 0.8f));
+
+        const Vector3f result = canonical_to_direction(direction_to_canonical(direction));
+
+        EXPECT_FEQ_EPS(direction, result, 1.0e-5f);
+    }
+
+    TEST_CASE(DTreeEvaluate_GivenEmptyTree_ReturnsZero)
+    {
+        const DTree d_tree;
+
+        EXPECT_EQ(0.0f, d_tree.evaluate(Vector3f(0.0f, 0.0f, 1.0f)));
+    }
+
+    TEST_CASE(DTreeSample_ReturnsSameProbabilityAsEvaluate)
+    {
+        DTree source;
+        source.record(Vector3f(0.0f, 0.0f, 1.0f), 10.0f);
+        source.record(Vector3f(1.0f, 0.0f, 0.0f), 1.0f);
+
+        // Give the tree some structure, then record radiance again.
+        DTree d_tree;
+        d_tree.refine(source, 0.01f, 20);
+        d_tree.record(Vector3f(0.0f, 0.0f, 1.0f), 10.0f);
+        d_tree.record(Vector3f(1.0f, 0.0f, 0.0f), 1.0f);
+        d_tree.record(Vector3f(0.0f, -1.0f, 0.0f), 0.5f);
+
+        for (size_t i = 0; i < 16; ++i)
+        {
+            const Vector2f s((i + 0.5f) / 16.0f, (i * 7 % 16 + 0.5f) / 16.0f);
+
+            float pdf;
+            const Vector3f direction = d_tree.sample(s, pdf);
+
+            EXPECT_FEQ_EPS(1.0f, norm(direction), 1.0e-5f);
+            EXPECT_FEQ_EPS(pdf, d_tree.evaluate(direction), pdf * 1.0e-3f);
+        }
+    }
+
+    TEST_CASE(DTreeEvaluate_IntegratesToOne)
+    {
+        DTree source;
+        source.record(Vector3f(0.0f, 0.0f, 1.0f), 4.0f);
+        source.record(normalize(Vector3f(1.0f, 1.0f, -1.0f)), 1.0f);
+
+        DTree d_tree;
+        d_tree.refine(source, 0.01f, 20);
+        d_tree.record(Vector3f(0.0f, 0.0f, 1.0f), 4.0f);
+        d_tree.record(normalize(Vector3f(1.0f, 1.0f, -1.0f)), 1.0f);
+
+        // Integrate the density over the unit square; the mapping has a constant Jacobian of 4 Pi.
+        const size_t N = 256;
+        float integral = 0.0f;
+        for (size_t y = 0; y < N; ++y)
+        {
+            for (size_t x = 0; x < N; ++x)
+            {
+                const Vector2f p((x + 0.5f) / N, (y + 0.5f) / N);
+                integral += d_tree.evaluate(canonical_to_direction(p));
+            }
+        }
+        integral *= FourPi<float>() / (N * N);
+
+        EXPECT_FEQ_EPS(1.0f, integral, 1.0e-2f);
+    }
+
+    TEST_CASE(DTreeRefine_SubdividesQuadrantsHoldingMostRadiance)
+    {
+        DTree source;
+        source.record(Vector3f(0.0f, 0.0f, 1.0f), 1.0f);
+
+        DTree d_tree;
+        d_tree.refine(source, 0.01f, 3);
+
+        // Radiance is assumed uniform below the leaves of the source tree:
+        // the quadrant holding the radiance is subdivided down to the maximum depth.
+        EXPECT_EQ(6, d_tree.get_node_count());
+        EXPECT_EQ(0.0f, d_tree.get_total());
+    }
+
+    TEST_CASE(SDTreeGetSamplingDistribution_BeforeFirstIteration_ReturnsNull)
+    {
+        SDTree sd_tree;
+        sd_tree.reset(AABB3f(Vector3f(-1.0f), Vector3f(1.0f)));
+        sd_tree.record(Vector3f(0.0f), Vector3f(0.0f, 0.0f, 1.0f), 1.0f);
+
+        EXPECT_EQ(0, sd_tree.get_sampling_distribution(Vector3f(0.0f)));
+    }
+
+    TEST_CASE(SDTreeEndIteration_SplitsLeavesThatReceivedManySamples)
+    {
+        SDTree sd_tree;
+        sd_tree.reset(AABB3f(Vector3f(-1.0f), Vector3f(1.0f)));
+
+        for (size_t i = 0; i < 100; ++i)
+            sd_tree.record(Vector3f(0.5f), Vector3f(0.0f, 0.0f, 1.0f), 1.0f);
+
+        sd_tree.end_iteration(40, 0.01f, 20);
+
+        // 100 samples -> 2 x 50 -> 4 x 25 (two levels of splitting).
+        EXPECT_EQ(1, sd_tree.get_iteration());
+        EXPECT_EQ(4, sd_tree.get_leaf_count());
+
+        const DTree* d_tree = sd_tree.get_sampling_distribution(Vector3f(-0.5f));
+        ASSERT_NEQ(0, d_tree);
+        EXPECT_FEQ(100.0f, d_tree->get_total());
+    }
+}
@@ -0,0 +1,126 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+// appleseed.renderer headers.
+#include "renderer/kernel/lighting/sppm/sppmphoton.h"
+
+// appleseed.foundation headers.
+#include "foundation/math/vector.h"
+#include "foundation/utility/job/jobmanager.h"
+#include "foundation/utility/job/jobqueue.h"
+#include "foundation/utility/log/logger.h"
+#include "foundation/utility/test.h"
+
+// Standard headers.
+#include <cstddef>
+#include <vector>
+
+using namespace foundation;
+using namespace renderer;
+
+TEST_SUITE(Renderer_Kernel_Lighting_SPPM_SPPMPhotonVector)
+{
+    SPPMPolyPhoton make_photon(const float value)
+    {
+        SPPMPolyPhoton photon;
+        photon.m_incoming = Vector3f(0.0f, 0.0f, value);
+        photon.m_geometric_normal = Vector3f(0.0f, value, 0.0f);
+        photon.m_flux.set(value);
+        return photon;
+    }
+
+    TEST_CASE(AssignConcatenation_ConcatenatesVectorsInOrder)
+    {
+        std::vector<SPPMPhotonVector> vectors(4);
+        size_t photon_count = 0;
+        for (size_t i = 0; i < vectors.size(); ++i)
+        {
+            // Leave the second vector empty.
+            if (i == 1)
+                continue;
+
+            for (size_t j = 0; j < 100 * (i + 1); ++j)
+            {
+                const float value = static_cast<float>(photon_count++);
+                vectors[i].push_back(Vector3f(value), make_photon(value));
+            }
+        }
+
+        Logger logger;
+        JobQueue job_queue;
+        JobManager job_manager(logger, job_queue, 4, JobManager::KeepRunningOnEmptyQueue);
+        job_manager.start();
+
+        SPPMPhotonVector photons;
+        photons.assign_concatenation(vectors, job_queue);
+
+        job_manager.stop();
+
+        ASSERT_EQ(photon_count, photons.size());
+        ASSERT_EQ(photon_count, photons.m_poly_fluxes.size());
+        EXPECT_TRUE(photons.m_mono_fluxes.empty());
+
+        bool ordered = true;
+        for (size_t i = 0; i < photon_count; ++i)
+        {
+            const float value = static_cast<float>(i);
+            if (photons.m_positions[i] != Vector3f(value) ||
+                photons.m_incoming[i] != Vector3f(0.0f, 0.0f, value) ||
+                photons.m_geometric_normals[i] != Vector3f(0.0f, value, 0.0f) ||
+                photons.m_poly_fluxes[i][0] != value)
+                ordered = false;
+        }
+        EXPECT_TRUE(ordered);
+    }
+
+    TEST_CASE(AssignConcatenation_GivenSmallerConcatenation_KeepsMemory)
+    {
+        std::vector<SPPMPhotonVector> vectors(1);
+        for (size_t i = 0; i < 1000; ++i)
+            vectors[0].push_back(Vector3f(0.0f), make_photon(0.0f));
+
+        Logger logger;
+        JobQueue job_queue;
+        JobManager job_manager(logger, job_queue, 2, JobManager::KeepRunningOnEmptyQueue);
+        job_manager.start();
+
+        SPPMPhotonVector photons;
+        photons.assign_concatenation(vectors, job_queue);
+        const size_t memory_size = photons.get_memory_size();
+
+        vectors[0].clear_keep_memory();
+        vectors[0].push_back(Vector3f(0.0f), make_photon(0.0f));
+        photons.assign_concatenation(vectors, job_queue);
+
+        job_manager.stop();
+
+        EXPECT_EQ(1, photons.size());
+        EXPECT_EQ(memory_size, photons.get_memory_size());
+    }
+}
@@ -0,0 +1,194 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+// appleseed.renderer headers.
+#include "renderer/kernel/lighting/sppm/sppmphoton.h"
+#include "renderer/kernel/lighting/sppm/sppmphotongrid.h"
+
+// appleseed.foundation headers.
+#include "foundation/math/knn.h"
+#include "foundation/math/rng/distribution.h"
+#include "foundation/math/rng/mersennetwister.h"
+#include "foundation/math/vector.h"
+#include "foundation/platform/defaulttimers.h"
+#include "foundation/utility/iostreamop.h"
+#include "foundation/utility/job/jobmanager.h"
+#include "foundation/utility/job/jobqueue.h"
+#include "foundation/utility/log/logger.h"
+#include "foundation/utility/test.h"
+
+// Standard headers.
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+using namespace foundation;
+using namespace renderer;
+
+TEST_SUITE(Renderer_Kernel_Lighting_SPPM_SPPMPhotonGrid)
+{
+    struct Fixture
+    {
+        std::vector<Vector3f>   m_positions;
+        SPPMPhotonVector        m_photons;
+        Logger                  m_logger;
+        JobQueue                m_job_queue;
+        JobManager              m_job_manager;
+
+        Fixture()
+          : m_job_manager(m_logger, m_job_queue, 4, JobManager::KeepRunningOnEmptyQueue)
+        {
+            MersenneTwister rng;
+
+            for (size_t i = 0; i < 50000; ++i)
+            {
+                const Vector3f position(
+                    rand_float1(rng, -1.0f, 1.0f),
+                    rand_float1(rng, -1.0f, 1.0f),
+                    rand_float1(rng, -1.0f, 1.0f));
+
+                m_positions.push_back(position);
+                m_photons.push_back(position, SPPMPolyPhoton());
+            }
+
+            m_job_manager.start();
+        }
+
+        std::vector<size_t> find_photons(
+            const Vector3f&             point,
+            const float                 radius) const
+        {
+            std::vector<size_t> indices;
+
+            for (size_t i = 0, e = m_positions.size(); i < e; ++i)
+            {
+                if (square_norm(m_positions[i] - point) <= radius * radius)
+                    indices.push_back(i);
+            }
+
+            return indices;
+        }
+
+        static std::vector<size_t> get_photons(
+            const SPPMPhotonGrid&       grid,
+            const knn::Answer<float>&   answer)
+        {
+            std::vector<size_t> indices;
+
+            for (size_t i = 0, e = answer.size(); i < e; ++i)
+                indices.push_back(grid.remap(answer.get(i).m_index));
+
+            std::sort(indices.begin(), indices.end());
+
+            return indices;
+        }
+    };
+
+    TEST_CASE_F(Constructor_ConsumesPhotonPositions, Fixture)
+    {
+        const SPPMPhotonGrid grid(m_photons, 0.05f, m_job_queue);
+
+        EXPECT_EQ(m_positions.size(), grid.size());
+        EXPECT_TRUE(m_photons.m_positions.empty());
+    }
+
+    TEST_CASE_F(GetPoint_ReturnsPositionOfRemappedPhoton, Fixture)
+    {
+        const SPPMPhotonGrid grid(m_photons, 0.05f, m_job_queue);
+
+        bool all_equal = true;
+
+        for (size_t i = 0, e = grid.size(); i < e; ++i)
+        {
+            if (grid.get_point(i) != m_positions[grid.remap(i)])
+                all_equal = false;
+        }
+
+        EXPECT_TRUE(all_equal);
+    }
+
+    TEST_CASE_F(Query_ReturnsPhotonsWithinLookupRadius, Fixture)
+    {
+        const float Radius = 0.05f;
+        const SPPMPhotonGrid grid(m_photons, Radius, m_job_queue);
+        knn::Answer<float> answer(1000);
+
+        MersenneTwister rng(42);
+
+        for (size_t i = 0; i < 100; ++i)
+        {
+            const Vector3f point(
+                rand_float1(rng, -1.0f, 1.0f),
+                rand_float1(rng, -1.0f, 1.0f),
+                rand_float1(rng, -1.0f, 1.0f));
+
+            grid.query(point, Radius * Radius, answer);
+
+            EXPECT_EQ(find_photons(point, Radius), get_photons(grid, answer));
+        }
+    }
+
+    TEST_CASE_F(Query_GivenRadiusLargerThanCells_ReturnsPhotonsWithinRadius, Fixture)
+    {
+        const SPPMPhotonGrid grid(m_photons, 0.01f, m_job_queue);
+        knn::Answer<float> answer(10000);
+
+        const Vector3f point(0.1f, 0.2f, 0.3f);
+        const float Radius = 0.2f;
+
+        grid.query(point, Radius * Radius, answer);
+
+        EXPECT_EQ(find_photons(point, Radius), get_photons(grid, answer));
+    }
+
+    TEST_CASE_F(Query_GivenMorePhotonsThanAnswerSize_ReturnsNearestPhotons, Fixture)
+    {
+        const float Radius = 0.1f;
+        const SPPMPhotonGrid grid(m_photons, Radius, m_job_queue);
+        knn::Answer<float> answer(10);
+
+        const Vector3f point(0.0f);
+        grid.query(point, Radius * Radius, answer);
+
+        knn::Tree3f tree;
+        knn::Builder3f builder(tree);
+        builder.build<DefaultWallclockTimer>(&m_positions[0], m_positions.size());
+        knn::Answer<float> expected_answer(10);
+        knn::Query3f query(tree, expected_answer);
+        query.run(point, Radius * Radius);
+
+        std::vector<size_t> expected;
+        for (size_t i = 0, e = expected_answer.size(); i < e; ++i)
+            expected.push_back(tree.remap(expected_answer.get(i).m_index));
+        std::sort(expected.begin(), expected.end());
+
+        ASSERT_EQ(10, answer.size());
+        EXPECT_EQ(expected, get_photons(grid, answer));
+    }
+}
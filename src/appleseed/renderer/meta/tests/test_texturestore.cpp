@@ -29,10 +29,27 @@
 
 // appleseed.renderer headers.
 #include "renderer/kernel/texturing/texturestore.h"
+#include "renderer/modeling/input/source.h"
+#include "renderer/modeling/scene/containers.h"
+#include "renderer/modeling/scene/scene.h"
+#include "renderer/modeling/texture/texture.h"
+#include "renderer/modeling/texture/tileptr.h"
+#include "renderer/utility/paramarray.h"
 
 // appleseed.foundation headers.
+#include "foundation/core/exceptions/exceptionioerror.h"
+#include "foundation/image/canvasproperties.h"
+#include "foundation/image/colorspace.h"
+#include "foundation/image/pixel.h"
+#include "foundation/image/tile.h"
+#include "foundation/utility/autoreleaseptr.h"
 #include "foundation/utility/test.h"
+#include "foundation/utility/uid.h"
 
+// Standard headers.
+#include <cstddef>
+
+using namespace foundation;
 using namespace renderer;
 
 TEST_SUITE(Renderer_Kernel_Texturing_TextureStore_TileKey)
@@ -46,4 +63,135 @@ TEST_SUITE(Renderer_Kernel_Texturing_TextureStore_TileKey)
         EXPECT_EQ(32323, key.get_tile_x());
         EXPECT_EQ(56565, key.get_tile_y());
     }
+
+    TEST_CASE(StoreAndRetrieveMipLevel)
+    {
+        const TextureStore::TileKey key(123, 12345, 32323, 56565, 7);
+
+        EXPECT_EQ(32323, key.get_tile_x());
+        EXPECT_EQ(56565, key.get_tile_y());
+        EXPECT_EQ(7, key.get_level());
+    }
+
+    TEST_CASE(KeysOfDifferentMipLevelsAreDifferent)
+    {
+        const TextureStore::TileKey key0(123, 12345, 3, 5, 0);
+        const TextureStore::TileKey key1(123, 12345, 3, 5, 1);
+
+        EXPECT_TRUE(key0 != key1);
+        EXPECT_TRUE(key0 < key1);
+        EXPECT_FALSE(key1 < key0);
+    }
+}
+
+TEST_SUITE(Renderer_Kernel_Texturing_TextureStore)
+{
+    // A single-tile texture whose tile fails to load until told otherwise.
+    class FailingTexture
+      : public Texture
+    {
+      public:
+        bool m_fail;
+
+        explicit FailingTexture(const char* name)
+          : Texture(name, ParamArray())
+          , m_fail(true)
+          , m_props(4, 4, 4, 4, 3, PixelFormatFloat)
+        {
+        }
+
+        void release() override
+        {
+            delete this;
+        }
+
+        const char* get_model() const override
+        {
+            return "failing_texture";
+        }
+
+        ColorSpace get_color_space() const override
+        {
+            return ColorSpaceLinearRGB;
+        }
+
+        const CanvasProperties& properties() override
+        {
+            return m_props;
+        }
+
+        Source* create_source(
+            const UniqueID          assembly_uid,
+            const TextureInstance&  texture_instance) override
+        {
+            return nullptr;
+        }
+
+        TilePtr load_tile(
+            const size_t            tile_x,
+            const size_t            tile_y) override
+        {
+            if (m_fail)
+                throw ExceptionIOError();
+
+            return
+                TilePtr::make_owning(
+                    new Tile(
+                        m_props.m_tile_width,
+                        m_props.m_tile_height,
+                        m_props.m_channel_count,
+                        m_props.m_pixel_format));
+        }
+
+      private:
+        const CanvasProperties  m_props;
+    };
+
+    TEST_CASE(Acquire_GivenTileLoadThrows_PropagatesExceptionAndLeavesTileUnowned)
+    {
+        auto_release_ptr<Scene> scene(SceneFactory::create());
+        FailingTexture* texture = new FailingTexture("texture");
+        scene->textures().insert(auto_release_ptr<Texture>(texture));
+
+        TextureStore store(scene.ref());
+        const TextureStore::TileKey key(~UniqueID(0), texture->get_uid(), 0, 0);
+
+        EXPECT_EXCEPTION(ExceptionIOError,
+        {
+            store.acquire(key);
+        });
+
+        // The next request loads the tile again instead of waiting forever for the failed load.
+        texture->m_fail = false;
+        TextureStore::TileRecord& record = store.acquire(key);
+
+        EXPECT_EQ(TextureStore::TileRecord::Loaded, record.m_state);
+        EXPECT_EQ(1, record.m_owners);
+        EXPECT_NEQ(nullptr, record.m_tile_ptr.get_tile());
+
+        store.release(record);
+    }
+
+    TEST_CASE(Acquire_GivenMipTileWhoseFinerTileLoadThrows_PropagatesException)
+    {
+        auto_release_ptr<Scene> scene(SceneFactory::create());
+        FailingTexture* texture = new FailingTexture("texture");
+        scene->textures().insert(auto_release_ptr<Texture>(texture));
+
+        TextureStore store(scene.ref());
+        const TextureStore::TileKey key(~UniqueID(0), texture->get_uid(), 0, 0, 1);
+
+        EXPECT_EXCEPTION(ExceptionIOError,
+        {
+            store.acquire(key);
+        });
+
+        texture->m_fail = false;
+        TextureStore::TileRecord& record = store.acquire(key);
+
+        EXPECT_EQ(TextureStore::TileRecord::Loaded, record.m_state);
+        EXPECT_EQ(1, record.m_owners);
+
+        store.release(record);
+    }
 }
@@ -0,0 +1,216 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Interface header.
+#include "texturecostaov.h"
+
+// appleseed.renderer headers.
+#include "renderer/kernel/aov/aovaccumulator.h"
+#include "renderer/kernel/rendering/pixelcontext.h"
+#include "renderer/kernel/texturing/texturestore.h"
+#include "renderer/modeling/aov/aov.h"
+#include "renderer/modeling/frame/frame.h"
+
+// appleseed.foundation headers.
+#include "foundation/math/aabb.h"
+#include "foundation/image/color.h"
+#include "foundation/image/colormap.h"
+#include "foundation/image/colormapdata.h"
+#include "foundation/image/image.h"
+#include "foundation/image/tile.h"
+#include "foundation/utility/api/specializedapiarrays.h"
+#include "foundation/utility/containers/dictionary.h"
+
+// Standard headers.
+#include <cstddef>
+#include <cstdint>
+
+using namespace foundation;
+
+namespace renderer
+{
+
+namespace
+{
+
+    //
+    // Texture Cost AOV accumulator.
+    //
+    // The cost of a sample is the number of texture tiles it requested from the texture
+    // store, that is, the number of misses of the thread-local texture cache it caused.
+    //
+
+    class TextureCostAOVAccumulator
+      : public UnfilteredAOVAccumulator
+    {
+      public:
+        explicit TextureCostAOVAccumulator(Image& image)
+          : UnfilteredAOVAccumulator(image)
+          , m_sample_begin_count(0)
+          , m_cost(0)
+        {
+        }
+
+        void on_sample_begin(const PixelContext& pixel_context) override
+        {
+            m_sample_begin_count = TextureStore::get_thread_request_count();
+        }
+
+        void on_sample_end(const PixelContext& pixel_context) override
+        {
+            // Only collect samples inside the tile.
+            if (m_cropped_tile_bbox.contains(pixel_context.get_pixel_coords()))
+                m_cost += TextureStore::get_thread_request_count() - m_sample_begin_count;
+        }
+
+        void on_pixel_begin(const Vector2i& pi) override
+        {
+            UnfilteredAOVAccumulator::on_pixel_begin(pi);
+
+            m_cost = 0;
+        }
+
+        void on_pixel_end(const Vector2i& pi) override
+        {
+            if (m_cropped_tile_bbox.contains(pi))
+            {
+                float* out =
+                    reinterpret_cast<float*>(
+                        m_tile->pixel(
+                            pi.x - m_tile_origin_x,
+                            pi.y - m_tile_origin_y));
+
+                // Pixel values are later divided by the sample count.
+                *out += static_cast<float>(m_cost);
+            }
+
+            UnfilteredAOVAccumulator::on_pixel_end(pi);
+        }
+
+      private:
+        std::uint64_t   m_sample_begin_count;
+        std::uint64_t   m_cost;
+    };
+
+
+    //
+    // Texture Cost AOV.
+    //
+
+    const char* TextureCostAOVModel = "texture_cost_aov";
+
+    class TextureCostAOV
+      : public UnfilteredAOV
+    {
+      public:
+        explicit TextureCostAOV(const ParamArray& params)
+          : UnfilteredAOV("texture_cost", params)
+        {
+        }
+
+        void release() override
+        {
+            delete this;
+        }
+
+        const char* get_model() const override
+        {
+            return TextureCostAOVModel;
+        }
+
+        size_t get_channel_count() const override
+        {
+            return 3;
+        }
+
+        const char** get_channel_names() const override
+        {
+            static const char* ChannelNames[] = { "R", "G", "B" };
+            return ChannelNames;
+        }
+
+        void clear_image() override
+        {
+            m_image->clear(Color<float, 3>(0.0f));
+        }
+
+        void post_process_image(const Frame& frame) override
+        {
+            const AABB2u& crop_window = frame.get_crop_window();
+
+            ColorMap color_map;
+            color_map.set_palette_from_array(InfernoColorMapLinearRGB, countof(InfernoColorMapLinearRGB) / 3);
+
+            float min_cost, max_cost;
+            color_map.find_min_max_red_channel(*m_image, crop_window, min_cost, max_cost);
+            color_map.remap_red_channel(*m_image, crop_window, min_cost, max_cost);
+        }
+
+      private:
+        auto_release_ptr<AOVAccumulator> create_accumulator() const override
+        {
+            return auto_release_ptr<AOVAccumulator>(new TextureCostAOVAccumulator(get_image()));
+        }
+    };
+}
+
+
+//
+// TextureCostAOVFactory class implementation.
+//
+
+void TextureCostAOVFactory::release()
+{
+    delete this;
+}
+
+const char* TextureCostAOVFactory::get_model() const
+{
+    return TextureCostAOVModel;
+}
+
+Dictionary TextureCostAOVFactory::get_model_metadata() const
+{
+    return
+        Dictionary()
+            .insert("name", TextureCostAOVModel)
+            .insert("label", "Texture Cost");
+}
+
+DictionaryArray TextureCostAOVFactory::get_input_metadata() const
+{
+    DictionaryArray metadata;
+    return metadata;
+}
+
+auto_release_ptr<AOV> TextureCostAOVFactory::create(const ParamArray& params) const
+{
+    return auto_release_ptr<AOV>(new TextureCostAOV(params));
+}
+
+}   // namespace renderer
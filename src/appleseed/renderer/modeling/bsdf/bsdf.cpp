@@ -85,7 +85,10 @@ void* BSDF::evaluate_inputs(
 
     get_inputs().evaluate(
         shading_context.get_texture_cache(),
-        SourceInputs(shading_point.get_uv(0)),
+        SourceInputs(
+            shading_point.get_uv(0),
+            shading_point.get_duvdx(0),
+            shading_point.get_duvdy(0)),
         data);
 
     prepare_inputs(
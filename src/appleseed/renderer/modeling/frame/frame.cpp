@@ -62,11 +62,15 @@
 #include "foundation/math/scalar.h"
 #include "foundation/platform/defaulttimers.h"
 #include "foundation/platform/path.h"
+#include "foundation/platform/system.h"
 #include "foundation/platform/types.h"
 #include "foundation/utility/containers/dictionary.h"
 #include "foundation/utility/api/specializedapiarrays.h"
 #include "foundation/utility/iostreamop.h"
 #include "foundation/utility/job/iabortswitch.h"
+#include "foundation/utility/job/ijob.h"
+#include "foundation/utility/job/jobmanager.h"
+#include "foundation/utility/job/jobqueue.h"
 #include "foundation/utility/stopwatch.h"
 #include "foundation/utility/string.h"
 
@@ -79,7 +83,9 @@
 
 // Standard headers.
 #include <algorithm>
+#include <cstdint>
 #include <exception>
+#include <functional>
 #include <memory>
 #include <string>
 #include <tuple>
@@ -1111,6 +1117,77 @@ namespace
 
         return true;
     }
+
+    //
+    // Image files are independent from one another, and so is their encoding: they are
+    // written (and images are converted) in parallel, one job per file.
+    //
+
+    typedef std::function<bool ()> ImageTask;
+
+    class ImageTaskJob
+      : public IJob
+    {
+      public:
+        ImageTaskJob(
+            const ImageTask&    task,
+            std::uint8_t&       success)
+          : m_task(task)
+          , m_success(success)
+        {
+        }
+
+        void execute(const size_t thread_index) override
+        {
+            m_success = m_task() ? 1 : 0;
+        }
+
+      private:
+        const ImageTask&        m_task;
+        std::uint8_t&           m_success;
+    };
+
+    // Execute tasks in parallel and return true if all of them succeeded.
+    bool execute_image_tasks(const std::vector<ImageTask>& tasks)
+    {
+        if (tasks.size() <= 1)
+            return tasks.empty() || tasks[0]();
+
+        std::vector<std::uint8_t> success(tasks.size(), 0);
+
+        JobQueue job_queue;
+        for (size_t i = 0, e = tasks.size(); i < e; ++i)
+            job_queue.schedule(new ImageTaskJob(tasks[i], success[i]));
+
+        const size_t thread_count =
+            std::min(tasks.size(), System::get_logical_cpu_core_count());
+
+        JobManager job_manager(global_logger(), job_queue, thread_count);
+        job_manager.start();
+        job_queue.wait_until_completion();
+
+        return std::find(success.begin(), success.end(), 0) == success.end();
+    }
+
+    // Return the path of the exr file an AOV is written to, given the path requested for it.
+    bf::path get_aov_exr_file_path(const AOV& aov, bf::path file_path)
+    {
+        const std::string extension = lower_case(file_path.extension().string());
+        if (extension != ".exr")
+        {
+            if (has_extension(file_path))
+            {
+                RENDERER_LOG_WARNING(
+                    "aov \"%s\" cannot be saved to %s file; saving it to exr file instead.",
+                    aov.get_path().c_str(),
+                    extension.substr(1).c_str());
+            }
+
+            file_path.replace_extension(".exr");
+        }
+
+        return file_path;
+    }
 }
 
 bool Frame::write_main_image(const char* file_path) const
@@ -1168,7 +1245,9 @@ bool Frame::write_aov_images(const char* file_path) const
     const bf::path directory = bf_file_path.parent_path();
     const std::string base_file_name = bf_file_path.stem().string();
 
-    bool success = true;
+    create_parent_directories(bf_file_path);
+
+    std::vector<ImageTask> tasks;
 
     for (const AOV& aov : impl->m_aovs)
     {
@@ -1179,55 +1258,54 @@ bool Frame::write_aov_images(const char* file_path) const
         const std::string aov_file_path = (directory / aov_file_name).string();
 
         // Write AOV image.
-        ImageAttributes image_attributes = ImageAttributes::create_default_attributes();
-        if (!aov.write_images(aov_file_path.c_str(), image_attributes))
-            success = false;
+        tasks.emplace_back(
+            [&aov, aov_file_path]()
+            {
+                ImageAttributes image_attributes = ImageAttributes::create_default_attributes();
+                return aov.write_images(aov_file_path.c_str(), image_attributes);
+            });
     }
 
-    return success;
+    return execute_image_tasks(tasks);
 }
 
 bool Frame::write_main_and_aov_images() const
 {
-    bool success = true;
+    std::vector<ImageTask> tasks;
 
     // Write main image.
     {
         const std::string file_path = get_parameters().get_optional<std::string>("output_filename");
         if (!file_path.empty())
         {
-            if (!write_main_image(file_path.c_str()))
-                success = false;
+            create_parent_directories(file_path.c_str());
+            tasks.emplace_back(
+                [this, file_path]()
+                {
+                    return write_main_image(file_path.c_str());
+                });
         }
     }
 
     // Write AOV images.
     for (const AOV& aov : impl->m_aovs)
     {
-        bf::path bf_file_path = aov.get_parameters().get_optional<std::string>("output_filename");
+        const bf::path bf_file_path = aov.get_parameters().get_optional<std::string>("output_filename");
         if (!bf_file_path.empty())
         {
-            const std::string extension = lower_case(bf_file_path.extension().string());
-            if (extension != ".exr")
-            {
-                if (has_extension(bf_file_path))
+            // Create the output directories beforehand so that jobs don't race to create them.
+            const std::string file_path = get_aov_exr_file_path(aov, bf_file_path).string();
+            create_parent_directories(file_path.c_str());
+            tasks.emplace_back(
+                [&aov, file_path]()
                 {
-                    RENDERER_LOG_WARNING(
-                        "aov \"%s\" cannot be saved to %s file; saving it to exr file instead.",
-                        aov.get_path().c_str(),
-                        extension.substr(1).c_str());
-                }
-
-                bf_file_path.replace_extension(".exr");
-            }
-
-            ImageAttributes image_attributes = ImageAttributes::create_default_attributes();
-            if (!aov.write_images(bf_file_path.string().c_str(), image_attributes))
-                success = false;
+                    ImageAttributes image_attributes = ImageAttributes::create_default_attributes();
+                    return aov.write_images(file_path.c_str(), image_attributes);
+                });
         }
     }
 
-    return success;
+    return execute_image_tasks(tasks);
 }
 
 void Frame::write_main_and_aov_images_to_multipart_exr(const char* file_path) const
@@ -1239,37 +1317,57 @@ void Frame::write_main_and_aov_images_to_multipart_exr(const char* file_path) co
     add_chromaticities_attributes(image_attributes);
     image_attributes.insert("color_space", "linear");
 
-    std::vector<Image> images;
+    // Always save the main image as half floats. If an AOV has color data, assume we can
+    // save it as half floats too. Convert all these images in parallel.
+    const size_t aov_count = impl->m_aovs.size();
+    std::vector<std::unique_ptr<Image>> half_images(aov_count + 1);
+    std::vector<ImageTask> tasks;
+
+    for (size_t i = 0; i <= aov_count; ++i)
+    {
+        const Image* image;
+
+        if (i == 0)
+            image = impl->m_image.get();
+        else
+        {
+            const AOV* aov = impl->m_aovs.get_by_index(i - 1);
+            if (!aov->has_color_data())
+                continue;
+            image = &aov->get_image();
+        }
+
+        std::unique_ptr<Image>& half_image = half_images[i];
+        tasks.emplace_back(
+            [image, &half_image]()
+            {
+                const CanvasProperties& props = image->properties();
+                half_image.reset(new Image(*image, props.m_tile_width, props.m_tile_height, PixelFormatHalf));
+                return true;
+            });
+    }
+
+    execute_image_tasks(tasks);
 
     create_parent_directories(file_path);
 
     GenericImageFileWriter writer(file_path);
 
-    // Always save the main image as half floats.
     {
-        const Image& image = *impl->m_image;
-        const CanvasProperties& props = image.properties();
-        images.emplace_back(image, props.m_tile_width, props.m_tile_height, PixelFormatHalf);
-
         image_attributes.insert("image_name", "beauty");
 
-        writer.append_image(&(images.back()));
+        writer.append_image(half_images[0].get());
         writer.set_image_attributes(image_attributes);
     }
 
-    for (const AOV& aov : impl->m_aovs)
+    for (size_t i = 0; i < aov_count; ++i)
     {
+        const AOV& aov = *impl->m_aovs.get_by_index(i);
         const std::string aov_name = aov.get_name();
-        const Image& image = aov.get_image();
 
-        if (aov.has_color_data())
-        {
-            // If the AOV has color data, assume we can save it as half floats.
-            const CanvasProperties& props = image.properties();
-            images.emplace_back(image, props.m_tile_width, props.m_tile_height, PixelFormatHalf);
-            writer.append_image(&(images.back()));
-        }
-        else writer.append_image(&image);
+        if (half_images[i + 1])
+            writer.append_image(half_images[i + 1].get());
+        else writer.append_image(&aov.get_image());
 
         image_attributes.insert("image_name", aov_name.c_str());
 
@@ -1279,6 +1377,8 @@ void Frame::write_main_and_aov_images_to_multipart_exr(const char* file_path) co
 
     writer.write();
 
+    stopwatch.measure();
+
     RENDERER_LOG_INFO(
         "wrote multipart exr image file %s in %s.",
         file_path,
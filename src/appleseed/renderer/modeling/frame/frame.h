@@ -196,16 +196,17 @@ class APPLESEED_DLLSYMBOL Frame
     // Return true if successful, false otherwise.
     bool write_main_image(const char* file_path) const;
 
-    // Write the AOV images to disk.
+    // Write the AOV images to disk. Images are written in parallel.
     // Return true if successful, false otherwise.
     bool write_aov_images(const char* file_path) const;
 
-    // Write the main image and the AOV images to disk.
+    // Write the main image and the AOV images to disk. Images are written in parallel.
     // Output file paths are taken from the frame's and AOVs' "output_filename" parameters.
     // Return true if successful, false otherwise.
     bool write_main_and_aov_images() const;
 
     // Write the main image and the AOV images to a multipart OpenEXR file.
+    // Images are converted to half floats in parallel, then written in a single pass.
     void write_main_and_aov_images_to_multipart_exr(const char* file_path) const;
 
     // Archive the frame to a given directory on disk. If output_path is provided,
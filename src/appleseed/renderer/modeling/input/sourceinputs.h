@@ -44,13 +44,22 @@ class APPLESEED_DLLSYMBOL SourceInputs
     float   m_uv_x;
     float   m_uv_y;
 
+    // Screen space partial derivatives of the texture coordinates from UV set #0.
+    // Both are zero when unknown, in which case textures are sampled at full resolution.
+    foundation::Vector2f m_duvdx;
+    foundation::Vector2f m_duvdy;
+
     // World space intersection point.
     double  m_point_x;
     double  m_point_y;
     double  m_point_z;
 
-    // Constructor.
+    // Constructors.
     explicit SourceInputs(const foundation::Vector2f& uv);
+    SourceInputs(
+        const foundation::Vector2f& uv,
+        const foundation::Vector2f& duvdx,
+        const foundation::Vector2f& duvdy);
 };
 
 
@@ -61,6 +70,22 @@ class APPLESEED_DLLSYMBOL SourceInputs
 inline SourceInputs::SourceInputs(const foundation::Vector2f& uv)
   : m_uv_x(uv.x)
   , m_uv_y(uv.y)
+  , m_duvdx(0.0f)
+  , m_duvdy(0.0f)
+  , m_point_x(0.0)
+  , m_point_y(0.0)
+  , m_point_z(0.0)
+{
+}
+
+inline SourceInputs::SourceInputs(
+    const foundation::Vector2f& uv,
+    const foundation::Vector2f& duvdx,
+    const foundation::Vector2f& duvdy)
+  : m_uv_x(uv.x)
+  , m_uv_y(uv.y)
+  , m_duvdx(duvdx)
+  , m_duvdy(duvdy)
   , m_point_x(0.0)
   , m_point_y(0.0)
   , m_point_z(0.0)
@@ -33,6 +33,7 @@
 // appleseed.renderer headers.
 #include "renderer/kernel/texturing/texturecache.h"
 #include "renderer/modeling/entity/entity.h"
+#include "renderer/modeling/input/sourceinputs.h"
 #include "renderer/modeling/texture/texture.h"
 
 // appleseed.foundation headers.
@@ -41,7 +42,9 @@
 #include "foundation/math/scalar.h"
 
 // Standard headers.
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 
 using namespace foundation;
 
@@ -100,10 +103,16 @@ namespace
             break;
 
           case TextureAddressingWrap:
-            if (ix < 0) ix = max_x;
-            if (iy < 0) iy = max_y;
-            if (ix > max_x) ix = 0;
-            if (iy > max_y) iy = 0;
+            if (ix < 0 || ix > max_x)
+            {
+                ix %= max_x + 1;
+                if (ix < 0) ix += max_x + 1;
+            }
+            if (iy < 0 || iy > max_y)
+            {
+                iy %= max_y + 1;
+                if (iy < 0) iy += max_y + 1;
+            }
             break;
 
           default:
@@ -121,6 +130,7 @@ namespace
         TextureCache&               texture_cache,
         const UniqueID              assembly_uid,
         const UniqueID              texture_uid,
+        const size_t                level,
         const size_t                tile_x,
         const size_t                tile_y,
         const size_t                pixel_x,
@@ -133,7 +143,8 @@ namespace
                 assembly_uid,
                 texture_uid,
                 tile_x,
-                tile_y);
+                tile_y,
+                level);
 
         // Sample the tile.
         if (tile.get_channel_count() == 3)
@@ -163,6 +174,11 @@ TextureSource::TextureSource(
   , m_max_x(static_cast<float>(m_texture_props.m_canvas_width - 1))
   , m_max_y(static_cast<float>(m_texture_props.m_canvas_height - 1))
 {
+    const size_t level_count = m_texture_props.get_mip_level_count();
+    m_level_props.reserve(level_count);
+
+    for (size_t i = 0; i < level_count; ++i)
+        m_level_props.push_back(m_texture_props.get_mip_level(i));
 }
 
 std::uint64_t TextureSource::compute_signature() const
@@ -190,19 +206,34 @@ Vector2f TextureSource::apply_transform(const Vector2f& uv) const
     return Vector2f(p.x, p.y);
 }
 
+Vector2f TextureSource::apply_transform_to_derivative(const Vector2f& duv) const
+{
+    // Convert to 3D coordinates.
+    Vector3f d(duv.x, duv.y, 0.0f);
+
+    // Apply transform.
+    d = m_texture_transform.vector_to_local(d);
+
+    // Convert back to 2D coordinates, flipping the V axis like sample_texture() does.
+    return Vector2f(d.x, -d.y);
+}
+
 Color4f TextureSource::get_texel(
     TextureCache&               texture_cache,
+    const size_t                level,
     const size_t                ix,
     const size_t                iy) const
 {
-    assert(ix < m_texture_props.m_canvas_width);
-    assert(iy < m_texture_props.m_canvas_height);
+    const CanvasProperties& props = m_level_props[level];
+
+    assert(ix < props.m_canvas_width);
+    assert(iy < props.m_canvas_height);
 
     // Compute the coordinates of the tile containing the texel (x, y).
-    const size_t tile_x = truncate<size_t>(ix * m_texture_props.m_rcp_tile_width);
-    const size_t tile_y = truncate<size_t>(iy * m_texture_props.m_rcp_tile_height);
-    assert(tile_x < m_texture_props.m_tile_count_x);
-    assert(tile_y < m_texture_props.m_tile_count_y);
+    const size_t tile_x = truncate<size_t>(ix * props.m_rcp_tile_width);
+    const size_t tile_y = truncate<size_t>(iy * props.m_rcp_tile_height);
+    assert(tile_x < props.m_tile_count_x);
+    assert(tile_y < props.m_tile_count_y);
 
 #ifdef DEBUG_DISPLAY_TEXTURE_TILES
 
@@ -219,10 +250,10 @@ Color4f TextureSource::get_texel(
 #endif
 
     // Compute the tile space coordinates of the texel (x, y).
-    const size_t pixel_x = ix - tile_x * m_texture_props.m_tile_width;
-    const size_t pixel_y = iy - tile_y * m_texture_props.m_tile_height;
-    assert(pixel_x < m_texture_props.m_tile_width);
-    assert(pixel_y < m_texture_props.m_tile_height);
+    const size_t pixel_x = ix - tile_x * props.m_tile_width;
+    const size_t pixel_y = iy - tile_y * props.m_tile_height;
+    assert(pixel_x < props.m_tile_width);
+    assert(pixel_y < props.m_tile_height);
 
     // Sample the tile.
     Color4f sample;
@@ -230,6 +261,7 @@ Color4f TextureSource::get_texel(
         texture_cache,
         m_assembly_uid,
         m_texture_uid,
+        level,
         tile_x,
         tile_y,
         pixel_x,
@@ -241,6 +273,7 @@ Color4f TextureSource::get_texel(
 
 void TextureSource::get_texels_2x2(
     TextureCache&               texture_cache,
+    const size_t                level,
     const int                   ix,
     const int                   iy,
     Color4f&                    t00,
@@ -248,19 +281,21 @@ void TextureSource::get_texels_2x2(
     Color4f&                    t01,
     Color4f&                    t11) const
 {
+    const CanvasProperties& props = m_level_props[level];
+
     const Vector<size_t, 2> p00 =
         constrain_to_canvas(
             m_texture_instance.get_addressing_mode(),
-            m_texture_props.m_canvas_width,
-            m_texture_props.m_canvas_height,
+            props.m_canvas_width,
+            props.m_canvas_height,
             ix + 0,
             iy + 0);
 
     const Vector<size_t, 2> p11 =
         constrain_to_canvas(
             m_texture_instance.get_addressing_mode(),
-            m_texture_props.m_canvas_width,
-            m_texture_props.m_canvas_height,
+            props.m_canvas_width,
+            props.m_canvas_height,
             ix + 1,
             iy + 1);
 
@@ -268,10 +303,10 @@ void TextureSource::get_texels_2x2(
     const Vector<size_t, 2> p01(p00.x, p11.y);
 
     // Compute the coordinates of the tile containing each texel.
-    const size_t tile_x_00 = truncate<size_t>(p00.x * m_texture_props.m_rcp_tile_width);
-    const size_t tile_y_00 = truncate<size_t>(p00.y * m_texture_props.m_rcp_tile_height);
-    const size_t tile_x_11 = truncate<size_t>(p11.x * m_texture_props.m_rcp_tile_width);
-    const size_t tile_y_11 = truncate<size_t>(p11.y * m_texture_props.m_rcp_tile_height);
+    const size_t tile_x_00 = truncate<size_t>(p00.x * props.m_rcp_tile_width);
+    const size_t tile_y_00 = truncate<size_t>(p00.y * props.m_rcp_tile_height);
+    const size_t tile_x_11 = truncate<size_t>(p11.x * props.m_rcp_tile_width);
+    const size_t tile_y_11 = truncate<size_t>(p11.y * props.m_rcp_tile_height);
 
     // Check whether all four texels are part of the same tile.
     const size_t tile_x_mask = tile_x_00 ^ tile_x_11;
@@ -282,24 +317,24 @@ void TextureSource::get_texels_2x2(
         // Not all four texels are part of the same tile.
 
         // Compute the tile space coordinates of each texel.
-        const size_t pixel_x_00 = p00.x - tile_x_00 * m_texture_props.m_tile_width;
-        const size_t pixel_y_00 = p00.y - tile_y_00 * m_texture_props.m_tile_height;
-        const size_t pixel_x_11 = p11.x - tile_x_11 * m_texture_props.m_tile_width;
-        const size_t pixel_y_11 = p11.y - tile_y_11 * m_texture_props.m_tile_height;
+        const size_t pixel_x_00 = p00.x - tile_x_00 * props.m_tile_width;
+        const size_t pixel_y_00 = p00.y - tile_y_00 * props.m_tile_height;
+        const size_t pixel_x_11 = p11.x - tile_x_11 * props.m_tile_width;
+        const size_t pixel_y_11 = p11.y - tile_y_11 * props.m_tile_height;
 
         // Sample the tile.
-        sample_tile(texture_cache, m_assembly_uid, m_texture_uid, tile_x_00, tile_y_00, pixel_x_00, pixel_y_00, t00);
-        sample_tile(texture_cache, m_assembly_uid, m_texture_uid, tile_x_11, tile_y_00, pixel_x_11, pixel_y_00, t10);
-        sample_tile(texture_cache, m_assembly_uid, m_texture_uid, tile_x_00, tile_y_11, pixel_x_00, pixel_y_11, t01);
-        sample_tile(texture_cache, m_assembly_uid, m_texture_uid, tile_x_11, tile_y_11, pixel_x_11, pixel_y_11, t11);
+        sample_tile(texture_cache, m_assembly_uid, m_texture_uid, level, tile_x_00, tile_y_00, pixel_x_00, pixel_y_00, t00);
+        sample_tile(texture_cache, m_assembly_uid, m_texture_uid, level, tile_x_11, tile_y_00, pixel_x_11, pixel_y_00, t10);
+        sample_tile(texture_cache, m_assembly_uid, m_texture_uid, level, tile_x_00, tile_y_11, pixel_x_00, pixel_y_11, t01);
+        sample_tile(texture_cache, m_assembly_uid, m_texture_uid, level, tile_x_11, tile_y_11, pixel_x_11, pixel_y_11, t11);
     }
     else
     {
         // All four texels are part of the same tile.
 
         // Compute the tile space coordinates of each texel.
-        const size_t org_x = tile_x_00 * m_texture_props.m_tile_width;
-        const size_t org_y = tile_y_00 * m_texture_props.m_tile_height;
+        const size_t org_x = tile_x_00 * props.m_tile_width;
+        const size_t org_y = tile_y_00 * props.m_tile_height;
         const size_t pixel_x_00 = p00.x - org_x;
         const size_t pixel_y_00 = p00.y - org_y;
         const size_t pixel_x_11 = p11.x - org_x;
@@ -311,7 +346,8 @@ void TextureSource::get_texels_2x2(
                 m_assembly_uid,
                 m_texture_uid,
                 tile_x_00,
-                tile_y_00);
+                tile_y_00,
+                level);
 
         // Sample the tile.
         if (tile.get_channel_count() == 3)
@@ -354,10 +390,10 @@ void TextureSource::get_texels_2x2(
 
 Color4f TextureSource::sample_texture(
     TextureCache&               texture_cache,
-    const Vector2f&             uv) const
+    const SourceInputs&         source_inputs) const
 {
     // Start with the transformed input texture coordinates.
-    Vector2f p = apply_transform(uv);
+    Vector2f p = apply_transform(Vector2f(source_inputs.m_uv_x, source_inputs.m_uv_y));
     p.y = 1.0f - p.y;
 
     // Apply the texture addressing mode.
@@ -373,7 +409,7 @@ Color4f TextureSource::sample_texture(
             const size_t ix = truncate<size_t>(p.x);
             const size_t iy = truncate<size_t>(p.y);
 
-            return get_texel(texture_cache, ix, iy);
+            return get_texel(texture_cache, 0, ix, iy);
         }
 
       case TextureFilteringBilinear:
@@ -388,6 +424,7 @@ Color4f TextureSource::sample_texture(
             Color4f t00, t10, t01, t11;
             get_texels_2x2(
                 texture_cache,
+                0,
                 ix, iy,
                 t00, t10, t01, t11);
 
@@ -411,10 +448,229 @@ Color4f TextureSource::sample_texture(
             return t00;
         }
 
+      case TextureFilteringTrilinear:
+        return
+            sample_trilinear(
+                texture_cache,
+                p,
+                apply_transform_to_derivative(source_inputs.m_duvdx),
+                apply_transform_to_derivative(source_inputs.m_duvdy));
+
+      case TextureFilteringEWA:
+        return
+            sample_ewa(
+                texture_cache,
+                p,
+                apply_transform_to_derivative(source_inputs.m_duvdx),
+                apply_transform_to_derivative(source_inputs.m_duvdy));
+
       default:
         assert(!"Wrong texture filtering mode.");
         return Color4f(0.0f);
     }
 }
 
+Color4f TextureSource::sample_bilinear(
+    TextureCache&               texture_cache,
+    const size_t                level,
+    const Vector2f&             p) const
+{
+    const CanvasProperties& props = m_level_props[level];
+
+    // Texel centers are at half-integer coordinates, so that all levels line up.
+    const float x = p.x * static_cast<float>(props.m_canvas_width) - 0.5f;
+    const float y = p.y * static_cast<float>(props.m_canvas_height) - 0.5f;
+    const float fx = fast_floor(x);
+    const float fy = fast_floor(y);
+
+    // Retrieve the four surrounding texels.
+    Color4f t00, t10, t01, t11;
+    get_texels_2x2(
+        texture_cache,
+        level,
+        truncate<int>(fx), truncate<int>(fy),
+        t00, t10, t01, t11);
+
+    // Compute weights.
+    const float wx1 = x - fx;
+    const float wy1 = y - fy;
+    const float wx0 = 1.0f - wx1;
+    const float wy0 = 1.0f - wy1;
+
+    return
+          t00 * (wx0 * wy0)
+        + t10 * (wx1 * wy0)
+        + t01 * (wx0 * wy1)
+        + t11 * (wx1 * wy1);
+}
+
+Color4f TextureSource::sample_trilinear(
+    TextureCache&               texture_cache,
+    const Vector2f&             p,
+    const Vector2f&             dpdx,
+    const Vector2f&             dpdy) const
+{
+    // Compute the width of the footprint, in texels of the full resolution texture.
+    const float width =
+        std::max(
+            norm(Vector2f(dpdx.x * m_scalar_canvas_width, dpdx.y * m_scalar_canvas_height)),
+            norm(Vector2f(dpdy.x * m_scalar_canvas_width, dpdy.y * m_scalar_canvas_height)));
+
+    // Select the pair of levels in which the footprint is about one texel wide.
+    const size_t last_level = m_level_props.size() - 1;
+    const float level = width > 1.0f ? std::log2(width) : 0.0f;
+
+    if (level <= 0.0f)
+        return sample_bilinear(texture_cache, 0, p);
+
+    if (level >= static_cast<float>(last_level))
+        return sample_bilinear(texture_cache, last_level, p);
+
+    const size_t level0 = truncate<size_t>(level);
+    const float t = level - static_cast<float>(level0);
+
+    return
+          sample_bilinear(texture_cache, level0 + 0, p) * (1.0f - t)
+        + sample_bilinear(texture_cache, level0 + 1, p) * t;
+}
+
+Color4f TextureSource::sample_ewa(
+    TextureCache&               texture_cache,
+    const Vector2f&             p,
+    const Vector2f&             dpdx,
+    const Vector2f&             dpdy) const
+{
+    // Bound the eccentricity of the footprint so that the number of texels to filter stays reasonable.
+    const float MaxAnisotropy = 8.0f;
+
+    // Express the derivatives in texels of the full resolution texture.
+    Vector2f major(dpdx.x * m_scalar_canvas_width, dpdx.y * m_scalar_canvas_height);
+    Vector2f minor(dpdy.x * m_scalar_canvas_width, dpdy.y * m_scalar_canvas_height);
+
+    if (square_norm(major) < square_norm(minor))
+        std::swap(major, minor);
+
+    const float major_length = norm(major);
+    float minor_length = norm(minor);
+
+    // Leave footprints with infinite or undefined extents to trilinear filtering,
+    // which falls back to the first or last level.
+    if (!std::isfinite(major_length) || !std::isfinite(minor_length))
+        return sample_trilinear(texture_cache, p, dpdx, dpdy);
+
+    // Lengthen the minor axis of overly eccentric footprints. This also bounds the
+    // major axis to MaxAnisotropy texels of the level selected below. A minor axis
+    // of zero length is replaced by one perpendicular to the major axis.
+    const float min_minor_length = major_length / MaxAnisotropy;
+    if (minor_length < min_minor_length)
+    {
+        minor =
+            minor_length > 0.0f
+                ? minor * (min_minor_length / minor_length)
+                : Vector2f(-major.y, major.x) * (min_minor_length / major_length);
+        minor_length = min_minor_length;
+    }
+
+    // Select the pair of levels in which the minor axis is about one texel long.
+    const size_t last_level = m_level_props.size() - 1;
+    const float level = minor_length > 1.0f ? std::log2(minor_length) : 0.0f;
+
+    // Past the last level, the footprint covers the whole texture.
+    if (level >= static_cast<float>(last_level))
+        return sample_bilinear(texture_cache, last_level, p);
+
+    // The derivatives passed to sample_ewa_level() are in the unit square.
+    const Vector2f d0(major.x / m_scalar_canvas_width, major.y / m_scalar_canvas_height);
+    const Vector2f d1(minor.x / m_scalar_canvas_width, minor.y / m_scalar_canvas_height);
+
+    const size_t level0 = truncate<size_t>(level);
+    const float t = level - static_cast<float>(level0);
+
+    if (t == 0.0f)
+        return sample_ewa_level(texture_cache, level0, p, d0, d1);
+
+    return
+          sample_ewa_level(texture_cache, level0 + 0, p, d0, d1) * (1.0f - t)
+        + sample_ewa_level(texture_cache, level0 + 1, p, d0, d1) * t;
+}
+
+Color4f TextureSource::sample_ewa_level(
+    TextureCache&               texture_cache,
+    const size_t                level,
+    const Vector2f&             p,
+    const Vector2f&             dpdx,
+    const Vector2f&             dpdy) const
+{
+    // Sharpness of the Gaussian filter.
+    const float Alpha = 2.0f;
+
+    const CanvasProperties& props = m_level_props[level];
+    const float level_width = static_cast<float>(props.m_canvas_width);
+    const float level_height = static_cast<float>(props.m_canvas_height);
+
+    // Express the center and the axes of the ellipse in texels of this level.
+    const float s = p.x * level_width - 0.5f;
+    const float t = p.y * level_height - 0.5f;
+    const float ds0 = dpdx.x * level_width;
+    const float dt0 = dpdx.y * level_height;
+    const float ds1 = dpdy.x * level_width;
+    const float dt1 = dpdy.y * level_height;
+
+    // Compute the coefficients of the implicit ellipse equation A s^2 + B s t + C t^2 < 1.
+    // Adding one texel to both axes ensures that at least one texel falls inside the ellipse.
+    float a = dt0 * dt0 + dt1 * dt1 + 1.0f;
+    float b = -2.0f * (ds0 * dt0 + ds1 * dt1);
+    float c = ds0 * ds0 + ds1 * ds1 + 1.0f;
+    const float rcp_f = 1.0f / (a * c - 0.25f * b * b);
+    a *= rcp_f;
+    b *= rcp_f;
+    c *= rcp_f;
+
+    // Compute the bounding box of the ellipse.
+    const float det = 4.0f * a * c - b * b;
+    const float rcp_det = 1.0f / det;
+    const float s_radius = 2.0f * rcp_det * std::sqrt(det * c);
+    const float t_radius = 2.0f * rcp_det * std::sqrt(det * a);
+    const int s0 = truncate<int>(std::ceil(s - s_radius));
+    const int s1 = truncate<int>(std::floor(s + s_radius));
+    const int t0 = truncate<int>(std::ceil(t - t_radius));
+    const int t1 = truncate<int>(std::floor(t + t_radius));
+
+    // Filter the texels inside the ellipse.
+    const float min_weight = std::exp(-Alpha);
+    Color4f sum(0.0f);
+    float weight_sum = 0.0f;
+
+    for (int it = t0; it <= t1; ++it)
+    {
+        const float dt = static_cast<float>(it) - t;
+
+        for (int is = s0; is <= s1; ++is)
+        {
+            const float ds = static_cast<float>(is) - s;
+            const float r2 = a * ds * ds + b * ds * dt + c * dt * dt;
+
+            if (r2 < 1.0f)
+            {
+                const Vector<size_t, 2> texel =
+                    constrain_to_canvas(
+                        m_texture_instance.get_addressing_mode(),
+                        props.m_canvas_width,
+                        props.m_canvas_height,
+                        is,
+                        it);
+
+                const float weight = std::exp(-Alpha * r2) - min_weight;
+                sum += get_texel(texture_cache, level, texel.x, texel.y) * weight;
+                weight_sum += weight;
+            }
+        }
+    }
+
+    return
+        weight_sum > 0.0f
+            ? sum / weight_sum
+            : sample_bilinear(texture_cache, level, p);
+}
+
 }   // namespace renderer
@@ -47,6 +47,7 @@
 // Standard headers.
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
 // Forward declarations.
 namespace renderer      { class TextureCache; }
@@ -57,6 +58,14 @@ namespace renderer
 //
 // Texture source.
 //
+// With trilinear and EWA filtering, the MIP level is selected from the screen space
+// derivatives of the texture coordinates. Coarser levels are read from the texture
+// store which builds them on demand, so distant surfaces only touch a few small tiles.
+//
+// Reference:
+//
+//   Physically Based Rendering, third edition, section 10.4.
+//
 
 class TextureSource
   : public Source
@@ -114,20 +123,27 @@ class TextureSource
     const float                             m_scalar_canvas_height;
     const float                             m_max_x;
     const float                             m_max_y;
+    std::vector<foundation::CanvasProperties> m_level_props;    // properties of each MIP level, starting with the texture itself
 
     // Apply the texture instance transform to UV coordinates.
     foundation::Vector2f apply_transform(
         const foundation::Vector2f&         uv) const;
 
-    // Retrieve a given texel. Return a color in the linear RGB color space.
+    // Apply the texture instance transform to a UV derivative.
+    foundation::Vector2f apply_transform_to_derivative(
+        const foundation::Vector2f&         duv) const;
+
+    // Retrieve a given texel of a given MIP level. Return a color in the linear RGB color space.
     foundation::Color4f get_texel(
         TextureCache&                       texture_cache,
+        const size_t                        level,
         const size_t                        ix,
         const size_t                        iy) const;
 
-    // Retrieve a 2x2 block of texels. Texels are expressed in the linear RGB color space.
+    // Retrieve a 2x2 block of texels of a given MIP level. Texels are expressed in the linear RGB color space.
     void get_texels_2x2(
         TextureCache&                       texture_cache,
+        const size_t                        level,
         const int                           ix,
         const int                           iy,
         foundation::Color4f&                t00,
@@ -138,7 +154,33 @@ class TextureSource
     // Sample the texture. Return a color in the linear RGB color space.
     foundation::Color4f sample_texture(
         TextureCache&                       texture_cache,
-        const foundation::Vector2f&         uv) const;
+        const SourceInputs&                 source_inputs) const;
+
+    // Bilinearly interpolate the texels of a given MIP level around a point of the unit square.
+    foundation::Color4f sample_bilinear(
+        TextureCache&                       texture_cache,
+        const size_t                        level,
+        const foundation::Vector2f&         p) const;
+
+    // Blend bilinear lookups in the two MIP levels bracketing the footprint's width.
+    foundation::Color4f sample_trilinear(
+        TextureCache&                       texture_cache,
+        const foundation::Vector2f&         p,
+        const foundation::Vector2f&         dpdx,
+        const foundation::Vector2f&         dpdy) const;
+
+    // Integrate the texture over the elliptical footprint with a Gaussian filter.
+    foundation::Color4f sample_ewa(
+        TextureCache&                       texture_cache,
+        const foundation::Vector2f&         p,
+        const foundation::Vector2f&         dpdx,
+        const foundation::Vector2f&         dpdy) const;
+    foundation::Color4f sample_ewa_level(
+        TextureCache&                       texture_cache,
+        const size_t                        level,
+        const foundation::Vector2f&         p,
+        const foundation::Vector2f&         dpdx,
+        const foundation::Vector2f&         dpdy) const;
 
     // Compute an alpha value given a linear RGBA color and the alpha mode of the texture instance.
     void evaluate_alpha(
@@ -161,7 +203,7 @@ inline void TextureSource::evaluate(
     const SourceInputs&                     source_inputs,
     float&                                  scalar) const
 {
-    const foundation::Color4f color = sample_texture(texture_cache, foundation::Vector2f(source_inputs.m_uv_x, source_inputs.m_uv_y));
+    const foundation::Color4f color = sample_texture(texture_cache, source_inputs);
     scalar = color[0];
 }
 
@@ -170,7 +212,7 @@ inline void TextureSource::evaluate(
     const SourceInputs&                     source_inputs,
     foundation::Color3f&                    linear_rgb) const
 {
-    const foundation::Color4f color = sample_texture(texture_cache, foundation::Vector2f(source_inputs.m_uv_x, source_inputs.m_uv_y));
+    const foundation::Color4f color = sample_texture(texture_cache, source_inputs);
     linear_rgb = color.rgb();
 }
 
@@ -179,7 +221,7 @@ inline void TextureSource::evaluate(
     const SourceInputs&                     source_inputs,
     Spectrum&                               spectrum) const
 {
-    const foundation::Color4f color = sample_texture(texture_cache, foundation::Vector2f(source_inputs.m_uv_x, source_inputs.m_uv_y));
+    const foundation::Color4f color = sample_texture(texture_cache, source_inputs);
     spectrum.set(color.rgb(), g_std_lighting_conditions, Spectrum::Reflectance);
 }
 
@@ -188,7 +230,7 @@ inline void TextureSource::evaluate(
     const SourceInputs&                     source_inputs,
     Alpha&                                  alpha) const
 {
-    const foundation::Color4f color = sample_texture(texture_cache, foundation::Vector2f(source_inputs.m_uv_x, source_inputs.m_uv_y));
+    const foundation::Color4f color = sample_texture(texture_cache, source_inputs);
     evaluate_alpha(color, alpha);
 }
 
@@ -198,7 +240,7 @@ inline void TextureSource::evaluate(
     foundation::Color3f&                    linear_rgb,
     Alpha&                                  alpha) const
 {
-    const foundation::Color4f color = sample_texture(texture_cache, foundation::Vector2f(source_inputs.m_uv_x, source_inputs.m_uv_y));
+    const foundation::Color4f color = sample_texture(texture_cache, source_inputs);
     linear_rgb = color.rgb();
     evaluate_alpha(color, alpha);
 }
@@ -209,7 +251,7 @@ inline void TextureSource::evaluate(
     Spectrum&                               spectrum,
     Alpha&                                  alpha) const
 {
-    const foundation::Color4f color = sample_texture(texture_cache, foundation::Vector2f(source_inputs.m_uv_x, source_inputs.m_uv_y));
+    const foundation::Color4f color = sample_texture(texture_cache, source_inputs);
     spectrum.set(color.rgb(), g_std_lighting_conditions, Spectrum::Reflectance);
     evaluate_alpha(color, alpha);
 }
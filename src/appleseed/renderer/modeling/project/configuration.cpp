@@ -170,6 +170,93 @@ Dictionary Configuration::get_metadata()
             .insert("label", "Render Threads")
             .insert("help", "Number of threads to use for rendering"));
 
+    metadata.insert(
+        "rendering_threads_pinning",
+        Dictionary()
+            .insert("type", "bool")
+            .insert("default", "false")
+            .insert("label", "Pin Render Threads")
+            .insert("help", "Pin each rendering thread to a CPU core and allocate per-thread data on its NUMA node"));
+
+    metadata.insert(
+        "triangle_tree_node_width",
+        Dictionary()
+            .insert("type", "enum")
+            .insert("values", "2|4|8")
+            .insert("default", "2")
+            .insert("label", "Triangle Tree Node Width")
+            .insert("help", "Number of children per node of triangle trees; 4 and 8 enable SIMD traversal")
+            .insert(
+                "options",
+                Dictionary()
+                    .insert(
+                        "2",
+                        Dictionary()
+                            .insert("label", "Binary")
+                            .insert("help", "Binary tree"))
+                    .insert(
+                        "4",
+                        Dictionary()
+                            .insert("label", "4-Wide")
+                            .insert("help", "4-wide tree traversed with SSE instructions"))
+                    .insert(
+                        "8",
+                        Dictionary()
+                            .insert("label", "8-Wide")
+                            .insert("help", "8-wide tree traversed with AVX instructions"))));
+
+    metadata.insert(
+        "triangle_tree_precision",
+        Dictionary()
+            .insert("type", "enum")
+            .insert("values", "single|double")
+            .insert("default", "double")
+            .insert("label", "Triangle Intersection Precision")
+            .insert("help", "Floating-point precision of ray-triangle intersections")
+            .insert(
+                "options",
+                Dictionary()
+                    .insert(
+                        "single",
+                        Dictionary()
+                            .insert("label", "Single")
+                            .insert("help", "Watertight single precision intersections"))
+                    .insert(
+                        "double",
+                        Dictionary()
+                            .insert("label", "Double")
+                            .insert("help", "Double precision intersections"))));
+
+    metadata.insert(
+        "bvh_node_compression",
+        Dictionary()
+            .insert("type", "enum")
+            .insert("values", "none|quantized")
+            .insert("default", "none")
+            .insert("label", "BVH Node Compression")
+            .insert("help", "Storage format of the nodes of wide triangle trees and of curve trees")
+            .insert(
+                "options",
+                Dictionary()
+                    .insert(
+                        "none",
+                        Dictionary()
+                            .insert("label", "None")
+                            .insert("help", "Single precision child bounding boxes"))
+                    .insert(
+                        "quantized",
+                        Dictionary()
+                            .insert("label", "Quantized")
+                            .insert("help", "8-bit child bounding boxes, halves the memory used by nodes"))));
+
+    metadata.insert(
+        "bvh_cache_directory",
+        Dictionary()
+            .insert("type", "text")
+            .insert("default", "")
+            .insert("label", "BVH Cache Directory")
+            .insert("help", "Directory where triangle trees are saved and reloaded on subsequent renders of the same geometry; leave empty to disable"));
+
 #ifdef APPLESEED_WITH_EMBREE
 
     metadata.insert(
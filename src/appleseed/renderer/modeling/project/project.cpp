@@ -340,6 +340,30 @@ LightPathRecorder& Project::get_light_path_recorder() const
     return impl->m_light_path_recorder;
 }
 
+void Project::set_triangle_tree_node_width(const size_t value)
+{
+    if (impl->m_trace_context)
+        impl->m_trace_context->set_triangle_tree_node_width(value);
+}
+
+void Project::set_triangle_tree_single_precision(const bool value)
+{
+    if (impl->m_trace_context)
+        impl->m_trace_context->set_triangle_tree_single_precision(value);
+}
+
+void Project::set_quantized_bvh_nodes(const bool value)
+{
+    if (impl->m_trace_context)
+        impl->m_trace_context->set_quantized_bvh_nodes(value);
+}
+
+void Project::set_bvh_cache_directory(const char* path)
+{
+    if (impl->m_trace_context)
+        impl->m_trace_context->set_bvh_cache_directory(path);
+}
+
 #ifdef APPLESEED_WITH_EMBREE
 
 void Project::set_use_embree(const bool value)
@@ -160,6 +160,18 @@ class APPLESEED_DLLSYMBOL Project
     // Access the light path recorder.
     LightPathRecorder& get_light_path_recorder() const;
 
+    // Set the number of children per interior node of triangle trees.
+    void set_triangle_tree_node_width(const size_t value);
+
+    // Set whether triangles are intersected in single precision.
+    void set_triangle_tree_single_precision(const bool value);
+
+    // Set whether wide triangle trees and curve trees use quantized nodes.
+    void set_quantized_bvh_nodes(const bool value);
+
+    // Set the directory where triangle trees are cached between renders (empty to disable).
+    void set_bvh_cache_directory(const char* path);
+
 #ifdef APPLESEED_WITH_EMBREE
     // Set use Embree flag for trace context
     void set_use_embree(const bool value);
@@ -43,6 +43,7 @@
 #include "foundation/image/canvasproperties.h"
 #include "foundation/image/colorspace.h"
 #include "foundation/image/genericprogressiveimagefilereader.h"
+#include "foundation/image/nativetexturefile.h"
 #include "foundation/image/tile.h"
 #include "foundation/platform/thread.h"
 #include "foundation/utility/api/apistring.h"
@@ -53,9 +54,15 @@
 #include "foundation/utility/string.h"
 #include "foundation/utility/uid.h"
 
+// Boost headers.
+#include "boost/thread/condition_variable.hpp"
+
 // Standard headers.
+#include <algorithm>
 #include <cstddef>
+#include <memory>
 #include <string>
+#include <vector>
 
 using namespace foundation;
 
@@ -67,6 +74,12 @@ namespace
     //
     // 2D on-disk texture.
     //
+    // Tiles are read through a small pool of readers, each with its own handle on the file,
+    // so that several threads can read and decode tiles of the same texture concurrently.
+    //
+    // Native texture files (.astx, see foundation/image/nativetexturefile.h) bypass the
+    // readers entirely: the file is memory-mapped and tiles point straight into the mapping.
+    //
 
     const char* Model = "disk_texture_2d";
 
@@ -79,7 +92,6 @@ namespace
             const ParamArray&       params,
             const SearchPaths&      search_paths)
           : Texture(name, params)
-          , m_reader(&global_logger())
         {
             const EntityDefMessageContext context("texture", this);
 
@@ -98,6 +110,11 @@ namespace
             else if (color_space == "srgb")
                 m_color_space = ColorSpaceSRGB;
             else m_color_space = ColorSpaceCIEXYZ;
+
+            // Retrieve the maximum number of concurrent readers.
+            m_max_reader_count = std::max<size_t>(m_params.get_optional<size_t>("max_file_readers", 4), 1);
+
+            m_is_native = ends_with(lower_case(m_filepath), ".astx");
         }
 
         void release() override
@@ -114,10 +131,17 @@ namespace
             const Project&          project,
             const BaseGroup*        parent) override
         {
-            if (m_reader.is_open())
+            boost::mutex::scoped_lock lock(m_mutex);
+
+            if (!m_readers.empty())
             {
                 RENDERER_LOG_INFO("closing texture file %s...", m_filepath.c_str());
-                m_reader.close();
+
+                for (const ReaderPtr& reader : m_readers)
+                    reader->close();
+
+                m_idle_readers.clear();
+                m_readers.clear();
             }
 
             Texture::on_render_end(project, parent);
@@ -125,7 +149,9 @@ namespace
 
         ColorSpace get_color_space() const override
         {
-            return m_color_space;
+            // Native texture files are always stored in linear RGB. Reporting it also keeps
+            // the texture store from converting mapped, read-only tiles in place.
+            return m_is_native ? ColorSpaceLinearRGB : m_color_space;
         }
 
         void collect_asset_paths(StringArray& paths) const override
@@ -146,6 +172,13 @@ namespace
         const CanvasProperties& properties() override
         {
             boost::mutex::scoped_lock lock(m_mutex);
+
+            if (m_is_native)
+            {
+                open_native_file();
+                return m_native_file->get_level_properties(0);
+            }
+
             open_image_file();
             return m_props;
         }
@@ -161,31 +194,133 @@ namespace
             const size_t            tile_x,
             const size_t            tile_y) override
         {
+            if (m_is_native)
+                return load_mip_tile(0, tile_x, tile_y);
+
+            GenericProgressiveImageFileReader* reader = acquire_reader();
+            Tile* tile;
+
+            try
+            {
+                tile = reader->read_tile(tile_x, tile_y);
+            }
+            catch (...)
+            {
+                release_reader(reader);
+                throw;
+            }
+
+            release_reader(reader);
+
+            return TilePtr::make_owning(tile);
+        }
+
+        size_t get_stored_mip_level_count() override
+        {
+            if (!m_is_native)
+                return 1;
+
             boost::mutex::scoped_lock lock(m_mutex);
-            open_image_file();
-            return TilePtr::make_owning(m_reader.read_tile(tile_x, tile_y));
+            open_native_file();
+            return m_native_file->get_level_count();
         }
 
-      private:
-        std::string                         m_filepath;
-        ColorSpace                          m_color_space;
+        TilePtr load_mip_tile(
+            const size_t            level,
+            const size_t            tile_x,
+            const size_t            tile_y) override
+        {
+            if (!m_is_native)
+                return Texture::load_mip_tile(level, tile_x, tile_y);
+
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                open_native_file();
+            }
 
-        mutable boost::mutex                m_mutex;
-        GenericProgressiveImageFileReader   m_reader;
-        CanvasProperties                    m_props;
+            // The tile does not own its pixels, they remain in the mapping.
+            return TilePtr::make_owning(m_native_file->get_tile(level, tile_x, tile_y));
+        }
 
+      private:
+        typedef std::unique_ptr<GenericProgressiveImageFileReader> ReaderPtr;
+
+        std::string                                     m_filepath;
+        ColorSpace                                      m_color_space;
+        size_t                                          m_max_reader_count;
+        bool                                            m_is_native;
+
+        mutable boost::mutex                            m_mutex;
+        boost::condition_variable                       m_reader_released;
+        std::vector<ReaderPtr>                          m_readers;
+        std::vector<GenericProgressiveImageFileReader*> m_idle_readers;
+        CanvasProperties                                m_props;
+        std::unique_ptr<NativeTextureFile>              m_native_file;
+
+        // Map the native texture file. m_mutex must be held. The mapping is kept until the
+        // texture is destroyed since the texture store may still hold tiles pointing into it.
+        void open_native_file()
+        {
+            if (!m_native_file)
+            {
+                RENDERER_LOG_INFO("mapping native texture file %s...", m_filepath.c_str());
+                m_native_file.reset(new NativeTextureFile(m_filepath.c_str()));
+            }
+        }
+
+        // Open the first reader and read the canvas properties. m_mutex must be held.
         void open_image_file()
         {
-            if (!m_reader.is_open())
+            if (m_readers.empty())
             {
                 RENDERER_LOG_INFO(
                     "opening texture file %s and reading metadata...",
                     m_filepath.c_str());
 
-                m_reader.open(m_filepath.c_str());
-                m_reader.read_canvas_properties(m_props);
+                ReaderPtr reader(new GenericProgressiveImageFileReader(&global_logger()));
+                reader->open(m_filepath.c_str());
+                reader->read_canvas_properties(m_props);
+
+                m_idle_readers.push_back(reader.get());
+                m_readers.push_back(std::move(reader));
             }
         }
+
+        // Take an idle reader, open a new one if the pool isn't full, or wait for one to be released.
+        GenericProgressiveImageFileReader* acquire_reader()
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+
+            open_image_file();
+
+            while (m_idle_readers.empty())
+            {
+                if (m_readers.size() < m_max_reader_count)
+                {
+                    ReaderPtr reader(new GenericProgressiveImageFileReader(&global_logger()));
+                    reader->open(m_filepath.c_str());
+                    m_readers.push_back(std::move(reader));
+                    return m_readers.back().get();
+                }
+
+                m_reader_released.wait(lock);
+            }
+
+            GenericProgressiveImageFileReader* reader = m_idle_readers.back();
+            m_idle_readers.pop_back();
+
+            return reader;
+        }
+
+        void release_reader(GenericProgressiveImageFileReader* reader)
+        {
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                m_idle_readers.push_back(reader);
+            }
+
+            m_reader_released.notify_one();
+        }
     };
 }
 
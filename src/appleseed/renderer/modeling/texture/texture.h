@@ -87,6 +87,18 @@ class APPLESEED_DLLSYMBOL Texture
     virtual TilePtr load_tile(
         const size_t                tile_x,
         const size_t                tile_y) = 0;
+
+    // Return the number of MIP levels this texture can load by itself, including the base level.
+    // The texture store builds the coarser levels on demand. The default is one.
+    virtual size_t get_stored_mip_level_count();
+
+    // Load a given tile of a given stored MIP level. Tiles of level n cover the same number of
+    // pixels as tiles of level 0, and level n is max(1, floor(size / 2^n)) pixels wide and high.
+    // The default implementation only supports level 0.
+    virtual TilePtr load_mip_tile(
+        const size_t                level,
+        const size_t                tile_x,
+        const size_t                tile_y);
 };
 
 }   // namespace renderer
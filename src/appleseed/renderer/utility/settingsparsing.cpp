@@ -171,4 +171,47 @@ size_t get_rendering_thread_count(const ParamArray& params)
     return thread_count;
 }
 
+bool get_rendering_thread_pinning(const ParamArray& params)
+{
+    return params.get_optional<bool>("rendering_threads_pinning", false);
+}
+
+size_t get_triangle_tree_node_width(const ParamArray& params)
+{
+    const std::string node_width =
+        params.get_optional<std::string>(
+            "triangle_tree_node_width",
+            "2",
+            make_vector("2", "4", "8"));
+
+    return from_string<size_t>(node_width);
+}
+
+bool get_triangle_tree_single_precision(const ParamArray& params)
+{
+    const std::string precision =
+        params.get_optional<std::string>(
+            "triangle_tree_precision",
+            "double",
+            make_vector("single", "double"));
+
+    return precision == "single";
+}
+
+bool get_quantized_bvh_nodes(const ParamArray& params)
+{
+    const std::string compression =
+        params.get_optional<std::string>(
+            "bvh_node_compression",
+            "none",
+            make_vector("none", "quantized"));
+
+    return compression == "quantized";
+}
+
+std::string get_bvh_cache_directory(const ParamArray& params)
+{
+    return params.get_optional<std::string>("bvh_cache_directory", "");
+}
+
 }   // namespace renderer
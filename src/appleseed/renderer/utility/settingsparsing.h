@@ -58,4 +58,19 @@ std::string get_sampling_context_mode_name(const SamplingContext::Mode mode);
 // Rendering threads.
 APPLESEED_DLLSYMBOL size_t get_rendering_thread_count(const ParamArray& params);
 
+// Whether rendering threads should be pinned to logical cores, grouped by NUMA node.
+bool get_rendering_thread_pinning(const ParamArray& params);
+
+// Number of children per interior node of triangle trees (2, 4 or 8).
+size_t get_triangle_tree_node_width(const ParamArray& params);
+
+// Return true if triangles should be intersected in single precision.
+bool get_triangle_tree_single_precision(const ParamArray& params);
+
+// Return true if wide triangle trees and curve trees should use quantized nodes.
+bool get_quantized_bvh_nodes(const ParamArray& params);
+
+// Directory where triangle trees are cached between renders, empty if caching is disabled.
+std::string get_bvh_cache_directory(const ParamArray& params);
+
 }   // namespace renderer
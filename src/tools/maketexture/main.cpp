@@ -0,0 +1,183 @@
+
+//
+// This source file is part of appleseed.
+// Visit https://appleseedhq.net/ for additional information and resources.
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2018 Francois Beaune, The appleseedhq Organization
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// maketexture headers.
+#include "commandlinehandler.h"
+
+// appleseed.common headers.
+#include "application/application.h"
+#include "application/superlogger.h"
+
+// appleseed.foundation headers.
+#include "foundation/image/canvasproperties.h"
+#include "foundation/image/color.h"
+#include "foundation/image/colorspace.h"
+#include "foundation/image/genericimagefilereader.h"
+#include "foundation/image/image.h"
+#include "foundation/image/nativetexturefile.h"
+#include "foundation/image/pixel.h"
+#include "foundation/utility/containers/dictionary.h"
+#include "foundation/utility/log.h"
+
+// Standard headers.
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <string>
+
+using namespace appleseed::maketexture;
+using namespace appleseed::common;
+using namespace foundation;
+
+namespace
+{
+    // Convert the color channels of a floating point image to linear RGB, in place.
+    void convert_to_linear_rgb(Image& image, const ColorSpace color_space)
+    {
+        if (color_space == ColorSpaceLinearRGB)
+            return;
+
+        const CanvasProperties& props = image.properties();
+
+        if (props.m_channel_count < 3)
+            return;
+
+        for (size_t y = 0; y < props.m_canvas_height; ++y)
+        {
+            for (size_t x = 0; x < props.m_canvas_width; ++x)
+            {
+                Color3f color;
+                image.get_pixel(x, y, &color[0], 3);
+
+                color =
+                    color_space == ColorSpaceSRGB
+                        ? srgb_to_linear_rgb(color)
+                        : ciexyz_to_linear_rgb(color);
+
+                image.set_pixel(x, y, &color[0], 3);
+            }
+        }
+    }
+}
+
+
+//
+// Entry point of maketexture.
+//
+
+int main(int argc, char* argv[])
+{
+    // Construct the logger that will be used throughout the program.
+    SuperLogger logger;
+
+    // Make sure this build can run on this host.
+    Application::check_compatibility_with_host(logger);
+
+    // Make sure appleseed is correctly installed.
+    Application::check_installation(logger);
+
+    // Parse the command line.
+    CommandLineHandler cl;
+    cl.parse(argc, argv, logger);
+
+    // Load an apply settings from the settings file.
+    Dictionary settings;
+    Application::load_settings("appleseed.tools.xml", settings, logger);
+    logger.configure_from_settings(settings);
+
+    // Apply command line arguments.
+    cl.apply(logger);
+
+    // Retrieve the input and output file paths.
+    const std::string& input_filepath = cl.m_filenames.values()[0];
+    const std::string& output_filepath = cl.m_filenames.values()[1];
+
+    // Retrieve the input color space.
+    const std::string& color_space_name = cl.m_color_space.value();
+    ColorSpace color_space = ColorSpaceLinearRGB;
+    if (color_space_name == "srgb")
+        color_space = ColorSpaceSRGB;
+    else if (color_space_name == "ciexyz")
+        color_space = ColorSpaceCIEXYZ;
+    else if (color_space_name != "linear_rgb")
+        LOG_FATAL(logger, "invalid color space: %s.", color_space_name.c_str());
+
+    // Retrieve the tile size.
+    const size_t tile_size = cl.m_tile_size.value();
+    if (tile_size == 0)
+    {
+        LOG_FATAL(logger, "the tile size must be greater than zero.");
+    }
+
+    // Read the input image and convert it to linear RGB floating point pixels.
+    std::unique_ptr<Image> image;
+    try
+    {
+        GenericImageFileReader reader;
+        std::unique_ptr<Image> source(reader.read(input_filepath.c_str()));
+        const CanvasProperties& source_props = source->properties();
+        image.reset(
+            new Image(
+                *source,
+                source_props.m_tile_width,
+                source_props.m_tile_height,
+                PixelFormatFloat));
+    }
+    catch (const std::exception& e)
+    {
+        LOG_FATAL(
+            logger,
+            "could not read image file %s (%s).",
+            input_filepath.c_str(),
+            e.what());
+    }
+
+    convert_to_linear_rgb(*image, color_space);
+
+    // Write the native texture file.
+    NativeTextureFileWriter::Options options;
+    options.m_tile_width = tile_size;
+    options.m_tile_height = tile_size;
+    options.m_pixel_format = cl.m_float.is_set() ? PixelFormatFloat : PixelFormatHalf;
+    options.m_mip_levels = !cl.m_no_mip_levels.is_set();
+
+    try
+    {
+        NativeTextureFileWriter::write(output_filepath.c_str(), *image, options);
+    }
+    catch (const std::exception& e)
+    {
+        LOG_FATAL(
+            logger,
+            "could not write texture file %s (%s).",
+            output_filepath.c_str(),
+            e.what());
+    }
+
+    return 0;
+}